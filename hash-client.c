@@ -0,0 +1,638 @@
+/*********************************************************************************
+ * Written by Lance N. Le
+ *
+ * Free to use.
+ * Free to distribute.
+ * No warranty, expressed or implied, comes with this program.
+ *********************************************************************************/
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+/*********************************************************************************
+ * Load generator for "hash-table --listen" and "--port".  Each connection runs
+ * on its own thread and sends --depth requests before reading their replies.
+ *********************************************************************************/
+#define CLIENT_CONNECTIONS  4
+#define CLIENT_DEPTH        16
+#define CLIENT_KEYS         100000
+#define CLIENT_HIT          0.9
+#define CLIENT_SEED         1
+#define CLIENT_MAX_CONNS    256
+#define CLIENT_MAX_DEPTH    4096
+#define CLIENT_REQUEST      64                /* Longest request sent            */
+#define CLIENT_REPLY        64                /* Longest reply that is counted   */
+
+
+/*********************************************************************************
+ * Options of the command line.
+ *********************************************************************************/
+typedef struct
+{
+   char          *pszSocket;                  /* Unix socket path, or NULL       */
+   int            nPort;                      /* Loopback TCP port, or 0         */
+   int            nConnections;               /* Connections, one thread each    */
+   int            nDepth;                     /* Requests sent per write         */
+   long           lnKeys;                     /* Keys added, then deleted        */
+   long           lnOps;                      /* Searches, 0 for as many as keys */
+   double         dHitRatio;                  /* Searches for an added key       */
+   unsigned long  ulSeed;                     /* Seed of the searched keys       */
+} strClientOptions;
+
+
+/*********************************************************************************
+ * Share of one connection in one phase.
+ *********************************************************************************/
+typedef struct
+{
+   const strClientOptions *pstrOptions;       /* Server and workload             */
+   int                     nSocket;           /* Connection to the server        */
+   int                     nPhase;            /* 0 add, 1 search, 2 delete       */
+   long                    lnFirst;           /* First op of the connection      */
+   long                    lnLast;            /* One past its last op            */
+   unsigned long           ulState;           /* Generator of the searched keys  */
+   unsigned int           *anLatency;         /* Round trip of each request      */
+   long                    lnSucceeded;       /* ADDED, FOUND or DELETED replies */
+   int                     nReturnCode;       /* 0, or <0 when the server failed */
+} strClientThread;
+
+
+/*********************************************************************************
+ * Function prototypes.
+ *********************************************************************************/
+int ClientConnect(const strClientOptions *);
+unsigned long ClientRandom(unsigned long *);
+void *ClientThread(void *);
+unsigned long ClientTime(void);
+int CompareLatency(const void *, const void *);
+strClientOptions *ProcessCommandLine(strClientOptions *, int, char **);
+int RunClientPhase(const strClientOptions *, strClientThread *, int, long);
+
+
+
+
+/*********************************************************************************
+ * Function: main()
+ * Params:   argc
+ *           argv
+ * Returns:  0 - no errors
+ *           1 - cannot connect, or the server failed a request
+ * Call by:  Shell
+ * Call to:  ClientConnect()
+ *           ProcessCommandLine()
+ *           RunClientPhase()
+ * Overview: Opens the connections, then adds --keys keys, runs --ops searches
+ *           and deletes the keys again, printing one line of JSON per phase.
+ * Notes:    The keys are "key:N", so a run leaves the table as it found it.
+ *********************************************************************************/
+int main(int argc, char *argv[])
+{
+   int               nReturnCode = 0;
+   int               nIndex      = 0;
+   strClientThread  *astrThreads = NULL;
+   strClientOptions  strOptions;
+
+
+
+   ProcessCommandLine(&strOptions, argc, argv);
+
+   if ((astrThreads = calloc(strOptions.nConnections, sizeof(strClientThread))) == NULL)
+   {
+      fprintf(stderr, "Cannot allocate memory for the connections.\n");
+      return(1);
+   }
+
+   for (nIndex=0; nIndex<strOptions.nConnections && nReturnCode == 0; nIndex++)
+   {
+      astrThreads[nIndex].pstrOptions = &strOptions;
+      astrThreads[nIndex].ulState     = strOptions.ulSeed + nIndex;
+
+      if ((astrThreads[nIndex].nSocket = ClientConnect(&strOptions)) < 0)
+      {
+         nReturnCode = 1;
+      }
+   }
+
+   if (nReturnCode == 0 &&
+       (RunClientPhase(&strOptions, astrThreads, 0, strOptions.lnKeys) != 0 ||
+        RunClientPhase(&strOptions, astrThreads, 1, strOptions.lnOps) != 0 ||
+        RunClientPhase(&strOptions, astrThreads, 2, strOptions.lnKeys) != 0))
+   {
+      nReturnCode = 1;
+   }
+
+   for (nIndex=0; nIndex<strOptions.nConnections; nIndex++)
+   {
+      if (astrThreads[nIndex].nSocket > 0)
+      {
+         close(astrThreads[nIndex].nSocket);
+      }
+   }
+
+   free(astrThreads);
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ClientConnect
+ * Params:   pstrOptions - server to connect to
+ * Returns:  >=0 - connected socket
+ *           <0 - cannot connect
+ * Call by:  main()
+ * Call to:  None
+ * Overview: Connects to the Unix socket of --socket, or to 127.0.0.1 and the
+ *           TCP port of --port.
+ * Notes:    Nagle's algorithm is turned off, since each write is a whole
+ *           batch of requests.
+ ********************************************************************************/
+int ClientConnect(const strClientOptions *pstrOptions)
+{
+   int                nSocket     = -1;
+   int                nOn         = 1;
+   socklen_t          nLength     = 0;
+   struct sockaddr   *pstrAddress = NULL;
+   struct sockaddr_un strUnix;
+   struct sockaddr_in strInet;
+
+
+
+   memset(&strUnix, 0, sizeof(strUnix));
+   memset(&strInet, 0, sizeof(strInet));
+
+   if (pstrOptions->pszSocket != NULL)
+   {
+      strUnix.sun_family = AF_UNIX;
+      strncpy(strUnix.sun_path, pstrOptions->pszSocket, sizeof(strUnix.sun_path) - 1);
+
+      pstrAddress = (struct sockaddr *) &strUnix;
+      nLength     = sizeof(strUnix);
+   }
+   else
+   {
+      strInet.sin_family      = AF_INET;
+      strInet.sin_port        = htons(pstrOptions->nPort);
+      strInet.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+      pstrAddress = (struct sockaddr *) &strInet;
+      nLength     = sizeof(strInet);
+   }
+
+   if ((nSocket = socket(pstrAddress->sa_family, SOCK_STREAM, 0)) < 0 ||
+       connect(nSocket, pstrAddress, nLength) != 0)
+   {
+      fprintf(stderr, "Cannot connect to the server. errno=%d.\n", errno);
+
+      if (nSocket >= 0)
+      {
+         close(nSocket);
+      }
+
+      return(-1);
+   }
+
+   if (pstrOptions->pszSocket == NULL)
+   {
+      setsockopt(nSocket, IPPROTO_TCP, TCP_NODELAY, &nOn, sizeof(nOn));
+   }
+
+
+   return(nSocket);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ClientRandom
+ * Params:   pulState - generator state, updated
+ * Returns:  64 random bits
+ * Call by:  ClientThread()
+ * Call to:  None
+ * Overview: splitmix64 step, the generator of hash-table --bench.
+ * Notes:    Not for anything secret, only to make repeatable workloads.
+ ********************************************************************************/
+unsigned long ClientRandom(unsigned long *pulState)
+{
+   unsigned long ulMix = 0;
+
+
+
+   *pulState += 0x9e3779b97f4a7c15UL;
+   ulMix      = *pulState;
+   ulMix      = (ulMix ^ (ulMix >> 30)) * 0xbf58476d1ce4e5b9UL;
+   ulMix      = (ulMix ^ (ulMix >> 27)) * 0x94d049bb133111ebUL;
+
+
+   return(ulMix ^ (ulMix >> 31));
+}
+
+
+
+
+/********************************************************************************
+ * Function: ClientThread
+ * Params:   pArgument - the strClientThread of the connection
+ * Returns:  NULL
+ * Call by:  RunClientPhase(), through pthread_create()
+ * Call to:  ClientRandom()
+ *           ClientTime()
+ * Overview: Runs the ops lnFirst to lnLast of the phase on one connection:
+ *           writes --depth requests at once, then reads their replies, and
+ *           counts the replies that added, found or deleted a key.
+ * Notes:    Every request of a batch gets the round trip of the batch as its
+ *           latency.  A missed search asks for "key:N" with N past --keys.
+ ********************************************************************************/
+void *ClientThread(void *pArgument)
+{
+   strClientThread        *pstrThread  = (strClientThread *) pArgument;
+   const strClientOptions *pstrOptions = pstrThread->pstrOptions;
+   long                    lnOp        = 0;
+   long                    lnKey       = 0;
+   int                     nBatch      = 0;
+   int                     nIndex      = 0;
+   int                     nReplies    = 0;
+   int                     nReplyUsed  = 0;
+   size_t                  nUsed       = 0;
+   size_t                  nSent       = 0;
+   ssize_t                 nBytes      = 0;
+   unsigned long           ulStart     = 0;
+   unsigned int            nLatency    = 0;
+   char                   *pchRequests = NULL;
+   char                    szReply[CLIENT_REPLY];
+   char                    achRead[65536];
+   static const char      *apszCommand[] = {"add", "search", "delete"};
+   static const char      *apszSuccess[] = {"ADDED", "FOUND", "DELETED"};
+
+
+
+   if ((pchRequests = malloc(pstrOptions->nDepth * CLIENT_REQUEST)) == NULL)
+   {
+      pstrThread->nReturnCode = -1;
+      return(NULL);
+   }
+
+   for (lnOp=pstrThread->lnFirst; lnOp<pstrThread->lnLast && pstrThread->nReturnCode == 0;
+        lnOp+=nBatch)
+   {
+      nBatch = pstrThread->lnLast - lnOp < pstrOptions->nDepth ?
+               pstrThread->lnLast - lnOp : pstrOptions->nDepth;
+      nUsed  = 0;
+
+      for (nIndex=0; nIndex<nBatch; nIndex++)
+      {
+         lnKey = lnOp + nIndex;
+
+         if (pstrThread->nPhase == 1)
+         {
+            lnKey = ClientRandom(&pstrThread->ulState) % pstrOptions->lnKeys;
+
+            if ((ClientRandom(&pstrThread->ulState) >> 11) * 0x1.0p-53 >= pstrOptions->dHitRatio)
+            {
+               lnKey += pstrOptions->lnKeys;
+            }
+         }
+
+         nUsed += snprintf(pchRequests + nUsed, CLIENT_REQUEST, "%s key:%ld\n",
+                           apszCommand[pstrThread->nPhase], lnKey);
+      }
+
+
+      /*************************************************************************
+       * Write the whole batch, then read until it has all its replies.
+       *************************************************************************/
+      ulStart = ClientTime();
+
+      for (nSent=0; nSent<nUsed; nSent+=nBytes)
+      {
+         if ((nBytes = write(pstrThread->nSocket, pchRequests + nSent, nUsed - nSent)) <= 0)
+         {
+            pstrThread->nReturnCode = -1;
+            break;
+         }
+      }
+
+      for (nReplies=0; nReplies<nBatch && pstrThread->nReturnCode == 0; )
+      {
+         if ((nBytes = read(pstrThread->nSocket, achRead, sizeof(achRead))) <= 0)
+         {
+            pstrThread->nReturnCode = -1;
+            break;
+         }
+
+         for (nIndex=0; nIndex<nBytes; nIndex++)
+         {
+            if (achRead[nIndex] != '\n')
+            {
+               if (nReplyUsed < CLIENT_REPLY - 1)
+               {
+                  szReply[nReplyUsed++] = achRead[nIndex];
+               }
+
+               continue;
+            }
+
+            szReply[nReplyUsed] = '\0';
+            nReplyUsed          = 0;
+            nReplies++;
+
+            if (strncmp(szReply, "ERROR", 5) == 0)
+            {
+               fprintf(stderr, "Server replied [%s].\n", szReply);
+               pstrThread->nReturnCode = -1;
+            }
+
+            if (strncmp(szReply, apszSuccess[pstrThread->nPhase],
+                        strlen(apszSuccess[pstrThread->nPhase])) == 0)
+            {
+               pstrThread->lnSucceeded++;
+            }
+         }
+      }
+
+      nLatency = ClientTime() - ulStart;
+
+      for (nIndex=0; nIndex<nBatch; nIndex++)
+      {
+         pstrThread->anLatency[lnOp - pstrThread->lnFirst + nIndex] = nLatency;
+      }
+   }
+
+   free(pchRequests);
+
+
+   return(NULL);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ClientTime
+ * Params:   None
+ * Returns:  Monotonic clock in nanoseconds
+ * Call by:  ClientThread()
+ *           RunClientPhase()
+ * Call to:  None
+ * Overview: One clock_gettime() call, read through the vDSO on Linux.
+ * Notes:    None
+ ********************************************************************************/
+unsigned long ClientTime(void)
+{
+   struct timespec strNow;
+
+
+
+   clock_gettime(CLOCK_MONOTONIC, &strNow);
+
+
+   return((unsigned long) strNow.tv_sec * 1000000000UL + strNow.tv_nsec);
+}
+
+
+
+
+/********************************************************************************
+ * Function: CompareLatency
+ * Params:   pLeft, pRight - two latencies
+ * Returns:  <0, 0 or >0 as for qsort()
+ * Call by:  RunClientPhase()
+ * Call to:  None
+ * Overview: Sorts latencies in increasing order.
+ * Notes:    None
+ ********************************************************************************/
+int CompareLatency(const void *pLeft, const void *pRight)
+{
+   unsigned int nLeft  = *(const unsigned int *) pLeft;
+   unsigned int nRight = *(const unsigned int *) pRight;
+
+
+
+   return((nLeft > nRight) - (nLeft < nRight));
+}
+
+
+
+
+/********************************************************************************
+ * Function: ProcessCommandLine
+ * Params:   pstrOptions - stores options read from the command line
+ *           argc - number of command line parameters
+ *           argv - each command line parameter is a string
+ * Returns:  Pointer to strClientOptions with options from command line.
+ * Call by:  main()
+ * Call to:  None
+ * Overview: Reads arguments from command line and fills options structure.
+ *           Valid options are
+ *           --socket path or --port n, the server
+ *           --connections n (optional, 4 by default)
+ *           --depth n (optional, requests per write, 16 by default)
+ *           --keys n (optional, 100000 by default)
+ *           --ops n (optional, searches, as many as --keys by default)
+ *           --hit ratio (optional, searches for an added key, 0.9 by default)
+ *           --seed n (optional, seed of the searched keys)
+ * Notes:    Prints the usage and exits when an option is invalid.
+ ********************************************************************************/
+strClientOptions *ProcessCommandLine(strClientOptions *pstrOptions, int argc, char **argv)
+{
+   int nIndex = 0;
+
+
+
+   pstrOptions->pszSocket    = NULL;
+   pstrOptions->nPort        = 0;
+   pstrOptions->nConnections = CLIENT_CONNECTIONS;
+   pstrOptions->nDepth       = CLIENT_DEPTH;
+   pstrOptions->lnKeys       = CLIENT_KEYS;
+   pstrOptions->lnOps        = 0;
+   pstrOptions->dHitRatio    = CLIENT_HIT;
+   pstrOptions->ulSeed       = CLIENT_SEED;
+
+
+   for (nIndex=1; nIndex+1<argc; nIndex+=2)
+   {
+      if (strcmp(argv[nIndex], "--socket") == 0)
+      {
+         pstrOptions->pszSocket = argv[nIndex+1];
+      }
+      else if (strcmp(argv[nIndex], "--port") == 0)
+      {
+         pstrOptions->nPort = atoi(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--connections") == 0)
+      {
+         pstrOptions->nConnections = atoi(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--depth") == 0)
+      {
+         pstrOptions->nDepth = atoi(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--keys") == 0)
+      {
+         pstrOptions->lnKeys = atol(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--ops") == 0)
+      {
+         pstrOptions->lnOps = atol(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--hit") == 0)
+      {
+         pstrOptions->dHitRatio = atof(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--seed") == 0)
+      {
+         pstrOptions->ulSeed = strtoul(argv[nIndex+1], NULL, 0);
+      }
+      else
+      {
+         break;
+      }
+   }
+
+   if (pstrOptions->lnOps == 0)
+   {
+      pstrOptions->lnOps = pstrOptions->lnKeys;
+   }
+
+   if (nIndex < argc ||
+       (pstrOptions->pszSocket == NULL) == (pstrOptions->nPort == 0) ||
+       pstrOptions->nPort < 0 || pstrOptions->nPort > 65535 ||
+       pstrOptions->nConnections < 1 || pstrOptions->nConnections > CLIENT_MAX_CONNS ||
+       pstrOptions->nDepth < 1 || pstrOptions->nDepth > CLIENT_MAX_DEPTH ||
+       pstrOptions->lnKeys < 1 || pstrOptions->lnOps < 0 ||
+       pstrOptions->dHitRatio < 0 || pstrOptions->dHitRatio > 1)
+   {
+      fprintf(stderr, "Usage: %s --socket path | --port n [--connections n] [--depth n]\n"
+                      "       [--keys n] [--ops n] [--hit ratio] [--seed n]\n", argv[0]);
+      fprintf(stderr, "Example: %s --socket /tmp/hash.sock --connections 8 --depth 32\n",
+              argv[0]);
+      exit(1);
+   }
+
+
+   return(pstrOptions);
+}
+
+
+
+
+/********************************************************************************
+ * Function: RunClientPhase
+ * Params:   pstrOptions - server and workload
+ *           astrThreads - one entry per connection, with its socket
+ *           nPhase - 0 add, 1 search, 2 delete
+ *           lnOps - ops of the phase, shared evenly by the connections
+ * Returns:  0 - phase run and reported
+ *           <0 - cannot allocate memory or start a thread, or the server
+ *                failed a request
+ * Call by:  main()
+ * Call to:  ClientThread()
+ *           ClientTime()
+ *           CompareLatency()
+ * Overview: Runs one phase on every connection at once and prints one line of
+ *           JSON with the throughput of all connections over the wall clock
+ *           time of the phase, and the round trip percentiles.
+ * Notes:    The round trips include the time the batch spends queued behind
+ *           the other connections, since the server runs on one thread.
+ ********************************************************************************/
+int RunClientPhase(const strClientOptions *pstrOptions, strClientThread *astrThreads,
+                   int nPhase, long lnOps)
+{
+   int            nReturnCode = 0;
+   int            nIndex      = 0;
+   int            nStarted    = 0;
+   long           lnSucceeded = 0;
+   unsigned long  ulStart     = 0;
+   double         dSeconds    = 0;
+   unsigned int  *anLatency   = NULL;
+   pthread_t      atThreads[CLIENT_MAX_CONNS];
+   static const char *apszPhase[] = {"insert", "search", "delete"};
+
+
+
+   if ((anLatency = calloc(lnOps > 0 ? lnOps : 1, sizeof(unsigned int))) == NULL)
+   {
+      fprintf(stderr, "Cannot allocate memory for the latencies.\n");
+      return(-1);
+   }
+
+   ulStart = ClientTime();
+
+   for (nIndex=0; nIndex<pstrOptions->nConnections; nIndex++)
+   {
+      astrThreads[nIndex].nPhase      = nPhase;
+      astrThreads[nIndex].lnFirst     = lnOps * nIndex / pstrOptions->nConnections;
+      astrThreads[nIndex].lnLast      = lnOps * (nIndex + 1) / pstrOptions->nConnections;
+      astrThreads[nIndex].anLatency   = anLatency + astrThreads[nIndex].lnFirst;
+      astrThreads[nIndex].lnSucceeded = 0;
+      astrThreads[nIndex].nReturnCode = 0;
+
+      if (pthread_create(&atThreads[nIndex], NULL, ClientThread, &astrThreads[nIndex]) != 0)
+      {
+         fprintf(stderr, "Cannot start thread %d.\n", nIndex);
+         nReturnCode = -1;
+         break;
+      }
+
+      nStarted++;
+   }
+
+   for (nIndex=0; nIndex<nStarted; nIndex++)
+   {
+      pthread_join(atThreads[nIndex], NULL);
+
+      lnSucceeded += astrThreads[nIndex].lnSucceeded;
+
+      if (astrThreads[nIndex].nReturnCode != 0)
+      {
+         fprintf(stderr, "Connection %d failed in the %s phase.\n", nIndex, apszPhase[nPhase]);
+         nReturnCode = -1;
+      }
+   }
+
+   dSeconds = (ClientTime() - ulStart) / 1e9;
+
+
+   if (nReturnCode == 0)
+   {
+      qsort(anLatency, lnOps, sizeof(unsigned int), CompareLatency);
+
+      printf("{\"phase\":\"%s\",\"connections\":%d,\"depth\":%d,\"keys\":%ld,\"ops\":%ld,"
+             "\"hit_ratio\":%.3f,\"succeeded\":%ld,\"seconds\":%.6f,\"ops_per_sec\":%.0f,"
+             "\"p50_ns\":%u,\"p99_ns\":%u,\"p999_ns\":%u,\"max_ns\":%u}\n",
+             apszPhase[nPhase],
+             pstrOptions->nConnections,
+             pstrOptions->nDepth,
+             pstrOptions->lnKeys,
+             lnOps,
+             pstrOptions->dHitRatio,
+             lnSucceeded,
+             dSeconds,
+             dSeconds > 0 ? lnOps / dSeconds : 0,
+             lnOps > 0 ? anLatency[lnOps * 50 / 100] : 0,
+             lnOps > 0 ? anLatency[lnOps * 99 / 100] : 0,
+             lnOps > 0 ? anLatency[lnOps * 999 / 1000] : 0,
+             lnOps > 0 ? anLatency[lnOps - 1] : 0);
+
+      fflush(stdout);
+   }
+
+   free(anLatency);
+
+
+   return(nReturnCode);
+}
@@ -0,0 +1,11909 @@
+/*********************************************************************************
+ * Written by Lance N. Le
+ *
+ * Free to use.
+ * Free to distribute.
+ * No warranty, expressed or implied, comes with this program.
+ *********************************************************************************/
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <linux/limits.h>
+#include <linux/mempolicy.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HASH_HAVE_AVX2
+#endif
+
+#include "hash-lib.h"
+
+
+
+
+/*********************************************************************************
+ * Keys shorter than HASH_INLINE_KEY (including the terminator) are stored inside
+ * the node.  Longer keys are copied into the key arena and the node points to
+ * them.  Values of up to HASH_INLINE_VALUE bytes are stored inside the node too,
+ * longer values go into the same arena.  Arena blocks start at HASH_ARENA_FIRST bytes and double in size up to
+ * HASH_ARENA_BLOCK bytes, so small tables do not pay for a large block.
+ *********************************************************************************/
+#define HASH_INLINE_KEY   24
+#define HASH_INLINE_VALUE 8
+#define HASH_ARENA_FIRST  1024
+#define HASH_ARENA_BLOCK  65536
+
+
+/*********************************************************************************
+ * Chain nodes past the bucket heads come from slabs of the table.  A slab holds
+ * HASH_SLAB_FIRST nodes, the next twice as many, up to HASH_SLAB_NODES.
+ * Deleted nodes go on a free list and are handed out again first.
+ *********************************************************************************/
+#define HASH_SLAB_FIRST   32
+#define HASH_SLAB_NODES   4096
+
+
+/*********************************************************************************
+ * A chain holding more than HASH_INDEX_CHAIN keys gets a sorted index of its
+ * nodes, so lookups in it are a binary search instead of a walk.  The index is
+ * dropped again once the chain is down to HASH_INDEX_CHAIN/2 keys.
+ *********************************************************************************/
+#define HASH_INDEX_CHAIN  8
+
+
+/*********************************************************************************
+ * Open addressing engine.  Each slot has a control byte: HASH_CTRL_EMPTY,
+ * HASH_CTRL_DELETED, or the low 7 bits of the key's hash when the slot is full.
+ * Slots are probed HASH_GROUP at a time, and the table holds at most
+ * HASH_MAX_LOAD_NUM/HASH_MAX_LOAD_DEN of its slots (live plus deleted).
+ *********************************************************************************/
+#define HASH_GROUP          16
+#define HASH_CTRL_EMPTY     0x80
+#define HASH_CTRL_DELETED   0xFE
+#define HASH_MAX_LOAD_NUM   7
+#define HASH_MAX_LOAD_DEN   8
+
+
+/*********************************************************************************
+ * Automatic resizing.  A chained table doubles when it holds more than
+ * HASH_CHAIN_LOAD entries per bucket, an open addressing table doubles when it
+ * is more than half of its maximum load.  Both halve when less than a quarter
+ * (chain) or an eighth (open) full, but never below the --hashsize they started
+ * with.  A resize only allocates the new array, then every add or delete moves
+ * HASH_MIGRATE_STEP old buckets (or slots) into it until the old array is empty.
+ *********************************************************************************/
+#define HASH_CHAIN_LOAD     1
+#define HASH_MIGRATE_STEP   16
+
+
+/*********************************************************************************
+ * Snapshot files, written by --save and mapped by --snapshot.  A header, then an
+ * array of bucket offsets, then the records of each bucket next to each other.
+ * Offsets are from the start of the file, so the file can be mapped anywhere.
+ * Records start on HASH_SNAPSHOT_ALIGN byte boundaries.  Numbers are stored in
+ * the byte order of the machine that wrote the file.
+ *********************************************************************************/
+#define HASH_SNAPSHOT_MAGIC     "HTSNAP\r\n"
+#define HASH_SNAPSHOT_VERSION   3
+#define HASH_SNAPSHOT_ALIGN     8
+
+
+/*********************************************************************************
+ * Frozen snapshots, built by FreezeHashTable(), give every key a slot of its own
+ * with a minimal perfect hash (CHD): the keys are split into buckets of about
+ * HASH_FREEZE_BUCKET keys, and each bucket gets the first pilot number that sends
+ * all its keys to free slots, largest buckets first.  A bucket that finds no
+ * pilot in HASH_FREEZE_PILOTS tries per slot starts the build over with another
+ * seed, at most HASH_FREEZE_TRIES times.
+ *********************************************************************************/
+#define HASH_FREEZE_BUCKET      4
+#define HASH_FREEZE_PILOTS      16
+#define HASH_FREEZE_TRIES       8
+
+
+/*********************************************************************************
+ * Journal files, opened by --journal.  A header, then one record for each add,
+ * put or delete, appended as the table changes.  Records are collected in a
+ * buffer of HASH_JOURNAL_BUFFER bytes, written out when it is full or when the
+ * journal is synced.  Once the journal holds more than HASH_JOURNAL_DEAD
+ * records per live key, plus HASH_JOURNAL_SLACK, it is rewritten with the live
+ * keys only.  Replay adds runs of HASH_JOURNAL_BATCH keys in one call.
+ *********************************************************************************/
+#define HASH_JOURNAL_MAGIC      "HTJRNL\r\n"
+#define HASH_JOURNAL_VERSION    1
+#define HASH_JOURNAL_BUFFER     65536
+#define HASH_JOURNAL_DEAD       2
+#define HASH_JOURNAL_SLACK      4096
+#define HASH_JOURNAL_BATCH      64
+#define HASH_JOURNAL_ADD        1
+#define HASH_JOURNAL_PUT        2
+#define HASH_JOURNAL_DELETE     3
+
+
+/*********************************************************************************
+ * Trace files, written by OpenHashTrace() and read by MapHashTrace().  A header,
+ * then one record per add, search, delete or put, collected in a buffer of
+ * HASH_TRACE_BUFFER bytes.  Numbers in records are varints of 7 bits per byte,
+ * so a record takes at most HASH_TRACE_NUMBERS bytes besides its key and value.
+ *********************************************************************************/
+#define HASH_TRACE_MAGIC        "HTTRAC\r\n"
+#define HASH_TRACE_VERSION      1
+#define HASH_TRACE_BUFFER       65536
+#define HASH_TRACE_NUMBERS      31
+
+
+/*********************************************************************************
+ * Concurrent table.  Writers lock one of HASH_LOCK_STRIPES stripes, picked by
+ * the low bits of the hash, and readers take no lock at all.  Memory a reader
+ * may still be looking at is freed through epochs, checked every
+ * HASH_RECLAIM_BATCH retired blocks.
+ *********************************************************************************/
+#define HASH_LOCK_STRIPES   64
+#define HASH_RECLAIM_BATCH  64
+
+
+/*********************************************************************************
+ * Shared tables, in a POSIX shared memory segment made by OpenSharedTable().
+ * The header, the bucket heads and then the nodes, linked by node numbers, not
+ * pointers, since each process maps the segment at its own address.  A process
+ * attaching waits up to HASH_SHARED_WAIT milliseconds for the creator to finish
+ * the header.  A table has at least HASH_SHARED_BUCKETS buckets.  A search that
+ * raced a delete HASH_SHARED_RETRIES times in a row takes the writers' lock.
+ *********************************************************************************/
+#define HASH_SHARED_MAGIC       "HTSHRD\r\n"
+#define HASH_SHARED_VERSION     1
+#define HASH_SHARED_BUCKETS     64
+#define HASH_SHARED_WAIT        5000
+#define HASH_SHARED_RETRIES     16
+
+
+/*********************************************************************************
+ * StatsHashTable() counts chains (or probe lengths) up to HASH_STATS_LENGTHS-1
+ * one by one, and every longer one in the last histogram entry.
+ *********************************************************************************/
+#define HASH_STATS_LENGTHS  9
+
+
+/*********************************************************************************
+ * AddEntriesToHashTable() and SearchEntriesInHashTable() hash HASH_PREFETCH_KEYS
+ * keys, prefetch their buckets, then resolve them, so the cache misses of the
+ * keys overlap instead of adding up.
+ *********************************************************************************/
+#define HASH_PREFETCH_KEYS  16
+
+
+/*********************************************************************************
+ * Keys are compared by length first, then by MatchBytes(), 32 bytes at a time
+ * with AVX2, 16 with SSE2, or 8 with plain words, as KeyKernel() picks from
+ * what the processor has.  HashKeys() runs HASH_HASH_LANES keys of a batch
+ * through FNV-1a side by side.
+ *********************************************************************************/
+#define HASH_HASH_LANES     4
+
+
+/*********************************************************************************
+ * BuildHashTable() splits the buckets (or slot groups) into HASH_BUILD_SLICES
+ * partitions per thread, handed out to the threads as they finish one, so a
+ * thread that gets crowded partitions does not hold up the others.  Each
+ * thread gets at least HASH_BUILD_MIN_KEYS keys, so a small build does not
+ * start threads it cannot keep busy.
+ *********************************************************************************/
+#define HASH_BUILD_SLICES   8
+#define HASH_BUILD_MIN_KEYS 16384
+
+
+/*********************************************************************************
+ * Optional filter in front of the table, see strHashFilter.  It has
+ * HASH_FILTER_COUNTERS counters for each key it is sized for, and each key
+ * uses HASH_FILTER_PROBES of them.  The filter is rebuilt twice as large when
+ * the table outgrows it.
+ *********************************************************************************/
+#define HASH_FILTER_PROBES    4
+#define HASH_FILTER_COUNTERS  16
+
+
+/*********************************************************************************
+ * Page policy of SetHashPages().  Outside PAGES_DEFAULT, a block of at least
+ * half a huge page is mapped in whole huge pages, aligned to one, so the
+ * kernel can back it with huge pages, and slabs and arena blocks grow to one
+ * huge page instead of stopping at HASH_SLAB_NODES nodes and HASH_ARENA_BLOCK
+ * bytes.  HASH_HUGE_PAGE is the size assumed when /proc/meminfo gives none.
+ * NUMA policies name nodes below HASH_NUMA_NODES.
+ *********************************************************************************/
+#define HASH_HUGE_PAGE      2097152
+#define HASH_NUMA_NODES     64
+
+
+/*********************************************************************************
+ * A stored key.  Short keys live in szInline, long keys live in the key arena
+ * and pszExternal points to them.  An nLength of 0 means the entry is empty.
+ * The full hash is kept with the key, so lookups compare hashes before calling
+ * MatchKey(), and a resize never has to hash the key again.
+ * nExpire and bRecent are only used by cache mode, see strHashCache.  They fill
+ * what would otherwise be padding, so entries do not grow.
+ * The value is a string of nValueLength bytes, without terminator, stored in
+ * achInline or in the arena like the key.  Keys added without a value have an
+ * nValueLength of 0.  With the value, a chain node is one cache line.
+ *********************************************************************************/
+typedef struct
+{
+   unsigned long ulHash;                      /* HashKey() of the key            */
+   unsigned int  nLength;                     /* Key length, 0 when empty        */
+   unsigned int  nExpire : 31;                /* Last CacheClock() second, or 0  */
+   unsigned int  bRecent : 1;                 /* Hit since the clock hand passed */
+   union
+   {
+      char  szInline[HASH_INLINE_KEY];        /* Short key stored in the entry   */
+      char *pszExternal;                      /* Long key stored in the arena    */
+   } uKey;
+   unsigned int  nValueLength;                /* Value length, 0 for no value    */
+   union
+   {
+      char  achInline[HASH_INLINE_VALUE];     /* Short value stored in the entry */
+      char *pchExternal;                      /* Long value stored in the arena  */
+   } uValue;
+} strHashKey;
+
+
+/*********************************************************************************
+ * Basic hash table structure to store data for chaining.
+ * This application stores the indexes as a linked list, thus, the hash table is
+ * an array of linked lists and uses the bucket, element 0, to store data.
+ *
+ * Long chains also get a sorted index, see strChainIndex, so a bucket flooded
+ * with keys is searched in O(log n) rather than O(n).
+ *********************************************************************************/
+typedef struct _strHashTable
+{
+   struct _strHashTable *pstrNext;            /* Link to next linked list entry  */
+   strHashKey            strKey;              /* Data entered by user            */
+} strHashTable;
+
+
+/*********************************************************************************
+ * Sorted index of one long chain: pointers to its nodes holding a key, ordered
+ * by hash and then by key.  The chain stays linked as it is, so code walking
+ * the chains does not need to know about indexes.
+ *********************************************************************************/
+typedef struct
+{
+   int            nCount;                     /* Nodes in apstrNodes             */
+   int            nSize;                      /* Room in apstrNodes              */
+   strHashTable  *apstrNodes[];               /* Nodes sorted by hash and key    */
+} strChainIndex;
+
+
+/*********************************************************************************
+ * Page and NUMA policy of a table, set by SetHashPages().  The node pool and
+ * the key arena point to it, so storage allocated by build threads follows it
+ * too.
+ *********************************************************************************/
+typedef struct
+{
+   pagepolicy     nPolicy;                    /* Pages of new storage            */
+   numapolicy     nNuma;                      /* Nodes of new storage            */
+   int            nNode;                      /* Node of NUMA_BIND               */
+} strHashPages;
+
+
+/*********************************************************************************
+ * How PageAlloc() obtained a block of buckets, nodes or keys, so PageFree()
+ * releases it the same way and PageUsage() can report it.  nMapped is 0 for
+ * memory from calloc(), else the bytes mapped.
+ *********************************************************************************/
+typedef enum {BACKING_HEAP, BACKING_PAGES, BACKING_THP, BACKING_HUGETLB} pagebacking;
+
+typedef struct
+{
+   size_t         nMapped;                    /* Bytes mapped, 0 from calloc()   */
+   pagebacking    nBacking;                   /* Pages behind the block          */
+   boolean        bPlaced;                    /* Under the NUMA policy           */
+} strPageMap;
+
+
+/*********************************************************************************
+ * Bump allocator for long keys and values.  Blocks are chained and only released
+ * when the whole table is freed.  Bytes of deleted keys and replaced values are
+ * counted in nDead, but are not reused.
+ *********************************************************************************/
+typedef struct _strArenaBlock
+{
+   struct _strArenaBlock *pstrNext;           /* Previously filled block         */
+   size_t                 nSize;              /* Usable bytes in acData          */
+   size_t                 nUsed;              /* Bytes handed out from acData    */
+   strPageMap             strMap;             /* How the block was allocated     */
+   char                   acData[];           /* Key storage                     */
+} strArenaBlock;
+
+typedef struct
+{
+   strArenaBlock      *pstrBlocks;            /* Current block, head of chain    */
+   size_t              nReserved;             /* Bytes obtained from PageAlloc() */
+   size_t              nUsed;                 /* Bytes handed out to keys        */
+   size_t              nDead;                 /* Bytes of deleted keys, values   */
+   const strHashPages *pstrPages;             /* Policy of new blocks            */
+} strArena;
+
+
+/*********************************************************************************
+ * Pool of chain nodes.  Slabs are chained and only released when the whole
+ * table is freed.  pstrFree links free nodes through their pstrNext.
+ *********************************************************************************/
+typedef struct _strNodeSlab
+{
+   struct _strNodeSlab *pstrNext;             /* Previously filled slab          */
+   size_t               nSize;                /* Nodes in astrNodes              */
+   size_t               nUsed;                /* Nodes handed out from astrNodes */
+   strPageMap           strMap;               /* How the slab was allocated      */
+   strHashTable         astrNodes[];          /* Node storage                    */
+} strNodeSlab;
+
+typedef struct
+{
+   strNodeSlab        *pstrSlabs;             /* Current slab, head of chain     */
+   strHashTable       *pstrFree;              /* Deleted nodes, ready for reuse  */
+   size_t              nReserved;             /* Bytes obtained from PageAlloc() */
+   long                lnFree;                /* Nodes on the free list          */
+   const strHashPages *pstrPages;             /* Policy of new slabs             */
+} strNodePool;
+
+
+/*********************************************************************************
+ * One array of buckets.  ENGINE_CHAIN uses pastrBuckets, and papstrIndexes
+ * once a chain is long enough to be indexed.  ENGINE_OPEN uses pachControl and
+ * pastrSlots, with nSize slots, a multiple of HASH_GROUP and a power of 2.
+ * The control bytes follow the slots in the same block of PageAlloc().
+ * nSize is 0 when the array is not allocated.
+ *********************************************************************************/
+typedef struct
+{
+   strHashTable   *pastrBuckets;              /* Array of bucket heads           */
+   strChainIndex **papstrIndexes;             /* Index of each bucket, or NULL   */
+   unsigned char  *pachControl;               /* One control byte per slot       */
+   strHashKey     *pastrSlots;                /* Keys for open addressing        */
+   int             nSize;                     /* Number of buckets or slots      */
+   int             nIndexes;                  /* Chains with an index            */
+   size_t          nIndexBytes;               /* Memory held by the indexes      */
+   long            lnDeleted;                 /* Open slots marked deleted       */
+   strPageMap      strMap;                    /* How the array was allocated     */
+} strHashArray;
+
+
+/*********************************************************************************
+ * Snapshot file layout.  The header is followed by ulBuckets offsets of the
+ * first record of each bucket, 0 for an empty bucket.  ulNext links the records
+ * of a bucket, 0 ends the chain.  The value of a record follows the terminator
+ * of its key.  The checksum is HashWy() of everything after
+ * the header.
+ * A frozen snapshot has ulPilots pilots after the offsets, padded to
+ * HASH_SNAPSHOT_ALIGN.  Its buckets are the slots of the perfect hash, one record
+ * each, and ulBuckets need not be a power of 2.
+ *********************************************************************************/
+typedef struct
+{
+   char          achMagic[8];                 /* HASH_SNAPSHOT_MAGIC             */
+   unsigned int  nVersion;                    /* HASH_SNAPSHOT_VERSION           */
+   unsigned int  nHash;                       /* hashfn of the stored hashes     */
+   unsigned long aulSeed[2];                  /* Key of the seeded hashes        */
+   unsigned long ulBuckets;                   /* Number of buckets, power of 2   */
+   unsigned long ulEntries;                   /* Number of records               */
+   unsigned long ulFileSize;                  /* Size of the whole file          */
+   unsigned long ulChecksum;                  /* HashWy() after the header       */
+   unsigned long ulPilots;                    /* Pilots if frozen, else 0        */
+   unsigned long ulPilotSeed;                 /* Seed of the perfect hash        */
+} strSnapshotHeader;
+
+typedef struct
+{
+   unsigned long ulHash;                      /* HashKey() of the key            */
+   unsigned long ulNext;                      /* Next record in bucket, or 0     */
+   unsigned int  nLength;                     /* Key length                      */
+   unsigned int  nValueLength;                /* Value length, after the key     */
+   char          achKey[];                    /* Key, terminator, then value     */
+} strSnapshotRecord;
+
+
+/*********************************************************************************
+ * A snapshot mapped read only.  puchMap is NULL when no snapshot is mapped.  A
+ * table frozen by FreezeHashTable() maps its snapshot from memory instead of a
+ * file.
+ *********************************************************************************/
+typedef struct
+{
+   unsigned char           *puchMap;          /* Start of the mapped file        */
+   size_t                   nSize;            /* Bytes mapped                    */
+   const strSnapshotHeader *pstrHeader;       /* Header at the start of the map  */
+   const unsigned long     *aulBuckets;       /* Offset of each bucket's chain   */
+   const unsigned int      *anPilots;         /* Pilots of a frozen snapshot     */
+} strSnapshot;
+
+
+/*********************************************************************************
+ * Journal file layout.  The header is followed by records: a strJournalRecord,
+ * then the key, its terminator and the value, with no padding.  nCheck is the
+ * low 32 bits of HashWy() of the key, terminator and value, seeded with the
+ * operation and the value length, so a record torn by a crash is found and
+ * dropped when the journal is replayed.
+ *********************************************************************************/
+typedef struct
+{
+   char          achMagic[8];                 /* HASH_JOURNAL_MAGIC              */
+   unsigned int  nVersion;                    /* HASH_JOURNAL_VERSION            */
+   unsigned int  nReserved;                   /* 0                               */
+} strJournalHeader;
+
+typedef struct
+{
+   unsigned int  nOp;                         /* HASH_JOURNAL_ADD, PUT or DELETE */
+   unsigned int  nLength;                     /* Key length                      */
+   unsigned int  nValueLength;                /* Value length, after the key     */
+   unsigned int  nCheck;                      /* HashWy() of the key and value   */
+} strJournalRecord;
+
+
+/*********************************************************************************
+ * Journal of a table, opened by OpenHashJournal().  pchBuffer is NULL when the
+ * table has no journal.  lnPending counts the records appended since the last
+ * sync.  With JOURNAL_GROUP, a change syncs the journal once lnGroupOps records
+ * are pending, or lnGroupMs milliseconds have passed since the last sync.
+ *********************************************************************************/
+typedef struct
+{
+   char          *pchBuffer;                  /* Records not written yet         */
+   size_t         nBuffered;                  /* Bytes used in pchBuffer         */
+   int            nFile;                      /* Journal, open for appending     */
+   journalsync    nSync;                      /* When changes are synced         */
+   long           lnGroupMs;                  /* Longest wait of a group, or 0   */
+   long           lnGroupOps;                 /* Most records of a group, or 0   */
+   long           lnPending;                  /* Records not synced yet          */
+   long           lnRecords;                  /* Records in the journal          */
+   long           lnSyncs;                    /* Times the journal was synced    */
+   unsigned long  ulSyncMs;                   /* JournalClock() of the last sync */
+   char           szFile[PATH_MAX];           /* Journal file, for compaction    */
+} strJournal;
+
+
+/*********************************************************************************
+ * Trace file layout.  The header is followed by records: the operation in one
+ * byte, the nanoseconds since the previous record and the key length as
+ * varints, the key and its terminator, then for a put the value length as a
+ * varint and the value.  ulStart is the CLOCK_REALTIME when the trace opened, so
+ * a trace can be matched with other logs.
+ *********************************************************************************/
+typedef struct
+{
+   char           achMagic[8];                /* HASH_TRACE_MAGIC                */
+   unsigned int   nVersion;                   /* HASH_TRACE_VERSION              */
+   unsigned int   nReserved;                  /* 0                               */
+   unsigned long  ulStart;                    /* Nanoseconds since the epoch     */
+} strTraceHeader;
+
+
+/*********************************************************************************
+ * Trace of a table, opened by OpenHashTrace().  pchBuffer is NULL when the
+ * table is not traced.  A trace that cannot be written is closed, and the
+ * table goes on without it.
+ *********************************************************************************/
+typedef struct
+{
+   char          *pchBuffer;                  /* Records not written yet         */
+   size_t         nBuffered;                  /* Bytes used in pchBuffer         */
+   int            nFile;                      /* Trace, open for writing         */
+   unsigned long  ulLast;                     /* TraceClock() of the last record */
+   long           lnRecords;                  /* Records in the trace            */
+} strTrace;
+
+
+/*********************************************************************************
+ * A trace mapped by MapHashTrace() for reading.  nOffset is the next record and
+ * ulTime the time of the last record read.
+ *********************************************************************************/
+struct _strHashTrace
+{
+   char          *pchMap;                     /* Trace file, mapped read only    */
+   size_t         nSize;                      /* Bytes mapped                    */
+   size_t         nOffset;                    /* Offset of the next record       */
+   unsigned long  ulTime;                     /* Nanoseconds of the last record  */
+};
+
+
+/*********************************************************************************
+ * Position of NextHashEntry() in a table.  Start with all fields 0.
+ *********************************************************************************/
+typedef struct
+{
+   int            nArray;                     /* 0 current array, 1 old array    */
+   int            nIndex;                     /* Next bucket or slot to visit    */
+   strHashTable  *pstrNode;                   /* Next node of the current chain  */
+} strHashCursor;
+
+
+/*********************************************************************************
+ * Counters kept on every call, reported by GetHashInfo() and StatsHashTable().
+ * An add or put of a new key counts in lnInserts, a put of a key already
+ * stored in lnUpdates.
+ * lnWalked counts the chain nodes (or open addressing groups) that searches
+ * looked at, found or not.  lnFiltered counts the misses answered by the
+ * filter alone, lnFalse the misses the filter let through.  A search that finds
+ * an expired key counts as a miss, and in lnExpired.
+ *********************************************************************************/
+typedef struct
+{
+   long           lnInserts;                  /* Adds that stored a new key      */
+   long           lnUpdates;                  /* Puts that replaced a value      */
+   long           lnHits;                     /* Searches that found the key     */
+   long           lnMisses;                   /* Searches that did not           */
+   long           lnDeletes;                  /* Deletes that removed the key    */
+   long           lnWalked;                   /* Nodes or groups searched        */
+   long           lnFiltered;                 /* Misses answered by the filter   */
+   long           lnFalse;                    /* Misses the filter let through   */
+   long           lnEvicted;                  /* Keys evicted to make room       */
+   long           lnExpired;                  /* Keys dropped past their TTL     */
+} strHashStats;
+
+
+/*********************************************************************************
+ * Counting Bloom filter kept in front of a table by SetHashFilter().  Counters
+ * are 4 bits, two per byte.  The counters of a key are all in one block of
+ * HASH_CACHE_LINE bytes picked by its hash, so a test reads one cache line.
+ * puchCounters is NULL when the table has no filter.
+ *********************************************************************************/
+typedef struct
+{
+   unsigned char *puchCounters;               /* ulBlocks blocks of counters     */
+   unsigned long  ulBlocks;                   /* Number of blocks, power of 2    */
+   long           lnCapacity;                 /* Keys the filter is sized for    */
+} strHashFilter;
+
+
+/*********************************************************************************
+ * Cache mode, turned on by SetHashCache().  Adds evict keys once the table holds
+ * lnMaxEntries keys, or nMaxBytes in CacheBytes(), picked with the CLOCK
+ * algorithm: nHand sweeps the buckets (or slots), a key hit since the hand last
+ * passed gets its bRecent cleared and is kept, any other key is evicted.  Hits
+ * only set a bit, so the hot path never relinks anything.
+ * Keys expire lnTtl seconds after they are added, counted in whole seconds of
+ * CacheClock() from tStart.  They are dropped when a lookup or the hand finds
+ * them, not by a timer.
+ *********************************************************************************/
+typedef struct
+{
+   boolean        bOn;                        /* Cache mode is on                */
+   long           lnMaxEntries;               /* Most keys kept, 0 no limit      */
+   size_t         nMaxBytes;                  /* Most bytes kept, 0 no limit     */
+   long           lnTtl;                      /* Seconds keys live, 0 forever    */
+   time_t         tStart;                     /* Monotonic second of CacheClock  */
+   int            nHand;                      /* Next bucket or slot to sweep    */
+} strHashCache;
+
+
+/*********************************************************************************
+ * A hash table: the array of buckets plus the storage used by its entries.
+ * While resizing, strOldArray holds the previous array.  Its buckets (or slots)
+ * below nMigrated have already been moved into strArray.
+ * While a snapshot is mapped, the arrays are empty and lnEntries counts the
+ * records of the snapshot.  The first add or delete copies them into the arrays.
+ * With a journal, every change is also appended to strJournal.  With a trace,
+ * every operation is also appended to strTrace.
+ * Arrays, node slabs and arena blocks are allocated as strPages says.
+ *********************************************************************************/
+typedef struct _strHash
+{
+   engine         nEngine;                    /* Chaining or open addressing     */
+   hashfn         nHash;                      /* Hash function used by HashKey() */
+   unsigned long  aulSeed[2];                 /* Key for seeded hash functions   */
+   strHashArray   strArray;                   /* Current buckets or slots        */
+   strHashArray   strOldArray;                /* Array being migrated, if any    */
+   int            nMigrated;                  /* Old buckets or slots moved      */
+   int            nMinSize;                   /* Never shrink below this size    */
+   long           lnEntries;                  /* Keys stored in the table        */
+   long           lnChainNodes;               /* Nodes allocated past the heads  */
+   long           lnResizes;                  /* Resizes started                 */
+   strArena       strKeys;                    /* Storage for long keys           */
+   strNodePool    strNodes;                   /* Storage for chain nodes         */
+   strHashStats   strStats;                   /* Operation counters              */
+   strHashFilter  strFilter;                  /* Filter of absent keys, if any   */
+   strHashCache   strCache;                   /* Limits of cache mode, if on     */
+   strSnapshot    strSnap;                    /* Snapshot served until a change  */
+   strJournal     strJournal;                 /* Log of changes, if any          */
+   strTrace       strTrace;                   /* Log of operations, if any       */
+   strHashPages   strPages;                   /* Pages and nodes of new storage  */
+} strHash;
+
+
+/*********************************************************************************
+ * A key of BuildHashTable(), hashed and moved into its partition.
+ *********************************************************************************/
+typedef struct
+{
+   unsigned long  ulHash;                     /* HashKey() of the key            */
+   size_t         nLength;                    /* strlen() of the key             */
+   long           lnKey;                      /* Index of the key in apszData    */
+} strBuildKey;
+
+
+/*********************************************************************************
+ * Share of one thread in BuildHashTable().  In phase 0 the thread hashes keys
+ * lnFirst to lnLast-1 and counts them per partition in alnCounts, in phase 1 it
+ * moves them into astrKeys from the offsets left in alnCounts, and in phase 2
+ * it builds the partitions it takes from pnNext.  Its nodes and long keys come
+ * from a pool and an arena of its own, handed over to the table at the end.
+ * alnLater holds the buckets whose chain needs an index, or for open addressing
+ * the keys whose probe left their partition, both done once the threads end.
+ *********************************************************************************/
+typedef struct
+{
+   strHash        *pstrHash;                  /* Table being built               */
+   const char    **apszData;                  /* Keys to add                     */
+   unsigned long  *aulHash;                   /* HashKey() of each key           */
+   size_t         *anLength;                  /* strlen() of each key            */
+   strBuildKey    *astrKeys;                  /* Keys in partition order         */
+   const long     *alnStarts;                 /* First key of each partition     */
+   long           *alnCounts;                 /* Keys of each partition, then    */
+                                              /* where the next one goes         */
+   int            *pnNext;                    /* Next partition to build, atomic */
+   int             nPartitions;               /* Number of partitions            */
+   int             nPhase;                    /* 0 hash, 1 move, 2 build         */
+   long            lnFirst;                   /* First key of the thread         */
+   long            lnLast;                    /* One past its last key           */
+   long            lnAdded;                   /* Keys stored by the thread       */
+   long            lnNodes;                   /* Chain nodes it linked           */
+   long            lnErrors;                  /* Keys it could not store         */
+   strNodePool     strNodes;                  /* Storage for its chain nodes     */
+   strArena        strKeys;                   /* Storage for its long keys       */
+   long           *alnLater;                  /* Buckets or keys left for later  */
+   long            lnLater;                   /* Entries used in alnLater        */
+   long            lnLaterSize;               /* Entries allocated               */
+} __attribute__((aligned(HASH_CACHE_LINE))) strBuildThread;
+
+
+/*********************************************************************************
+ * Concurrent table node.  The key is allocated with the node and never changes,
+ * only pstrNext does, so a reader without a lock always sees a whole node.
+ *********************************************************************************/
+typedef struct _strConcurrentNode
+{
+   struct _strConcurrentNode *pstrNext;       /* Next node, changed atomically   */
+   unsigned long              ulHash;         /* HashBytes() of the key          */
+   unsigned int               nLength;        /* Key length                      */
+   char                       achKey[];       /* Key and its terminator          */
+} strConcurrentNode;
+
+
+/*********************************************************************************
+ * Buckets of a concurrent table.  A resize builds a new array and swaps the
+ * pointer, readers still walking the old array finish there.
+ *********************************************************************************/
+typedef struct
+{
+   unsigned long      ulSize;                 /* Number of buckets, power of 2   */
+   strConcurrentNode *apstrBuckets[];         /* First node of each chain        */
+} strConcurrentArray;
+
+
+/*********************************************************************************
+ * Memory unlinked from a concurrent table, freed once no reader can see it.
+ *********************************************************************************/
+typedef struct
+{
+   void          *pMemory;                    /* Node, or a whole old array      */
+   unsigned long  ulEpoch;                    /* Global epoch when unlinked      */
+   boolean        bArray;                     /* TRUE for an array and its nodes */
+} strRetired;
+
+
+/*********************************************************************************
+ * One lock stripe, and one thread's epoch record.  Each is on its own cache
+ * line, so threads do not slow each other down by writing next to each other.
+ *********************************************************************************/
+typedef struct
+{
+   pthread_mutex_t strMutex;                  /* Held while changing a bucket    */
+   long            lnEntries;                 /* Keys in the stripe's buckets    */
+} __attribute__((aligned(HASH_CACHE_LINE))) strLockStripe;
+
+typedef struct _strEpochThread
+{
+   unsigned long  ulEpoch;                    /* Epoch while reading, 0 if not   */
+   int            bInUse;                     /* Record taken by a thread        */
+   size_t         nRetired;                   /* Entries used in pastrRetired    */
+   size_t         nCapacity;                  /* Entries allocated               */
+   strRetired    *pastrRetired;               /* Memory waiting to be freed      */
+} __attribute__((aligned(HASH_CACHE_LINE))) strEpochThread;
+
+
+/*********************************************************************************
+ * A hash table shared by threads.  Keys are hashed like strHash keys, and the
+ * table doubles when a stripe holds more than one key per bucket.
+ *********************************************************************************/
+typedef struct _strConcurrentHash
+{
+   hashfn              nHash;                 /* Hash function of the keys       */
+   unsigned long       aulSeed[2];            /* Key for siphash                 */
+   strConcurrentArray *pstrArray;             /* Current buckets, atomic         */
+   unsigned long       ulEpoch;               /* Global epoch, starts at 1       */
+   long                lnResizes;             /* Resizes done                    */
+   strLockStripe       astrStripes[HASH_LOCK_STRIPES];
+   strEpochThread      astrThreads[HASH_MAX_THREADS];
+} strConcurrentHash;
+
+
+/*********************************************************************************
+ * Start of a shared table segment.  Everything after strMutex changes only
+ * under it, except ulSequence, which readers check.  Node numbers in the
+ * bucket heads and in nNext are one more than the node, so 0 ends a chain.
+ *********************************************************************************/
+typedef struct
+{
+   char            achMagic[8];               /* HASH_SHARED_MAGIC               */
+   unsigned int    nVersion;                  /* HASH_SHARED_VERSION, set last   */
+   hashfn          nHash;                     /* Hash function of the keys       */
+   unsigned long   aulSeed[2];                /* Key for siphash                 */
+   unsigned long   ulBuckets;                 /* Number of buckets, power of 2   */
+   unsigned int    nCapacity;                 /* Nodes in the segment            */
+   unsigned int    nKeyMax;                   /* Longest key a node holds        */
+   size_t          nNodeSize;                 /* Bytes of a node, aligned        */
+   size_t          nBuckets;                  /* Offset of the bucket heads      */
+   size_t          nNodeStart;                /* Offset of the first node        */
+   size_t          nSize;                     /* Bytes of the whole segment      */
+   pthread_mutex_t strMutex;                  /* Writers, robust, process shared */
+   unsigned int    nFree;                     /* First free node + 1, 0 if none  */
+   unsigned int    nUsed;                     /* Nodes handed out at least once  */
+   unsigned long   ulSequence;                /* Bumped before a node is reused  */
+   long            lnEntries;                 /* Keys in the table               */
+   long            lnInserts;                 /* Adds that stored a new key      */
+   long            lnDeletes;                 /* Deletes that removed the key    */
+   long            lnRecovered;               /* Locks taken from dead writers   */
+} strSharedHeader;
+
+
+/*********************************************************************************
+ * Shared table node.  The key is stored in the node, up to nKeyMax bytes.
+ *********************************************************************************/
+typedef struct
+{
+   unsigned long   ulHash;                    /* HashBytes() of the key          */
+   unsigned int    nNext;                     /* Next node + 1, set atomically   */
+   unsigned short  nLength;                   /* Key length                      */
+   unsigned char   uchMark;                   /* Reached, during a recovery      */
+   char            achKey[];                  /* Key and its terminator          */
+} strSharedNode;
+
+
+/*********************************************************************************
+ * One process's handle on a shared table.  The counters of searches are kept
+ * here, not in the segment, so readers never write to shared memory.
+ *********************************************************************************/
+typedef struct _strSharedHash
+{
+   strSharedHeader *pstrHeader;               /* Start of the mapped segment     */
+   unsigned int    *anBuckets;                /* First node + 1 of each chain    */
+   char            *pchNodes;                 /* First node                      */
+   size_t           nSize;                    /* Bytes mapped                    */
+   long             lnHits;                   /* Searches that found the key     */
+   long             lnMisses;                 /* Searches that did not           */
+   long             lnWalked;                 /* Nodes searched                  */
+   long             lnRetries;                /* Searches redone after a delete  */
+} strSharedHash;
+
+
+/*********************************************************************************
+ * Function prototypes.
+ *********************************************************************************/
+static int AddEntryToChainTable(strHash *, const char *, size_t, unsigned long, unsigned int,
+                                const char *, size_t);
+static int AddEntryToOpenTable(strHash *, const char *, size_t, unsigned long, unsigned int,
+                               const char *, size_t);
+static int AllocateHashArray(strHashArray *, const strHashPages *, engine, int);
+static int AppendJournal(strHash *, unsigned int, const char *, const char *, size_t);
+static void AppendTrace(strHash *, traceop, const char *, const char *, size_t);
+static char *ArenaAlloc(strArena *, size_t);
+static size_t ArenaBytesOfEntry(const strHashKey *);
+static int BuildChainIndex(strHashArray *, int);
+static void BuildChainPartition(strBuildThread *, int);
+static int BuildHashFilter(strHash *, long);
+static void *BuildHashThread(void *);
+static void BuildOpenPartition(strBuildThread *, int);
+static int BuildPerfectHash(const unsigned long *, unsigned long, unsigned long, unsigned long,
+                            unsigned long, unsigned int *);
+static size_t CacheBytes(const strHash *);
+static unsigned int CacheClock(const strHash *);
+static unsigned int CacheExpiry(const strHash *, long);
+static boolean CacheFull(const strHash *, long, size_t);
+static int CheckHashLoad(strHash *, boolean);
+static void CloseJournal(strHash *);
+static void CloseTrace(strHash *);
+static int CommitJournal(strHash *);
+static long CompactJournal(strHash *);
+static int CompactKeyArena(strHash *);
+static int CompareChainNodes(const void *, const void *);
+static void CountFilterKey(strHashFilter *, unsigned long, int);
+static void CountPageBlock(strHashInfo *, const strPageMap *, size_t);
+static int DeferBuildItem(strBuildThread *, long);
+static int DeleteEntryFromOpenTable(strHash *, const char *, size_t);
+static void DropChainIndex(strHashArray *, int);
+static void EnterEpoch(strConcurrentHash *, strEpochThread *);
+static int EvictCacheEntry(strHash *);
+static strHashTable *FindChainEntry(const strHashArray *, const char *, size_t, unsigned long,
+                                    int *);
+static strHashKey *FindHashedKey(const strHash *, const char *, size_t, unsigned long);
+static int FindOpenSlot(const strHashArray *, const char *, size_t, unsigned long, int *);
+static void FreeEntryStorage(strHash *);
+static void FreeHashArray(strHashArray *);
+static int FreeOpenSlot(const strHashArray *, unsigned long);
+static void FreeRetired(strRetired *);
+static unsigned long HashFnv1a(const char *, size_t);
+static void HashFnv1aLanes(const char * const *, const size_t *, unsigned long *);
+static unsigned long HashKey(const strHash *, const char *, size_t);
+static unsigned long HashSip(const char *, size_t, const unsigned long *);
+static unsigned long HashSum(const char *, size_t);
+static unsigned long HashU64(unsigned long, unsigned long);
+static unsigned long HashUuid(strUuid, unsigned long);
+static unsigned long HashWy(const char *, size_t, unsigned long);
+static unsigned long HashWyMix(unsigned long, unsigned long);
+static long HistogramHashTable(const strHash *, long *, long *, long *);
+static size_t HugePageSize(void);
+static int ImportSnapshot(strHash *);
+static int IndexChainNode(strHashArray *, int, strHashTable *);
+static unsigned long JournalClock(void);
+static keykernel KeyKernel(int);
+static const char *KeyOfEntry(const strHashKey *);
+static void LeaveEpoch(strEpochThread *);
+static int LinkChainKey(strHash *, strHashArray *, unsigned long, const strHashKey *);
+static int ListOpenTable(const strHash *, FILE *);
+static int ListSnapshot(const strHash *, FILE *);
+static int LockSharedTable(strSharedHash *);
+static int MakeCacheRoom(strHash *, const char *, size_t, unsigned long, size_t);
+static boolean MatchBytesAvx2(const char *, const char *, size_t);
+static boolean MatchBytesSse2(const char *, const char *, size_t);
+static unsigned int MatchGroup(const unsigned char *, unsigned char);
+static boolean MatchKey(const strHashKey *, const char *, size_t);
+static size_t MemoryInUse(const strHash *);
+static void MergeArena(strArena *, strArena *);
+static void MergeNodePool(strNodePool *, strNodePool *);
+static int MigrateHashTable(strHash *, int);
+static unsigned long MixFilterHash(unsigned long);
+static const strHashKey *NextHashEntry(const strHash *, strHashCursor *);
+static strHashTable *NodeAlloc(strNodePool *);
+static void NodeFree(strNodePool *, strHashTable *);
+static unsigned long NumaNodes(void);
+static void *PageAlloc(const strHashPages *, size_t, strPageMap *);
+static void PageFree(void *, const strPageMap *);
+static void PageUsage(const strHash *, strHashInfo *);
+static int PartitionOfHash(const strHash *, unsigned long, int);
+static unsigned long PerfectBucket(unsigned long, unsigned long, unsigned long);
+static unsigned long PerfectSlot(unsigned long, unsigned long, unsigned int, unsigned long);
+static int PlacePages(void *, size_t, const strHashPages *);
+static void PrefetchBuckets(const strHash *, const unsigned long *, int);
+static size_t PutTraceNumber(char *, unsigned long);
+static int ReadTraceNumber(const strHashTrace *, size_t *, unsigned long *);
+static int ReclaimMemory(strConcurrentHash *, strEpochThread *);
+static void RecoverSharedTable(strSharedHash *);
+static int RemoveCacheEntry(strHash *, strHashKey *);
+static long ReplayJournal(strHash *, const char *, size_t, size_t *);
+static int ResizeConcurrentTable(strConcurrentHash *, strEpochThread *, unsigned long);
+static int ResizeHashTable(strHash *, int);
+static int RetireMemory(strConcurrentHash *, strEpochThread *, void *, boolean);
+static void RunBuildPhase(strBuildThread *, int, int);
+static long SaveFrozenSnapshot(const strSnapshot *, const char *);
+static int SearchChainIndex(const strChainIndex *, const char *, size_t, unsigned long, int *);
+static int SearchHashedEntry(strHash *, const char *, size_t, unsigned long, int *,
+                             const char **, size_t *);
+static int SearchOpenTable(const strHash *, const char *, size_t, unsigned long, int *,
+                           strHashKey **);
+static int SearchSnapshot(const strHash *, const char *, size_t, unsigned long, int *,
+                          const strSnapshotRecord **);
+static int SetEntryKey(strArena *, strHashKey *, const char *, size_t, unsigned long,
+                       unsigned int, const char *, size_t);
+static int SetEntryValue(strArena *, strHashKey *, const char *, size_t);
+static strSharedNode *SharedNode(const strSharedHash *, unsigned int);
+static unsigned long SnapshotBucket(const strSnapshot *, unsigned long);
+static const strSnapshotRecord *SnapshotRecord(const strSnapshot *, unsigned long);
+static size_t SnapshotRecordSize(unsigned int, unsigned int);
+static unsigned long SnapshotRecordStart(const strSnapshotHeader *);
+static boolean TestFilterKey(const strHashFilter *, unsigned long);
+static long ThpBackedBytes(void);
+static boolean TornJournalTail(const char *, size_t, size_t);
+static int TouchCacheEntry(strHash *, strHashKey *);
+static unsigned long TraceClock(void);
+static int UnlinkChainEntry(strHash *, strHashArray *, const char *, size_t, unsigned long);
+static int UnlinkOpenEntry(strHash *, strHashArray *, const char *, size_t, unsigned long);
+static const char *ValueOfEntry(const strHashKey *);
+static int WriteJournal(const strJournal *, const char *, size_t);
+static int WriteTrace(const strTrace *, const char *, size_t);
+
+
+
+
+/*********************************************************************************
+ * Typed tables declared in hash-lib.h.  Keys are compared as whole words.
+ *********************************************************************************/
+#define HASH_U64_EQUAL(ulKey1, ulKey2)   ((ulKey1) == (ulKey2))
+#define HASH_UUID_EQUAL(strKey1, strKey2)                                             \
+        ((strKey1).aulWord[0] == (strKey2).aulWord[0] &&                              \
+         (strKey1).aulWord[1] == (strKey2).aulWord[1])
+
+HASH_TYPED_DEFINE(U64, unsigned long, unsigned long, HashU64, HASH_U64_EQUAL)
+HASH_TYPED_DEFINE(Uuid, strUuid, unsigned long, HashUuid, HASH_UUID_EQUAL)
+
+
+
+
+/********************************************************************************
+ * Function: AddEntriesToHashTable
+ * Params:   pstrHash - hash table
+ *           apszData - data to add
+ *           nCount - number of entries in apszData
+ *           anResults - if not NULL, receives what AddEntryToHashTable() would
+ *                       return for each entry
+ * Returns:  Number of entries added
+ *           <0 - cannot import the mapped snapshot
+ * Call by:  BuildHashTable()
+ *           FlushLoadKeys()
+ *           ReplayJournal()
+ * Call to:  AddEntryToChainTable()
+ *           AddEntryToOpenTable()
+ *           AppendJournal()
+ *           AppendTrace()
+ *           CacheExpiry()
+ *           CommitJournal()
+ *           HashKeys()
+ *           ImportSnapshot()
+ *           MakeCacheRoom()
+ *           PrefetchBuckets()
+ * Overview: Adds the entries HASH_PREFETCH_KEYS at a time: hashes them all,
+ *           prefetches their buckets, then adds them one by one while the
+ *           buckets are on their way into the cache.
+ * Notes:    Entries are added in order, so a duplicate later in apszData is
+ *           reported as already there.  An add can resize the table, which
+ *           only makes the prefetches of the rest of the group useless.
+ *           In cache mode, every entry gets the TTL of SetHashCache().  With
+ *           a journal, the whole call is committed once.
+ ********************************************************************************/
+int AddEntriesToHashTable(strHash *pstrHash, const char **apszData, int nCount,
+                          int *anResults)
+{
+   int           nIndex      = 0;
+   int           nFirst      = 0;
+   int           nKeys       = 0;
+   int           nAdded      = 0;
+   int           nReturnCode = 0;
+   unsigned int  nExpire     = 0;
+   unsigned long aulHash[HASH_PREFETCH_KEYS];
+   size_t        anLength[HASH_PREFETCH_KEYS];
+
+
+
+   Debug("Inside AddEntriesToHashTable()\n");
+
+   if (pstrHash->strSnap.puchMap != NULL && ImportSnapshot(pstrHash) != 0)
+   {
+      return(-1);
+   }
+
+   nExpire = CacheExpiry(pstrHash, pstrHash->strCache.lnTtl);
+
+
+   for (nFirst=0; nFirst<nCount; nFirst+=HASH_PREFETCH_KEYS)
+   {
+      nKeys = nCount - nFirst < HASH_PREFETCH_KEYS ? nCount - nFirst : HASH_PREFETCH_KEYS;
+
+      HashKeys(pstrHash->nHash, pstrHash->aulSeed, &apszData[nFirst], nKeys, aulHash, anLength);
+
+      PrefetchBuckets(pstrHash, aulHash, nKeys);
+
+      for (nIndex=0; nIndex<nKeys; nIndex++)
+      {
+         AppendTrace(pstrHash, TRACE_ADD, apszData[nFirst+nIndex], NULL, 0);
+
+         if (anLength[nIndex] == 0)
+         {
+            nReturnCode = 1;                  /* Empty data is never stored      */
+         }
+         else if (pstrHash->strCache.bOn == TRUE &&
+                  (nReturnCode = MakeCacheRoom(pstrHash, apszData[nFirst+nIndex],
+                                               anLength[nIndex], aulHash[nIndex], 0)) != 0)
+         {
+            ;                                 /* Still cached, nothing to add    */
+         }
+         else if (pstrHash->nEngine == ENGINE_OPEN)
+         {
+            nReturnCode = AddEntryToOpenTable(pstrHash, apszData[nFirst+nIndex],
+                                              anLength[nIndex], aulHash[nIndex], nExpire,
+                                              NULL, 0);
+         }
+         else
+         {
+            nReturnCode = AddEntryToChainTable(pstrHash, apszData[nFirst+nIndex],
+                                               anLength[nIndex], aulHash[nIndex], nExpire,
+                                               NULL, 0);
+         }
+
+         if (nReturnCode == 0)
+         {
+            AppendJournal(pstrHash, HASH_JOURNAL_ADD, apszData[nFirst+nIndex], NULL, 0);
+            pstrHash->strStats.lnInserts++;
+            nAdded++;
+         }
+
+         if (anResults != NULL)
+         {
+            anResults[nFirst+nIndex] = nReturnCode;
+         }
+      }
+   }
+
+   CommitJournal(pstrHash);
+
+
+   return(nAdded);
+}
+
+
+
+
+/********************************************************************************
+ * Function: AddEntrytoHashTable
+ * Params:   pstrHash - hash table
+ *           pszData - data to add
+ * Returns:  0 - data added successfully
+ *           greater than 0 - data already exists, or is empty
+ *           less than 0 - error, normally cannot allocate memory
+ * Call by:  main()
+ *           ProcessBatchLine()
+ *           RunReplay()
+ *           ServerCommand()
+ * Call to:  AddExpiringEntry()
+ * Overview: Hashes the data and adds it with the engine of the table.
+ * Notes:    In cache mode, the data gets the TTL of SetHashCache().
+ ********************************************************************************/
+int AddEntryToHashTable(strHash *pstrHash, const char *pszData)
+{
+   Debug("Inside AddEntryToHashTable()\n");
+
+
+   return(AddExpiringEntry(pstrHash, pszData, pstrHash->strCache.lnTtl));
+}
+
+
+
+
+/********************************************************************************
+ * Function: AddEntryToChainTable
+ * Params:   pstrHash - chained hash table
+ *           pszData - data to add
+ *           nLength - strlen() of pszData
+ *           ulHash - HashKey() of pszData
+ *           nExpire - CacheExpiry() of the data, 0 if it never expires
+ *           pchValue - value stored with the data, may be NULL
+ *           nValueLength - bytes of pchValue, 0 for no value
+ * Returns:  0 - data added successfully
+ *           greater than 0 - data already exists
+ *           less than 0 - error, normally cannot allocate memory
+ * Call by:  AddEntriesToHashTable()
+ *           AddExpiringEntry()
+ *           ImportSnapshot()
+ *           PutEntryInHashTable()
+ * Call to:  CheckHashLoad()
+ *           CountFilterKey()
+ *           FindChainEntry()
+ *           IndexChainNode()
+ *           MigrateHashTable()
+ *           NodeAlloc()
+ *           NodeFree()
+ *           SetEntryKey()
+ *           TestFilterKey()
+ * Overview: Inserts the data into the hash table by finding the appropriate
+ *           bucket. If data already exist, do not add.
+ * Notes:    Chains come from the node pool of the table, and go back to it in
+ *           DeleteEntryFromHashTable().
+ *           An indexed chain gets the new node right after its head, so adding
+ *           to it does not walk it.  Other chains are only counted for an
+ *           index when the walk to their end was long enough.
+ *           While the table is resizing, the data is also looked for in the
+ *           old array, but new data always goes into the current array.
+ ********************************************************************************/
+static int AddEntryToChainTable(strHash *pstrHash, const char *pszData, size_t nLength,
+                                unsigned long ulHash, unsigned int nExpire, const char *pchValue,
+                                size_t nValueLength)
+{
+   boolean        bIndexed     = FALSE;
+   int            nHashIndex   = 0;
+   int            nChain       = 0;
+   int            nReturnCode  = 0;
+   strHashArray  *pstrArray    = &pstrHash->strArray;
+   strHashTable  *pstrCurrent  = NULL;
+   strHashTable  *pstrNewChain = NULL;
+
+
+
+   MigrateHashTable(pstrHash, HASH_MIGRATE_STEP);
+
+   if (TestFilterKey(&pstrHash->strFilter, ulHash) == TRUE &&
+       (FindChainEntry(&pstrHash->strArray, pszData, nLength, ulHash, NULL) != NULL ||
+        FindChainEntry(&pstrHash->strOldArray, pszData, nLength, ulHash, NULL) != NULL))
+   {
+      return(1);                              /* Data already exists             */
+   }
+
+   nHashIndex = (int) (ulHash % pstrArray->nSize);
+
+   Debug("Hash index for [%s] is bucket [%d]\n", pszData, nHashIndex);
+
+
+   /****************************************************************************
+    * If the first chain/element in the bucket is empty, store the new data
+    * there.  Otherwise, take a new linked list chain from the node pool and
+    * link it to the end of the list, or after the head if the list is indexed.
+    *
+    * Returning linked list chains to the pool is done by UnlinkChainEntry().
+    ****************************************************************************/
+   pstrCurrent = &pstrArray->pastrBuckets[nHashIndex];
+   bIndexed    = pstrArray->papstrIndexes != NULL &&
+                 pstrArray->papstrIndexes[nHashIndex] != NULL ? TRUE : FALSE;
+
+   if (pstrCurrent->strKey.nLength == 0)
+   {
+      nReturnCode = SetEntryKey(&pstrHash->strKeys, &pstrCurrent->strKey, pszData, nLength,
+                                ulHash, nExpire, pchValue, nValueLength);
+   }
+   else
+   {
+      pstrNewChain = NodeAlloc(&pstrHash->strNodes);
+
+      if (pstrNewChain == NULL)
+      {
+         nReturnCode = -1;
+      }
+      else if (SetEntryKey(&pstrHash->strKeys, &pstrNewChain->strKey, pszData, nLength,
+                           ulHash, nExpire, pchValue, nValueLength) != 0)
+      {
+         NodeFree(&pstrHash->strNodes, pstrNewChain);
+         nReturnCode = -1;
+      }
+      else
+      {
+         while (pstrCurrent->pstrNext != NULL && bIndexed == FALSE)
+         {
+            pstrCurrent = pstrCurrent->pstrNext;
+            nChain++;
+         }
+
+         pstrNewChain->pstrNext = pstrCurrent->pstrNext;
+         pstrCurrent->pstrNext  = pstrNewChain;
+         pstrCurrent            = pstrNewChain;
+         pstrHash->lnChainNodes++;
+      }
+   }
+
+
+   if (nReturnCode == 0)
+   {
+      if (bIndexed == TRUE || nChain >= HASH_INDEX_CHAIN - 1)
+      {
+         IndexChainNode(pstrArray, nHashIndex, pstrCurrent);
+      }
+
+      CountFilterKey(&pstrHash->strFilter, ulHash, 1);
+
+      pstrHash->lnEntries++;
+
+      CheckHashLoad(pstrHash, TRUE);
+   }
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: AddEntryToConcurrentTable
+ * Params:   pstrConc - concurrent hash table
+ *           pstrThread - epoch record of the calling thread
+ *           pszData - data to add
+ * Returns:  0 - data added successfully
+ *           greater than 0 - data already exists, or is empty
+ *           less than 0 - error, cannot allocate memory
+ * Call by:  BenchConcurrentThread()
+ * Call to:  HashBytes()
+ *           MatchBytes()
+ *           ResizeConcurrentTable()
+ * Overview: Builds the node before taking the lock, then, holding the lock of
+ *           the key's stripe, checks the chain and links the node in front of
+ *           it.  The node is complete before the release store that makes it
+ *           visible, so readers never see half of it.
+ * Notes:    Two keys in the same bucket always have the same stripe, because
+ *           both are picked by the low bits of the hash and there are at least
+ *           as many buckets as stripes.  The table doubles when the stripe has
+ *           more keys than its share of buckets.
+ ********************************************************************************/
+int AddEntryToConcurrentTable(strConcurrentHash *pstrConc, strEpochThread *pstrThread,
+                              const char *pszData)
+{
+   int                 nReturnCode = 0;
+   size_t              nLength     = strlen(pszData);
+   unsigned long       ulHash      = 0;
+   unsigned long       ulSize      = 0;
+   strLockStripe      *pstrStripe  = NULL;
+   strConcurrentArray *pstrArray   = NULL;
+   strConcurrentNode  *pstrNode    = NULL;
+   strConcurrentNode  *pstrCurrent = NULL;
+   strConcurrentNode **ppstrHead   = NULL;
+
+
+
+   if (nLength == 0)
+   {
+      return(1);
+   }
+
+   ulHash   = HashBytes(pstrConc->nHash, pstrConc->aulSeed, pszData, nLength);
+   pstrNode = (strConcurrentNode *) malloc(sizeof(strConcurrentNode) + nLength + 1);
+
+   if (pstrNode == NULL)
+   {
+      fprintf(stderr, "Failed malloc() in AddEntryToConcurrentTable(). errno=%d.\n", errno);
+      return(-1);
+   }
+
+   pstrNode->ulHash  = ulHash;
+   pstrNode->nLength = (unsigned int) nLength;
+   memcpy(pstrNode->achKey, pszData, nLength + 1);
+
+
+   pstrStripe = &pstrConc->astrStripes[ulHash & (HASH_LOCK_STRIPES-1)];
+   pthread_mutex_lock(&pstrStripe->strMutex);
+
+   pstrArray = pstrConc->pstrArray;          /* Only changes under every lock  */
+   ppstrHead = &pstrArray->apstrBuckets[ulHash & (pstrArray->ulSize-1)];
+
+   for (pstrCurrent = *ppstrHead; pstrCurrent != NULL; pstrCurrent = pstrCurrent->pstrNext)
+   {
+      if (pstrCurrent->ulHash == ulHash && pstrCurrent->nLength == nLength &&
+          MatchBytes(pstrCurrent->achKey, pszData, nLength) == TRUE)
+      {
+         nReturnCode = 1;                     /* Data already exists             */
+         break;
+      }
+   }
+
+   if (nReturnCode == 0)
+   {
+      pstrNode->pstrNext = *ppstrHead;
+      __atomic_store_n(ppstrHead, pstrNode, __ATOMIC_RELEASE);
+
+      pstrStripe->lnEntries++;
+   }
+
+   ulSize = pstrArray->ulSize;
+
+   if (pstrStripe->lnEntries <= (long) (ulSize / HASH_LOCK_STRIPES))
+   {
+      ulSize = 0;                             /* No need to grow                 */
+   }
+
+   pthread_mutex_unlock(&pstrStripe->strMutex);
+
+
+   if (nReturnCode != 0)
+   {
+      free(pstrNode);
+   }
+   else if (ulSize != 0)
+   {
+      ResizeConcurrentTable(pstrConc, pstrThread, ulSize);
+   }
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: AddEntryToOpenTable
+ * Params:   pstrHash - open addressing hash table
+ *           pszData - data to add
+ *           nLength - strlen() of pszData
+ *           ulHash - HashKey() of pszData
+ *           nExpire - CacheExpiry() of the data, 0 if it never expires
+ *           pchValue - value stored with the data, may be NULL
+ *           nValueLength - bytes of pchValue, 0 for no value
+ * Returns:  0 - data added successfully
+ *           greater than 0 - data already exists
+ *           less than 0 - error, cannot allocate memory
+ * Call by:  AddEntriesToHashTable()
+ *           AddExpiringEntry()
+ *           BuildHashTable()
+ *           ImportSnapshot()
+ *           PutEntryInHashTable()
+ * Call to:  CheckHashLoad()
+ *           CountFilterKey()
+ *           FindOpenSlot()
+ *           FreeOpenSlot()
+ *           MigrateHashTable()
+ *           SetEntryKey()
+ *           TestFilterKey()
+ * Overview: Probes for the data and, if it is not there, stores it in the first
+ *           empty or deleted slot along the probe sequence.
+ * Notes:    CheckHashLoad() is called before storing, so the current array
+ *           always has room for every entry of the table.
+ ********************************************************************************/
+static int AddEntryToOpenTable(strHash *pstrHash, const char *pszData, size_t nLength,
+                               unsigned long ulHash, unsigned int nExpire, const char *pchValue,
+                               size_t nValueLength)
+{
+   int           nSlot     = 0;
+   strHashArray *pstrArray = &pstrHash->strArray;
+
+
+
+   MigrateHashTable(pstrHash, HASH_MIGRATE_STEP);
+
+   if (TestFilterKey(&pstrHash->strFilter, ulHash) == TRUE &&
+       (FindOpenSlot(&pstrHash->strArray, pszData, nLength, ulHash, NULL) >= 0 ||
+        FindOpenSlot(&pstrHash->strOldArray, pszData, nLength, ulHash, NULL) >= 0))
+   {
+      return(1);                              /* Data already exists             */
+   }
+
+   if (CheckHashLoad(pstrHash, TRUE) != 0)
+   {
+      return(-1);
+   }
+
+
+   nSlot = FreeOpenSlot(pstrArray, ulHash);
+
+   if (SetEntryKey(&pstrHash->strKeys, &pstrArray->pastrSlots[nSlot], pszData, nLength, ulHash,
+                   nExpire, pchValue, nValueLength) != 0)
+   {
+      return(-1);
+   }
+
+   if (pstrArray->pachControl[nSlot] == HASH_CTRL_DELETED)
+   {
+      pstrArray->lnDeleted--;
+   }
+
+   pstrArray->pachControl[nSlot] = (unsigned char) (ulHash & 0x7F);
+   pstrHash->lnEntries++;
+
+   CountFilterKey(&pstrHash->strFilter, ulHash, 1);
+
+   Debug("Stored [%s] in slot [%d]\n", pszData, nSlot);
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: AddEntryToSharedTable
+ * Params:   pstrShared - shared hash table
+ *           pszData - data to add
+ * Returns:  0 - data added successfully
+ *           greater than 0 - data already exists, or is empty
+ *           -1 - cannot take the lock
+ *           -2 - table full
+ *           -3 - data longer than the table allows
+ * Call by:  FlushLoadKeys()
+ *           ProcessBatchLine()
+ * Call to:  HashBytes()
+ *           LockSharedTable()
+ *           MatchBytes()
+ *           SharedNode()
+ * Overview: Holding the writers' lock, checks the chain, takes a free node, or
+ *           the next node never used, and fills it in.  The node is complete
+ *           before the release store that links it in front of the chain, so
+ *           readers in any process never see half of it.
+ * Notes:    The table never grows, so -2 and -3 are not printed; the caller
+ *           counts them like any other failed add.
+ ********************************************************************************/
+int AddEntryToSharedTable(strSharedHash *pstrShared, const char *pszData)
+{
+   int              nReturnCode = 0;
+   size_t           nLength     = strlen(pszData);
+   unsigned int     nNode       = 0;
+   unsigned int    *pnHead      = NULL;
+   unsigned long    ulHash      = 0;
+   strSharedHeader *pstrHeader  = pstrShared->pstrHeader;
+   strSharedNode   *pstrNode    = NULL;
+
+
+
+   if (nLength == 0)
+   {
+      return(1);
+   }
+
+   if (nLength > pstrHeader->nKeyMax)
+   {
+      return(-3);
+   }
+
+   ulHash = HashBytes(pstrHeader->nHash, pstrHeader->aulSeed, pszData, nLength);
+   pnHead = &pstrShared->anBuckets[ulHash & (pstrHeader->ulBuckets-1)];
+
+   if (LockSharedTable(pstrShared) != 0)
+   {
+      return(-1);
+   }
+
+
+   for (nNode = *pnHead; nNode != 0; nNode = pstrNode->nNext)
+   {
+      pstrNode = SharedNode(pstrShared, nNode);
+
+      if (pstrNode->ulHash == ulHash && pstrNode->nLength == nLength &&
+          MatchBytes(pstrNode->achKey, pszData, nLength) == TRUE)
+      {
+         nReturnCode = 1;                     /* Data already exists             */
+         break;
+      }
+   }
+
+   if (nReturnCode == 0 && pstrHeader->nFree != 0)
+   {
+      nNode              = pstrHeader->nFree;
+      pstrNode           = SharedNode(pstrShared, nNode);
+      pstrHeader->nFree  = pstrNode->nNext;
+   }
+   else if (nReturnCode == 0 && pstrHeader->nUsed < pstrHeader->nCapacity)
+   {
+      nNode    = ++pstrHeader->nUsed;
+      pstrNode = SharedNode(pstrShared, nNode);
+   }
+   else if (nReturnCode == 0)
+   {
+      nReturnCode = -2;                       /* Every node is in use            */
+   }
+
+   if (nReturnCode == 0)
+   {
+      pstrNode->ulHash  = ulHash;
+      pstrNode->nLength = (unsigned short) nLength;
+      pstrNode->nNext   = *pnHead;
+      memcpy(pstrNode->achKey, pszData, nLength + 1);
+
+      __atomic_store_n(pnHead, nNode, __ATOMIC_RELEASE);
+
+      pstrHeader->lnEntries++;
+      pstrHeader->lnInserts++;
+   }
+
+   pthread_mutex_unlock(&pstrHeader->strMutex);
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: AddExpiringEntry
+ * Params:   pstrHash - hash table
+ *           pszData - data to add
+ *           lnTtl - seconds the data lives, 0 for as long as it is not evicted
+ * Returns:  0 - data added successfully
+ *           greater than 0 - data already exists, or is empty
+ *           less than 0 - error, normally cannot allocate memory
+ * Call by:  AddEntryToHashTable()
+ *           ServerCommand()
+ *           ProcessBatchLine()
+ * Call to:  AddEntryToChainTable()
+ *           AddEntryToOpenTable()
+ *           AppendJournal()
+ *           AppendTrace()
+ *           CacheExpiry()
+ *           CommitJournal()
+ *           HashKey()
+ *           ImportSnapshot()
+ *           MakeCacheRoom()
+ * Overview: Hashes the data and adds it with the engine of the table.  In cache
+ *           mode, first evicts keys until there is room for it.
+ * Notes:    A mapped snapshot is read only, so its records are copied into the
+ *           table before the first add.
+ *           A TTL turns cache mode on, without limits, if it was off.  Adding
+ *           data that is still cached does not change its TTL.  The journal
+ *           does not keep the TTL.
+ ********************************************************************************/
+int AddExpiringEntry(strHash *pstrHash, const char *pszData, long lnTtl)
+{
+   int            nReturnCode  = 0;
+   size_t         nLength      = strlen(pszData);
+   unsigned long  ulHash       = 0;
+
+
+
+   AppendTrace(pstrHash, TRACE_ADD, pszData, NULL, 0);
+
+   if (nLength == 0)
+   {
+      return(1);                              /* Empty data is never stored      */
+   }
+
+   if (pstrHash->strSnap.puchMap != NULL && ImportSnapshot(pstrHash) != 0)
+   {
+      return(-1);
+   }
+
+   if (lnTtl > 0)
+   {
+      pstrHash->strCache.bOn = TRUE;
+   }
+
+   ulHash = HashKey(pstrHash, pszData, nLength);
+
+   if (pstrHash->strCache.bOn == TRUE &&
+       (nReturnCode = MakeCacheRoom(pstrHash, pszData, nLength, ulHash, 0)) != 0)
+   {
+      return(nReturnCode);
+   }
+
+   if (pstrHash->nEngine == ENGINE_OPEN)
+   {
+      nReturnCode = AddEntryToOpenTable(pstrHash, pszData, nLength, ulHash,
+                                        CacheExpiry(pstrHash, lnTtl), NULL, 0);
+   }
+   else
+   {
+      nReturnCode = AddEntryToChainTable(pstrHash, pszData, nLength, ulHash,
+                                         CacheExpiry(pstrHash, lnTtl), NULL, 0);
+   }
+
+   if (nReturnCode == 0)
+   {
+      pstrHash->strStats.lnInserts++;
+
+      AppendJournal(pstrHash, HASH_JOURNAL_ADD, pszData, NULL, 0);
+      CommitJournal(pstrHash);
+   }
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: AllocateHashArray
+ * Params:   pstrArray - array to allocate
+ *           pstrPages - page and NUMA policy of the table
+ *           nEngine - ENGINE_CHAIN or ENGINE_OPEN
+ *           nSize - number of buckets, or slots for open addressing
+ * Returns:  0 - array allocated
+ *           <0 - cannot allocate memory, pstrArray is left empty
+ * Call by:  BuildHashTable()
+ *           CreateHashTable()
+ *           FreezeHashTable()
+ *           ImportSnapshot()
+ *           ResizeHashTable()
+ *           SetHashPages()
+ * Call to:  PageAlloc()
+ * Overview: Allocates empty bucket heads, or empty slots followed by their
+ *           control bytes, in one block of PageAlloc().
+ * Notes:    Control bytes are aligned to HASH_GROUP for MatchGroup(), since
+ *           nSize is a multiple of HASH_GROUP and blocks start 16 byte
+ *           aligned.
+ ********************************************************************************/
+static int AllocateHashArray(strHashArray *pstrArray, const strHashPages *pstrPages,
+                             engine nEngine, int nSize)
+{
+   memset(pstrArray, 0, sizeof(strHashArray));
+
+
+   if (nEngine == ENGINE_OPEN)
+   {
+      pstrArray->pastrSlots = (strHashKey *) PageAlloc(pstrPages,
+                                                       nSize * (sizeof(strHashKey) + 1),
+                                                       &pstrArray->strMap);
+
+      if (pstrArray->pastrSlots == NULL)
+      {
+         fprintf(stderr, "Failed allocation in AllocateHashArray(). errno=%d.\n", errno);
+         memset(pstrArray, 0, sizeof(strHashArray));
+         return(-1);
+      }
+
+      pstrArray->pachControl = (unsigned char *) &pstrArray->pastrSlots[nSize];
+      memset(pstrArray->pachControl, HASH_CTRL_EMPTY, nSize);
+   }
+   else
+   {
+      pstrArray->pastrBuckets = (strHashTable *) PageAlloc(pstrPages,
+                                                           nSize * sizeof(strHashTable),
+                                                           &pstrArray->strMap);
+
+      if (pstrArray->pastrBuckets == NULL)
+      {
+         fprintf(stderr, "Failed allocation in AllocateHashArray(). errno=%d.\n", errno);
+         memset(pstrArray, 0, sizeof(strHashArray));
+         return(-1);
+      }
+   }
+
+   pstrArray->nSize = nSize;
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: AppendJournal
+ * Params:   pstrHash - hash table
+ *           nOp - HASH_JOURNAL_ADD, HASH_JOURNAL_PUT or HASH_JOURNAL_DELETE
+ *           pszData - data changed
+ *           pchValue - value of a put, may be NULL when nValueLength is 0
+ *           nValueLength - bytes of pchValue
+ * Returns:  0 - record appended, or the table has no journal
+ *           <0 - cannot write the journal
+ * Call by:  AddEntriesToHashTable()
+ *           AddExpiringEntry()
+ *           CompactJournal()
+ *           DeleteEntryFromHashTable()
+ *           PutEntryInHashTable()
+ *           RemoveCacheEntry()
+ * Call to:  HashWy()
+ *           WriteJournal()
+ * Overview: Builds the record in the journal buffer, after writing the buffer
+ *           out if the record does not fit.  A record larger than the whole
+ *           buffer is built in memory of its own and written at once.
+ * Notes:    Nothing is synced here, see CommitJournal().
+ ********************************************************************************/
+static int AppendJournal(strHash *pstrHash, unsigned int nOp, const char *pszData,
+                         const char *pchValue, size_t nValueLength)
+{
+   int               nReturnCode = 0;
+   size_t            nLength     = 0;
+   size_t            nBytes      = 0;
+   char             *pchRecord   = NULL;
+   strJournal       *pstrJournal = &pstrHash->strJournal;
+   strJournalRecord  strRecord;
+
+
+
+   if (pstrJournal->pchBuffer == NULL)
+   {
+      return(0);
+   }
+
+   nLength = strlen(pszData);
+   nBytes  = sizeof(strJournalRecord) + nLength + 1 + nValueLength;
+
+   if (pstrJournal->nBuffered + nBytes > HASH_JOURNAL_BUFFER && pstrJournal->nBuffered > 0)
+   {
+      if (WriteJournal(pstrJournal, pstrJournal->pchBuffer, pstrJournal->nBuffered) != 0)
+      {
+         return(-1);
+      }
+
+      pstrJournal->nBuffered = 0;
+   }
+
+   if (nBytes <= HASH_JOURNAL_BUFFER)
+   {
+      pchRecord = pstrJournal->pchBuffer + pstrJournal->nBuffered;
+   }
+   else if ((pchRecord = (char *) malloc(nBytes)) == NULL)
+   {
+      fprintf(stderr, "Failed malloc() in AppendJournal(). errno=%d.\n", errno);
+      return(-1);
+   }
+
+
+   /****************************************************************************
+    * The record header is copied in with memcpy(), since records are not
+    * aligned.
+    ****************************************************************************/
+   memcpy(pchRecord + sizeof(strJournalRecord), pszData, nLength + 1);
+
+   if (nValueLength > 0)
+   {
+      memcpy(pchRecord + sizeof(strJournalRecord) + nLength + 1, pchValue, nValueLength);
+   }
+
+   strRecord.nOp          = nOp;
+   strRecord.nLength      = (unsigned int) nLength;
+   strRecord.nValueLength = (unsigned int) nValueLength;
+   strRecord.nCheck       = (unsigned int) HashWy(pchRecord + sizeof(strJournalRecord),
+                                                  nLength + 1 + nValueLength,
+                                                  ((unsigned long) nOp << 32) | nValueLength);
+   memcpy(pchRecord, &strRecord, sizeof(strJournalRecord));
+
+   if (nBytes <= HASH_JOURNAL_BUFFER)
+   {
+      pstrJournal->nBuffered += nBytes;
+   }
+   else
+   {
+      nReturnCode = WriteJournal(pstrJournal, pchRecord, nBytes);
+      free(pchRecord);
+   }
+
+   if (nReturnCode == 0)
+   {
+      pstrJournal->lnPending++;
+      pstrJournal->lnRecords++;
+   }
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: AppendTrace
+ * Params:   pstrHash - hash table
+ *           nOp - TRACE_ADD, TRACE_SEARCH, TRACE_DELETE or TRACE_PUT
+ *           pszData - key of the operation
+ *           pchValue - value of a put, may be NULL when nValueLength is 0
+ *           nValueLength - bytes of pchValue
+ * Returns:  None
+ * Call by:  AddEntriesToHashTable()
+ *           AddExpiringEntry()
+ *           DeleteEntryFromHashTable()
+ *           GetValueFromHashTable()
+ *           PutEntryInHashTable()
+ *           SearchEntriesInHashTable()
+ *           SearchHashTable()
+ * Call to:  CloseTrace()
+ *           PutTraceNumber()
+ *           TraceClock()
+ *           WriteTrace()
+ * Overview: Builds the record in the trace buffer, after writing the buffer
+ *           out if the record does not fit.  A record larger than the whole
+ *           buffer is built in memory of its own and written at once.
+ * Notes:    A trace that cannot be written is closed, since the operation
+ *           itself went through and searches cannot report an error.
+ ********************************************************************************/
+static void AppendTrace(strHash *pstrHash, traceop nOp, const char *pszData,
+                        const char *pchValue, size_t nValueLength)
+{
+   int             nReturnCode = 0;
+   size_t          nLength     = 0;
+   size_t          nBytes      = 0;
+   size_t          nUsed       = 0;
+   unsigned long   ulNow       = 0;
+   char           *pchRecord   = NULL;
+   strTrace       *pstrTrace   = &pstrHash->strTrace;
+
+
+
+   if (pstrTrace->pchBuffer == NULL)
+   {
+      return;
+   }
+
+   ulNow   = TraceClock();
+   nLength = strlen(pszData);
+   nBytes  = HASH_TRACE_NUMBERS + nLength + 1 + nValueLength;
+
+   if (pstrTrace->nBuffered + nBytes > HASH_TRACE_BUFFER && pstrTrace->nBuffered > 0)
+   {
+      nReturnCode = WriteTrace(pstrTrace, pstrTrace->pchBuffer, pstrTrace->nBuffered);
+
+      pstrTrace->nBuffered = 0;
+   }
+
+   if (nBytes <= HASH_TRACE_BUFFER)
+   {
+      pchRecord = pstrTrace->pchBuffer + pstrTrace->nBuffered;
+   }
+   else if ((pchRecord = (char *) malloc(nBytes)) == NULL)
+   {
+      fprintf(stderr, "Failed malloc() in AppendTrace(). errno=%d.\n", errno);
+      nReturnCode = -1;
+   }
+
+   if (nReturnCode != 0)
+   {
+      CloseTrace(pstrHash);
+      return;
+   }
+
+
+   pchRecord[nUsed++]  = (char) nOp;
+   nUsed              += PutTraceNumber(pchRecord + nUsed, ulNow - pstrTrace->ulLast);
+   nUsed              += PutTraceNumber(pchRecord + nUsed, nLength);
+   memcpy(pchRecord + nUsed, pszData, nLength + 1);
+   nUsed              += nLength + 1;
+
+   if (nOp == TRACE_PUT)
+   {
+      nUsed += PutTraceNumber(pchRecord + nUsed, nValueLength);
+
+      if (nValueLength > 0)
+      {
+         memcpy(pchRecord + nUsed, pchValue, nValueLength);
+         nUsed += nValueLength;
+      }
+   }
+
+   if (nBytes <= HASH_TRACE_BUFFER)
+   {
+      pstrTrace->nBuffered += nUsed;
+   }
+   else
+   {
+      nReturnCode = WriteTrace(pstrTrace, pchRecord, nUsed);
+      free(pchRecord);
+   }
+
+   if (nReturnCode != 0)
+   {
+      CloseTrace(pstrHash);
+      return;
+   }
+
+   pstrTrace->ulLast = ulNow;
+   pstrTrace->lnRecords++;
+}
+
+
+
+
+/********************************************************************************
+ * Function: ArenaAlloc
+ * Params:   pstrArena - arena to allocate from
+ *           nBytes - number of bytes needed
+ * Returns:  Pointer to nBytes of storage
+ *           NULL - cannot allocate memory
+ * Call by:  CompactKeyArena()
+ *           SetEntryKey()
+ *           SetEntryValue()
+ * Call to:  HugePageSize()
+ *           PageAlloc()
+ * Overview: Bump allocator.  Hands out the next nBytes of the current block, and
+ *           starts a new block when the current one is full.
+ * Notes:    Memory is only released by FreeHashTable().  A key larger than
+ *           the next block size gets a block of its own.  Outside
+ *           PAGES_DEFAULT, blocks grow to a huge page, and a block gets the
+ *           whole of its mapping.
+ ********************************************************************************/
+static char *ArenaAlloc(strArena *pstrArena, size_t nBytes)
+{
+   char          *pszReturn  = NULL;
+   size_t         nBlockSize = HASH_ARENA_FIRST;
+   size_t         nMaxSize   = HASH_ARENA_BLOCK;
+   strArenaBlock *pstrBlock  = pstrArena->pstrBlocks;
+   strPageMap     strMap;
+
+
+
+   if (pstrBlock == NULL || pstrBlock->nSize - pstrBlock->nUsed < nBytes)
+   {
+      if (pstrArena->pstrPages != NULL && pstrArena->pstrPages->nPolicy != PAGES_DEFAULT)
+      {
+         nMaxSize = HugePageSize() - sizeof(strArenaBlock);
+      }
+
+      if (pstrBlock != NULL)
+      {
+         nBlockSize = pstrBlock->nSize * 2;
+      }
+
+      if (nBlockSize > nMaxSize)
+      {
+         nBlockSize = nMaxSize;
+      }
+
+      if (nBytes > nBlockSize)
+      {
+         nBlockSize = nBytes;
+      }
+
+      pstrBlock = (strArenaBlock *) PageAlloc(pstrArena->pstrPages,
+                                              sizeof(strArenaBlock) + nBlockSize, &strMap);
+
+      if (pstrBlock == NULL)
+      {
+         fprintf(stderr, "Failed allocation in ArenaAlloc(). errno=%d.\n", errno);
+         return(NULL);
+      }
+
+      if (strMap.nMapped != 0)
+      {
+         nBlockSize = strMap.nMapped - sizeof(strArenaBlock);
+      }
+
+      pstrBlock->nSize      = nBlockSize;
+      pstrBlock->nUsed      = 0;
+      pstrBlock->strMap     = strMap;
+      pstrBlock->pstrNext   = pstrArena->pstrBlocks;
+      pstrArena->pstrBlocks = pstrBlock;
+      pstrArena->nReserved += sizeof(strArenaBlock) + nBlockSize;
+   }
+
+
+   pszReturn         = &pstrBlock->acData[pstrBlock->nUsed];
+   pstrBlock->nUsed += nBytes;
+   pstrArena->nUsed += nBytes;
+
+
+   return(pszReturn);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ArenaBytesOfEntry
+ * Params:   pstrEntry - key of a chain node or open addressing slot
+ * Returns:  Bytes the entry holds in the key arena
+ * Call by:  UnlinkChainEntry()
+ *           UnlinkOpenEntry()
+ * Call to:  None
+ * Overview: The long key with its terminator, plus the long value.
+ * Notes:    Short keys and values are inside the entry and hold no arena bytes.
+ ********************************************************************************/
+static size_t ArenaBytesOfEntry(const strHashKey *pstrEntry)
+{
+   size_t nBytes = 0;
+
+
+
+   if (pstrEntry->nLength >= HASH_INLINE_KEY)
+   {
+      nBytes += pstrEntry->nLength + 1;
+   }
+
+   if (pstrEntry->nValueLength > HASH_INLINE_VALUE)
+   {
+      nBytes += pstrEntry->nValueLength;
+   }
+
+
+   return(nBytes);
+}
+
+
+
+
+/********************************************************************************
+ * Function: BuildChainIndex
+ * Params:   pstrArray - chained bucket array
+ *           nBucket - bucket whose chain gets an index
+ * Returns:  0 - index built
+ *           <0 - cannot allocate memory, the chain is left without index
+ * Call by:  BuildHashTable()
+ *           IndexChainNode()
+ * Call to:  CompareChainNodes()
+ * Overview: Collects the nodes of the chain that hold a key, with as much room
+ *           again to grow, and sorts them by hash and key.
+ * Notes:    The table of indexes of the array is only allocated with its first
+ *           index, so arrays without long chains do not pay for it.
+ ********************************************************************************/
+static int BuildChainIndex(strHashArray *pstrArray, int nBucket)
+{
+   int            nCount      = 0;
+   strHashTable  *pstrCurrent = NULL;
+   strChainIndex *pstrIndex   = NULL;
+
+
+
+   if (pstrArray->papstrIndexes == NULL)
+   {
+      pstrArray->papstrIndexes = (strChainIndex **) calloc(pstrArray->nSize,
+                                                            sizeof(strChainIndex *));
+
+      if (pstrArray->papstrIndexes == NULL)
+      {
+         fprintf(stderr, "Failed calloc() in BuildChainIndex(). errno=%d.\n", errno);
+         return(-1);
+      }
+
+      pstrArray->nIndexBytes += (size_t) pstrArray->nSize * sizeof(strChainIndex *);
+   }
+
+
+   for (pstrCurrent  = &pstrArray->pastrBuckets[nBucket];
+        pstrCurrent != NULL;
+        pstrCurrent  = pstrCurrent->pstrNext)
+   {
+      nCount += pstrCurrent->strKey.nLength != 0;
+   }
+
+   pstrIndex = (strChainIndex *) malloc(sizeof(strChainIndex) +
+                                        2 * (size_t) nCount * sizeof(strHashTable *));
+
+   if (pstrIndex == NULL)
+   {
+      fprintf(stderr, "Failed malloc() in BuildChainIndex(). errno=%d.\n", errno);
+      return(-1);
+   }
+
+   pstrIndex->nCount = 0;
+   pstrIndex->nSize  = 2 * nCount;
+
+   for (pstrCurrent  = &pstrArray->pastrBuckets[nBucket];
+        pstrCurrent != NULL;
+        pstrCurrent  = pstrCurrent->pstrNext)
+   {
+      if (pstrCurrent->strKey.nLength != 0)
+      {
+         pstrIndex->apstrNodes[pstrIndex->nCount++] = pstrCurrent;
+      }
+   }
+
+   qsort(pstrIndex->apstrNodes, nCount, sizeof(strHashTable *), CompareChainNodes);
+
+
+   pstrArray->papstrIndexes[nBucket] = pstrIndex;
+   pstrArray->nIndexes++;
+   pstrArray->nIndexBytes += sizeof(strChainIndex) + pstrIndex->nSize * sizeof(strHashTable *);
+
+   Debug("Bucket [%d] indexed with %d keys\n", nBucket, nCount);
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: BuildChainPartition
+ * Params:   pstrWork - share of the thread
+ *           nPartition - partition to build
+ * Returns:  None
+ * Call by:  BuildHashThread()
+ * Call to:  DeferBuildItem()
+ *           MatchKey()
+ *           NodeAlloc()
+ *           SetEntryKey()
+ * Overview: Adds the keys of the partition to their buckets, all of which
+ *           belong to the partition, so no other thread touches them.  A key
+ *           goes into the bucket head, or else into a node linked right after
+ *           it, once the chain is known not to hold it.
+ * Notes:    Nodes and long keys come from the pool and arena of the thread.
+ *           A chain reaching HASH_INDEX_CHAIN+1 keys is left for
+ *           BuildHashTable() to index, since the table of indexes is shared.
+ ********************************************************************************/
+static void BuildChainPartition(strBuildThread *pstrWork, int nPartition)
+{
+   boolean        bFound      = FALSE;
+   int            nBucket     = 0;
+   int            nChain      = 0;
+   long           lnIndex     = 0;
+   size_t         nLength     = 0;
+   unsigned long  ulHash      = 0;
+   const char    *pszData     = NULL;
+   strHashArray  *pstrArray   = &pstrWork->pstrHash->strArray;
+   strHashTable  *pstrCurrent = NULL;
+   strHashTable  *pstrNewNode = NULL;
+
+
+
+   for (lnIndex  = pstrWork->alnStarts[nPartition];
+        lnIndex  < pstrWork->alnStarts[nPartition+1];
+        lnIndex++)
+   {
+      ulHash  = pstrWork->astrKeys[lnIndex].ulHash;
+      nLength = pstrWork->astrKeys[lnIndex].nLength;
+      pszData = pstrWork->apszData[pstrWork->astrKeys[lnIndex].lnKey];
+
+      if (nLength == 0)
+      {
+         continue;                            /* Empty data is never stored      */
+      }
+
+      nBucket = (int) (ulHash % pstrArray->nSize);
+      nChain  = 0;
+      bFound  = FALSE;
+
+      for (pstrCurrent  = &pstrArray->pastrBuckets[nBucket];
+           pstrCurrent != NULL && bFound == FALSE;
+           pstrCurrent  = pstrCurrent->pstrNext)
+      {
+         if (pstrCurrent->strKey.nLength != 0)
+         {
+            bFound = pstrCurrent->strKey.ulHash == ulHash &&
+                     MatchKey(&pstrCurrent->strKey, pszData, nLength) == TRUE ? TRUE : FALSE;
+            nChain++;
+         }
+      }
+
+      if (bFound == TRUE)
+      {
+         continue;                            /* Data already exists             */
+      }
+
+
+      pstrCurrent = &pstrArray->pastrBuckets[nBucket];
+
+      if (pstrCurrent->strKey.nLength == 0)
+      {
+         if (SetEntryKey(&pstrWork->strKeys, &pstrCurrent->strKey, pszData, nLength, ulHash,
+                         0, NULL, 0) != 0)
+         {
+            pstrWork->lnErrors++;
+            continue;
+         }
+      }
+      else
+      {
+         if ((pstrNewNode = NodeAlloc(&pstrWork->strNodes)) == NULL ||
+             SetEntryKey(&pstrWork->strKeys, &pstrNewNode->strKey, pszData, nLength, ulHash,
+                         0, NULL, 0) != 0)
+         {
+            pstrWork->lnErrors++;
+            continue;                         /* The node stays in the pool      */
+         }
+
+         pstrNewNode->pstrNext = pstrCurrent->pstrNext;
+         pstrCurrent->pstrNext = pstrNewNode;
+         pstrWork->lnNodes++;
+      }
+
+      pstrWork->lnAdded++;
+
+      if (nChain == HASH_INDEX_CHAIN && DeferBuildItem(pstrWork, nBucket) != 0)
+      {
+         pstrWork->lnErrors++;
+      }
+   }
+}
+
+
+
+
+/********************************************************************************
+ * Function: BuildHashFilter
+ * Params:   pstrHash - hash table
+ *           lnCapacity - number of keys the filter is sized for
+ * Returns:  0 - filter built from the keys of the table
+ *           <0 - cannot allocate memory, the old filter is kept
+ * Call by:  CheckHashLoad()
+ *           SetHashFilter()
+ * Call to:  CountFilterKey()
+ *           NextHashEntry()
+ * Overview: Allocates HASH_FILTER_COUNTERS counters per key of lnCapacity,
+ *           rounded up to a power of 2 of cache line blocks, and counts every
+ *           key of the table into it.  The old filter, if any, is freed.
+ * Notes:    Only the hash kept with each key is read, nothing is hashed again.
+ *           Rebuilding also clears counters stuck at their maximum.
+ ********************************************************************************/
+static int BuildHashFilter(strHash *pstrHash, long lnCapacity)
+{
+   unsigned long     ulBlocks  = 1;
+   const strHashKey *pstrKey   = NULL;
+   strHashFilter     strFilter;
+   strHashCursor     strCursor;
+
+
+
+   while (ulBlocks * HASH_CACHE_LINE * 2 < (unsigned long) lnCapacity * HASH_FILTER_COUNTERS)
+   {
+      ulBlocks *= 2;
+   }
+
+   strFilter.ulBlocks     = ulBlocks;
+   strFilter.lnCapacity   = (long) (ulBlocks * HASH_CACHE_LINE * 2 / HASH_FILTER_COUNTERS);
+   strFilter.puchCounters = (unsigned char *) aligned_alloc(HASH_CACHE_LINE,
+                                                            ulBlocks * HASH_CACHE_LINE);
+
+   if (strFilter.puchCounters == NULL)
+   {
+      fprintf(stderr, "Failed aligned_alloc() in BuildHashFilter(). errno=%d.\n", errno);
+      return(-1);
+   }
+
+   memset(strFilter.puchCounters, 0, ulBlocks * HASH_CACHE_LINE);
+
+
+   memset(&strCursor, 0, sizeof(strHashCursor));
+
+   while ((pstrKey = NextHashEntry(pstrHash, &strCursor)) != NULL)
+   {
+      CountFilterKey(&strFilter, pstrKey->ulHash, 1);
+   }
+
+   Debug("Filter built for %ld keys, %lu bytes\n",
+         strFilter.lnCapacity, ulBlocks * HASH_CACHE_LINE);
+
+   free(pstrHash->strFilter.puchCounters);
+   pstrHash->strFilter = strFilter;
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: BuildHashTable
+ * Params:   pstrHash - hash table
+ *           apszData - data to add
+ *           lnCount - number of entries in apszData
+ *           nThreads - most threads to build with
+ * Returns:  Number of entries added
+ *           <0 - cannot allocate memory for the build, or cannot import the
+ *                mapped snapshot
+ * Call by:  RunBuild()
+ * Call to:  AddEntriesToHashTable()
+ *           AddEntryToOpenTable()
+ *           AllocateHashArray()
+ *           BuildChainIndex()
+ *           FreeHashArray()
+ *           MergeArena()
+ *           MergeNodePool()
+ *           RunBuildPhase()
+ *           SetHashFilter()
+ * Overview: Fills an empty table from many keys at once.  The array is sized
+ *           for all of them up front, then the threads hash the keys, move
+ *           them into partitions of consecutive buckets (or slot groups), and
+ *           build the partitions side by side without any lock, each thread
+ *           with a node pool and key arena of its own.  What the threads leave
+ *           over is finished here: long chains are indexed, and open
+ *           addressing keys whose probe left their partition are added.
+ * Notes:    Only an empty table, with no snapshot, cache mode, journal or
+ *           trace, and no resize going on, is built in parallel.  Any other
+ *           table gets the keys through AddEntriesToHashTable(), so the result
+ *           is the same either way, apart from the order of the chains.
+ *           A filter is dropped during the build and built again after it.
+ ********************************************************************************/
+long BuildHashTable(strHash *pstrHash, const char **apszData, long lnCount, int nThreads)
+{
+   boolean         bFilter     = FALSE;
+   int             nThread     = 0;
+   int             nPartition  = 0;
+   int             nPartitions = 0;
+   int             nNext       = 0;
+   int             nSize       = pstrHash->strArray.nSize;
+   int             nUnits      = 0;
+   int             nReturnCode = 0;
+   long            lnIndex     = 0;
+   long            lnKeys      = 0;
+   long            lnStart     = 0;
+   long            lnAdded     = 0;
+   long           *alnCounts   = NULL;
+   long           *alnStarts   = NULL;
+   unsigned long  *aulHash     = NULL;
+   size_t         *anLength    = NULL;
+   strBuildKey    *astrKeys    = NULL;
+   strBuildThread *astrWork    = NULL;
+   strBuildThread *pstrWork    = NULL;
+   strHashArray    strNewArray;
+
+
+
+   if (pstrHash->lnEntries != 0 || pstrHash->strOldArray.nSize != 0 ||
+       pstrHash->strArray.lnDeleted != 0 || pstrHash->strSnap.puchMap != NULL ||
+       pstrHash->strCache.bOn == TRUE || pstrHash->strJournal.pchBuffer != NULL ||
+       pstrHash->strTrace.pchBuffer != NULL)
+   {
+      for (lnIndex=0; lnIndex<lnCount; lnIndex+=lnKeys)
+      {
+         lnKeys      = lnCount - lnIndex < INT_MAX ? lnCount - lnIndex : INT_MAX;
+         nReturnCode = AddEntriesToHashTable(pstrHash, &apszData[lnIndex], (int) lnKeys, NULL);
+
+         if (nReturnCode < 0)
+         {
+            return(-1);
+         }
+
+         lnAdded += nReturnCode;
+      }
+
+      return(lnAdded);
+   }
+
+
+   /****************************************************************************
+    * Size the array to hold every key within the load CheckHashLoad() allows,
+    * so no resize happens while the threads build.  Duplicates in apszData
+    * only make the array larger than needed.
+    ****************************************************************************/
+   if (pstrHash->nEngine == ENGINE_OPEN)
+   {
+      while ((long) nSize * HASH_MAX_LOAD_NUM / HASH_MAX_LOAD_DEN < lnCount &&
+             nSize <= INT_MAX / 2)
+      {
+         nSize *= 2;
+      }
+   }
+   else
+   {
+      while ((long) nSize * HASH_CHAIN_LOAD < lnCount && nSize <= INT_MAX / 2)
+      {
+         nSize *= 2;
+      }
+   }
+
+   if (nSize != pstrHash->strArray.nSize)
+   {
+      if (AllocateHashArray(&strNewArray, &pstrHash->strPages, pstrHash->nEngine, nSize) != 0)
+      {
+         return(-1);
+      }
+
+      FreeHashArray(&pstrHash->strArray);
+      pstrHash->strArray = strNewArray;
+      pstrHash->lnResizes++;
+   }
+
+
+   if (nThreads > HASH_MAX_THREADS)
+   {
+      nThreads = HASH_MAX_THREADS;
+   }
+
+   if (nThreads > lnCount / HASH_BUILD_MIN_KEYS)
+   {
+      nThreads = (int) (lnCount / HASH_BUILD_MIN_KEYS);
+   }
+
+   if (nThreads < 1)
+   {
+      nThreads = 1;
+   }
+
+   nPartitions = nThreads * HASH_BUILD_SLICES;
+   nUnits      = pstrHash->nEngine == ENGINE_OPEN ? nSize / HASH_GROUP : nSize;
+
+   if (nPartitions > nUnits)
+   {
+      nPartitions = nUnits;
+   }
+
+   if ((aulHash   = (unsigned long *) malloc(lnCount * sizeof(unsigned long) + 1)) == NULL ||
+       (anLength  = (size_t *) malloc(lnCount * sizeof(size_t) + 1)) == NULL ||
+       (astrKeys  = (strBuildKey *) malloc(lnCount * sizeof(strBuildKey) + 1)) == NULL ||
+       (alnCounts = (long *) calloc((size_t) nThreads * nPartitions, sizeof(long))) == NULL ||
+       (alnStarts = (long *) malloc((nPartitions + 1) * sizeof(long))) == NULL ||
+       (astrWork  = (strBuildThread *) aligned_alloc(HASH_CACHE_LINE,
+                                                     nThreads * sizeof(strBuildThread))) == NULL)
+   {
+      fprintf(stderr, "Failed malloc() in BuildHashTable(). errno=%d.\n", errno);
+      free(aulHash);
+      free(anLength);
+      free(astrKeys);
+      free(alnCounts);
+      free(alnStarts);
+      return(-1);
+   }
+
+   bFilter = pstrHash->strFilter.puchCounters != NULL ? TRUE : FALSE;
+   SetHashFilter(pstrHash, FALSE);
+
+   Debug("Building %ld keys with %d threads, %d partitions\n", lnCount, nThreads, nPartitions);
+
+
+   /****************************************************************************
+    * Hash the keys and count them per thread and partition.  The counts then
+    * become the offset where each thread moves the first key it has of each
+    * partition, so the keys of a partition end up together, in their order in
+    * apszData.
+    ****************************************************************************/
+   memset(astrWork, 0, nThreads * sizeof(strBuildThread));
+
+   for (nThread=0; nThread<nThreads; nThread++)
+   {
+      pstrWork = &astrWork[nThread];
+
+      pstrWork->pstrHash    = pstrHash;
+      pstrWork->apszData    = apszData;
+      pstrWork->aulHash     = aulHash;
+      pstrWork->anLength    = anLength;
+      pstrWork->astrKeys    = astrKeys;
+      pstrWork->alnStarts   = alnStarts;
+      pstrWork->alnCounts   = &alnCounts[(size_t) nThread * nPartitions];
+      pstrWork->pnNext      = &nNext;
+      pstrWork->nPartitions = nPartitions;
+      pstrWork->lnFirst     = lnCount * nThread / nThreads;
+      pstrWork->lnLast      = lnCount * (nThread + 1) / nThreads;
+
+      pstrWork->strNodes.pstrPages = &pstrHash->strPages;
+      pstrWork->strKeys.pstrPages  = &pstrHash->strPages;
+   }
+
+   RunBuildPhase(astrWork, nThreads, 0);
+
+   for (nPartition=0; nPartition<nPartitions; nPartition++)
+   {
+      alnStarts[nPartition] = lnStart;
+
+      for (nThread=0; nThread<nThreads; nThread++)
+      {
+         lnKeys                                  = astrWork[nThread].alnCounts[nPartition];
+         astrWork[nThread].alnCounts[nPartition] = lnStart;
+         lnStart                                += lnKeys;
+      }
+   }
+
+   alnStarts[nPartitions] = lnStart;
+
+   RunBuildPhase(astrWork, nThreads, 1);
+   RunBuildPhase(astrWork, nThreads, 2);
+
+
+   /****************************************************************************
+    * Hand the storage of the threads over to the table, then finish what the
+    * threads left for later.
+    ****************************************************************************/
+   for (nThread=0; nThread<nThreads; nThread++)
+   {
+      pstrWork = &astrWork[nThread];
+
+      MergeArena(&pstrHash->strKeys, &pstrWork->strKeys);
+      MergeNodePool(&pstrHash->strNodes, &pstrWork->strNodes);
+
+      pstrHash->lnEntries          += pstrWork->lnAdded;
+      pstrHash->lnChainNodes       += pstrWork->lnNodes;
+      pstrHash->strStats.lnInserts += pstrWork->lnAdded;
+      lnAdded                      += pstrWork->lnAdded;
+   }
+
+   for (nThread=0; nThread<nThreads; nThread++)
+   {
+      pstrWork = &astrWork[nThread];
+
+      for (lnIndex=0; lnIndex<pstrWork->lnLater; lnIndex++)
+      {
+         if (pstrHash->nEngine != ENGINE_OPEN)
+         {
+            BuildChainIndex(&pstrHash->strArray, (int) pstrWork->alnLater[lnIndex]);
+         }
+         else if (AddEntryToOpenTable(pstrHash,
+                                      apszData[astrKeys[pstrWork->alnLater[lnIndex]].lnKey],
+                                      astrKeys[pstrWork->alnLater[lnIndex]].nLength,
+                                      astrKeys[pstrWork->alnLater[lnIndex]].ulHash,
+                                      0, NULL, 0) == 0)
+         {
+            pstrHash->strStats.lnInserts++;
+            lnAdded++;
+         }
+      }
+
+      free(pstrWork->alnLater);
+   }
+
+   if (bFilter == TRUE)
+   {
+      SetHashFilter(pstrHash, TRUE);
+   }
+
+   free(aulHash);
+   free(anLength);
+   free(astrKeys);
+   free(alnCounts);
+   free(alnStarts);
+   free(astrWork);
+
+
+   return(lnAdded);
+}
+
+
+
+
+/********************************************************************************
+ * Function: BuildHashThread
+ * Params:   pArgument - strBuildThread of the thread
+ * Returns:  NULL
+ * Call by:  RunBuildPhase(), also through pthread_create()
+ * Call to:  BuildChainPartition()
+ *           BuildOpenPartition()
+ *           HashKeys()
+ *           PartitionOfHash()
+ * Overview: Runs the share of the thread in one phase of BuildHashTable():
+ *           hashes its keys and counts them per partition, moves them to their
+ *           partition, or builds partitions until none is left.
+ * Notes:    Partitions are taken one at a time from a shared counter, so a
+ *           thread done early takes more of them.
+ ********************************************************************************/
+static void *BuildHashThread(void *pArgument)
+{
+   strBuildThread *pstrWork   = (strBuildThread *) pArgument;
+   const strHash  *pstrHash   = pstrWork->pstrHash;
+   int             nPartition = 0;
+   int             nKey       = 0;
+   int             nKeys      = 0;
+   long            lnIndex    = 0;
+
+
+
+   switch (pstrWork->nPhase)
+   {
+      case 0:
+         for (lnIndex=pstrWork->lnFirst; lnIndex<pstrWork->lnLast; lnIndex+=nKeys)
+         {
+            nKeys = pstrWork->lnLast - lnIndex < HASH_PREFETCH_KEYS ?
+                    (int) (pstrWork->lnLast - lnIndex) : HASH_PREFETCH_KEYS;
+
+            HashKeys(pstrHash->nHash, pstrHash->aulSeed, &pstrWork->apszData[lnIndex], nKeys,
+                     &pstrWork->aulHash[lnIndex], &pstrWork->anLength[lnIndex]);
+
+            for (nKey=0; nKey<nKeys; nKey++)
+            {
+               nPartition = PartitionOfHash(pstrHash, pstrWork->aulHash[lnIndex+nKey],
+                                            pstrWork->nPartitions);
+               pstrWork->alnCounts[nPartition]++;
+            }
+         }
+         break;
+
+      case 1:
+         for (lnIndex=pstrWork->lnFirst; lnIndex<pstrWork->lnLast; lnIndex++)
+         {
+            nPartition = PartitionOfHash(pstrHash, pstrWork->aulHash[lnIndex],
+                                         pstrWork->nPartitions);
+            pstrWork->astrKeys[pstrWork->alnCounts[nPartition]].ulHash  =
+               pstrWork->aulHash[lnIndex];
+            pstrWork->astrKeys[pstrWork->alnCounts[nPartition]].nLength =
+               pstrWork->anLength[lnIndex];
+            pstrWork->astrKeys[pstrWork->alnCounts[nPartition]].lnKey   = lnIndex;
+            pstrWork->alnCounts[nPartition]++;
+         }
+         break;
+
+      default:
+         while ((nPartition = __atomic_fetch_add(pstrWork->pnNext, 1, __ATOMIC_RELAXED)) <
+                pstrWork->nPartitions)
+         {
+            if (pstrHash->nEngine == ENGINE_OPEN)
+            {
+               BuildOpenPartition(pstrWork, nPartition);
+            }
+            else
+            {
+               BuildChainPartition(pstrWork, nPartition);
+            }
+         }
+         break;
+   }
+
+
+   return(NULL);
+}
+
+
+
+
+/********************************************************************************
+ * Function: BuildOpenPartition
+ * Params:   pstrWork - share of the thread
+ *           nPartition - partition to build
+ * Returns:  None
+ * Call by:  BuildHashThread()
+ * Call to:  DeferBuildItem()
+ *           MatchGroup()
+ *           MatchKey()
+ *           SetEntryKey()
+ * Overview: Probes for each key of the partition like FindOpenSlot(), and
+ *           stores it in the first empty slot when it is not there.  Only the
+ *           groups of the partition are read or written, so no other thread
+ *           touches them.
+ * Notes:    A key whose probe sequence leaves the partition before finding an
+ *           empty slot is left for BuildHashTable() to add once the threads are
+ *           done.  Groups only ever fill up during the build, so a key stored
+ *           here is found again by the probe of FindOpenSlot().
+ ********************************************************************************/
+static void BuildOpenPartition(strBuildThread *pstrWork, int nPartition)
+{
+   boolean        bFound    = FALSE;
+   int            nGroups   = 0;
+   int            nGroup    = 0;
+   int            nProbe    = 0;
+   int            nSlot     = 0;
+   unsigned int   nMatch    = 0;
+   unsigned int   nFree     = 0;
+   unsigned char  chHash    = 0;
+   long           lnIndex   = 0;
+   size_t         nLength   = 0;
+   unsigned long  ulHash    = 0;
+   const char    *pszData   = NULL;
+   strHashArray  *pstrArray = &pstrWork->pstrHash->strArray;
+
+
+
+   nGroups = pstrArray->nSize / HASH_GROUP;
+
+   for (lnIndex  = pstrWork->alnStarts[nPartition];
+        lnIndex  < pstrWork->alnStarts[nPartition+1];
+        lnIndex++)
+   {
+      ulHash  = pstrWork->astrKeys[lnIndex].ulHash;
+      nLength = pstrWork->astrKeys[lnIndex].nLength;
+      pszData = pstrWork->apszData[pstrWork->astrKeys[lnIndex].lnKey];
+
+      if (nLength == 0)
+      {
+         continue;                            /* Empty data is never stored      */
+      }
+
+      chHash = (unsigned char) (ulHash & 0x7F);
+      nGroup = (int) ((ulHash >> 7) & (unsigned long) (nGroups-1));
+      nProbe = 0;
+      nFree  = 0;
+      bFound = FALSE;
+
+      while (nProbe < nGroups && (int) ((long) nGroup * pstrWork->nPartitions / nGroups) ==
+                                 nPartition)
+      {
+         nMatch = MatchGroup(&pstrArray->pachControl[nGroup*HASH_GROUP], chHash);
+
+         for (; nMatch != 0 && bFound == FALSE; nMatch &= nMatch - 1)
+         {
+            nSlot  = nGroup*HASH_GROUP + __builtin_ctz(nMatch);
+            bFound = pstrArray->pastrSlots[nSlot].ulHash == ulHash &&
+                     MatchKey(&pstrArray->pastrSlots[nSlot], pszData, nLength) == TRUE ?
+                     TRUE : FALSE;
+         }
+
+         nFree = MatchGroup(&pstrArray->pachControl[nGroup*HASH_GROUP], HASH_CTRL_EMPTY);
+
+         if (bFound == TRUE || nFree != 0)
+         {
+            break;
+         }
+
+         nGroup = (nGroup + nProbe + 1) & (nGroups-1);
+         nProbe++;
+      }
+
+
+      if (bFound == TRUE)
+      {
+         continue;                            /* Data already exists             */
+      }
+
+      if (nFree == 0)
+      {
+         if (DeferBuildItem(pstrWork, lnIndex) != 0)
+         {
+            pstrWork->lnErrors++;
+         }
+
+         continue;
+      }
+
+      nSlot = nGroup*HASH_GROUP + __builtin_ctz(nFree);
+
+      if (SetEntryKey(&pstrWork->strKeys, &pstrArray->pastrSlots[nSlot], pszData, nLength,
+                      ulHash, 0, NULL, 0) != 0)
+      {
+         pstrWork->lnErrors++;
+         continue;
+      }
+
+      pstrArray->pachControl[nSlot] = chHash;
+      pstrWork->lnAdded++;
+   }
+}
+
+
+
+
+/********************************************************************************
+ * Function: BuildPerfectHash
+ * Params:   aulHash - HashKey() of each key
+ *           ulKeys - number of keys
+ *           ulSeed - seed of the perfect hash
+ *           ulPilots - number of buckets of the perfect hash
+ *           ulSlots - number of slots, at least ulKeys
+ *           anPilots - receives the pilot of each bucket
+ * Returns:  0 - every key has a slot of its own
+ *           >0 - a bucket found no pilot, try another seed
+ *           <0 - cannot allocate memory, or two keys have the same hash
+ * Call by:  FreezeHashTable()
+ * Call to:  Debug()
+ *           PerfectBucket()
+ *           PerfectSlot()
+ * Overview: Sorts the keys by bucket, then the buckets by size, largest first,
+ *           and gives each bucket the lowest pilot that sends all its keys to
+ *           slots still free and different from each other.  Taken slots are
+ *           kept as 1 bit each, so the many tries of the last buckets, when
+ *           few slots are left, stay in the cache.
+ * Notes:    Only the hashes are read.  Keys with the same hash share a slot
+ *           whatever the pilot, so the hash function must not collide on whole
+ *           hashes, as sum does for anagrams.
+ ********************************************************************************/
+static int BuildPerfectHash(const unsigned long *aulHash, unsigned long ulKeys,
+                            unsigned long ulSeed, unsigned long ulPilots, unsigned long ulSlots,
+                            unsigned int *anPilots)
+{
+   int            nReturnCode = 0;
+   unsigned long  ulKey       = 0;
+   unsigned long  ulOther     = 0;
+   unsigned long  ulBucket    = 0;
+   unsigned long  ulIndex     = 0;
+   unsigned long  ulFirst     = 0;
+   unsigned long  ulSize      = 0;
+   unsigned long  ulMaxSize   = 0;
+   unsigned long  ulSlot      = 0;
+   unsigned long  ulTry       = 0;
+   unsigned long  ulTries     = ulSlots * HASH_FREEZE_PILOTS;
+   unsigned long *aulEnd      = NULL;
+   unsigned long *aulSorted   = NULL;
+   unsigned long *aulOrder    = NULL;
+   unsigned long *aulBySize   = NULL;
+   unsigned long *aulTaken    = NULL;
+   unsigned long *aulPicked   = NULL;
+
+
+
+   if (ulTries > UINT_MAX)
+   {
+      ulTries = UINT_MAX;
+   }
+
+   memset(anPilots, 0, ulPilots * sizeof(unsigned int));
+
+   if ((aulEnd    = (unsigned long *) calloc(ulPilots + 1, sizeof(unsigned long))) == NULL ||
+       (aulSorted = (unsigned long *) malloc((ulKeys + 1) * sizeof(unsigned long))) == NULL ||
+       (aulOrder  = (unsigned long *) malloc(ulPilots * sizeof(unsigned long))) == NULL ||
+       (aulTaken  = (unsigned long *) calloc((ulSlots + 63) / 64, sizeof(unsigned long))) == NULL)
+   {
+      fprintf(stderr, "Failed malloc() in BuildPerfectHash(). errno=%d.\n", errno);
+      nReturnCode = -1;
+   }
+
+
+   /****************************************************************************
+    * Counting sort of the keys by bucket.  Once placed, aulEnd[b] is the end of
+    * bucket b in aulSorted, and the start of bucket b+1.
+    ****************************************************************************/
+   for (ulKey=0; ulKey<ulKeys && nReturnCode == 0; ulKey++)
+   {
+      aulEnd[PerfectBucket(aulHash[ulKey], ulSeed, ulPilots) + 1]++;
+   }
+
+   for (ulBucket=0; ulBucket<ulPilots && nReturnCode == 0; ulBucket++)
+   {
+      ulSize             = aulEnd[ulBucket+1];
+      aulEnd[ulBucket+1] = aulEnd[ulBucket] + ulSize;
+      ulMaxSize          = ulSize > ulMaxSize ? ulSize : ulMaxSize;
+   }
+
+   for (ulKey=0; ulKey<ulKeys && nReturnCode == 0; ulKey++)
+   {
+      aulSorted[aulEnd[PerfectBucket(aulHash[ulKey], ulSeed, ulPilots)]++] = aulHash[ulKey];
+   }
+
+   if (nReturnCode == 0 &&
+       ((aulBySize = (unsigned long *) calloc(ulMaxSize + 2, sizeof(unsigned long))) == NULL ||
+        (aulPicked = (unsigned long *) malloc((ulMaxSize + 1) * sizeof(unsigned long))) == NULL))
+   {
+      fprintf(stderr, "Failed malloc() in BuildPerfectHash(). errno=%d.\n", errno);
+      nReturnCode = -1;
+   }
+
+
+   /****************************************************************************
+    * Counting sort of the buckets by size, largest first.  aulBySize[s] becomes
+    * the position of the first bucket of size s in aulOrder.
+    ****************************************************************************/
+   for (ulBucket=0; ulBucket<ulPilots && nReturnCode == 0; ulBucket++)
+   {
+      ulFirst = ulBucket == 0 ? 0 : aulEnd[ulBucket-1];
+      aulBySize[aulEnd[ulBucket] - ulFirst]++;
+   }
+
+   for (ulSize=ulMaxSize+1, ulIndex=0; ulSize-- > 0 && nReturnCode == 0; )
+   {
+      ulKey             = aulBySize[ulSize];
+      aulBySize[ulSize] = ulIndex;
+      ulIndex          += ulKey;
+   }
+
+   for (ulBucket=0; ulBucket<ulPilots && nReturnCode == 0; ulBucket++)
+   {
+      ulFirst = ulBucket == 0 ? 0 : aulEnd[ulBucket-1];
+      aulOrder[aulBySize[aulEnd[ulBucket] - ulFirst]++] = ulBucket;
+   }
+
+
+   /****************************************************************************
+    * Place the buckets.  Empty buckets come last and keep pilot 0.
+    ****************************************************************************/
+   for (ulIndex=0; ulIndex<ulPilots && nReturnCode == 0; ulIndex++)
+   {
+      ulBucket = aulOrder[ulIndex];
+      ulFirst  = ulBucket == 0 ? 0 : aulEnd[ulBucket-1];
+      ulSize   = aulEnd[ulBucket] - ulFirst;
+
+      if (ulSize == 0)
+      {
+         break;
+      }
+
+      for (ulKey=1; ulKey<ulSize && nReturnCode == 0; ulKey++)
+      {
+         for (ulOther=0; ulOther<ulKey; ulOther++)
+         {
+            if (aulSorted[ulFirst+ulKey] == aulSorted[ulFirst+ulOther])
+            {
+               fprintf(stderr, "Two keys have the hash %lx, a table using them cannot be "
+                       "frozen.\n", aulSorted[ulFirst+ulKey]);
+               nReturnCode = -1;
+               break;
+            }
+         }
+      }
+
+      for (ulTry=0; ulTry<ulTries && nReturnCode == 0; ulTry++)
+      {
+         for (ulKey=0; ulKey<ulSize; ulKey++)
+         {
+            ulSlot = PerfectSlot(aulSorted[ulFirst+ulKey], ulSeed, (unsigned int) ulTry, ulSlots);
+
+            if ((aulTaken[ulSlot / 64] & (1UL << (ulSlot % 64))) != 0)
+            {
+               break;
+            }
+
+            for (ulOther=0; ulOther<ulKey && aulPicked[ulOther] != ulSlot; ulOther++)
+            {
+               ;
+            }
+
+            if (ulOther < ulKey)
+            {
+               break;
+            }
+
+            aulPicked[ulKey] = ulSlot;
+         }
+
+         if (ulKey == ulSize)
+         {
+            break;
+         }
+      }
+
+      if (nReturnCode == 0 && ulTry == ulTries)
+      {
+         Debug("No pilot for bucket %lu of %lu keys, seed %lx\n", ulBucket, ulSize, ulSeed);
+         nReturnCode = 1;
+      }
+
+      for (ulKey=0; ulKey<ulSize && nReturnCode == 0; ulKey++)
+      {
+         aulTaken[aulPicked[ulKey] / 64] |= 1UL << (aulPicked[ulKey] % 64);
+      }
+
+      anPilots[ulBucket] = (unsigned int) ulTry;
+   }
+
+
+   free(aulEnd);
+   free(aulSorted);
+   free(aulOrder);
+   free(aulBySize);
+   free(aulTaken);
+   free(aulPicked);
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: CacheBytes
+ * Params:   pstrHash - hash table
+ * Returns:  Bytes held by the keys of the table
+ * Call by:  CacheFull()
+ *           MemoryHashTable()
+ * Call to:  None
+ * Overview: Adds up the bucket heads (or slots and control bytes), the chain
+ *           indexes, the filter, the chain nodes in use and the long keys still
+ *           stored, the memory the cache limit of SetHashCache() applies to.
+ * Notes:    Unlike MemoryInUse(), free nodes and dead arena bytes are left out,
+ *           since evicting keys gives them back for reuse.
+ ********************************************************************************/
+static size_t CacheBytes(const strHash *pstrHash)
+{
+   size_t nPerSlot = sizeof(strHashTable);
+
+
+
+   if (pstrHash->nEngine == ENGINE_OPEN)
+   {
+      nPerSlot = sizeof(strHashKey) + 1;
+   }
+
+
+   return(((size_t) pstrHash->strArray.nSize + pstrHash->strOldArray.nSize) * nPerSlot +
+          pstrHash->strArray.nIndexBytes + pstrHash->strOldArray.nIndexBytes +
+          pstrHash->strFilter.ulBlocks * HASH_CACHE_LINE +
+          (size_t) pstrHash->lnChainNodes * sizeof(strHashTable) +
+          pstrHash->strKeys.nUsed - pstrHash->strKeys.nDead);
+}
+
+
+
+
+/********************************************************************************
+ * Function: CacheClock
+ * Params:   pstrHash - hash table
+ * Returns:  Seconds since the table was created, plus 1
+ * Call by:  CacheExpiry()
+ *           EvictCacheEntry()
+ *           TouchCacheEntry()
+ * Call to:  None
+ * Overview: Reads the monotonic clock, so expiries do not move when the time of
+ *           day is changed.
+ * Notes:    Never 0, which nExpire keeps for keys without a TTL.
+ ********************************************************************************/
+static unsigned int CacheClock(const strHash *pstrHash)
+{
+   struct timespec strNow;
+
+
+
+   clock_gettime(CLOCK_MONOTONIC, &strNow);
+
+
+   return((unsigned int) (strNow.tv_sec - pstrHash->strCache.tStart) + 1);
+}
+
+
+
+
+/********************************************************************************
+ * Function: CacheExpiry
+ * Params:   pstrHash - hash table
+ *           lnTtl - seconds a key added now lives, 0 or less for ever
+ * Returns:  nExpire of a key added now
+ *           0 - the key never expires
+ * Call by:  AddEntriesToHashTable()
+ *           PutEntryInHashTable()
+ *           AddExpiringEntry()
+ *           ImportSnapshot()
+ * Call to:  CacheClock()
+ * Overview: The key expires once CacheClock() is past the returned second, so
+ *           it lives at least lnTtl seconds.
+ * Notes:    The clock is only read for a TTL, so tables without one never call
+ *           clock_gettime().  Expiries are capped at 31 bits, about 68 years.
+ ********************************************************************************/
+static unsigned int CacheExpiry(const strHash *pstrHash, long lnTtl)
+{
+   unsigned long ulExpire = 0;
+
+
+
+   if (lnTtl <= 0)
+   {
+      return(0);
+   }
+
+   ulExpire = CacheClock(pstrHash) + (unsigned long) lnTtl;
+
+
+   return(ulExpire > 0x7FFFFFFF ? 0x7FFFFFFF : (unsigned int) ulExpire);
+}
+
+
+
+
+/********************************************************************************
+ * Function: CacheFull
+ * Params:   pstrHash - hash table in cache mode
+ *           lnAdding - keys about to be added
+ *           nAdding - bytes those keys will take
+ * Returns:  TRUE - a key must be evicted first
+ *           FALSE - the keys fit within the limits of SetHashCache()
+ * Call by:  MakeCacheRoom()
+ *           PutEntryInHashTable()
+ *           SetHashCache()
+ * Call to:  CacheBytes()
+ * Overview: Checks the entry limit, then the byte limit.
+ * Notes:    A limit of 0 is no limit.
+ ********************************************************************************/
+static boolean CacheFull(const strHash *pstrHash, long lnAdding, size_t nAdding)
+{
+   const strHashCache *pstrCache = &pstrHash->strCache;
+
+
+
+   if (pstrCache->lnMaxEntries > 0 &&
+       pstrHash->lnEntries + lnAdding > pstrCache->lnMaxEntries)
+   {
+      return(TRUE);
+   }
+
+   if (pstrCache->nMaxBytes > 0 && CacheBytes(pstrHash) + nAdding > pstrCache->nMaxBytes)
+   {
+      return(TRUE);
+   }
+
+
+   return(FALSE);
+}
+
+
+
+
+/********************************************************************************
+ * Function: CheckHashLoad
+ * Params:   pstrHash - hash table
+ *           bAdding - TRUE before (open) or after (chain) an add, FALSE after a
+ *                     delete
+ * Returns:  0 - the current array has room for the table
+ *           <0 - the open addressing table is full and cannot grow
+ * Call by:  AddEntryToChainTable()
+ *           AddEntryToOpenTable()
+ *           DeleteEntryFromHashTable()
+ * Call to:  BuildHashFilter()
+ *           ResizeHashTable()
+ * Overview: Starts growing the table when its load factor is too high, and
+ *           shrinking it when the load factor is too low.  Rebuilds the
+ *           filter twice as large when the table holds more keys than it was
+ *           sized for.
+ * Notes:    An open addressing table with many deleted slots but a reasonable
+ *           load is rehashed at the same size to clear them.
+ *           A failed resize of a chained table is not an error, the chains just
+ *           get longer until the next attempt.
+ ********************************************************************************/
+static int CheckHashLoad(strHash *pstrHash, boolean bAdding)
+{
+   int   nSize   = pstrHash->strArray.nSize;
+   long  lnMax   = 0;
+
+
+
+   if (bAdding == TRUE && pstrHash->strFilter.puchCounters != NULL &&
+       pstrHash->lnEntries > pstrHash->strFilter.lnCapacity)
+   {
+      BuildHashFilter(pstrHash, pstrHash->strFilter.lnCapacity * 2);
+   }
+
+   if (pstrHash->nEngine == ENGINE_CHAIN)
+   {
+      if (bAdding == TRUE && pstrHash->lnEntries > (long) nSize * HASH_CHAIN_LOAD &&
+          nSize <= INT_MAX / 2)
+      {
+         ResizeHashTable(pstrHash, nSize * 2);
+      }
+      else if (bAdding == FALSE && pstrHash->lnEntries * 4 < nSize &&
+               nSize / 2 >= pstrHash->nMinSize)
+      {
+         ResizeHashTable(pstrHash, nSize / 2);
+      }
+
+      return(0);
+   }
+
+
+   /****************************************************************************
+    * Deleted slots still lengthen probe sequences, so they count toward the
+    * load of an open addressing table.
+    ****************************************************************************/
+   lnMax = (long) nSize * HASH_MAX_LOAD_NUM / HASH_MAX_LOAD_DEN;
+
+   if (bAdding == TRUE && pstrHash->lnEntries + pstrHash->strArray.lnDeleted + 1 > lnMax)
+   {
+      if (pstrHash->lnEntries + 1 <= lnMax / 2)
+      {
+         return(ResizeHashTable(pstrHash, nSize));
+      }
+
+      if (nSize > INT_MAX / 2 || ResizeHashTable(pstrHash, nSize * 2) != 0)
+      {
+         fprintf(stderr, "Open addressing table is full (%ld entries).\n",
+                 pstrHash->lnEntries);
+         return(-1);
+      }
+   }
+   else if (bAdding == FALSE && pstrHash->lnEntries * 8 < nSize &&
+            nSize / 2 >= pstrHash->nMinSize)
+   {
+      ResizeHashTable(pstrHash, nSize / 2);
+   }
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: CloseJournal
+ * Params:   pstrHash - hash table
+ * Returns:  None
+ * Call by:  FreeHashTable()
+ * Call to:  SyncHashJournal()
+ *           WriteJournal()
+ * Overview: Writes the records still in the buffer, syncs them unless the
+ *           journal is never synced, and closes the journal.
+ * Notes:    The table may have no journal.
+ ********************************************************************************/
+static void CloseJournal(strHash *pstrHash)
+{
+   strJournal *pstrJournal = &pstrHash->strJournal;
+
+
+
+   if (pstrJournal->pchBuffer == NULL)
+   {
+      return;
+   }
+
+   if (pstrJournal->nSync != JOURNAL_NEVER)
+   {
+      SyncHashJournal(pstrHash);
+   }
+   else if (pstrJournal->nBuffered > 0)
+   {
+      WriteJournal(pstrJournal, pstrJournal->pchBuffer, pstrJournal->nBuffered);
+   }
+
+   close(pstrJournal->nFile);
+   free(pstrJournal->pchBuffer);
+
+   memset(pstrJournal, 0, sizeof(strJournal));
+}
+
+
+
+
+/********************************************************************************
+ * Function: CloseSharedTable
+ * Params:   pstrShared - shared hash table, may be NULL
+ * Returns:  None
+ * Call by:  RunShared()
+ * Call to:  None
+ * Overview: Unmaps the segment and frees the handle.
+ * Notes:    The table stays in the segment for the other processes, and for
+ *           the next OpenSharedTable(), until RemoveSharedTable().
+ ********************************************************************************/
+void CloseSharedTable(strSharedHash *pstrShared)
+{
+   if (pstrShared == NULL)
+   {
+      return;
+   }
+
+   munmap(pstrShared->pstrHeader, pstrShared->nSize);
+   free(pstrShared);
+}
+
+
+
+
+/********************************************************************************
+ * Function: CloseTrace
+ * Params:   pstrHash - hash table
+ * Returns:  None
+ * Call by:  AppendTrace()
+ *           FreeHashTable()
+ * Call to:  WriteTrace()
+ * Overview: Writes the records still in the buffer and closes the trace.
+ * Notes:    The table may have no trace.  The trace is not synced; a trace is
+ *           for benchmarks, not for recovery.
+ ********************************************************************************/
+static void CloseTrace(strHash *pstrHash)
+{
+   strTrace *pstrTrace = &pstrHash->strTrace;
+
+
+
+   if (pstrTrace->pchBuffer == NULL)
+   {
+      return;
+   }
+
+   if (pstrTrace->nBuffered > 0)
+   {
+      WriteTrace(pstrTrace, pstrTrace->pchBuffer, pstrTrace->nBuffered);
+   }
+
+   close(pstrTrace->nFile);
+   free(pstrTrace->pchBuffer);
+
+   memset(pstrTrace, 0, sizeof(strTrace));
+}
+
+
+
+
+/********************************************************************************
+ * Function: CommitJournal
+ * Params:   pstrHash - hash table
+ * Returns:  0 - the changes are in the journal, synced as its policy asks
+ *           <0 - cannot write the journal
+ * Call by:  AddEntriesToHashTable()
+ *           AddExpiringEntry()
+ *           DeleteEntryFromHashTable()
+ *           PutEntryInHashTable()
+ * Call to:  CompactJournal()
+ *           JournalClock()
+ *           SyncHashJournal()
+ *           WriteJournal()
+ * Overview: Ends a change of the table.  The records of the call are written
+ *           to the file whatever the policy, so a crash of the process loses
+ *           none of them.  JOURNAL_ALWAYS then syncs the journal now,
+ *           JOURNAL_GROUP once enough records are pending or enough time has
+ *           passed since the last sync, so one sync covers a group of changes,
+ *           and JOURNAL_NEVER leaves the sync to the system.  Rewrites the
+ *           journal once it holds too many records of keys since changed or
+ *           deleted.
+ * Notes:    Called once per call of the table, so a batch of keys added in one
+ *           call is written and synced once, even with JOURNAL_ALWAYS.
+ ********************************************************************************/
+static int CommitJournal(strHash *pstrHash)
+{
+   strJournal *pstrJournal = &pstrHash->strJournal;
+
+
+
+   if (pstrJournal->pchBuffer == NULL || pstrJournal->lnPending == 0)
+   {
+      return(0);
+   }
+
+   if (pstrJournal->nBuffered > 0)
+   {
+      if (WriteJournal(pstrJournal, pstrJournal->pchBuffer, pstrJournal->nBuffered) != 0)
+      {
+         return(-1);
+      }
+
+      pstrJournal->nBuffered = 0;
+   }
+
+   if ((pstrJournal->nSync == JOURNAL_ALWAYS ||
+        (pstrJournal->nSync == JOURNAL_GROUP &&
+         ((pstrJournal->lnGroupOps > 0 && pstrJournal->lnPending >= pstrJournal->lnGroupOps) ||
+          (pstrJournal->lnGroupMs > 0 &&
+           JournalClock() - pstrJournal->ulSyncMs >= (unsigned long) pstrJournal->lnGroupMs)))) &&
+       SyncHashJournal(pstrHash) != 0)
+   {
+      return(-1);
+   }
+
+   if (pstrJournal->lnRecords > HASH_JOURNAL_DEAD * pstrHash->lnEntries + HASH_JOURNAL_SLACK &&
+       CompactJournal(pstrHash) < 0)
+   {
+      return(-1);
+   }
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: CompactJournal
+ * Params:   pstrHash - hash table with a journal
+ * Returns:  >=0 - journal rewritten, number of records in it
+ *           <0 - cannot write the new journal, the old one is kept
+ * Call by:  CommitJournal()
+ *           OpenHashJournal()
+ * Call to:  AppendJournal()
+ *           ImportSnapshot()
+ *           JournalClock()
+ *           KeyOfEntry()
+ *           NextHashEntry()
+ *           SyncHashJournal()
+ *           ValueOfEntry()
+ *           WriteJournal()
+ * Overview: Writes a new journal with one add, or one put for a key with a
+ *           value, per key of the table, syncs it and renames it over the old
+ *           journal.  Records of keys deleted or changed since are gone, so
+ *           the next replay only adds the live keys.
+ * Notes:    The old journal is synced first and stays in place until the new
+ *           one is on disk, so a crash at any point leaves a whole journal.
+ *           The new journal is written as pszFile.tmp through the journal
+ *           buffer.  TTLs are not kept, as in any journal record.
+ ********************************************************************************/
+static long CompactJournal(strHash *pstrHash)
+{
+   int               nFile       = -1;
+   int               nOldFile    = -1;
+   int               nReturnCode = 0;
+   long              lnOld       = 0;
+   char              szTemp[PATH_MAX];
+   strJournal       *pstrJournal = &pstrHash->strJournal;
+   const strHashKey *pstrKey     = NULL;
+   strHashCursor     strCursor;
+   strJournalHeader  strHeader;
+
+
+
+   if (SyncHashJournal(pstrHash) != 0 ||
+       (pstrHash->strSnap.puchMap != NULL && ImportSnapshot(pstrHash) != 0))
+   {
+      return(-1);
+   }
+
+   if (snprintf(szTemp, sizeof(szTemp), "%s.tmp", pstrJournal->szFile) >= (int) sizeof(szTemp))
+   {
+      fprintf(stderr, "Journal name [%s] is too long.\n", pstrJournal->szFile);
+      return(-1);
+   }
+
+   if ((nFile = open(szTemp, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644)) < 0)
+   {
+      fprintf(stderr, "Cannot create [%s]. errno=%d.\n", szTemp, errno);
+      return(-1);
+   }
+
+   memset(&strHeader, 0, sizeof(strHeader));
+   memcpy(strHeader.achMagic, HASH_JOURNAL_MAGIC, sizeof(strHeader.achMagic));
+   strHeader.nVersion = HASH_JOURNAL_VERSION;
+
+   nOldFile               = pstrJournal->nFile;
+   lnOld                  = pstrJournal->lnRecords;
+   pstrJournal->nFile     = nFile;
+   pstrJournal->lnRecords = 0;
+
+
+   /****************************************************************************
+    * AppendJournal() writes to nFile, now the new journal, whenever the buffer
+    * fills.
+    ****************************************************************************/
+   memset(&strCursor, 0, sizeof(strCursor));
+
+   nReturnCode = WriteJournal(pstrJournal, (const char *) &strHeader, sizeof(strHeader));
+
+   while (nReturnCode == 0 && (pstrKey = NextHashEntry(pstrHash, &strCursor)) != NULL)
+   {
+      nReturnCode = AppendJournal(pstrHash,
+                                  pstrKey->nValueLength > 0 ? HASH_JOURNAL_PUT : HASH_JOURNAL_ADD,
+                                  KeyOfEntry(pstrKey), ValueOfEntry(pstrKey),
+                                  pstrKey->nValueLength);
+   }
+
+   if (nReturnCode == 0 &&
+       WriteJournal(pstrJournal, pstrJournal->pchBuffer, pstrJournal->nBuffered) == 0 &&
+       fdatasync(nFile) == 0 && rename(szTemp, pstrJournal->szFile) == 0)
+   {
+      close(nOldFile);
+
+      pstrJournal->nBuffered = 0;
+      pstrJournal->lnPending = 0;
+      pstrJournal->ulSyncMs  = JournalClock();
+      pstrJournal->lnSyncs++;
+
+      Debug("Compacted journal [%s] from %ld to %ld records\n", pstrJournal->szFile, lnOld,
+            pstrJournal->lnRecords);
+
+      return(pstrJournal->lnRecords);
+   }
+
+
+   fprintf(stderr, "Failed to compact journal [%s]. errno=%d.\n", pstrJournal->szFile, errno);
+
+   close(nFile);
+   unlink(szTemp);
+
+   pstrJournal->nFile     = nOldFile;
+   pstrJournal->lnRecords = lnOld;
+   pstrJournal->lnPending = 0;
+   pstrJournal->nBuffered = 0;
+
+
+   return(-1);
+}
+
+
+
+
+/********************************************************************************
+ * Function: CompactKeyArena
+ * Params:   pstrHash - hash table
+ * Returns:  0 - live long keys and values moved into a new arena, the old one
+ *               freed
+ *           <0 - cannot allocate memory, keys stay where they were
+ * Call by:  RemoveCacheEntry()
+ * Call to:  ArenaAlloc()
+ *           NextHashEntry()
+ *           PageFree()
+ * Overview: Copies every long key and value still in the table into a fresh
+ *           arena and points its entry at the copy, so the bytes of evicted
+ *           keys and replaced values are given back instead of only counted as
+ *           dead.
+ * Notes:    Only cache mode needs this, other tables keep their deletes
+ *           counted as dead until FreeHashTable().  Chain indexes point at
+ *           nodes, not keys, so they stay valid.
+ ********************************************************************************/
+static int CompactKeyArena(strHash *pstrHash)
+{
+   char          *pszKey    = NULL;
+   char          *pchValue  = NULL;
+   strHashKey    *pstrKey   = NULL;
+   strArenaBlock *pstrBlock = NULL;
+   strArena       strKeys;
+   strHashCursor  strCursor;
+
+
+
+   memset(&strKeys, 0, sizeof(strArena));
+   strKeys.pstrPages = pstrHash->strKeys.pstrPages;
+   memset(&strCursor, 0, sizeof(strHashCursor));
+
+
+   /****************************************************************************
+    * NextHashEntry() only reads the table, but the entries it returns belong to
+    * pstrHash, which may be changed here.
+    ****************************************************************************/
+   while ((pstrKey = (strHashKey *) NextHashEntry(pstrHash, &strCursor)) != NULL)
+   {
+      if (pstrKey->nLength >= HASH_INLINE_KEY)
+      {
+         if ((pszKey = ArenaAlloc(&strKeys, pstrKey->nLength + 1)) == NULL)
+         {
+            break;
+         }
+
+         memcpy(pszKey, pstrKey->uKey.pszExternal, pstrKey->nLength + 1);
+         pstrKey->uKey.pszExternal = pszKey;
+      }
+
+      if (pstrKey->nValueLength > HASH_INLINE_VALUE)
+      {
+         if ((pchValue = ArenaAlloc(&strKeys, pstrKey->nValueLength)) == NULL)
+         {
+            break;
+         }
+
+         memcpy(pchValue, pstrKey->uValue.pchExternal, pstrKey->nValueLength);
+         pstrKey->uValue.pchExternal = pchValue;
+      }
+   }
+
+
+   /****************************************************************************
+    * Some keys may already point into the new arena, so on failure it is kept
+    * behind the old one, and the copies made count as used.
+    ****************************************************************************/
+   if (pstrKey != NULL)
+   {
+      for (pstrBlock = strKeys.pstrBlocks; pstrBlock != NULL; pstrBlock = pstrBlock->pstrNext)
+      {
+         if (pstrBlock->pstrNext == NULL)
+         {
+            pstrBlock->pstrNext = pstrHash->strKeys.pstrBlocks;
+            pstrHash->strKeys.pstrBlocks = strKeys.pstrBlocks;
+            break;
+         }
+      }
+
+      pstrHash->strKeys.nReserved += strKeys.nReserved;
+      pstrHash->strKeys.nDead     += strKeys.nUsed;
+      pstrHash->strKeys.nUsed     += strKeys.nUsed;
+      return(-1);
+   }
+
+
+   while ((pstrBlock = pstrHash->strKeys.pstrBlocks) != NULL)
+   {
+      pstrHash->strKeys.pstrBlocks = pstrBlock->pstrNext;
+      PageFree(pstrBlock, &pstrBlock->strMap);
+   }
+
+   Debug("Key arena compacted from %zu to %zu bytes\n",
+         pstrHash->strKeys.nReserved, strKeys.nReserved);
+
+   pstrHash->strKeys = strKeys;
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: CompareChainNodes
+ * Params:   pFirst - pointer to a chain node pointer
+ *           pSecond - pointer to a chain node pointer
+ * Returns:  <0, 0 or >0 as the first key sorts before, with, or after the second
+ * Call by:  BuildChainIndex() through qsort()
+ * Call to:  KeyOfEntry()
+ * Overview: Orders chain nodes by hash, then by key length, then by key bytes.
+ * Notes:    SearchChainIndex() compares in the same order.
+ ********************************************************************************/
+static int CompareChainNodes(const void *pFirst, const void *pSecond)
+{
+   const strHashKey *pstrFirst  = &(*(strHashTable * const *) pFirst)->strKey;
+   const strHashKey *pstrSecond = &(*(strHashTable * const *) pSecond)->strKey;
+
+
+
+   if (pstrFirst->ulHash != pstrSecond->ulHash)
+   {
+      return(pstrFirst->ulHash < pstrSecond->ulHash ? -1 : 1);
+   }
+
+   if (pstrFirst->nLength != pstrSecond->nLength)
+   {
+      return(pstrFirst->nLength < pstrSecond->nLength ? -1 : 1);
+   }
+
+
+   return(memcmp(KeyOfEntry(pstrFirst), KeyOfEntry(pstrSecond), pstrFirst->nLength));
+}
+
+
+
+
+/********************************************************************************
+ * Function: CountFilterKey
+ * Params:   pstrFilter - filter of a table, may be off
+ *           ulHash - HashKey() of the key
+ *           nDelta - 1 for a key added, -1 for a key deleted
+ * Returns:  None
+ * Call by:  AddEntryToChainTable()
+ *           AddEntryToOpenTable()
+ *           BuildHashFilter()
+ *           DeleteEntryFromHashTable()
+ *           DeleteEntryFromOpenTable()
+ *           RemoveCacheEntry()
+ * Call to:  MixFilterHash()
+ * Overview: Steps the HASH_FILTER_PROBES counters of the key up or down, all in
+ *           the block picked by the hash.
+ * Notes:    A counter at 15 stays there, since it no longer knows how many
+ *           keys it counts.  A key using the same counter twice steps it twice.
+ ********************************************************************************/
+static void CountFilterKey(strHashFilter *pstrFilter, unsigned long ulHash, int nDelta)
+{
+   int            nProbe    = 0;
+   unsigned int   nCounter  = 0;
+   unsigned int   nShift    = 0;
+   unsigned int   nValue    = 0;
+   unsigned long  ulMix     = 0;
+   unsigned char *puchBlock = NULL;
+
+
+
+   if (pstrFilter->puchCounters == NULL)
+   {
+      return;
+   }
+
+   ulMix     = MixFilterHash(ulHash);
+   puchBlock = pstrFilter->puchCounters +
+               (ulMix & (pstrFilter->ulBlocks - 1)) * HASH_CACHE_LINE;
+
+
+   for (nProbe=0, ulMix>>=32; nProbe<HASH_FILTER_PROBES; nProbe++, ulMix/=HASH_CACHE_LINE*2)
+   {
+      nCounter = (unsigned int) (ulMix % (HASH_CACHE_LINE * 2));
+      nShift   = (nCounter & 1) * 4;
+      nValue   = (puchBlock[nCounter / 2] >> nShift) & 0x0F;
+
+      if (nValue == 0x0F || (nDelta < 0 && nValue == 0))
+      {
+         continue;
+      }
+
+      if (nDelta > 0)
+      {
+         puchBlock[nCounter / 2] += (unsigned char) (1 << nShift);
+      }
+      else
+      {
+         puchBlock[nCounter / 2] -= (unsigned char) (1 << nShift);
+      }
+   }
+}
+
+
+
+
+/********************************************************************************
+ * Function: CountPageBlock
+ * Params:   pstrInfo - page counts being added up
+ *           pstrMap - how the block was allocated
+ *           nBytes - bytes asked for the block
+ * Returns:  None
+ * Call by:  PageUsage()
+ * Call to:  None
+ * Overview: Adds a block to the count of the pages behind it.  A mapped block
+ *           counts all the bytes mapped.
+ * Notes:    Memory from calloc() counts as base pages.
+ ********************************************************************************/
+static void CountPageBlock(strHashInfo *pstrInfo, const strPageMap *pstrMap, size_t nBytes)
+{
+   long lnBytes = (long) (pstrMap->nMapped != 0 ? pstrMap->nMapped : nBytes);
+
+
+
+   switch (pstrMap->nBacking)
+   {
+      case BACKING_THP:     pstrInfo->lnThpBytes     += lnBytes; break;
+      case BACKING_HUGETLB: pstrInfo->lnHugetlbBytes += lnBytes; break;
+      default:              pstrInfo->lnBaseBytes    += lnBytes; break;
+   }
+
+   if (pstrMap->bPlaced == TRUE)
+   {
+      pstrInfo->lnPlacedBytes += lnBytes;
+   }
+}
+
+
+
+
+/********************************************************************************
+ * Function: CreateConcurrentTable
+ * Params:   nHash - hash function used for keys
+ *           aulSeed - key for siphash
+ *           nSize - starting number of buckets
+ * Returns:  New concurrent hash table
+ *           NULL - cannot allocate memory
+ * Call by:  RunConcurrentBenchmark()
+ * Call to:  None
+ * Overview: Allocates the bucket array and initializes the stripe locks and
+ *           the epoch records.
+ * Notes:    nSize is rounded up to a power of 2 of at least HASH_LOCK_STRIPES
+ *           buckets.  The table is aligned to HASH_CACHE_LINE, like its stripes
+ *           and epoch records.  Release with FreeConcurrentTable().
+ ********************************************************************************/
+strConcurrentHash *CreateConcurrentTable(hashfn nHash, const unsigned long *aulSeed, int nSize)
+{
+   int                nIndex   = 0;
+   unsigned long      ulSize   = HASH_LOCK_STRIPES;
+   strConcurrentHash *pstrConc = NULL;
+
+
+
+   pstrConc = (strConcurrentHash *) aligned_alloc(HASH_CACHE_LINE, sizeof(strConcurrentHash));
+
+   if (pstrConc == NULL)
+   {
+      fprintf(stderr, "Failed aligned_alloc() in CreateConcurrentTable(). errno=%d.\n", errno);
+      return(NULL);
+   }
+
+   memset(pstrConc, 0, sizeof(strConcurrentHash));
+
+   pstrConc->nHash      = nHash;
+   pstrConc->aulSeed[0] = aulSeed[0];
+   pstrConc->aulSeed[1] = aulSeed[1];
+   pstrConc->ulEpoch    = 1;
+
+   while (ulSize < (unsigned long) nSize)
+   {
+      ulSize = ulSize * 2;
+   }
+
+
+   pstrConc->pstrArray = (strConcurrentArray *) calloc(1, sizeof(strConcurrentArray) +
+                                                       ulSize * sizeof(strConcurrentNode *));
+
+   if (pstrConc->pstrArray == NULL)
+   {
+      fprintf(stderr, "Failed calloc() in CreateConcurrentTable(). errno=%d.\n", errno);
+      free(pstrConc);
+      return(NULL);
+   }
+
+   pstrConc->pstrArray->ulSize = ulSize;
+
+   for (nIndex=0; nIndex<HASH_LOCK_STRIPES; nIndex++)
+   {
+      pthread_mutex_init(&pstrConc->astrStripes[nIndex].strMutex, NULL);
+   }
+
+
+   return(pstrConc);
+}
+
+
+
+
+/********************************************************************************
+ * Function: CreateHashTable
+ * Params:   nEngine - ENGINE_CHAIN or ENGINE_OPEN
+ *           nHash - hash function used for keys
+ *           ulSeed - seed for the keyed hash function, 0 for a random seed
+ *           nSize - number of buckets, or slots for open addressing
+ * Returns:  New hash table
+ *           NULL - invalid size or cannot allocate memory
+ * Call by:  main()
+ * Call to:  AllocateHashArray()
+ * Overview: Allocates the bucket heads, or the control bytes and slots, and
+ *           starts with an empty key arena.  TTLs are counted from now.
+ *           Storage comes from the heap until SetHashPages() says otherwise.
+ *           The seed is stretched into the 128 bit key of siphash with the
+ *           splitmix64 steps.
+ * Notes:    Release with FreeHashTable().
+ *           Open addressing rounds nSize up to a power of 2 of at least
+ *           HASH_GROUP slots.  The table never shrinks below its starting size.
+ ********************************************************************************/
+strHash *CreateHashTable(engine nEngine, hashfn nHash, unsigned long ulSeed, int nSize)
+{
+   int             nIndex   = 0;
+   int             nSlots   = HASH_GROUP;
+   unsigned long   ulMix    = 0;
+   strHash        *pstrHash = NULL;
+   struct timespec strNow;
+
+
+
+   if (nSize < 1)
+   {
+      fprintf(stderr, "Hash size must be at least 1.\n");
+      return(NULL);
+   }
+
+   if ((pstrHash = (strHash *) calloc(1, sizeof(strHash))) == NULL)
+   {
+      fprintf(stderr, "Failed calloc() in CreateHashTable(). errno=%d.\n", errno);
+      return(NULL);
+   }
+
+   pstrHash->nEngine = nEngine;
+   pstrHash->nHash   = nHash;
+
+   clock_gettime(CLOCK_MONOTONIC, &strNow);
+   pstrHash->strCache.tStart = strNow.tv_sec;
+
+
+   if (ulSeed == 0 && getrandom(&ulSeed, sizeof(ulSeed), 0) != sizeof(ulSeed))
+   {
+      ulSeed = (unsigned long) time(NULL) ^ ((unsigned long) getpid() << 32);
+   }
+
+   for (nIndex=0; nIndex<2; nIndex++)
+   {
+      ulSeed += 0x9e3779b97f4a7c15UL;
+      ulMix   = ulSeed;
+      ulMix   = (ulMix ^ (ulMix >> 30)) * 0xbf58476d1ce4e5b9UL;
+      ulMix   = (ulMix ^ (ulMix >> 27)) * 0x94d049bb133111ebUL;
+
+      pstrHash->aulSeed[nIndex] = ulMix ^ (ulMix >> 31);
+   }
+
+
+   if (nEngine == ENGINE_OPEN)
+   {
+      while (nSlots < nSize && nSlots <= INT_MAX / 2)
+      {
+         nSlots = nSlots * 2;
+      }
+
+      nSize = nSlots;
+   }
+
+   pstrHash->nMinSize           = nSize;
+   pstrHash->strKeys.pstrPages  = &pstrHash->strPages;
+   pstrHash->strNodes.pstrPages = &pstrHash->strPages;
+
+   if (AllocateHashArray(&pstrHash->strArray, &pstrHash->strPages, nEngine, nSize) != 0)
+   {
+      free(pstrHash);
+      return(NULL);
+   }
+
+
+   return(pstrHash);
+}
+
+
+
+
+/********************************************************************************
+ * Function: DeferBuildItem
+ * Params:   pstrWork - share of a thread of BuildHashTable()
+ *           lnItem - bucket to index, or key to add, once the threads are done
+ * Returns:  0 - item kept
+ *           <0 - cannot allocate memory
+ * Call by:  BuildChainPartition()
+ *           BuildOpenPartition()
+ * Call to:  None
+ * Overview: Appends the item to alnLater, doubling it when full.
+ * Notes:    None
+ ********************************************************************************/
+static int DeferBuildItem(strBuildThread *pstrWork, long lnItem)
+{
+   long  lnSize   = 0;
+   long *alnLater = NULL;
+
+
+
+   if (pstrWork->lnLater == pstrWork->lnLaterSize)
+   {
+      lnSize   = pstrWork->lnLaterSize * 2 + 64;
+      alnLater = (long *) realloc(pstrWork->alnLater, lnSize * sizeof(long));
+
+      if (alnLater == NULL)
+      {
+         fprintf(stderr, "Failed realloc() in DeferBuildItem(). errno=%d.\n", errno);
+         return(-1);
+      }
+
+      pstrWork->alnLater    = alnLater;
+      pstrWork->lnLaterSize = lnSize;
+   }
+
+   pstrWork->alnLater[pstrWork->lnLater++] = lnItem;
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: DeleteEntryFromHashTable
+ * Params:   pstrHash - hash table
+ *           pszData - data to search for in hash table to remove if found
+ * Returns:  0  - data found and deleted
+ *           >0 - data not found to delete
+ *           <0 - error attempting to delete, such as not able to free memory
+ * Call by:  main()
+ *           ReplayJournal()
+ *           RunReplay()
+ *           ServerCommand()
+ * Call to:  AppendJournal()
+ *           AppendTrace()
+ *           CheckHashLoad()
+ *           CommitJournal()
+ *           CountFilterKey()
+ *           DeleteEntryFromOpenTable()
+ *           HashKey()
+ *           ImportSnapshot()
+ *           MigrateHashTable()
+ *           TestFilterKey()
+ *           UnlinkChainEntry()
+ * Overview: Removes the data from the current array, or from the old array
+ *           while the table is resizing.
+ * Notes:    Open addressing tables are handled by DeleteEntryFromOpenTable().
+ *           A mapped snapshot is copied into the table before the first delete.
+ ********************************************************************************/
+int DeleteEntryFromHashTable(strHash *pstrHash, const char *pszData)
+{
+   int           nReturnCode  = 1;
+   size_t        nLength      = strlen(pszData);
+   unsigned long ulHash       = 0;
+
+
+   Debug("Inside DeleteEntryFromHashTable()\n");
+
+   AppendTrace(pstrHash, TRACE_DELETE, pszData, NULL, 0);
+
+   if (pstrHash->strSnap.puchMap != NULL && ImportSnapshot(pstrHash) != 0)
+   {
+      return(-1);
+   }
+
+   if (pstrHash->nEngine == ENGINE_OPEN)
+   {
+      nReturnCode = DeleteEntryFromOpenTable(pstrHash, pszData, nLength);
+   }
+   else
+   {
+      MigrateHashTable(pstrHash, HASH_MIGRATE_STEP);
+
+      ulHash = HashKey(pstrHash, pszData, nLength);
+
+      if (TestFilterKey(&pstrHash->strFilter, ulHash) == FALSE)
+      {
+         return(1);
+      }
+
+      nReturnCode = UnlinkChainEntry(pstrHash, &pstrHash->strArray, pszData, nLength, ulHash);
+
+      if (nReturnCode != 0)
+      {
+         nReturnCode = UnlinkChainEntry(pstrHash, &pstrHash->strOldArray, pszData, nLength,
+                                        ulHash);
+      }
+
+      if (nReturnCode == 0)
+      {
+         CountFilterKey(&pstrHash->strFilter, ulHash, -1);
+         CheckHashLoad(pstrHash, FALSE);
+      }
+   }
+
+
+   if (nReturnCode == 0)
+   {
+      pstrHash->strStats.lnDeletes++;
+
+      AppendJournal(pstrHash, HASH_JOURNAL_DELETE, pszData, NULL, 0);
+      CommitJournal(pstrHash);
+   }
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: DeleteEntryFromConcurrentTable
+ * Params:   pstrConc - concurrent hash table
+ *           pstrThread - epoch record of the calling thread
+ *           pszData - data to remove if found
+ * Returns:  0  - data found and deleted
+ *           >0 - data not found to delete
+ * Call by:  BenchConcurrentThread()
+ * Call to:  HashBytes()
+ *           MatchBytes()
+ *           RetireMemory()
+ * Overview: Holding the lock of the key's stripe, unlinks the node with one
+ *           release store into the link that points at it.
+ * Notes:    The unlinked node still points to the rest of the chain, so a
+ *           reader standing on it carries on normally.  It is only freed once
+ *           every reader that might have seen it has left, by RetireMemory().
+ ********************************************************************************/
+int DeleteEntryFromConcurrentTable(strConcurrentHash *pstrConc, strEpochThread *pstrThread,
+                                   const char *pszData)
+{
+   size_t              nLength     = strlen(pszData);
+   unsigned long       ulHash      = 0;
+   strLockStripe      *pstrStripe  = NULL;
+   strConcurrentArray *pstrArray   = NULL;
+   strConcurrentNode  *pstrCurrent = NULL;
+   strConcurrentNode **ppstrLink   = NULL;
+
+
+
+   ulHash     = HashBytes(pstrConc->nHash, pstrConc->aulSeed, pszData, nLength);
+   pstrStripe = &pstrConc->astrStripes[ulHash & (HASH_LOCK_STRIPES-1)];
+
+   pthread_mutex_lock(&pstrStripe->strMutex);
+
+   pstrArray = pstrConc->pstrArray;
+   ppstrLink = &pstrArray->apstrBuckets[ulHash & (pstrArray->ulSize-1)];
+
+   for (pstrCurrent = *ppstrLink; pstrCurrent != NULL; pstrCurrent = *ppstrLink)
+   {
+      if (pstrCurrent->ulHash == ulHash && pstrCurrent->nLength == nLength &&
+          MatchBytes(pstrCurrent->achKey, pszData, nLength) == TRUE)
+      {
+         __atomic_store_n(ppstrLink, pstrCurrent->pstrNext, __ATOMIC_RELEASE);
+         pstrStripe->lnEntries--;
+         break;
+      }
+
+      ppstrLink = &pstrCurrent->pstrNext;
+   }
+
+   pthread_mutex_unlock(&pstrStripe->strMutex);
+
+
+   if (pstrCurrent == NULL)
+   {
+      return(1);
+   }
+
+   RetireMemory(pstrConc, pstrThread, pstrCurrent, FALSE);
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: DeleteEntryFromOpenTable
+ * Params:   pstrHash - open addressing hash table
+ *           pszData - data to search for in hash table to remove if found
+ *           nLength - strlen() of pszData
+ * Returns:  0  - data found and deleted
+ *           >0 - data not found to delete
+ * Call by:  DeleteEntryFromHashTable()
+ * Call to:  CheckHashLoad()
+ *           CountFilterKey()
+ *           HashKey()
+ *           MigrateHashTable()
+ *           TestFilterKey()
+ *           UnlinkOpenEntry()
+ * Overview: Removes the data from the current array, or from the old array
+ *           while the table is resizing.
+ * Notes:    None
+ ********************************************************************************/
+static int DeleteEntryFromOpenTable(strHash *pstrHash, const char *pszData, size_t nLength)
+{
+   int           nReturnCode = 1;
+   unsigned long ulHash      = 0;
+
+
+
+   MigrateHashTable(pstrHash, HASH_MIGRATE_STEP);
+
+
+   ulHash = HashKey(pstrHash, pszData, nLength);
+
+   if (TestFilterKey(&pstrHash->strFilter, ulHash) == FALSE)
+   {
+      return(1);
+   }
+
+   nReturnCode = UnlinkOpenEntry(pstrHash, &pstrHash->strArray, pszData, nLength, ulHash);
+
+   if (nReturnCode != 0)
+   {
+      nReturnCode = UnlinkOpenEntry(pstrHash, &pstrHash->strOldArray, pszData, nLength, ulHash);
+   }
+
+
+   if (nReturnCode == 0)
+   {
+      CountFilterKey(&pstrHash->strFilter, ulHash, -1);
+      CheckHashLoad(pstrHash, FALSE);
+   }
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: DeleteEntryFromSharedTable
+ * Params:   pstrShared - shared hash table
+ *           pszData - data to search for in the table to remove if found
+ * Returns:  0  - data found and deleted
+ *           >0 - data not found to delete
+ *           <0 - cannot take the lock
+ * Call by:  ProcessBatchLine()
+ * Call to:  HashBytes()
+ *           LockSharedTable()
+ *           MatchBytes()
+ *           SharedNode()
+ * Overview: Holding the writers' lock, unlinks the node with one release store
+ *           and puts it on the free list.
+ * Notes:    A reader may still be on the node, so ulSequence is bumped after it
+ *           is unlinked and before its link is reused for the free list.  The
+ *           reader sees the new sequence when it is done and searches again.
+ ********************************************************************************/
+int DeleteEntryFromSharedTable(strSharedHash *pstrShared, const char *pszData)
+{
+   int              nReturnCode = 1;
+   size_t           nLength     = strlen(pszData);
+   unsigned int     nNode       = 0;
+   unsigned int    *pnLink      = NULL;
+   unsigned long    ulHash      = 0;
+   strSharedHeader *pstrHeader  = pstrShared->pstrHeader;
+   strSharedNode   *pstrNode    = NULL;
+
+
+
+   ulHash = HashBytes(pstrHeader->nHash, pstrHeader->aulSeed, pszData, nLength);
+   pnLink = &pstrShared->anBuckets[ulHash & (pstrHeader->ulBuckets-1)];
+
+   if (LockSharedTable(pstrShared) != 0)
+   {
+      return(-1);
+   }
+
+
+   for (nNode = *pnLink; nNode != 0; nNode = *pnLink)
+   {
+      pstrNode = SharedNode(pstrShared, nNode);
+
+      if (pstrNode->ulHash == ulHash && pstrNode->nLength == nLength &&
+          MatchBytes(pstrNode->achKey, pszData, nLength) == TRUE)
+      {
+         __atomic_store_n(pnLink, pstrNode->nNext, __ATOMIC_RELEASE);
+         __atomic_fetch_add(&pstrHeader->ulSequence, 1, __ATOMIC_RELAXED);
+         __atomic_thread_fence(__ATOMIC_RELEASE);
+
+         pstrNode->nNext   = pstrHeader->nFree;
+         pstrHeader->nFree = nNode;
+
+         pstrHeader->lnEntries--;
+         pstrHeader->lnDeletes++;
+         nReturnCode = 0;
+         break;
+      }
+
+      pnLink = &pstrNode->nNext;
+   }
+
+   pthread_mutex_unlock(&pstrHeader->strMutex);
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: DropChainIndex
+ * Params:   pstrArray - chained bucket array
+ *           nBucket - bucket whose index goes away
+ * Returns:  None
+ * Call by:  IndexChainNode()
+ *           MigrateHashTable()
+ *           UnlinkChainEntry()
+ * Call to:  None
+ * Overview: Frees the index of the chain, if it has one, so lookups walk the
+ *           chain again.  Frees the table of indexes with the last index.
+ * Notes:    The chain itself is not touched.
+ ********************************************************************************/
+static void DropChainIndex(strHashArray *pstrArray, int nBucket)
+{
+   strChainIndex *pstrIndex = NULL;
+
+
+
+   if (pstrArray->papstrIndexes == NULL ||
+       (pstrIndex = pstrArray->papstrIndexes[nBucket]) == NULL)
+   {
+      return;
+   }
+
+   Debug("Bucket [%d] no longer indexed, %d keys\n", nBucket, pstrIndex->nCount);
+
+   pstrArray->nIndexBytes -= sizeof(strChainIndex) + pstrIndex->nSize * sizeof(strHashTable *);
+   pstrArray->papstrIndexes[nBucket] = NULL;
+   pstrArray->nIndexes--;
+   free(pstrIndex);
+
+
+   if (pstrArray->nIndexes == 0)
+   {
+      free(pstrArray->papstrIndexes);
+      pstrArray->papstrIndexes = NULL;
+      pstrArray->nIndexBytes   = 0;
+   }
+}
+
+
+
+
+/********************************************************************************
+ * Function: EnterEpoch
+ * Params:   pstrConc - concurrent hash table
+ *           pstrThread - epoch record of the calling thread
+ * Returns:  None
+ * Call by:  SearchConcurrentTable()
+ * Call to:  None
+ * Overview: Announces that the thread is about to read the table, in the
+ *           current global epoch.  Memory retired from now on is not freed
+ *           before the thread calls LeaveEpoch().
+ * Notes:    The epoch is read again after the announcement is visible, in
+ *           case it moved on in between; otherwise ReclaimMemory() could have
+ *           missed the announcement.
+ ********************************************************************************/
+static void EnterEpoch(strConcurrentHash *pstrConc, strEpochThread *pstrThread)
+{
+   unsigned long ulEpoch = 0;
+
+
+
+   do
+   {
+      ulEpoch = __atomic_load_n(&pstrConc->ulEpoch, __ATOMIC_SEQ_CST);
+
+      __atomic_store_n(&pstrThread->ulEpoch, ulEpoch, __ATOMIC_SEQ_CST);
+   } while (__atomic_load_n(&pstrConc->ulEpoch, __ATOMIC_SEQ_CST) != ulEpoch);
+}
+
+
+
+
+/********************************************************************************
+ * Function: EvictCacheEntry
+ * Params:   pstrHash - hash table in cache mode
+ * Returns:  0 - one key evicted, or dropped because it expired
+ *           >0 - no key to evict
+ * Call by:  MakeCacheRoom()
+ *           SetHashCache()
+ * Call to:  CacheClock()
+ *           MigrateHashTable()
+ *           RemoveCacheEntry()
+ * Overview: Moves the clock hand over the buckets (or slots) from where it last
+ *           stopped.  An expired key, or a key not hit since the hand last
+ *           passed it, is removed.  A key that was hit loses its bit and stays.
+ *           The hand stays on a chain until it has nothing left to remove.
+ * Notes:    A resize in progress is finished first, so the hand sees every key.
+ *           Two turns of the hand always find a key, as the first clears every
+ *           bit.
+ ********************************************************************************/
+static int EvictCacheEntry(strHash *pstrHash)
+{
+   long           lnVisit     = 0;
+   unsigned int   nNow        = CacheClock(pstrHash);
+   strHashArray  *pstrArray   = &pstrHash->strArray;
+   strHashCache  *pstrCache   = &pstrHash->strCache;
+   strHashKey    *pstrVictim  = NULL;
+   strHashKey    *pstrKey     = NULL;
+   strHashTable  *pstrCurrent = NULL;
+
+
+
+   MigrateHashTable(pstrHash, INT_MAX);
+
+   if (pstrHash->lnEntries == 0)
+   {
+      return(1);
+   }
+
+
+   for (lnVisit=0; lnVisit <= 2L * pstrArray->nSize && pstrVictim == NULL; lnVisit++)
+   {
+      if (pstrCache->nHand >= pstrArray->nSize)
+      {
+         pstrCache->nHand = 0;
+      }
+
+      pstrCurrent = NULL;
+      pstrKey     = NULL;
+
+      if (pstrHash->nEngine == ENGINE_OPEN)
+      {
+         if ((pstrArray->pachControl[pstrCache->nHand] & HASH_CTRL_EMPTY) == 0)
+         {
+            pstrKey = &pstrArray->pastrSlots[pstrCache->nHand];
+         }
+      }
+      else
+      {
+         pstrCurrent = &pstrArray->pastrBuckets[pstrCache->nHand];
+         pstrKey     = &pstrCurrent->strKey;
+      }
+
+
+      while (pstrKey != NULL && pstrVictim == NULL)
+      {
+         if (pstrKey->nLength != 0 &&
+             ((pstrKey->nExpire != 0 && pstrKey->nExpire < nNow) || pstrKey->bRecent == 0))
+         {
+            pstrVictim = pstrKey;
+         }
+         else
+         {
+            pstrKey->bRecent = 0;
+         }
+
+         pstrCurrent = pstrCurrent != NULL ? pstrCurrent->pstrNext : NULL;
+         pstrKey     = pstrCurrent != NULL ? &pstrCurrent->strKey : NULL;
+      }
+
+      if (pstrVictim == NULL || pstrHash->nEngine == ENGINE_OPEN)
+      {
+         pstrCache->nHand++;
+      }
+   }
+
+
+   if (pstrVictim == NULL)
+   {
+      return(1);
+   }
+
+   if (pstrVictim->nExpire != 0 && pstrVictim->nExpire < nNow)
+   {
+      pstrHash->strStats.lnExpired++;
+   }
+   else
+   {
+      pstrHash->strStats.lnEvicted++;
+   }
+
+
+   return(RemoveCacheEntry(pstrHash, pstrVictim) == 0 ? 0 : 1);
+}
+
+
+
+
+/********************************************************************************
+ * Function: FindChainEntry
+ * Params:   pstrArray - chained bucket array, may be empty
+ *           pszData - data to look for
+ *           nLength - strlen() of pszData
+ *           ulHash - HashKey() of pszData
+ *           pnChain - if not NULL, receives the position in the chain, or the
+ *                     number of nodes looked at when not found
+ * Returns:  Node holding the data
+ *           NULL - not found
+ * Call by:  AddEntryToChainTable()
+ *           FindHashedKey()
+ *           SearchHashedEntry()
+ * Call to:  MatchKey()
+ *           SearchChainIndex()
+ * Overview: Loop through through the linked list in the proper bucket.  A
+ *           chain with an index is binary searched instead.
+ * Notes:    MatchKey() is only called when the stored hash matches.  For an
+ *           indexed chain, *pnChain counts the nodes compared, less one when
+ *           found, like a walk.
+ ********************************************************************************/
+static strHashTable *FindChainEntry(const strHashArray *pstrArray, const char *pszData,
+                                    size_t nLength, unsigned long ulHash, int *pnChain)
+{
+   int            nChain      = 0;
+   int            nBucket     = 0;
+   int            nPosition   = 0;
+   strHashTable  *pstrCurrent = NULL;
+   strChainIndex *pstrIndex   = NULL;
+
+
+
+   if (pnChain != NULL)
+   {
+      *pnChain = 0;
+   }
+
+   if (pstrArray->nSize == 0)
+   {
+      return(NULL);
+   }
+
+   nBucket = (int) (ulHash % pstrArray->nSize);
+
+
+   if (pstrArray->papstrIndexes != NULL &&
+       (pstrIndex = pstrArray->papstrIndexes[nBucket]) != NULL)
+   {
+      nPosition = SearchChainIndex(pstrIndex, pszData, nLength, ulHash, &nChain);
+
+      if (pnChain != NULL)
+      {
+         *pnChain = nPosition >= 0 ? nChain - 1 : nChain;
+      }
+
+      return(nPosition >= 0 ? pstrIndex->apstrNodes[nPosition] : NULL);
+   }
+
+
+   for (pstrCurrent  = &pstrArray->pastrBuckets[nBucket];
+        pstrCurrent != NULL;
+        pstrCurrent  = pstrCurrent->pstrNext, nChain++)
+   {
+      if (pstrCurrent->strKey.ulHash == ulHash &&
+          MatchKey(&pstrCurrent->strKey, pszData, nLength) == TRUE)
+      {
+         if (pnChain != NULL)
+         {
+            *pnChain = nChain;
+         }
+
+         return(pstrCurrent);
+      }
+   }
+
+
+   if (pnChain != NULL)
+   {
+      *pnChain = nChain;
+   }
+
+
+   return(NULL);
+}
+
+
+
+
+/********************************************************************************
+ * Function: FindHashedKey
+ * Params:   pstrHash - hash table
+ *           pszData - data to search for
+ *           nLength - strlen() of pszData
+ *           ulHash - HashKey() of pszData
+ * Returns:  Key of the entry holding the data
+ *           NULL - not found
+ * Call by:  MakeCacheRoom()
+ *           PutEntryInHashTable()
+ * Call to:  FindChainEntry()
+ *           FindOpenSlot()
+ * Overview: Looks in the current array, then in the old array, with the engine
+ *           of the table.
+ * Notes:    Nothing is counted in the statistics.
+ ********************************************************************************/
+static strHashKey *FindHashedKey(const strHash *pstrHash, const char *pszData, size_t nLength,
+                                 unsigned long ulHash)
+{
+   int            nSlot    = 0;
+   strHashTable  *pstrNode = NULL;
+
+
+
+   if (pstrHash->nEngine == ENGINE_OPEN)
+   {
+      if ((nSlot = FindOpenSlot(&pstrHash->strArray, pszData, nLength, ulHash, NULL)) >= 0)
+      {
+         return(&pstrHash->strArray.pastrSlots[nSlot]);
+      }
+
+      if ((nSlot = FindOpenSlot(&pstrHash->strOldArray, pszData, nLength, ulHash, NULL)) >= 0)
+      {
+         return(&pstrHash->strOldArray.pastrSlots[nSlot]);
+      }
+
+      return(NULL);
+   }
+
+
+   if ((pstrNode = FindChainEntry(&pstrHash->strArray, pszData, nLength, ulHash, NULL)) == NULL)
+   {
+      pstrNode = FindChainEntry(&pstrHash->strOldArray, pszData, nLength, ulHash, NULL);
+   }
+
+
+   return(pstrNode != NULL ? &pstrNode->strKey : NULL);
+}
+
+
+
+
+/********************************************************************************
+ * Function: FindOpenSlot
+ * Params:   pstrArray - open addressing array, may be empty
+ *           pszData - data to look for
+ *           nLength - strlen() of pszData
+ *           ulHash - HashKey() of pszData
+ *           pnProbes - if not NULL, receives the number of groups probed
+ * Returns:  Slot index holding the data
+ *           -1 - not found
+ * Call by:  AddEntryToOpenTable()
+ *           FindHashedKey()
+ *           SearchOpenTable()
+ *           UnlinkOpenEntry()
+ * Call to:  MatchGroup()
+ *           MatchKey()
+ * Overview: Starting at the group picked by the hash, compares the 7 bit hash
+ *           fragment against HASH_GROUP control bytes at once, and only calls
+ *           MatchKey() on slots whose fragment matches.  The probe ends at the
+ *           first group that has an empty slot.
+ * Notes:    Groups are visited in triangular order, which reaches every group
+ *           when the number of groups is a power of 2.
+ ********************************************************************************/
+static int FindOpenSlot(const strHashArray *pstrArray, const char *pszData, size_t nLength,
+                        unsigned long ulHash, int *pnProbes)
+{
+   int           nGroups = pstrArray->nSize / HASH_GROUP;
+   int           nGroup  = 0;
+   int           nProbe  = 0;
+   int           nSlot   = 0;
+   unsigned int  nMatch  = 0;
+   unsigned char chHash  = (unsigned char) (ulHash & 0x7F);
+
+
+
+   if (pnProbes != NULL)
+   {
+      *pnProbes = 0;
+   }
+
+   if (nGroups == 0)
+   {
+      return(-1);
+   }
+
+   nGroup = (int) ((ulHash >> 7) & (unsigned long) (nGroups-1));
+
+
+   for (nProbe=0; nProbe<nGroups; nProbe++)
+   {
+      nMatch = MatchGroup(&pstrArray->pachControl[nGroup*HASH_GROUP], chHash);
+
+      for (; nMatch != 0; nMatch &= nMatch - 1)
+      {
+         nSlot = nGroup*HASH_GROUP + __builtin_ctz(nMatch);
+
+         if (pstrArray->pastrSlots[nSlot].ulHash == ulHash &&
+             MatchKey(&pstrArray->pastrSlots[nSlot], pszData, nLength) == TRUE)
+         {
+            if (pnProbes != NULL)
+            {
+               *pnProbes = nProbe + 1;
+            }
+
+            return(nSlot);
+         }
+      }
+
+      if (MatchGroup(&pstrArray->pachControl[nGroup*HASH_GROUP], HASH_CTRL_EMPTY) != 0)
+      {
+         break;
+      }
+
+      nGroup = (nGroup + nProbe + 1) & (nGroups-1);
+   }
+
+
+   if (pnProbes != NULL)
+   {
+      *pnProbes = nProbe + 1;
+   }
+
+
+   return(-1);
+}
+
+
+
+
+/********************************************************************************
+ * Function: FreeConcurrentTable
+ * Params:   pstrConc - concurrent hash table to release
+ * Returns:  None
+ * Call by:  RunConcurrentBenchmark()
+ * Call to:  FreeRetired()
+ * Overview: Frees the nodes and buckets, everything still waiting in the epoch
+ *           records, destroys the stripe locks, then frees the table itself.
+ * Notes:    No other thread may use the table any more.
+ ********************************************************************************/
+void FreeConcurrentTable(strConcurrentHash *pstrConc)
+{
+   int            nIndex = 0;
+   size_t         nItem  = 0;
+   strRetired     strCurrent;
+
+
+
+   for (nIndex=0; nIndex<HASH_MAX_THREADS; nIndex++)
+   {
+      for (nItem=0; nItem<pstrConc->astrThreads[nIndex].nRetired; nItem++)
+      {
+         FreeRetired(&pstrConc->astrThreads[nIndex].pastrRetired[nItem]);
+      }
+
+      free(pstrConc->astrThreads[nIndex].pastrRetired);
+   }
+
+   if (pstrConc->pstrArray != NULL)
+   {
+      strCurrent.pMemory = pstrConc->pstrArray;
+      strCurrent.bArray  = TRUE;
+      FreeRetired(&strCurrent);
+   }
+
+   for (nIndex=0; nIndex<HASH_LOCK_STRIPES; nIndex++)
+   {
+      pthread_mutex_destroy(&pstrConc->astrStripes[nIndex].strMutex);
+   }
+
+
+   free(pstrConc);
+}
+
+
+
+
+/********************************************************************************
+ * Function: FreeEntryStorage
+ * Params:   pstrHash - hash table
+ * Returns:  None
+ * Call by:  FreeHashTable()
+ *           FreezeHashTable()
+ * Call to:  FreeHashArray()
+ *           PageFree()
+ * Overview: Frees the current and old arrays, all node slabs and arena blocks,
+ *           so the table holds no array and no entries.
+ * Notes:    Chains are not walked, their nodes go with the slabs.  The caller
+ *           gives the table a new array, or frees it.
+ ********************************************************************************/
+static void FreeEntryStorage(strHash *pstrHash)
+{
+   strArenaBlock *pstrBlock   = NULL;
+   strNodeSlab   *pstrSlab    = NULL;
+
+
+
+   FreeHashArray(&pstrHash->strArray);
+   FreeHashArray(&pstrHash->strOldArray);
+
+   while ((pstrBlock = pstrHash->strKeys.pstrBlocks) != NULL)
+   {
+      pstrHash->strKeys.pstrBlocks = pstrBlock->pstrNext;
+      PageFree(pstrBlock, &pstrBlock->strMap);
+   }
+
+   while ((pstrSlab = pstrHash->strNodes.pstrSlabs) != NULL)
+   {
+      pstrHash->strNodes.pstrSlabs = pstrSlab->pstrNext;
+      PageFree(pstrSlab, &pstrSlab->strMap);
+   }
+
+   memset(&pstrHash->strKeys, 0, sizeof(strArena));
+   memset(&pstrHash->strNodes, 0, sizeof(strNodePool));
+
+   pstrHash->strKeys.pstrPages  = &pstrHash->strPages;
+   pstrHash->strNodes.pstrPages = &pstrHash->strPages;
+   pstrHash->nMigrated          = 0;
+   pstrHash->lnChainNodes       = 0;
+}
+
+
+
+
+/********************************************************************************
+ * Function: FreeHashArray
+ * Params:   pstrArray - array to release
+ * Returns:  None
+ * Call by:  BuildHashTable()
+ *           FreeHashTable()
+ *           MigrateHashTable()
+ *           SetHashPages()
+ * Call to:  PageFree()
+ * Overview: Frees the bucket heads and chain indexes, or the control bytes and
+ *           slots.
+ * Notes:    Chain nodes are released with the node pool, and keys in the arena
+ *           with the arena.
+ ********************************************************************************/
+static void FreeHashArray(strHashArray *pstrArray)
+{
+   int nIndex = 0;
+
+
+
+   for (nIndex=0; pstrArray->papstrIndexes != NULL && nIndex<pstrArray->nSize; nIndex++)
+   {
+      free(pstrArray->papstrIndexes[nIndex]);
+   }
+
+   free(pstrArray->papstrIndexes);
+   PageFree(pstrArray->pastrBuckets != NULL ? (void *) pstrArray->pastrBuckets :
+                                              (void *) pstrArray->pastrSlots,
+            &pstrArray->strMap);
+
+
+   memset(pstrArray, 0, sizeof(strHashArray));
+}
+
+
+
+
+/********************************************************************************
+ * Function: FreeHashTable
+ * Params:   pstrHash - hash table to release
+ * Returns:  None
+ * Call by:  main()
+ * Call to:  CloseJournal()
+ *           CloseTrace()
+ *           FreeEntryStorage()
+ * Overview: Closes the journal and the trace, frees the arrays, node slabs and
+ *           arena blocks, the filter, unmaps the snapshot, then frees the table
+ *           itself.
+ * Notes:    pstrHash may be NULL.
+ ********************************************************************************/
+void FreeHashTable(strHash *pstrHash)
+{
+   if (pstrHash == NULL)
+   {
+      return;
+   }
+
+   CloseJournal(pstrHash);
+   CloseTrace(pstrHash);
+   FreeEntryStorage(pstrHash);
+   free(pstrHash->strFilter.puchCounters);
+
+   if (pstrHash->strSnap.puchMap != NULL)
+   {
+      munmap(pstrHash->strSnap.puchMap, pstrHash->strSnap.nSize);
+   }
+
+
+   free(pstrHash);
+}
+
+
+
+
+/********************************************************************************
+ * Function: FreeOpenSlot
+ * Params:   pstrArray - open addressing array
+ *           ulHash - HashKey() of the data to store
+ * Returns:  Index of the first empty or deleted slot along the probe sequence
+ * Call by:  AddEntryToOpenTable()
+ *           MigrateHashTable()
+ * Call to:  MatchGroup()
+ * Overview: Follows the same group order as FindOpenSlot().
+ * Notes:    The maximum load guarantees a free slot exists.
+ ********************************************************************************/
+static int FreeOpenSlot(const strHashArray *pstrArray, unsigned long ulHash)
+{
+   int           nGroups = pstrArray->nSize / HASH_GROUP;
+   int           nGroup  = (int) ((ulHash >> 7) & (unsigned long) (nGroups-1));
+   int           nProbe  = 0;
+   unsigned int  nFree   = 0;
+
+
+
+   for (nProbe=0; nProbe<nGroups; nProbe++)
+   {
+      nFree = MatchGroup(&pstrArray->pachControl[nGroup*HASH_GROUP], HASH_CTRL_EMPTY) |
+              MatchGroup(&pstrArray->pachControl[nGroup*HASH_GROUP], HASH_CTRL_DELETED);
+
+      if (nFree != 0)
+      {
+         return(nGroup*HASH_GROUP + __builtin_ctz(nFree));
+      }
+
+      nGroup = (nGroup + nProbe + 1) & (nGroups-1);
+   }
+
+
+   return(-1);
+}
+
+
+
+
+/********************************************************************************
+ * Function: FreeRetired
+ * Params:   pstrRetired - retired node or array
+ * Returns:  None
+ * Call by:  FreeConcurrentTable()
+ *           ReclaimMemory()
+ *           ResizeConcurrentTable()
+ * Call to:  None
+ * Overview: Frees a node, or an array with every node still linked in it.
+ * Notes:    A resize copies the nodes into the new array, so the nodes of an
+ *           old array belong to it alone.
+ ********************************************************************************/
+static void FreeRetired(strRetired *pstrRetired)
+{
+   unsigned long       ulBucket    = 0;
+   strConcurrentArray *pstrArray   = NULL;
+   strConcurrentNode  *pstrCurrent = NULL;
+   strConcurrentNode  *pstrNext    = NULL;
+
+
+
+   if (pstrRetired->bArray == TRUE)
+   {
+      pstrArray = (strConcurrentArray *) pstrRetired->pMemory;
+
+      for (ulBucket=0; ulBucket<pstrArray->ulSize; ulBucket++)
+      {
+         for (pstrCurrent = pstrArray->apstrBuckets[ulBucket];
+              pstrCurrent != NULL;
+              pstrCurrent = pstrNext)
+         {
+            pstrNext = pstrCurrent->pstrNext;
+            free(pstrCurrent);
+         }
+      }
+   }
+
+
+   free(pstrRetired->pMemory);
+}
+
+
+
+
+/********************************************************************************
+ * Function: FreezeHashTable
+ * Params:   pstrHash - hash table
+ * Returns:  >=0 - table frozen, bytes of its frozen snapshot
+ *           <0 - cannot allocate memory, or no perfect hash was found; the
+ *                table is not changed
+ * Call by:  FreezeTable()
+ * Call to:  AllocateHashArray()
+ *           BuildPerfectHash()
+ *           FreeEntryStorage()
+ *           HashWy()
+ *           HashWyMix()
+ *           ImportSnapshot()
+ *           KeyOfEntry()
+ *           NextHashEntry()
+ *           PerfectBucket()
+ *           PerfectSlot()
+ *           SnapshotRecordSize()
+ *           SnapshotRecordStart()
+ *           ValueOfEntry()
+ * Overview: Turns the table into a frozen snapshot held in memory: the keys
+ *           and values stored next to each other in slot order, and a minimal
+ *           perfect hash giving each key a slot of its own.  A search then
+ *           reads the pilot of the key's bucket, the offset of its slot and the
+ *           one record there: no chain to walk, no empty slot, and only one key
+ *           compared.  The buckets, chain nodes and key arena are released.
+ * Notes:    The snapshot is read only, like one mapped by LoadSnapshot(), so
+ *           the first add or delete copies the keys back into buckets.
+ *           SaveSnapshot() writes the frozen snapshot as it is, and
+ *           LoadSnapshot() maps it back, so a table can be frozen once and
+ *           then served from the file.  A snapshot mapped from a file is copied
+ *           into the table first, unless it is already frozen.  TTLs are not
+ *           kept, as in any snapshot.
+ ********************************************************************************/
+long FreezeHashTable(strHash *pstrHash)
+{
+   int                 nTry        = 0;
+   int                 nReturnCode = 1;
+   unsigned long       ulKeys      = 0;
+   unsigned long       ulKey       = 0;
+   unsigned long       ulSlots     = 0;
+   unsigned long       ulSlot      = 0;
+   unsigned long       ulPilots    = 0;
+   unsigned long       ulSeed      = 0;
+   unsigned long       ulOffset    = 0;
+   unsigned long       ulRecords   = 0;
+   unsigned long       ulMapSize   = 0;
+   unsigned long      *aulHash     = NULL;
+   unsigned long      *aulBuckets  = NULL;
+   unsigned int       *anPilots    = NULL;
+   unsigned char      *puchMap     = NULL;
+   const strHashKey  **apstrKeys   = NULL;
+   const strHashKey   *pstrKey     = NULL;
+   strSnapshotHeader  *pstrHeader  = NULL;
+   strSnapshotRecord  *pstrRecord  = NULL;
+   strSnapshotHeader   strHeader;
+   strHashArray        strNewArray;
+   strHashCursor       strCursor;
+
+
+
+   if (pstrHash->strSnap.puchMap != NULL && pstrHash->strSnap.pstrHeader->ulPilots != 0)
+   {
+      return((long) pstrHash->strSnap.nSize);
+   }
+
+   if (pstrHash->strSnap.puchMap != NULL && ImportSnapshot(pstrHash) != 0)
+   {
+      return(-1);
+   }
+
+   ulSlots  = pstrHash->lnEntries > 0 ? (unsigned long) pstrHash->lnEntries : 1;
+   ulPilots = (ulSlots + HASH_FREEZE_BUCKET - 1) / HASH_FREEZE_BUCKET;
+
+   if ((aulHash   = (unsigned long *) malloc(ulSlots * sizeof(unsigned long))) == NULL ||
+       (apstrKeys = (const strHashKey **) malloc(ulSlots * sizeof(strHashKey *))) == NULL ||
+       (anPilots  = (unsigned int *) malloc(ulPilots * sizeof(unsigned int))) == NULL)
+   {
+      fprintf(stderr, "Failed malloc() in FreezeHashTable(). errno=%d.\n", errno);
+      free(aulHash);
+      free(apstrKeys);
+      return(-1);
+   }
+
+
+   /****************************************************************************
+    * Only the stored hashes are needed to build the perfect hash.
+    ****************************************************************************/
+   memset(&strCursor, 0, sizeof(strCursor));
+
+   while (ulKeys < ulSlots && (pstrKey = NextHashEntry(pstrHash, &strCursor)) != NULL)
+   {
+      apstrKeys[ulKeys] = pstrKey;
+      aulHash[ulKeys]   = pstrKey->ulHash;
+      ulRecords        += SnapshotRecordSize(pstrKey->nLength, pstrKey->nValueLength);
+      ulKeys++;
+   }
+
+   for (nTry=0; nTry<HASH_FREEZE_TRIES && nReturnCode > 0; nTry++)
+   {
+      ulSeed      = HashWyMix(pstrHash->aulSeed[1] + nTry, 0x9e3779b97f4a7c15UL);
+      nReturnCode = BuildPerfectHash(aulHash, ulKeys, ulSeed, ulPilots, ulSlots, anPilots);
+   }
+
+   if (nReturnCode > 0)
+   {
+      fprintf(stderr, "No perfect hash found for %lu keys after %d seeds.\n", ulKeys, nTry);
+   }
+
+
+   /****************************************************************************
+    * The map starts zeroed, so padding and the slot left empty by an empty
+    * table need no writes.
+    ****************************************************************************/
+   memset(&strHeader, 0, sizeof(strHeader));
+   strHeader.ulBuckets = ulSlots;
+   strHeader.ulPilots  = ulPilots;
+
+   ulMapSize = SnapshotRecordStart(&strHeader) + ulRecords;
+
+   if (nReturnCode == 0 &&
+       (puchMap = (unsigned char *) mmap(NULL, ulMapSize, PROT_READ | PROT_WRITE,
+                                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+   {
+      fprintf(stderr, "Failed mmap() in FreezeHashTable(). errno=%d.\n", errno);
+      nReturnCode = -1;
+   }
+
+   if (nReturnCode == 0 &&
+       AllocateHashArray(&strNewArray, &pstrHash->strPages, pstrHash->nEngine,
+                         pstrHash->nMinSize) != 0)
+   {
+      munmap(puchMap, ulMapSize);
+      nReturnCode = -1;
+   }
+
+   if (nReturnCode != 0)
+   {
+      free(aulHash);
+      free(apstrKeys);
+      free(anPilots);
+      return(-1);
+   }
+
+
+   pstrHeader = (strSnapshotHeader *) puchMap;
+   aulBuckets = (unsigned long *) (puchMap + sizeof(strSnapshotHeader));
+
+   memcpy(pstrHeader->achMagic, HASH_SNAPSHOT_MAGIC, sizeof(pstrHeader->achMagic));
+   pstrHeader->nVersion    = HASH_SNAPSHOT_VERSION;
+   pstrHeader->nHash       = pstrHash->nHash;
+   pstrHeader->aulSeed[0]  = pstrHash->aulSeed[0];
+   pstrHeader->aulSeed[1]  = pstrHash->aulSeed[1];
+   pstrHeader->ulBuckets   = ulSlots;
+   pstrHeader->ulEntries   = ulKeys;
+   pstrHeader->ulFileSize  = ulMapSize;
+   pstrHeader->ulPilots    = ulPilots;
+   pstrHeader->ulPilotSeed = ulSeed;
+
+   memcpy(aulBuckets + ulSlots, anPilots, ulPilots * sizeof(unsigned int));
+
+
+   /****************************************************************************
+    * Note the key of each slot, then write the records in slot order, so a
+    * listing reads the map from start to end.
+    ****************************************************************************/
+   for (ulKey=0; ulKey<ulKeys; ulKey++)
+   {
+      ulSlot = PerfectSlot(aulHash[ulKey], ulSeed,
+                           anPilots[PerfectBucket(aulHash[ulKey], ulSeed, ulPilots)], ulSlots);
+      aulBuckets[ulSlot] = ulKey + 1;
+   }
+
+   ulOffset = SnapshotRecordStart(pstrHeader);
+
+   for (ulSlot=0; ulSlot<ulSlots; ulSlot++)
+   {
+      if (aulBuckets[ulSlot] == 0)
+      {
+         continue;
+      }
+
+      pstrKey    = apstrKeys[aulBuckets[ulSlot] - 1];
+      pstrRecord = (strSnapshotRecord *) (puchMap + ulOffset);
+
+      pstrRecord->ulHash       = pstrKey->ulHash;
+      pstrRecord->nLength      = pstrKey->nLength;
+      pstrRecord->nValueLength = pstrKey->nValueLength;
+      memcpy(pstrRecord->achKey, KeyOfEntry(pstrKey), pstrKey->nLength + 1);
+      memcpy(pstrRecord->achKey + pstrKey->nLength + 1, ValueOfEntry(pstrKey),
+             pstrKey->nValueLength);
+
+      aulBuckets[ulSlot]  = ulOffset;
+      ulOffset           += SnapshotRecordSize(pstrKey->nLength, pstrKey->nValueLength);
+   }
+
+   pstrHeader->ulChecksum = HashWy((const char *) puchMap + sizeof(strSnapshotHeader),
+                                   ulMapSize - sizeof(strSnapshotHeader), 0);
+
+   mprotect(puchMap, ulMapSize, PROT_READ);
+
+   free(aulHash);
+   free(apstrKeys);
+   free(anPilots);
+
+
+   /****************************************************************************
+    * Every key is in the snapshot now.  The filter counts the keys again as
+    * they are copied back, so it starts empty.
+    ****************************************************************************/
+   FreeEntryStorage(pstrHash);
+
+   pstrHash->strArray       = strNewArray;
+   pstrHash->lnEntries      = (long) ulKeys;
+   pstrHash->strCache.nHand = 0;
+
+   if (pstrHash->strFilter.puchCounters != NULL)
+   {
+      memset(pstrHash->strFilter.puchCounters, 0,
+             pstrHash->strFilter.ulBlocks * HASH_CACHE_LINE);
+   }
+
+   pstrHash->strSnap.puchMap    = puchMap;
+   pstrHash->strSnap.nSize      = ulMapSize;
+   pstrHash->strSnap.pstrHeader = pstrHeader;
+   pstrHash->strSnap.aulBuckets = aulBuckets;
+   pstrHash->strSnap.anPilots   = (const unsigned int *) (aulBuckets + ulSlots);
+
+   Debug("Froze %lu entries into %lu slots and %lu pilots, seed %lx\n",
+         ulKeys, ulSlots, ulPilots, ulSeed);
+
+
+   return((long) ulMapSize);
+}
+
+
+
+
+/********************************************************************************
+ * Function: GetConcurrentInfo
+ * Params:   pstrConc - concurrent hash table
+ *           pstrInfo - filled with the state of the table
+ * Returns:  None
+ * Call by:  RunConcurrentBenchmark()
+ *           RunConcurrentPhase()
+ * Call to:  None
+ * Overview: Reports the size of the table and the keys stored in it.
+ * Notes:    Stripes are read without their locks, so while threads are changing
+ *           the table the count is only a close estimate.
+ ********************************************************************************/
+void GetConcurrentInfo(const strConcurrentHash *pstrConc, strHashInfo *pstrInfo)
+{
+   int                       nIndex    = 0;
+   const strConcurrentArray *pstrArray = NULL;
+
+
+
+   memset(pstrInfo, 0, sizeof(strHashInfo));
+
+   pstrArray = __atomic_load_n(&pstrConc->pstrArray, __ATOMIC_ACQUIRE);
+
+   pstrInfo->nEngine    = ENGINE_CHAIN;
+   pstrInfo->nHash      = pstrConc->nHash;
+   pstrInfo->aulSeed[0] = pstrConc->aulSeed[0];
+   pstrInfo->aulSeed[1] = pstrConc->aulSeed[1];
+   pstrInfo->lnSize     = (long) pstrArray->ulSize;
+   pstrInfo->lnMinSize  = HASH_LOCK_STRIPES;
+   pstrInfo->lnResizes  = __atomic_load_n(&pstrConc->lnResizes, __ATOMIC_RELAXED);
+
+   for (nIndex=0; nIndex<HASH_LOCK_STRIPES; nIndex++)
+   {
+      pstrInfo->lnEntries += __atomic_load_n(&pstrConc->astrStripes[nIndex].lnEntries,
+                                             __ATOMIC_RELAXED);
+   }
+}
+
+
+
+
+/********************************************************************************
+ * Function: GetHashInfo
+ * Params:   pstrHash - hash table
+ *           pstrInfo - filled with the state of the table
+ * Returns:  None
+ * Call by:  main()
+ *           OpenJournal()
+ *           RunBatch()
+ *           RunBenchmark()
+ *           RunConcurrentBenchmark()
+ *           RunReplay()
+ *           RunServer()
+ *           RunShared()
+ *           StatsHashTable()
+ * Call to:  PageUsage()
+ * Overview: Reports the engine, hash function and size of the table, so a
+ *           program can describe a table without seeing inside strHash.
+ * Notes:    While a snapshot is mapped, lnSize is the number of buckets of the
+ *           snapshot, or of slots of a frozen one.  The page counts walk the
+ *           storage of the table.
+ ********************************************************************************/
+void GetHashInfo(const strHash *pstrHash, strHashInfo *pstrInfo)
+{
+   memset(pstrInfo, 0, sizeof(strHashInfo));
+
+   pstrInfo->nEngine    = pstrHash->nEngine;
+   pstrInfo->nHash      = pstrHash->nHash;
+   pstrInfo->aulSeed[0] = pstrHash->aulSeed[0];
+   pstrInfo->aulSeed[1] = pstrHash->aulSeed[1];
+   pstrInfo->lnEntries  = pstrHash->lnEntries;
+   pstrInfo->lnSize     = pstrHash->strArray.nSize;
+   pstrInfo->lnMinSize  = pstrHash->nMinSize;
+   pstrInfo->lnResizes  = pstrHash->lnResizes;
+   pstrInfo->bResizing  = (pstrHash->strOldArray.nSize > 0) ? TRUE : FALSE;
+   pstrInfo->bSnapshot  = (pstrHash->strSnap.puchMap != NULL) ? TRUE : FALSE;
+   pstrInfo->bFrozen    = (pstrInfo->bSnapshot == TRUE &&
+                           pstrHash->strSnap.pstrHeader->ulPilots != 0) ? TRUE : FALSE;
+   pstrInfo->lnInserts  = pstrHash->strStats.lnInserts;
+   pstrInfo->lnUpdates  = pstrHash->strStats.lnUpdates;
+   pstrInfo->lnHits     = pstrHash->strStats.lnHits;
+   pstrInfo->lnMisses   = pstrHash->strStats.lnMisses;
+   pstrInfo->lnDeletes  = pstrHash->strStats.lnDeletes;
+   pstrInfo->lnWalked   = pstrHash->strStats.lnWalked;
+   pstrInfo->lnFiltered = pstrHash->strStats.lnFiltered;
+   pstrInfo->lnFalse    = pstrHash->strStats.lnFalse;
+   pstrInfo->bFilter    = pstrHash->strFilter.puchCounters != NULL ? TRUE : FALSE;
+   pstrInfo->bCache     = pstrHash->strCache.bOn;
+   pstrInfo->lnEvicted  = pstrHash->strStats.lnEvicted;
+   pstrInfo->lnExpired  = pstrHash->strStats.lnExpired;
+   pstrInfo->bJournal   = pstrHash->strJournal.pchBuffer != NULL ? TRUE : FALSE;
+   pstrInfo->lnJournal  = pstrHash->strJournal.lnRecords;
+   pstrInfo->lnSyncs    = pstrHash->strJournal.lnSyncs;
+   pstrInfo->lnUnsynced = pstrHash->strJournal.lnPending;
+   pstrInfo->bTrace     = pstrHash->strTrace.pchBuffer != NULL ? TRUE : FALSE;
+   pstrInfo->lnTraced   = pstrHash->strTrace.lnRecords;
+   pstrInfo->nPages     = pstrHash->strPages.nPolicy;
+   pstrInfo->nNuma      = pstrHash->strPages.nNuma;
+   pstrInfo->nNode      = pstrHash->strPages.nNode;
+
+   if (pstrInfo->bSnapshot == TRUE)
+   {
+      pstrInfo->lnSize = (long) pstrHash->strSnap.pstrHeader->ulBuckets;
+   }
+
+   PageUsage(pstrHash, pstrInfo);
+}
+
+
+
+
+/********************************************************************************
+ * Function: GetSharedInfo
+ * Params:   pstrShared - shared hash table
+ *           pstrInfo - filled with the state of the table
+ * Returns:  None
+ * Call by:  RunBatch()
+ *           RunShared()
+ * Call to:  None
+ * Overview: Reports the size of the table and the keys stored in it by every
+ *           process, and the searches of this process.
+ * Notes:    Read without the lock, so while other processes are changing the
+ *           table the counts are only a close estimate.
+ ********************************************************************************/
+void GetSharedInfo(const strSharedHash *pstrShared, strHashInfo *pstrInfo)
+{
+   const strSharedHeader *pstrHeader = pstrShared->pstrHeader;
+
+
+
+   memset(pstrInfo, 0, sizeof(strHashInfo));
+
+   pstrInfo->nEngine     = ENGINE_CHAIN;
+   pstrInfo->nHash       = pstrHeader->nHash;
+   pstrInfo->aulSeed[0]  = pstrHeader->aulSeed[0];
+   pstrInfo->aulSeed[1]  = pstrHeader->aulSeed[1];
+   pstrInfo->lnSize      = (long) pstrHeader->ulBuckets;
+   pstrInfo->lnMinSize   = (long) pstrHeader->ulBuckets;
+   pstrInfo->lnCapacity  = (long) pstrHeader->nCapacity;
+   pstrInfo->lnEntries   = __atomic_load_n(&pstrHeader->lnEntries, __ATOMIC_RELAXED);
+   pstrInfo->lnInserts   = __atomic_load_n(&pstrHeader->lnInserts, __ATOMIC_RELAXED);
+   pstrInfo->lnDeletes   = __atomic_load_n(&pstrHeader->lnDeletes, __ATOMIC_RELAXED);
+   pstrInfo->lnRecovered = __atomic_load_n(&pstrHeader->lnRecovered, __ATOMIC_RELAXED);
+   pstrInfo->lnHits      = pstrShared->lnHits;
+   pstrInfo->lnMisses    = pstrShared->lnMisses;
+   pstrInfo->lnWalked    = pstrShared->lnWalked;
+}
+
+
+
+
+/********************************************************************************
+ * Function: GetValueFromHashTable
+ * Params:   pstrHash - hash table
+ *           pszData - data to search for
+ *           pnChain - receives the position in the chain, or the number of
+ *                     group probes with open addressing; may be NULL
+ *           ppchValue - receives the value stored with the data, NULL when
+ *                       not found
+ *           pnValueLength - receives the bytes of the value, 0 when not found
+ * Returns:  -1 - not found
+ *           >=0 - bucket index where found
+ * Call by:  main()
+ *           ServerCommand()
+ *           ProcessBatchLine()
+ * Call to:  AppendTrace()
+ *           HashKey()
+ *           SearchHashedEntry()
+ * Overview: Searches like SearchHashTable(), and gives a view of the stored
+ *           value instead of a copy: *ppchValue points into the entry, the key
+ *           arena or the mapped snapshot.
+ * Notes:    The value has no terminator.  The view is only valid until the
+ *           table is next changed; in cache mode, a search can change it too.
+ ********************************************************************************/
+int GetValueFromHashTable(strHash *pstrHash, const char *pszData, int *pnChain,
+                          const char **ppchValue, size_t *pnValueLength)
+{
+   size_t nLength = strlen(pszData);
+
+
+
+   Debug("Inside GetValueFromHashTable()\n");
+
+   AppendTrace(pstrHash, TRACE_SEARCH, pszData, NULL, 0);
+
+   *ppchValue     = NULL;
+   *pnValueLength = 0;
+
+
+   return(SearchHashedEntry(pstrHash, pszData, nLength, HashKey(pstrHash, pszData, nLength),
+                            pnChain, ppchValue, pnValueLength));
+}
+
+
+
+
+/********************************************************************************
+ * Function: HashBytes
+ * Params:   nHash - hash function
+ *           aulSeed - key for siphash
+ *           pszData - bytes to hash
+ *           nLength - number of bytes
+ * Returns:  Hash value of the bytes
+ * Call by:  AddEntryToConcurrentTable()
+ *           AddEntryToSharedTable()
+ *           DeleteEntryFromConcurrentTable()
+ *           DeleteEntryFromSharedTable()
+ *           HashKey()
+ *           HashKeys()
+ *           ReportHashDistribution()
+ *           RunKernelBenchmark()
+ *           SearchConcurrentTable()
+ *           SearchSharedTable()
+ * Call to:  HashFnv1a()
+ *           HashSip()
+ *           HashSum()
+ *           HashWy()
+ * Overview: Runs the hash function chosen by --hash.
+ * Notes:    Does not need a table, so tables of other kinds can share it.
+ ********************************************************************************/
+unsigned long HashBytes(hashfn nHash, const unsigned long *aulSeed, const char *pszData,
+                        size_t nLength)
+{
+   switch (nHash)
+   {
+      case HASHFN_SUM:
+         return(HashSum(pszData, nLength));
+
+      case HASHFN_FNV1A:
+         return(HashFnv1a(pszData, nLength));
+
+      case HASHFN_SIPHASH:
+         return(HashSip(pszData, nLength, aulSeed));
+
+      case HASHFN_WYHASH:
+      default:
+         return(HashWy(pszData, nLength, 0));
+   }
+}
+
+
+
+
+/********************************************************************************
+ * Function: HashFnv1a
+ * Params:   pszData - bytes to hash
+ *           nLength - number of bytes
+ * Returns:  64 bit FNV-1a hash of the bytes
+ * Call by:  HashBytes()
+ * Call to:  None
+ * Overview: XOR each byte into the hash, then multiply by the FNV prime.
+ * Notes:    Simple and good for short keys, but one multiply per byte.
+ ********************************************************************************/
+static unsigned long HashFnv1a(const char *pszData, size_t nLength)
+{
+   size_t        nIndex = 0;
+   unsigned long ulHash = 14695981039346656037UL;
+
+
+
+   for (nIndex=0; nIndex<nLength; nIndex++)
+   {
+      ulHash ^= (unsigned char) pszData[nIndex];
+      ulHash *= 1099511628211UL;
+   }
+
+
+   return(ulHash);
+}
+
+
+
+
+/********************************************************************************
+ * Function: HashFnv1aLanes
+ * Params:   apszData - HASH_HASH_LANES strings to hash
+ *           anLength - strlen() of each string
+ *           aulHash - receives the FNV-1a hash of each string
+ * Returns:  None
+ * Call by:  HashKeys()
+ * Call to:  None
+ * Overview: Runs HashFnv1a() on several strings at once.  Byte N of every
+ *           string is mixed in before byte N+1 of any, so the multiplies of
+ *           different strings are in flight together instead of each waiting
+ *           for the one before it.  Past the end of the shortest string, the
+ *           others are finished one at a time.
+ * Notes:    Gives the same hashes as HashFnv1a().
+ ********************************************************************************/
+static void HashFnv1aLanes(const char * const *apszData, const size_t *anLength,
+                           unsigned long *aulHash)
+{
+   int           nLane   = 0;
+   size_t        nIndex  = 0;
+   size_t        nCommon = anLength[0];
+   unsigned long aulLane[HASH_HASH_LANES];
+
+
+
+   for (nLane=0; nLane<HASH_HASH_LANES; nLane++)
+   {
+      aulLane[nLane] = 14695981039346656037UL;
+
+      if (anLength[nLane] < nCommon)
+      {
+         nCommon = anLength[nLane];
+      }
+   }
+
+
+   for (nIndex=0; nIndex<nCommon; nIndex++)
+   {
+      for (nLane=0; nLane<HASH_HASH_LANES; nLane++)
+      {
+         aulLane[nLane] ^= (unsigned char) apszData[nLane][nIndex];
+         aulLane[nLane] *= 1099511628211UL;
+      }
+   }
+
+   for (nLane=0; nLane<HASH_HASH_LANES; nLane++)
+   {
+      for (nIndex=nCommon; nIndex<anLength[nLane]; nIndex++)
+      {
+         aulLane[nLane] ^= (unsigned char) apszData[nLane][nIndex];
+         aulLane[nLane] *= 1099511628211UL;
+      }
+
+      aulHash[nLane] = aulLane[nLane];
+   }
+}
+
+
+
+
+/********************************************************************************
+ * Function: HashKey
+ * Params:   pstrHash - hash table, selects the hash function and seed
+ *           pszData - string to hash
+ *           nLength - strlen() of pszData
+ * Returns:  Hash value of the string
+ * Call by:  AddExpiringEntry()
+ *           DeleteEntryFromHashTable()
+ *           DeleteEntryFromOpenTable()
+ *           GetValueFromHashTable()
+ *           PutEntryInHashTable()
+ *           SearchHashTable()
+ * Call to:  HashBytes()
+ * Overview: Hashes the string with the function chosen by --hash.
+ * Notes:    Chained tables take the hash modulo the number of buckets.  The
+ *           open addressing engine uses the low 7 bits as the control byte and
+ *           the remaining bits to pick the first group to probe.
+ ********************************************************************************/
+static unsigned long HashKey(const strHash *pstrHash, const char *pszData, size_t nLength)
+{
+   Debug("Inside HashKey()\n");
+
+
+   return(HashBytes(pstrHash->nHash, pstrHash->aulSeed, pszData, nLength));
+}
+
+
+
+
+/********************************************************************************
+ * Function: HashKeys
+ * Params:   nHash - hash function
+ *           aulSeed - key for siphash
+ *           apszData - strings to hash
+ *           nCount - number of strings in apszData
+ *           aulHash - receives the hash of each string
+ *           anLength - receives the strlen() of each string
+ * Returns:  None
+ * Call by:  AddEntriesToHashTable()
+ *           BuildHashThread()
+ *           RunKernelBenchmark()
+ *           SearchEntriesInHashTable()
+ * Call to:  HashBytes()
+ *           HashFnv1aLanes()
+ * Overview: Hashes a batch of strings, as HashBytes() would one at a time.
+ *           The lengths are measured once, up front, and serve both the hash
+ *           and the length checks of the key compares that follow.  FNV-1a
+ *           runs HASH_HASH_LANES strings side by side, since one string alone
+ *           is a chain of dependent multiplies that leaves the multiplier idle
+ *           most of the time.
+ * Notes:    wyhash and siphash mix 8 bytes or more per step, and the processor
+ *           already overlaps the work of consecutive strings, so they are run
+ *           one string at a time.
+ ********************************************************************************/
+void HashKeys(hashfn nHash, const unsigned long *aulSeed, const char **apszData, int nCount,
+              unsigned long *aulHash, size_t *anLength)
+{
+   int nIndex = 0;
+   int nFirst = 0;
+
+
+
+   for (nIndex=0; nIndex<nCount; nIndex++)
+   {
+      anLength[nIndex] = strlen(apszData[nIndex]);
+   }
+
+   if (nHash == HASHFN_FNV1A)
+   {
+      for (; nFirst + HASH_HASH_LANES <= nCount; nFirst += HASH_HASH_LANES)
+      {
+         HashFnv1aLanes(&apszData[nFirst], &anLength[nFirst], &aulHash[nFirst]);
+      }
+   }
+
+   for (nIndex=nFirst; nIndex<nCount; nIndex++)
+   {
+      aulHash[nIndex] = HashBytes(nHash, aulSeed, apszData[nIndex], anLength[nIndex]);
+   }
+}
+
+
+
+
+/********************************************************************************
+ * Function: HashName
+ * Params:   nHash - hash function
+ * Returns:  Name of the hash function as given to --hash
+ * Call by:  MemoryHashTable()
+ *           ProcessCommandLine()
+ *           ReportHashDistribution()
+ *           RunKernelBenchmark()
+ *           RunReplay()
+ *           RunShared()
+ * Call to:  None
+ * Overview: Maps a hash function to its command line name.
+ * Notes:    Returns NULL past the last hash function, so callers can loop over
+ *           all of them.
+ ********************************************************************************/
+const char *HashName(hashfn nHash)
+{
+   switch (nHash)
+   {
+      case HASHFN_SUM:     return("sum");
+      case HASHFN_FNV1A:   return("fnv1a");
+      case HASHFN_WYHASH:  return("wyhash");
+      case HASHFN_SIPHASH: return("siphash");
+      default:             return(NULL);
+   }
+}
+
+
+
+
+/********************************************************************************
+ * Function: HashSip
+ * Params:   pszData - bytes to hash
+ *           nLength - number of bytes
+ *           aulKey - 128 bit secret key
+ * Returns:  64 bit SipHash-1-3 of the bytes
+ * Call by:  HashBytes()
+ * Call to:  None
+ * Overview: Keyed hash.  Without the key, an attacker cannot pick keys that all
+ *           land in one bucket, which protects the chains from flooding.
+ * Notes:    One compression round per 8 bytes and three finalization rounds.
+ ********************************************************************************/
+#define SIP_ROTL(x, b)  (((x) << (b)) | ((x) >> (64 - (b))))
+#define SIP_ROUND(v0, v1, v2, v3)                                      \
+   do {                                                                \
+      v0 += v1; v1 = SIP_ROTL(v1, 13); v1 ^= v0; v0 = SIP_ROTL(v0, 32); \
+      v2 += v3; v3 = SIP_ROTL(v3, 16); v3 ^= v2;                       \
+      v0 += v3; v3 = SIP_ROTL(v3, 21); v3 ^= v0;                       \
+      v2 += v1; v1 = SIP_ROTL(v1, 17); v1 ^= v2; v2 = SIP_ROTL(v2, 32); \
+   } while (0)
+
+static unsigned long HashSip(const char *pszData, size_t nLength, const unsigned long *aulKey)
+{
+   size_t        nIndex = 0;
+   unsigned long ulWord = 0;
+   unsigned long ulV0   = aulKey[0] ^ 0x736f6d6570736575UL;
+   unsigned long ulV1   = aulKey[1] ^ 0x646f72616e646f6dUL;
+   unsigned long ulV2   = aulKey[0] ^ 0x6c7967656e657261UL;
+   unsigned long ulV3   = aulKey[1] ^ 0x7465646279746573UL;
+
+
+
+   for (nIndex=0; nIndex+8 <= nLength; nIndex+=8)
+   {
+      memcpy(&ulWord, pszData+nIndex, 8);
+
+      ulV3 ^= ulWord;
+      SIP_ROUND(ulV0, ulV1, ulV2, ulV3);
+      ulV0 ^= ulWord;
+   }
+
+
+   /****************************************************************************
+    * The last 0 to 7 bytes go into the low bytes, the length into the top byte.
+    ****************************************************************************/
+   ulWord = (unsigned long) nLength << 56;
+
+   for (; nIndex<nLength; nIndex++)
+   {
+      ulWord |= (unsigned long) (unsigned char) pszData[nIndex] << (8 * (nIndex & 7));
+   }
+
+   ulV3 ^= ulWord;
+   SIP_ROUND(ulV0, ulV1, ulV2, ulV3);
+   ulV0 ^= ulWord;
+
+   ulV2 ^= 0xff;
+   SIP_ROUND(ulV0, ulV1, ulV2, ulV3);
+   SIP_ROUND(ulV0, ulV1, ulV2, ulV3);
+   SIP_ROUND(ulV0, ulV1, ulV2, ulV3);
+
+
+   return(ulV0 ^ ulV1 ^ ulV2 ^ ulV3);
+}
+
+
+
+
+/********************************************************************************
+ * Function: HashSum
+ * Params:   pszData - bytes to hash
+ *           nLength - number of bytes
+ * Returns:  Sum of the bytes
+ * Call by:  HashBytes()
+ * Call to:  None
+ * Overview: Adds up each character in a string.
+ * Notes:    The original hash of this program, kept for comparison.  Anagrams
+ *           always collide, and short keys only use a narrow range of values.
+ ********************************************************************************/
+static unsigned long HashSum(const char *pszData, size_t nLength)
+{
+   size_t        nIndex = 0;
+   unsigned long ulSum  = 0;
+
+
+
+   for (nIndex=0; nIndex<nLength; nIndex++)
+   {
+      ulSum = ulSum + pszData[nIndex];
+   }
+
+
+   return(ulSum);
+}
+
+
+
+
+/********************************************************************************
+ * Function: HashU64
+ * Params:   ulKey - 64 bit key of a U64 table
+ *           ulSeed - seed of the table
+ * Returns:  64 bit hash of the key
+ * Call by:  DeleteU64Entry()
+ *           GrowU64Table()
+ *           PutU64Entry()
+ *           SearchU64Table()
+ * Call to:  HashWyMix()
+ * Overview: One multiply-fold of the key with the seed, the last step of
+ *           HashWy() without reading any bytes.
+ * Notes:    Only one key hashes to 0 for a given seed.
+ ********************************************************************************/
+static unsigned long HashU64(unsigned long ulKey, unsigned long ulSeed)
+{
+   return(HashWyMix(ulKey ^ 0xa0761d6478bd642fUL, ulSeed ^ 0xe7037ed1a0b428dbUL));
+}
+
+
+
+
+/********************************************************************************
+ * Function: HashUuid
+ * Params:   strKey - 16 byte key of a Uuid table
+ *           ulSeed - seed of the table
+ * Returns:  64 bit hash of the key
+ * Call by:  DeleteUuidEntry()
+ *           GrowUuidTable()
+ *           PutUuidEntry()
+ *           SearchUuidTable()
+ * Call to:  HashWyMix()
+ * Overview: Hashes the two words like HashWy() hashes a 16 byte key: one
+ *           multiply-fold of both words, then one with the length.
+ * Notes:    None
+ ********************************************************************************/
+static unsigned long HashUuid(strUuid strKey, unsigned long ulSeed)
+{
+   const unsigned long  ulS1 = 0xe7037ed1a0b428dbUL;
+
+
+
+   return(HashWyMix(ulS1 ^ sizeof(strUuid),
+                    HashWyMix(strKey.aulWord[0] ^ ulS1, strKey.aulWord[1] ^ ulSeed)));
+}
+
+
+
+
+/********************************************************************************
+ * Function: HashWy
+ * Params:   pszData - bytes to hash
+ *           nLength - number of bytes
+ *           ulSeed - seed, 0 unless a different hash family is wanted
+ * Returns:  64 bit hash of the bytes
+ * Call by:  AppendJournal()
+ *           FreezeHashTable()
+ *           HashBytes()
+ *           LoadSnapshot()
+ *           ReplayJournal()
+ *           SaveSnapshot()
+ * Call to:  HashWyMix()
+ * Overview: wyhash style hash.  Reads the key 8 or 16 bytes at a time and folds
+ *           them in with 64x64 to 128 bit multiplies, so short keys cost only a
+ *           couple of multiplies.
+ * Notes:    Keys of 4 to 16 bytes are read as two overlapping halves, so no
+ *           byte loop is needed.
+ ********************************************************************************/
+static unsigned long HashWy(const char *pszData, size_t nLength, unsigned long ulSeed)
+{
+   const unsigned char *puchData = (const unsigned char *) pszData;
+   const unsigned long  ulS0     = 0xa0761d6478bd642fUL;
+   const unsigned long  ulS1     = 0xe7037ed1a0b428dbUL;
+   const unsigned long  ulS2     = 0x8ebc6af09c88c6e3UL;
+   const unsigned long  ulS3     = 0x589965cc75374cc3UL;
+   unsigned long        ulA      = 0;
+   unsigned long        ulB      = 0;
+   unsigned long        ulSee1   = 0;
+   unsigned long        ulSee2   = 0;
+   unsigned int         nLow     = 0;
+   unsigned int         nHigh    = 0;
+   size_t               nLeft    = nLength;
+
+
+
+   ulSeed ^= HashWyMix(ulSeed ^ ulS0, ulS1);
+
+
+   if (nLength <= 16)
+   {
+      if (nLength >= 4)
+      {
+         memcpy(&nHigh, puchData, 4);
+         memcpy(&nLow, puchData + ((nLength >> 3) << 2), 4);
+         ulA = ((unsigned long) nHigh << 32) | nLow;
+
+         memcpy(&nHigh, puchData + nLength - 4, 4);
+         memcpy(&nLow, puchData + nLength - 4 - ((nLength >> 3) << 2), 4);
+         ulB = ((unsigned long) nHigh << 32) | nLow;
+      }
+      else if (nLength > 0)
+      {
+         ulA = ((unsigned long) puchData[0] << 16) |
+               ((unsigned long) puchData[nLength >> 1] << 8) |
+               puchData[nLength - 1];
+      }
+   }
+   else
+   {
+      if (nLeft > 48)
+      {
+         ulSee1 = ulSeed;
+         ulSee2 = ulSeed;
+
+         do
+         {
+            memcpy(&ulA, puchData, 8);
+            memcpy(&ulB, puchData + 8, 8);
+            ulSeed = HashWyMix(ulA ^ ulS1, ulB ^ ulSeed);
+
+            memcpy(&ulA, puchData + 16, 8);
+            memcpy(&ulB, puchData + 24, 8);
+            ulSee1 = HashWyMix(ulA ^ ulS2, ulB ^ ulSee1);
+
+            memcpy(&ulA, puchData + 32, 8);
+            memcpy(&ulB, puchData + 40, 8);
+            ulSee2 = HashWyMix(ulA ^ ulS3, ulB ^ ulSee2);
+
+            puchData += 48;
+            nLeft    -= 48;
+         } while (nLeft > 48);
+
+         ulSeed ^= ulSee1 ^ ulSee2;
+      }
+
+      while (nLeft > 16)
+      {
+         memcpy(&ulA, puchData, 8);
+         memcpy(&ulB, puchData + 8, 8);
+         ulSeed = HashWyMix(ulA ^ ulS1, ulB ^ ulSeed);
+
+         puchData += 16;
+         nLeft    -= 16;
+      }
+
+      memcpy(&ulA, puchData + nLeft - 16, 8);
+      memcpy(&ulB, puchData + nLeft - 8, 8);
+   }
+
+
+   return(HashWyMix(ulS1 ^ nLength, HashWyMix(ulA ^ ulS1, ulB ^ ulSeed)));
+}
+
+
+
+
+/********************************************************************************
+ * Function: HashWyMix
+ * Params:   ulA, ulB - values to mix
+ * Returns:  High and low halves of the 128 bit product, XORed together
+ * Call by:  FreezeHashTable()
+ *           HashU64()
+ *           HashUuid()
+ *           HashWy()
+ *           MixFilterHash()
+ * Call to:  None
+ * Overview: Multiply-fold step of HashWy().
+ * Notes:    Uses the compiler's 128 bit integer type.
+ ********************************************************************************/
+static unsigned long HashWyMix(unsigned long ulA, unsigned long ulB)
+{
+   unsigned __int128 ulProduct = (unsigned __int128) ulA * ulB;
+
+
+
+   return((unsigned long) ulProduct ^ (unsigned long) (ulProduct >> 64));
+}
+
+
+
+
+/********************************************************************************
+ * Function: HistogramHashTable
+ * Params:   pstrHash - hash table
+ *           alnLengths - HASH_STATS_LENGTHS counters, receives the histogram
+ *           plnUsed - receives the buckets holding a key, or the full slots
+ *           plnBuckets - receives the buckets, or slots, looked at
+ * Returns:  Longest chain, or most groups probed to reach a key
+ * Call by:  StatsHashTable()
+ * Call to:  SnapshotRecord()
+ * Overview: Chained tables and snapshots count the buckets by the number of
+ *           keys in their chain.  Open addressing counts the keys by the number
+ *           of groups a search probes to reach them.
+ * Notes:    While resizing, the buckets of the old array that are not migrated
+ *           yet are counted too.  Walks the whole table, so it is only meant
+ *           for reports, not for the hot path.
+ ********************************************************************************/
+static long HistogramHashTable(const strHash *pstrHash, long *alnLengths, long *plnUsed,
+                               long *plnBuckets)
+{
+   int                      nArray     = 0;
+   int                      nIndex     = 0;
+   int                      nGroups    = 0;
+   int                      nGroup     = 0;
+   long                     lnLength   = 0;
+   long                     lnMax      = 0;
+   unsigned long            ulBucket   = 0;
+   unsigned long            ulOffset   = 0;
+   const strHashArray      *pstrArray  = NULL;
+   const strHashTable      *pstrNode   = NULL;
+   const strSnapshot       *pstrSnap   = &pstrHash->strSnap;
+   const strSnapshotRecord *pstrRecord = NULL;
+
+
+
+   memset(alnLengths, 0, HASH_STATS_LENGTHS * sizeof(long));
+   *plnUsed    = 0;
+   *plnBuckets = 0;
+
+
+   /****************************************************************************
+    * A mapped snapshot holds every key, the arrays are empty.  A damaged chain
+    * is counted up to the damaged record.
+    ****************************************************************************/
+   if (pstrSnap->puchMap != NULL)
+   {
+      for (ulBucket=0; ulBucket<pstrSnap->pstrHeader->ulBuckets; ulBucket++)
+      {
+         ulOffset = pstrSnap->aulBuckets[ulBucket];
+
+         for (lnLength=0; ulOffset != 0; lnLength++)
+         {
+            if ((pstrRecord = SnapshotRecord(pstrSnap, ulOffset)) == NULL ||
+                lnLength >= (long) pstrSnap->pstrHeader->ulEntries)
+            {
+               break;
+            }
+
+            ulOffset = pstrRecord->ulNext;
+         }
+
+         alnLengths[lnLength < HASH_STATS_LENGTHS ? lnLength : HASH_STATS_LENGTHS-1]++;
+         *plnUsed += lnLength > 0;
+         lnMax     = lnLength > lnMax ? lnLength : lnMax;
+      }
+
+      *plnBuckets = (long) pstrSnap->pstrHeader->ulBuckets;
+
+      return(lnMax);
+   }
+
+
+   for (nArray=0; nArray<2; nArray++)
+   {
+      pstrArray = nArray == 0 ? &pstrHash->strArray : &pstrHash->strOldArray;
+      nIndex    = nArray == 0 ? 0 : pstrHash->nMigrated;
+      nGroups   = pstrArray->nSize / HASH_GROUP;
+
+      for (; nIndex<pstrArray->nSize; nIndex++)
+      {
+         (*plnBuckets)++;
+
+         if (pstrHash->nEngine == ENGINE_OPEN)
+         {
+            if ((pstrArray->pachControl[nIndex] & HASH_CTRL_EMPTY) != 0)
+            {
+               continue;
+            }
+
+            /******************************************************************
+             * Replay the group order of FindOpenSlot() until the key's group.
+             ******************************************************************/
+            nGroup = (int) ((pstrArray->pastrSlots[nIndex].ulHash >> 7) &
+                            (unsigned long) (nGroups-1));
+
+            for (lnLength=1;
+                 nGroup != nIndex / HASH_GROUP && lnLength < nGroups;
+                 lnLength++)
+            {
+               nGroup = (nGroup + (int) lnLength) & (nGroups-1);
+            }
+         }
+         else
+         {
+            lnLength = 0;
+
+            for (pstrNode = &pstrArray->pastrBuckets[nIndex];
+                 pstrNode != NULL;
+                 pstrNode = pstrNode->pstrNext)
+            {
+               lnLength += pstrNode->strKey.nLength != 0;
+            }
+
+            if (lnLength == 0)
+            {
+               alnLengths[0]++;
+               continue;
+            }
+         }
+
+         alnLengths[lnLength < HASH_STATS_LENGTHS ? lnLength : HASH_STATS_LENGTHS-1]++;
+         (*plnUsed)++;
+         lnMax = lnLength > lnMax ? lnLength : lnMax;
+      }
+   }
+
+
+   return(lnMax);
+}
+
+
+
+
+/********************************************************************************
+ * Function: HugePageSize
+ * Params:   None
+ * Returns:  Bytes in a huge page
+ * Call by:  ArenaAlloc()
+ *           NodeAlloc()
+ *           PageAlloc()
+ *           PageUsage()
+ * Call to:  None
+ * Overview: Reads Hugepagesize from /proc/meminfo on the first call, and
+ *           HASH_HUGE_PAGE when it cannot.
+ * Notes:    Kept in a static of the function like KeyKernel(), and read and
+ *           written atomically for the build threads.
+ ********************************************************************************/
+static size_t HugePageSize(void)
+{
+   static size_t  nHuge  = 0;
+   size_t         nNow   = __atomic_load_n(&nHuge, __ATOMIC_RELAXED);
+   unsigned long  ulKb   = 0;
+   FILE          *pFile  = NULL;
+   char           szLine[128];
+
+
+
+   if (nNow != 0)
+   {
+      return(nNow);
+   }
+
+   nNow = HASH_HUGE_PAGE;
+
+   if ((pFile = fopen("/proc/meminfo", "r")) != NULL)
+   {
+      while (fgets(szLine, sizeof(szLine), pFile) != NULL)
+      {
+         if (sscanf(szLine, "Hugepagesize: %lu kB", &ulKb) == 1 && ulKb > 0)
+         {
+            nNow = ulKb * 1024;
+            break;
+         }
+      }
+
+      fclose(pFile);
+   }
+
+   __atomic_store_n(&nHuge, nNow, __ATOMIC_RELAXED);
+
+
+   return(nNow);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ImportSnapshot
+ * Params:   pstrHash - hash table with a mapped snapshot
+ * Returns:  0 - every record copied into the table, the snapshot is unmapped
+ *           <0 - cannot allocate memory, or the snapshot is damaged
+ * Call by:  AddEntriesToHashTable()
+ *           AddExpiringEntry()
+ *           CompactJournal()
+ *           DeleteEntryFromHashTable()
+ *           FreezeHashTable()
+ *           PutEntryInHashTable()
+ *           SaveSnapshot()
+ * Call to:  AddEntryToChainTable()
+ *           AddEntryToOpenTable()
+ *           AllocateHashArray()
+ *           CacheExpiry()
+ *           FreeHashArray()
+ *           SnapshotRecord()
+ * Overview: Copies every record of the snapshot, with its value, into the table
+ *           so it can be changed.  The array is first sized for all the
+ *           records, so the copy does not resize, and the hash stored in each
+ *           record is reused.
+ * Notes:    The snapshot is unmapped even when the copy fails, and the records
+ *           copied so far stay in the table.
+ ********************************************************************************/
+static int ImportSnapshot(strHash *pstrHash)
+{
+   int                      nReturnCode = 0;
+   int                      nSize       = pstrHash->strArray.nSize;
+   unsigned int             nExpire     = CacheExpiry(pstrHash, pstrHash->strCache.lnTtl);
+   long                     lnChain     = 0;
+   unsigned long            ulBucket    = 0;
+   unsigned long            ulOffset    = 0;
+   strSnapshot              strSnap     = pstrHash->strSnap;
+   strHashArray             strNewArray;
+   const strSnapshotRecord *pstrRecord  = NULL;
+
+
+
+   Debug("Importing %ld snapshot entries\n", pstrHash->lnEntries);
+
+
+   /****************************************************************************
+    * Forget the snapshot first, so the adds below do not import it again.
+    ****************************************************************************/
+   memset(&pstrHash->strSnap, 0, sizeof(strSnapshot));
+
+   while (nSize <= INT_MAX / 2 &&
+          (pstrHash->nEngine == ENGINE_CHAIN ?
+           (long) nSize * HASH_CHAIN_LOAD < pstrHash->lnEntries :
+           (long) nSize * HASH_MAX_LOAD_NUM / HASH_MAX_LOAD_DEN / 2 < pstrHash->lnEntries))
+   {
+      nSize = nSize * 2;
+   }
+
+   pstrHash->lnEntries = 0;
+
+   if (nSize != pstrHash->strArray.nSize &&
+       AllocateHashArray(&strNewArray, &pstrHash->strPages, pstrHash->nEngine, nSize) == 0)
+   {
+      FreeHashArray(&pstrHash->strArray);
+      pstrHash->strArray = strNewArray;
+   }
+
+
+   for (ulBucket=0; ulBucket<strSnap.pstrHeader->ulBuckets && nReturnCode == 0; ulBucket++)
+   {
+      ulOffset = strSnap.aulBuckets[ulBucket];
+
+      for (lnChain=0; ulOffset != 0 && nReturnCode == 0; lnChain++)
+      {
+         if ((pstrRecord = SnapshotRecord(&strSnap, ulOffset)) == NULL ||
+             lnChain >= (long) strSnap.pstrHeader->ulEntries)
+         {
+            fprintf(stderr, "Snapshot record at offset %lu is damaged.\n", ulOffset);
+            nReturnCode = -1;
+            break;
+         }
+
+         if (pstrHash->nEngine == ENGINE_OPEN)
+         {
+            nReturnCode = AddEntryToOpenTable(pstrHash, pstrRecord->achKey, pstrRecord->nLength,
+                                              pstrRecord->ulHash, nExpire,
+                                              pstrRecord->achKey + pstrRecord->nLength + 1,
+                                              pstrRecord->nValueLength);
+         }
+         else
+         {
+            nReturnCode = AddEntryToChainTable(pstrHash, pstrRecord->achKey, pstrRecord->nLength,
+                                               pstrRecord->ulHash, nExpire,
+                                               pstrRecord->achKey + pstrRecord->nLength + 1,
+                                               pstrRecord->nValueLength);
+         }
+
+         if (nReturnCode > 0)
+         {
+            nReturnCode = 0;                  /* Duplicate record, keep one      */
+         }
+
+         ulOffset = pstrRecord->ulNext;
+      }
+   }
+
+
+   munmap(strSnap.puchMap, strSnap.nSize);
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: IndexChainNode
+ * Params:   pstrArray - chained bucket array
+ *           nBucket - bucket the node was just linked into
+ *           pstrNode - node holding the new key, the bucket head or a chain node
+ * Returns:  0 - index up to date
+ *           <0 - cannot allocate memory, the chain is left without index
+ * Call by:  AddEntryToChainTable()
+ *           LinkChainKey()
+ *           MigrateHashTable()
+ * Call to:  BuildChainIndex()
+ *           DropChainIndex()
+ *           KeyOfEntry()
+ *           SearchChainIndex()
+ * Overview: Inserts the node into the index of an indexed chain, growing the
+ *           index when it is full.  A chain without index is counted, and gets
+ *           one once it holds more than HASH_INDEX_CHAIN keys.
+ * Notes:    The count stops past HASH_INDEX_CHAIN, so short chains are cheap to
+ *           check.  A chain whose index cannot grow loses its index rather than
+ *           missing a key.
+ ********************************************************************************/
+static int IndexChainNode(strHashArray *pstrArray, int nBucket, strHashTable *pstrNode)
+{
+   int            nCount      = 0;
+   int            nPosition   = 0;
+   strHashTable  *pstrCurrent = NULL;
+   strChainIndex *pstrIndex   = NULL;
+   strChainIndex *pstrGrown   = NULL;
+
+
+
+   if (pstrArray->papstrIndexes != NULL)
+   {
+      pstrIndex = pstrArray->papstrIndexes[nBucket];
+   }
+
+   if (pstrIndex == NULL)
+   {
+      for (pstrCurrent  = &pstrArray->pastrBuckets[nBucket];
+           pstrCurrent != NULL && nCount <= HASH_INDEX_CHAIN;
+           pstrCurrent  = pstrCurrent->pstrNext)
+      {
+         nCount += pstrCurrent->strKey.nLength != 0;
+      }
+
+      return(nCount > HASH_INDEX_CHAIN ? BuildChainIndex(pstrArray, nBucket) : 0);
+   }
+
+
+   if (pstrIndex->nCount == pstrIndex->nSize)
+   {
+      pstrGrown = (strChainIndex *) realloc(pstrIndex, sizeof(strChainIndex) +
+                                            2 * (size_t) pstrIndex->nSize *
+                                            sizeof(strHashTable *));
+
+      if (pstrGrown == NULL)
+      {
+         fprintf(stderr, "Failed realloc() in IndexChainNode(). errno=%d.\n", errno);
+         DropChainIndex(pstrArray, nBucket);
+         return(-1);
+      }
+
+      pstrArray->nIndexBytes += pstrGrown->nSize * sizeof(strHashTable *);
+      pstrGrown->nSize       *= 2;
+      pstrIndex               = pstrGrown;
+      pstrArray->papstrIndexes[nBucket] = pstrIndex;
+   }
+
+   nPosition = -1 - SearchChainIndex(pstrIndex, KeyOfEntry(&pstrNode->strKey),
+                                     pstrNode->strKey.nLength, pstrNode->strKey.ulHash, NULL);
+
+   memmove(&pstrIndex->apstrNodes[nPosition + 1], &pstrIndex->apstrNodes[nPosition],
+           (pstrIndex->nCount - nPosition) * sizeof(strHashTable *));
+
+   pstrIndex->apstrNodes[nPosition] = pstrNode;
+   pstrIndex->nCount++;
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: JournalClock
+ * Params:   None
+ * Returns:  Milliseconds of CLOCK_MONOTONIC
+ * Call by:  CommitJournal()
+ *           CompactJournal()
+ *           OpenHashJournal()
+ *           SyncHashJournal()
+ * Call to:  None
+ * Overview: Times the groups of JOURNAL_GROUP.
+ * Notes:    None
+ ********************************************************************************/
+static unsigned long JournalClock(void)
+{
+   struct timespec strNow;
+
+
+
+   clock_gettime(CLOCK_MONOTONIC, &strNow);
+
+
+   return((unsigned long) strNow.tv_sec * 1000 + strNow.tv_nsec / 1000000);
+}
+
+
+
+
+/********************************************************************************
+ * Function: KeyKernel
+ * Params:   nSet - kernel to use from now on, or -1 to keep the current one
+ * Returns:  Kernel MatchBytes() compares with
+ * Call by:  MatchBytes()
+ *           SetKeyKernel()
+ * Call to:  None
+ * Overview: The first call picks the widest kernel available: KERNEL_AVX2 when
+ *           the processor has AVX2, KERNEL_SSE2 when the build targets SSE2,
+ *           else KERNEL_SCALAR.  A kernel set wider than that is lowered to it.
+ * Notes:    Like DebugOn(), the choice is kept in a static of the function
+ *           instead of a global variable.  It is read and written atomically,
+ *           since threads of a concurrent table compare keys at any time.
+ ********************************************************************************/
+static keykernel KeyKernel(int nSet)
+{
+   static int nKernel = -1;
+   int        nBest   = KERNEL_SCALAR;
+   int        nNow    = __atomic_load_n(&nKernel, __ATOMIC_RELAXED);
+
+
+
+   if (nNow >= 0 && nSet < 0)
+   {
+      return((keykernel) nNow);
+   }
+
+#ifdef __SSE2__
+   nBest = KERNEL_SSE2;
+#endif
+
+#ifdef HASH_HAVE_AVX2
+   if (__builtin_cpu_supports("avx2"))
+   {
+      nBest = KERNEL_AVX2;
+   }
+#endif
+
+   nNow = nSet < 0 || nSet > nBest ? nBest : nSet;
+
+   __atomic_store_n(&nKernel, nNow, __ATOMIC_RELAXED);
+
+
+   return((keykernel) nNow);
+}
+
+
+
+
+/********************************************************************************
+ * Function: KeyKernelName
+ * Params:   nKernel - key compare kernel
+ * Returns:  Name of the kernel, as printed by --bench --kernels
+ * Call by:  RunKernelBenchmark()
+ * Call to:  None
+ * Overview: Maps a key compare kernel to its name.
+ * Notes:    Returns NULL past the last kernel, so callers can loop over all of
+ *           them.
+ ********************************************************************************/
+const char *KeyKernelName(keykernel nKernel)
+{
+   switch (nKernel)
+   {
+      case KERNEL_SCALAR: return("scalar");
+      case KERNEL_SSE2:   return("sse2");
+      case KERNEL_AVX2:   return("avx2");
+      default:            return(NULL);
+   }
+}
+
+
+
+
+/********************************************************************************
+ * Function: KeyOfEntry
+ * Params:   pstrEntry - key of a chain node or open addressing slot
+ * Returns:  The key stored in the entry, "" for an empty entry
+ * Call by:  CompactJournal()
+ *           CompareChainNodes()
+ *           FreezeHashTable()
+ *           IndexChainNode()
+ *           ListHashTable()
+ *           MatchKey()
+ *           MigrateHashTable()
+ *           RemoveCacheEntry()
+ *           SaveSnapshot()
+ *           SearchChainIndex()
+ *           UnlinkChainEntry()
+ * Call to:  None
+ * Overview: Short keys are inside the entry, long keys are in the key arena.
+ * Notes:    None
+ ********************************************************************************/
+static const char *KeyOfEntry(const strHashKey *pstrEntry)
+{
+   if (pstrEntry->nLength >= HASH_INLINE_KEY)
+   {
+      return(pstrEntry->uKey.pszExternal);
+   }
+
+
+   return(pstrEntry->uKey.szInline);
+}
+
+
+
+
+/********************************************************************************
+ * Function: LeaveEpoch
+ * Params:   pstrThread - epoch record of the calling thread
+ * Returns:  None
+ * Call by:  SearchConcurrentTable()
+ * Call to:  None
+ * Overview: Announces that the thread holds no more pointers into the table.
+ * Notes:    The release store keeps the reads of the table before it.
+ ********************************************************************************/
+static void LeaveEpoch(strEpochThread *pstrThread)
+{
+   __atomic_store_n(&pstrThread->ulEpoch, 0, __ATOMIC_RELEASE);
+}
+
+
+
+
+/********************************************************************************
+ * Function: LinkChainKey
+ * Params:   pstrHash - hash table
+ *           pstrArray - chained bucket array to link into
+ *           ulHash - HashKey() of the key
+ *           pstrKey - key to move into the array
+ * Returns:  0 - key linked
+ *           <0 - cannot allocate memory
+ * Call by:  MigrateHashTable()
+ * Call to:  IndexChainNode()
+ *           NodeAlloc()
+ * Overview: Moves an already stored key into the bucket head when it is empty,
+ *           otherwise into a new node linked right after the head.
+ * Notes:    The key itself is not copied, long keys stay in the arena.
+ ********************************************************************************/
+static int LinkChainKey(strHash *pstrHash, strHashArray *pstrArray, unsigned long ulHash,
+                        const strHashKey *pstrKey)
+{
+   int           nBucket      = (int) (ulHash % pstrArray->nSize);
+   strHashTable *pstrHead     = &pstrArray->pastrBuckets[nBucket];
+   strHashTable *pstrNewChain = NULL;
+
+
+
+   if (pstrHead->strKey.nLength == 0)
+   {
+      pstrHead->strKey = *pstrKey;
+      IndexChainNode(pstrArray, nBucket, pstrHead);
+      return(0);
+   }
+
+
+   if ((pstrNewChain = NodeAlloc(&pstrHash->strNodes)) == NULL)
+   {
+      return(-1);
+   }
+
+   pstrNewChain->strKey   = *pstrKey;
+   pstrNewChain->pstrNext = pstrHead->pstrNext;
+   pstrHead->pstrNext     = pstrNewChain;
+   pstrHash->lnChainNodes++;
+
+   IndexChainNode(pstrArray, nBucket, pstrNewChain);
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ListHashTable
+ * Params:   pstrHash
+ *           pFile - stream to list the entries on
+ * Returns:  Number of non-empty items in hash table.
+ * Call by:  main()
+ *           ServerCommand()
+ * Call to:  KeyOfEntry()
+ *           ListOpenTable()
+ *           ListSnapshot()
+ * Overview: Lists all entries in the hash table that is non-NULL data.
+ * Notes:    While the table is resizing, buckets of the old array that have not
+ *           been migrated yet are listed as Old bucket.
+ ********************************************************************************/
+int ListHashTable(const strHash *pstrHash, FILE *pFile)
+{
+   int           nIndex       = 0;
+   int           nReturnCode  = 0;
+   strHashTable *pstrCurrent  = NULL;
+
+
+
+   Debug("Inside ListHashTable()\n");
+
+   if (pstrHash->strSnap.puchMap != NULL)
+   {
+      return(ListSnapshot(pstrHash, pFile));
+   }
+
+   if (pstrHash->nEngine == ENGINE_OPEN)
+   {
+      return(ListOpenTable(pstrHash, pFile));
+   }
+
+
+   for (nIndex=0; nIndex<pstrHash->strArray.nSize; nIndex++)
+   {
+      for (pstrCurrent = &pstrHash->strArray.pastrBuckets[nIndex];
+           pstrCurrent != NULL;
+           pstrCurrent = pstrCurrent->pstrNext)
+      {
+         fprintf(pFile, "Bucket[%d] data:  [%s]\n", nIndex, KeyOfEntry(&pstrCurrent->strKey));
+         ++nReturnCode;
+      }
+   }
+
+
+   for (nIndex=pstrHash->nMigrated; nIndex<pstrHash->strOldArray.nSize; nIndex++)
+   {
+      for (pstrCurrent = &pstrHash->strOldArray.pastrBuckets[nIndex];
+           pstrCurrent != NULL;
+           pstrCurrent = pstrCurrent->pstrNext)
+      {
+         fprintf(pFile, "Old bucket[%d] data:  [%s]\n", nIndex,
+                 KeyOfEntry(&pstrCurrent->strKey));
+         ++nReturnCode;
+      }
+   }
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ListOpenTable
+ * Params:   pstrHash - open addressing hash table
+ *           pFile - stream to list the slots on
+ * Returns:  Number of non-empty slots in hash table.
+ * Call by:  ListHashTable()
+ * Call to:  KeyOfEntry()
+ * Overview: Lists all slots in the hash table that hold data.
+ * Notes:    Empty and deleted slots are not listed.  While the table is
+ *           resizing, slots of the old array are listed as Old slot.
+ ********************************************************************************/
+static int ListOpenTable(const strHash *pstrHash, FILE *pFile)
+{
+   int                 nIndex      = 0;
+   int                 nReturnCode = 0;
+   const strHashArray *pstrArray   = &pstrHash->strArray;
+
+
+
+   for (nIndex=0; nIndex<pstrArray->nSize; nIndex++)
+   {
+      if ((pstrArray->pachControl[nIndex] & HASH_CTRL_EMPTY) == 0)
+      {
+         fprintf(pFile, "Slot[%d] data:  [%s]\n", nIndex,
+                 KeyOfEntry(&pstrArray->pastrSlots[nIndex]));
+         ++nReturnCode;
+      }
+   }
+
+
+   pstrArray = &pstrHash->strOldArray;
+
+   for (nIndex=0; nIndex<pstrArray->nSize; nIndex++)
+   {
+      if ((pstrArray->pachControl[nIndex] & HASH_CTRL_EMPTY) == 0)
+      {
+         fprintf(pFile, "Old slot[%d] data:  [%s]\n", nIndex,
+                 KeyOfEntry(&pstrArray->pastrSlots[nIndex]));
+         ++nReturnCode;
+      }
+   }
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ListSnapshot
+ * Params:   pstrHash - hash table with a mapped snapshot
+ *           pFile - stream to list the records on
+ * Returns:  Number of records in the snapshot.
+ * Call by:  ListHashTable()
+ * Call to:  SnapshotRecord()
+ * Overview: Lists all records of the mapped snapshot, bucket by bucket.
+ * Notes:    Stops at the first damaged record of a bucket.
+ ********************************************************************************/
+static int ListSnapshot(const strHash *pstrHash, FILE *pFile)
+{
+   int                      nReturnCode = 0;
+   long                     lnChain     = 0;
+   unsigned long            ulBucket    = 0;
+   unsigned long            ulOffset    = 0;
+   const strSnapshot       *pstrSnap    = &pstrHash->strSnap;
+   const strSnapshotRecord *pstrRecord  = NULL;
+
+
+
+   for (ulBucket=0; ulBucket<pstrSnap->pstrHeader->ulBuckets; ulBucket++)
+   {
+      ulOffset = pstrSnap->aulBuckets[ulBucket];
+
+      for (lnChain=0; ulOffset != 0; lnChain++)
+      {
+         if ((pstrRecord = SnapshotRecord(pstrSnap, ulOffset)) == NULL ||
+             lnChain >= (long) pstrSnap->pstrHeader->ulEntries)
+         {
+            fprintf(stderr, "Snapshot record at offset %lu is damaged.\n", ulOffset);
+            break;
+         }
+
+         fprintf(pFile, "Snapshot bucket[%lu] data:  [%s]\n", ulBucket, pstrRecord->achKey);
+         ++nReturnCode;
+
+         ulOffset = pstrRecord->ulNext;
+      }
+   }
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: LoadSnapshot
+ * Params:   pstrHash - empty hash table from CreateHashTable()
+ *           pszFile - snapshot file written by SaveSnapshot()
+ *           bVerify - TRUE to check the checksum of the whole file
+ * Returns:  0 - snapshot mapped
+ *           <0 - cannot open or map the file, or it is not a valid snapshot
+ * Call by:  main()
+ * Call to:  HashName()
+ *           HashWy()
+ *           SnapshotRecordStart()
+ * Overview: Maps the file read only and serves searches from it directly, so
+ *           startup does not depend on the number of keys.  The table takes
+ *           the hash function and seed of the snapshot, so the hashes stored in
+ *           the file stay valid.  A snapshot written by a frozen table is
+ *           served frozen, see FreezeHashTable().
+ * Notes:    Only the header and the size of the file are checked, unless
+ *           bVerify is TRUE, because the checksum has to read every page.
+ *           Records are still bounds checked when they are read.
+ *           The pages are read on demand, so the file must not be changed while
+ *           it is mapped.
+ ********************************************************************************/
+int LoadSnapshot(strHash *pstrHash, const char *pszFile, boolean bVerify)
+{
+   int                      nFile       = -1;
+   unsigned char           *puchMap     = NULL;
+   const strSnapshotHeader *pstrHeader  = NULL;
+   const char              *pszError    = NULL;
+   struct stat              strStat;
+
+
+
+   if ((nFile = open(pszFile, O_RDONLY)) < 0 || fstat(nFile, &strStat) != 0)
+   {
+      fprintf(stderr, "Cannot open [%s]. errno=%d.\n", pszFile, errno);
+
+      if (nFile >= 0)
+      {
+         close(nFile);
+      }
+
+      return(-1);
+   }
+
+   if ((size_t) strStat.st_size < sizeof(strSnapshotHeader))
+   {
+      fprintf(stderr, "[%s] is too small to be a snapshot.\n", pszFile);
+      close(nFile);
+      return(-1);
+   }
+
+
+   puchMap = (unsigned char *) mmap(NULL, strStat.st_size, PROT_READ, MAP_PRIVATE, nFile, 0);
+   close(nFile);
+
+   if (puchMap == MAP_FAILED)
+   {
+      fprintf(stderr, "Failed mmap() of [%s]. errno=%d.\n", pszFile, errno);
+      return(-1);
+   }
+
+   madvise(puchMap, strStat.st_size, MADV_RANDOM);
+
+
+   /****************************************************************************
+    * The bucket array, and the pilots of a frozen snapshot, must fit in the
+    * file, and the bucket count must be a power of 2 unless frozen, because
+    * lookups mask the hash with it.
+    ****************************************************************************/
+   pstrHeader = (const strSnapshotHeader *) puchMap;
+
+   if (memcmp(pstrHeader->achMagic, HASH_SNAPSHOT_MAGIC, sizeof(pstrHeader->achMagic)) != 0)
+   {
+      pszError = "is not a snapshot";
+   }
+   else if (pstrHeader->nVersion != HASH_SNAPSHOT_VERSION)
+   {
+      pszError = "has an unsupported version";
+   }
+   else if (pstrHeader->ulFileSize != (unsigned long) strStat.st_size)
+   {
+      pszError = "is truncated";
+   }
+   else if (HashName((hashfn) pstrHeader->nHash) == NULL)
+   {
+      pszError = "uses an unknown hash function";
+   }
+   else if (pstrHeader->ulBuckets == 0 ||
+            (pstrHeader->ulPilots == 0 &&
+             (pstrHeader->ulBuckets & (pstrHeader->ulBuckets - 1)) != 0) ||
+            pstrHeader->ulBuckets > (strStat.st_size - sizeof(strSnapshotHeader)) /
+                                    sizeof(unsigned long) ||
+            pstrHeader->ulPilots > pstrHeader->ulBuckets ||
+            SnapshotRecordStart(pstrHeader) > (unsigned long) strStat.st_size ||
+            pstrHeader->ulEntries > LONG_MAX)
+   {
+      pszError = "has a damaged header";
+   }
+   else if (bVerify == TRUE &&
+            HashWy((const char *) puchMap + sizeof(strSnapshotHeader),
+                   strStat.st_size - sizeof(strSnapshotHeader), 0) != pstrHeader->ulChecksum)
+   {
+      pszError = "fails its checksum";
+   }
+
+   if (pszError != NULL)
+   {
+      fprintf(stderr, "[%s] %s.\n", pszFile, pszError);
+      munmap(puchMap, strStat.st_size);
+      return(-1);
+   }
+
+
+   pstrHash->nHash      = (hashfn) pstrHeader->nHash;
+   pstrHash->aulSeed[0] = pstrHeader->aulSeed[0];
+   pstrHash->aulSeed[1] = pstrHeader->aulSeed[1];
+   pstrHash->lnEntries  = (long) pstrHeader->ulEntries;
+
+   pstrHash->strSnap.puchMap    = puchMap;
+   pstrHash->strSnap.nSize      = strStat.st_size;
+   pstrHash->strSnap.pstrHeader = pstrHeader;
+   pstrHash->strSnap.aulBuckets = (const unsigned long *) (puchMap + sizeof(strSnapshotHeader));
+   pstrHash->strSnap.anPilots   = (const unsigned int *) (pstrHash->strSnap.aulBuckets +
+                                                          pstrHeader->ulBuckets);
+
+   Debug("Mapped [%s], %ld entries in %lu buckets\n",
+         pszFile, pstrHash->lnEntries, pstrHeader->ulBuckets);
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: LockSharedTable
+ * Params:   pstrShared - shared hash table
+ * Returns:  0 - lock taken
+ *           <0 - cannot take the lock
+ * Call by:  AddEntryToSharedTable()
+ *           DeleteEntryFromSharedTable()
+ *           SearchSharedTable()
+ * Call to:  RecoverSharedTable()
+ * Overview: Takes the writers' lock.  When its last owner died holding it,
+ *           repairs the table before marking the lock consistent again.
+ * Notes:    The lock is robust, so a writer killed in the middle of a change
+ *           does not block the other processes for good.
+ ********************************************************************************/
+static int LockSharedTable(strSharedHash *pstrShared)
+{
+   int              nReturnCode = 0;
+   strSharedHeader *pstrHeader  = pstrShared->pstrHeader;
+
+
+
+   nReturnCode = pthread_mutex_lock(&pstrHeader->strMutex);
+
+   if (nReturnCode == EOWNERDEAD)
+   {
+      RecoverSharedTable(pstrShared);
+      nReturnCode = pthread_mutex_consistent(&pstrHeader->strMutex);
+   }
+
+   if (nReturnCode != 0)
+   {
+      fprintf(stderr, "Failed pthread_mutex_lock() in LockSharedTable(). errno=%d.\n",
+              nReturnCode);
+      return(-1);
+   }
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: MakeCacheRoom
+ * Params:   pstrHash - hash table in cache mode
+ *           pszData - data about to be added
+ *           nLength - strlen() of pszData
+ *           ulHash - HashKey() of pszData
+ *           nValueLength - bytes of the value added with the data
+ * Returns:  0 - the data is not in the table, and fits in it now
+ *           >0 - the data is already in the table and has not expired
+ * Call by:  AddEntriesToHashTable()
+ *           AddExpiringEntry()
+ *           PutEntryInHashTable()
+ * Call to:  CacheFull()
+ *           EvictCacheEntry()
+ *           FindHashedKey()
+ *           TestFilterKey()
+ *           TouchCacheEntry()
+ * Overview: Drops the data if it is stored but expired, so it can be added
+ *           again, then evicts keys until a new entry fits in the limits.
+ * Notes:    Adding data that is still there counts as a hit for the clock.
+ *           Keys are only evicted for data that is really added.
+ ********************************************************************************/
+static int MakeCacheRoom(strHash *pstrHash, const char *pszData, size_t nLength,
+                         unsigned long ulHash, size_t nValueLength)
+{
+   size_t      nAdding = sizeof(strHashTable);
+   strHashKey *pstrKey = NULL;
+
+
+
+   if (TestFilterKey(&pstrHash->strFilter, ulHash) == TRUE &&
+       (pstrKey = FindHashedKey(pstrHash, pszData, nLength, ulHash)) != NULL &&
+       TouchCacheEntry(pstrHash, pstrKey) == 0)
+   {
+      return(1);                              /* Data already exists             */
+   }
+
+   if (nLength >= HASH_INLINE_KEY)
+   {
+      nAdding += nLength + 1;
+   }
+
+   if (nValueLength > HASH_INLINE_VALUE)
+   {
+      nAdding += nValueLength;
+   }
+
+
+   while (CacheFull(pstrHash, 1, nAdding) == TRUE && EvictCacheEntry(pstrHash) == 0)
+   {
+      ;
+   }
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: MapHashTrace
+ * Params:   pszFile - trace written by OpenHashTrace()
+ * Returns:  Trace to read with NextTraceRecord()
+ *           NULL - cannot open or map the file, or it is not a trace
+ * Call by:  RunReplay()
+ * Call to:  None
+ * Overview: Maps the trace read only, checks its header and starts reading at
+ *           the first record.
+ * Notes:    Release with UnmapHashTrace().  The keys of the records point into
+ *           the map, so they are only good until then.
+ ********************************************************************************/
+strHashTrace *MapHashTrace(const char *pszFile)
+{
+   int             nFile     = -1;
+   char           *pchMap    = MAP_FAILED;
+   strHashTrace   *pstrTrace = NULL;
+   strTraceHeader  strHeader;
+   struct stat     strStat;
+
+
+
+   if ((nFile = open(pszFile, O_RDONLY)) < 0 || fstat(nFile, &strStat) != 0)
+   {
+      fprintf(stderr, "Cannot open [%s]. errno=%d.\n", pszFile, errno);
+
+      if (nFile >= 0)
+      {
+         close(nFile);
+      }
+
+      return(NULL);
+   }
+
+   if ((size_t) strStat.st_size >= sizeof(strTraceHeader))
+   {
+      pchMap = (char *) mmap(NULL, strStat.st_size, PROT_READ, MAP_PRIVATE, nFile, 0);
+   }
+
+   close(nFile);
+
+   if (pchMap == MAP_FAILED)
+   {
+      fprintf(stderr, "Trace [%s] cannot be read.\n", pszFile);
+      return(NULL);
+   }
+
+   memcpy(&strHeader, pchMap, sizeof(strHeader));
+
+   if (memcmp(strHeader.achMagic, HASH_TRACE_MAGIC, sizeof(strHeader.achMagic)) != 0 ||
+       strHeader.nVersion != HASH_TRACE_VERSION)
+   {
+      fprintf(stderr, "Trace [%s] is not a trace of this version.\n", pszFile);
+      munmap(pchMap, strStat.st_size);
+      return(NULL);
+   }
+
+   if ((pstrTrace = (strHashTrace *) calloc(1, sizeof(strHashTrace))) == NULL)
+   {
+      fprintf(stderr, "Failed calloc() in MapHashTrace(). errno=%d.\n", errno);
+      munmap(pchMap, strStat.st_size);
+      return(NULL);
+   }
+
+   pstrTrace->pchMap  = pchMap;
+   pstrTrace->nSize   = strStat.st_size;
+   pstrTrace->nOffset = sizeof(strTraceHeader);
+
+
+   return(pstrTrace);
+}
+
+
+
+
+/********************************************************************************
+ * Function: MatchBytes
+ * Params:   pchFirst - bytes to compare
+ *           pchSecond - bytes to compare them with
+ *           nLength - number of bytes of each
+ * Returns:  TRUE - the bytes are the same
+ *           FALSE - they differ
+ * Call by:  AddEntryToConcurrentTable()
+ *           AddEntryToSharedTable()
+ *           DeleteEntryFromConcurrentTable()
+ *           DeleteEntryFromSharedTable()
+ *           MatchKey()
+ *           RunKernelBenchmark()
+ *           SearchConcurrentTable()
+ *           SearchSharedTable()
+ *           SearchSnapshot()
+ * Call to:  KeyKernel()
+ *           MatchBytesAvx2()
+ *           MatchBytesSse2()
+ * Overview: Compares 16 bytes or more with the vector kernel of KeyKernel().
+ *           Shorter keys, and all keys with KERNEL_SCALAR, are compared as
+ *           8 byte words, then 4 byte words, then byte by byte.
+ * Notes:    The lengths are known to be equal, so unlike strcmp() no byte is
+ *           tested for the terminator.  The last word overlaps the one before
+ *           it instead of ending in a byte loop, and nothing past nLength is
+ *           ever read.  The last two words are tested with one branch, so keys
+ *           of 8 to 16 bytes take no branch that depends on their length.
+ ********************************************************************************/
+boolean MatchBytes(const char *pchFirst, const char *pchSecond, size_t nLength)
+{
+   size_t        nIndex   = 0;
+   unsigned int  nFirst   = 0;
+   unsigned int  nSecond  = 0;
+   unsigned long ulFirst  = 0;
+   unsigned long ulSecond = 0;
+   unsigned long ulDiff   = 0;
+
+
+
+   if (nLength >= 16)
+   {
+      switch (KeyKernel(-1))
+      {
+         case KERNEL_AVX2:
+            return(nLength >= 32 ? MatchBytesAvx2(pchFirst, pchSecond, nLength) :
+                                   MatchBytesSse2(pchFirst, pchSecond, nLength));
+
+         case KERNEL_SSE2:
+            return(MatchBytesSse2(pchFirst, pchSecond, nLength));
+
+         case KERNEL_SCALAR:
+         default:
+            break;
+      }
+   }
+
+
+   if (nLength >= 8)
+   {
+      for (nIndex=0; nIndex+16 < nLength; nIndex+=8)
+      {
+         memcpy(&ulFirst, pchFirst + nIndex, 8);
+         memcpy(&ulSecond, pchSecond + nIndex, 8);
+
+         if (ulFirst != ulSecond)
+         {
+            return(FALSE);
+         }
+      }
+
+      memcpy(&ulFirst, pchFirst + nIndex, 8);
+      memcpy(&ulSecond, pchSecond + nIndex, 8);
+      ulDiff = ulFirst ^ ulSecond;
+      memcpy(&ulFirst, pchFirst + nLength - 8, 8);
+      memcpy(&ulSecond, pchSecond + nLength - 8, 8);
+
+      return((ulDiff | (ulFirst ^ ulSecond)) == 0 ? TRUE : FALSE);
+   }
+
+   if (nLength >= 4)
+   {
+      memcpy(&nFirst, pchFirst, 4);
+      memcpy(&nSecond, pchSecond, 4);
+
+      if (nFirst != nSecond)
+      {
+         return(FALSE);
+      }
+
+      memcpy(&nFirst, pchFirst + nLength - 4, 4);
+      memcpy(&nSecond, pchSecond + nLength - 4, 4);
+
+      return(nFirst == nSecond ? TRUE : FALSE);
+   }
+
+
+   for (nIndex=0; nIndex<nLength; nIndex++)
+   {
+      if (pchFirst[nIndex] != pchSecond[nIndex])
+      {
+         return(FALSE);
+      }
+   }
+
+
+   return(TRUE);
+}
+
+
+
+
+/********************************************************************************
+ * Function: MatchBytesAvx2
+ * Params:   pchFirst - bytes to compare
+ *           pchSecond - bytes to compare them with
+ *           nLength - number of bytes of each, at least 32
+ * Returns:  TRUE - the bytes are the same
+ *           FALSE - they differ
+ * Call by:  MatchBytes()
+ * Call to:  None
+ * Overview: Compares 32 bytes per AVX2 instruction, the last 32 bytes
+ *           overlapping the ones before them.
+ * Notes:    Compiled for AVX2 whatever the build targets, and only called once
+ *           KeyKernel() has found AVX2 in the processor.  Falls back to
+ *           memcmp() when the compiler cannot build it.
+ ********************************************************************************/
+#ifdef HASH_HAVE_AVX2
+__attribute__((target("avx2")))
+#endif
+static boolean MatchBytesAvx2(const char *pchFirst, const char *pchSecond, size_t nLength)
+{
+#ifdef HASH_HAVE_AVX2
+   size_t  nIndex = 0;
+   __m256i vEqual;
+
+   for (nIndex=0; nIndex+32 < nLength; nIndex+=32)
+   {
+      vEqual = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (pchFirst + nIndex)),
+                                 _mm256_loadu_si256((const __m256i *) (pchSecond + nIndex)));
+
+      if ((unsigned int) _mm256_movemask_epi8(vEqual) != 0xFFFFFFFFu)
+      {
+         return(FALSE);
+      }
+   }
+
+   vEqual = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (pchFirst + nLength - 32)),
+                              _mm256_loadu_si256((const __m256i *) (pchSecond + nLength - 32)));
+
+   return((unsigned int) _mm256_movemask_epi8(vEqual) == 0xFFFFFFFFu ? TRUE : FALSE);
+#else
+   return(memcmp(pchFirst, pchSecond, nLength) == 0 ? TRUE : FALSE);
+#endif
+}
+
+
+
+
+/********************************************************************************
+ * Function: MatchBytesSse2
+ * Params:   pchFirst - bytes to compare
+ *           pchSecond - bytes to compare them with
+ *           nLength - number of bytes of each, at least 16
+ * Returns:  TRUE - the bytes are the same
+ *           FALSE - they differ
+ * Call by:  MatchBytes()
+ * Call to:  None
+ * Overview: Compares 16 bytes per SSE2 instruction, the last 16 bytes
+ *           overlapping the ones before them.
+ * Notes:    Falls back to memcmp() when SSE2 is not available.
+ ********************************************************************************/
+static boolean MatchBytesSse2(const char *pchFirst, const char *pchSecond, size_t nLength)
+{
+#ifdef __SSE2__
+   size_t  nIndex = 0;
+   __m128i vEqual;
+
+   for (nIndex=0; nIndex+16 < nLength; nIndex+=16)
+   {
+      vEqual = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (pchFirst + nIndex)),
+                              _mm_loadu_si128((const __m128i *) (pchSecond + nIndex)));
+
+      if (_mm_movemask_epi8(vEqual) != 0xFFFF)
+      {
+         return(FALSE);
+      }
+   }
+
+   vEqual = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (pchFirst + nLength - 16)),
+                           _mm_loadu_si128((const __m128i *) (pchSecond + nLength - 16)));
+
+   return(_mm_movemask_epi8(vEqual) == 0xFFFF ? TRUE : FALSE);
+#else
+   return(memcmp(pchFirst, pchSecond, nLength) == 0 ? TRUE : FALSE);
+#endif
+}
+
+
+
+
+/********************************************************************************
+ * Function: MatchGroup
+ * Params:   pachGroup - HASH_GROUP control bytes, aligned to HASH_GROUP
+ *           chValue - control byte to look for
+ * Returns:  Bit mask, bit N is set when pachGroup[N] equals chValue
+ * Call by:  BuildOpenPartition()
+ *           FindOpenSlot()
+ *           FreeOpenSlot()
+ *           PrefetchBuckets()
+ *           UnlinkOpenEntry()
+ * Call to:  None
+ * Overview: Compares a whole group of control bytes in one SSE2 instruction.
+ * Notes:    Falls back to a byte loop when SSE2 is not available.
+ ********************************************************************************/
+static unsigned int MatchGroup(const unsigned char *pachGroup, unsigned char chValue)
+{
+#ifdef __SSE2__
+   __m128i vGroup = _mm_load_si128((const __m128i *) pachGroup);
+
+   return((unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(vGroup,
+                                                          _mm_set1_epi8((char) chValue))));
+#else
+   int          nIndex = 0;
+   unsigned int nMask  = 0;
+
+   for (nIndex=0; nIndex<HASH_GROUP; nIndex++)
+   {
+      if (pachGroup[nIndex] == chValue)
+      {
+         nMask |= 1u << nIndex;
+      }
+   }
+
+   return(nMask);
+#endif
+}
+
+
+
+
+/********************************************************************************
+ * Function: MatchKey
+ * Params:   pstrKey - key of a chain node or slot, may be empty
+ *           pszData - data to compare it with
+ *           nLength - strlen() of pszData
+ * Returns:  TRUE - the entry holds the data
+ *           FALSE - it holds other data, or nothing
+ * Call by:  BuildChainPartition()
+ *           BuildOpenPartition()
+ *           FindChainEntry()
+ *           FindOpenSlot()
+ *           UnlinkChainEntry()
+ * Call to:  KeyOfEntry()
+ *           MatchBytes()
+ * Overview: Compares the lengths, then the bytes with MatchBytes().  Callers
+ *           compare the hashes first, so keys that differ are nearly always
+ *           turned down without reading them.
+ * Notes:    An empty entry has a length of 0 and never matches, even data of
+ *           length 0.
+ ********************************************************************************/
+static boolean MatchKey(const strHashKey *pstrKey, const char *pszData, size_t nLength)
+{
+   if (pstrKey->nLength != nLength || nLength == 0)
+   {
+      return(FALSE);
+   }
+
+
+   return(MatchBytes(KeyOfEntry(pstrKey), pszData, nLength));
+}
+
+
+
+
+/********************************************************************************
+ * Function: MemoryHashTable
+ * Params:   pstrHash
+ *           pFile - stream to print the report on
+ * Returns:  Total bytes used by the hash table
+ * Call by:  main()
+ * Call to:  CacheBytes()
+ *           HashName()
+ *           MemoryInUse()
+ * Overview: Prints the memory held by the bucket heads (or open addressing
+ *           slots and control bytes), chain nodes, chain indexes, filter and
+ *           key arena, the bytes counted against the cache limit, and the
+ *           average bytes needed per stored entry.  Also prints the load
+ *           factor and the progress of a resize.
+ * Notes:    Chain nodes count with the slabs reserved for them.  A mapped
+ *           snapshot counts with its file size, although only the pages that
+ *           were read are in memory.
+ ********************************************************************************/
+int MemoryHashTable(const strHash *pstrHash, FILE *pFile)
+{
+   size_t nBuckets = 0;
+   size_t nChains  = 0;
+   size_t nTotal   = 0;
+   size_t nPerSlot = sizeof(strHashTable);
+   int    nSize    = pstrHash->strArray.nSize;
+
+
+
+   if (pstrHash->nEngine == ENGINE_OPEN)
+   {
+      nPerSlot = sizeof(strHashKey) + 1;
+   }
+
+   nBuckets = ((size_t) nSize + pstrHash->strOldArray.nSize) * nPerSlot;
+   nChains  = (size_t) pstrHash->lnChainNodes * sizeof(strHashTable);
+   nTotal   = MemoryInUse(pstrHash);
+
+
+   fprintf(pFile, "Entries:          %ld\n", pstrHash->lnEntries);
+   fprintf(pFile, "%s %zu bytes (keys under %d bytes and values up to %d stored inline)\n",
+           pstrHash->nEngine == ENGINE_OPEN ? "Slot size:       " : "Node size:       ",
+           pstrHash->nEngine == ENGINE_OPEN ? sizeof(strHashKey) : sizeof(strHashTable),
+           HASH_INLINE_KEY,
+           HASH_INLINE_VALUE);
+   fprintf(pFile, "%s %zu bytes\n",
+           pstrHash->nEngine == ENGINE_OPEN ? "Slots/control:   " : "Bucket heads:    ",
+           nBuckets);
+   fprintf(pFile, "Chain nodes:      %zu bytes reserved, %zu used, %ld free\n",
+           pstrHash->strNodes.nReserved,
+           nChains,
+           pstrHash->strNodes.lnFree);
+   fprintf(pFile, "Key arena:        %zu bytes reserved, %zu used, %zu dead\n",
+           pstrHash->strKeys.nReserved,
+           pstrHash->strKeys.nUsed,
+           pstrHash->strKeys.nDead);
+
+   if (pstrHash->strArray.nIndexes + pstrHash->strOldArray.nIndexes > 0)
+   {
+      fprintf(pFile, "Chain indexes:    %zu bytes, %d chains\n",
+              pstrHash->strArray.nIndexBytes + pstrHash->strOldArray.nIndexBytes,
+              pstrHash->strArray.nIndexes + pstrHash->strOldArray.nIndexes);
+   }
+
+   if (pstrHash->strFilter.puchCounters != NULL)
+   {
+      fprintf(pFile, "Filter:           %lu bytes, sized for %ld keys\n",
+              pstrHash->strFilter.ulBlocks * HASH_CACHE_LINE,
+              pstrHash->strFilter.lnCapacity);
+   }
+
+   if (pstrHash->strCache.bOn == TRUE)
+   {
+      fprintf(pFile, "Cache:            %zu bytes held by keys, limits %ld keys, %zu bytes, "
+              "TTL %ld s\n",
+              CacheBytes(pstrHash),
+              pstrHash->strCache.lnMaxEntries,
+              pstrHash->strCache.nMaxBytes,
+              pstrHash->strCache.lnTtl);
+   }
+
+   if (pstrHash->strJournal.pchBuffer != NULL)
+   {
+      fprintf(pFile, "Journal:          %d bytes of buffer, %zu waiting to be written\n",
+              HASH_JOURNAL_BUFFER,
+              pstrHash->strJournal.nBuffered);
+   }
+
+   if (pstrHash->strTrace.pchBuffer != NULL)
+   {
+      fprintf(pFile, "Trace:            %d bytes of buffer, %ld records\n",
+              HASH_TRACE_BUFFER,
+              pstrHash->strTrace.lnRecords);
+   }
+
+   if (pstrHash->strSnap.puchMap != NULL && pstrHash->strSnap.pstrHeader->ulPilots != 0)
+   {
+      fprintf(pFile, "Frozen:           %zu bytes mapped, %lu slots, %lu pilots (%.1f bits "
+              "per key)\n",
+              pstrHash->strSnap.nSize,
+              pstrHash->strSnap.pstrHeader->ulBuckets,
+              pstrHash->strSnap.pstrHeader->ulPilots,
+              8.0 * sizeof(unsigned int) * pstrHash->strSnap.pstrHeader->ulPilots /
+              pstrHash->strSnap.pstrHeader->ulBuckets);
+   }
+   else if (pstrHash->strSnap.puchMap != NULL)
+   {
+      fprintf(pFile, "Snapshot:         %zu bytes mapped, %lu buckets\n",
+              pstrHash->strSnap.nSize,
+              pstrHash->strSnap.pstrHeader->ulBuckets);
+   }
+
+   fprintf(pFile, "Total:            %zu bytes\n", nTotal);
+
+   if (pstrHash->lnEntries > 0)
+   {
+      fprintf(pFile, "Bytes per entry:  %.1f\n", (double) nTotal / pstrHash->lnEntries);
+   }
+
+   fprintf(pFile, "Size:             %d %s (started at %d, %ld resizes)\n",
+           nSize,
+           pstrHash->nEngine == ENGINE_OPEN ? "slots" : "buckets",
+           pstrHash->nMinSize,
+           pstrHash->lnResizes);
+   fprintf(pFile, "Load factor:      %.3f\n",
+           (double) pstrHash->lnEntries / (pstrHash->strSnap.puchMap != NULL ?
+                                           pstrHash->strSnap.pstrHeader->ulBuckets :
+                                           (unsigned long) nSize));
+   fprintf(pFile, "Hash function:    %s\n", HashName(pstrHash->nHash));
+
+   if (pstrHash->strOldArray.nSize != 0)
+   {
+      fprintf(pFile, "Resizing:         %d of %d old %s migrated\n",
+              pstrHash->nMigrated,
+              pstrHash->strOldArray.nSize,
+              pstrHash->nEngine == ENGINE_OPEN ? "slots" : "buckets");
+   }
+
+
+   return((int) nTotal);
+}
+
+
+
+
+/********************************************************************************
+ * Function: MemoryInUse
+ * Params:   pstrHash - hash table
+ * Returns:  Bytes held by the table
+ * Call by:  MemoryHashTable()
+ *           StatsHashTable()
+ * Call to:  None
+ * Overview: Adds up the bucket heads (or slots and control bytes), the chain
+ *           indexes, the filter, the node slabs, the key arena and the mapped
+ *           snapshot.
+ * Notes:    The strHash itself is not counted.
+ ********************************************************************************/
+static size_t MemoryInUse(const strHash *pstrHash)
+{
+   size_t nPerSlot = sizeof(strHashTable);
+
+
+
+   if (pstrHash->nEngine == ENGINE_OPEN)
+   {
+      nPerSlot = sizeof(strHashKey) + 1;
+   }
+
+
+   return(((size_t) pstrHash->strArray.nSize + pstrHash->strOldArray.nSize) * nPerSlot +
+          pstrHash->strArray.nIndexBytes + pstrHash->strOldArray.nIndexBytes +
+          pstrHash->strFilter.ulBlocks * HASH_CACHE_LINE +
+          pstrHash->strNodes.nReserved + pstrHash->strKeys.nReserved +
+          pstrHash->strSnap.nSize +
+          (pstrHash->strJournal.pchBuffer != NULL ? HASH_JOURNAL_BUFFER : 0) +
+          (pstrHash->strTrace.pchBuffer != NULL ? HASH_TRACE_BUFFER : 0));
+}
+
+
+
+
+/********************************************************************************
+ * Function: MergeArena
+ * Params:   pstrArena - arena of the table
+ *           pstrOther - arena whose blocks move to pstrArena, left empty
+ * Returns:  None
+ * Call by:  BuildHashTable()
+ * Call to:  None
+ * Overview: Links the blocks of pstrOther after the last block of pstrArena,
+ *           and adds up the counters.
+ * Notes:    The current block of pstrArena stays the one allocated from.
+ ********************************************************************************/
+static void MergeArena(strArena *pstrArena, strArena *pstrOther)
+{
+   strArenaBlock **ppstrLast = &pstrArena->pstrBlocks;
+
+
+
+   while (*ppstrLast != NULL)
+   {
+      ppstrLast = &(*ppstrLast)->pstrNext;
+   }
+
+   *ppstrLast            = pstrOther->pstrBlocks;
+   pstrArena->nReserved += pstrOther->nReserved;
+   pstrArena->nUsed     += pstrOther->nUsed;
+   pstrArena->nDead     += pstrOther->nDead;
+
+   memset(pstrOther, 0, sizeof(strArena));
+}
+
+
+
+
+/********************************************************************************
+ * Function: MergeNodePool
+ * Params:   pstrPool - node pool of the table
+ *           pstrOther - pool whose slabs and free nodes move to pstrPool, left
+ *                       empty
+ * Returns:  None
+ * Call by:  BuildHashTable()
+ * Call to:  None
+ * Overview: Links the slabs of pstrOther after the last slab of pstrPool, and
+ *           its free nodes in front of the free list of pstrPool.
+ * Notes:    The current slab of pstrPool stays the one allocated from.
+ ********************************************************************************/
+static void MergeNodePool(strNodePool *pstrPool, strNodePool *pstrOther)
+{
+   strNodeSlab  **ppstrLast = &pstrPool->pstrSlabs;
+   strHashTable  *pstrNode  = NULL;
+
+
+
+   while (*ppstrLast != NULL)
+   {
+      ppstrLast = &(*ppstrLast)->pstrNext;
+   }
+
+   *ppstrLast = pstrOther->pstrSlabs;
+
+   while ((pstrNode = pstrOther->pstrFree) != NULL)
+   {
+      pstrOther->pstrFree = pstrNode->pstrNext;
+      pstrNode->pstrNext  = pstrPool->pstrFree;
+      pstrPool->pstrFree  = pstrNode;
+   }
+
+   pstrPool->nReserved += pstrOther->nReserved;
+   pstrPool->lnFree    += pstrOther->lnFree;
+
+   memset(pstrOther, 0, sizeof(strNodePool));
+}
+
+
+
+
+/********************************************************************************
+ * Function: MigrateHashTable
+ * Params:   pstrHash - hash table
+ *           nSteps - number of old buckets (or slots) to move, INT_MAX to
+ *                    finish the resize
+ * Returns:  0 - no resize in progress anymore
+ *           >0 - old buckets (or slots) still to be moved
+ *           <0 - cannot allocate memory, try again later
+ * Call by:  AddEntryToChainTable()
+ *           AddEntryToOpenTable()
+ *           DeleteEntryFromHashTable()
+ *           DeleteEntryFromOpenTable()
+ *           EvictCacheEntry()
+ *           ResizeHashTable()
+ * Call to:  DropChainIndex()
+ *           FreeHashArray()
+ *           FreeOpenSlot()
+ *           IndexChainNode()
+ *           LinkChainKey()
+ *           NodeFree()
+ * Overview: Moves the next buckets of the old array into the current array.
+ *           Chain nodes are relinked as they are, only the key in the bucket
+ *           head may need a new node.  Chains growing long in the current
+ *           array get indexed, and the index of a moved chain is dropped.  Open addressing moves one group of slots
+ *           at a time, and marks the moved slots as deleted so probes through
+ *           the old array still pass them.
+ *           The old array is freed once all of it has been moved.
+ * Notes:    Keys are moved, not copied, so long keys stay in the arena.  The
+ *           hash stored with each key is reused, nothing is hashed again.
+ ********************************************************************************/
+static int MigrateHashTable(strHash *pstrHash, int nSteps)
+{
+   int            nIndex      = 0;
+   int            nSlot       = 0;
+   unsigned long  ulHash      = 0;
+   strHashArray  *pstrOld     = &pstrHash->strOldArray;
+   strHashArray  *pstrArray   = &pstrHash->strArray;
+   strHashTable  *pstrHead    = NULL;
+   strHashTable  *pstrCurrent = NULL;
+   strHashTable  *pstrNext    = NULL;
+
+
+
+   for (; nSteps > 0 && pstrHash->nMigrated < pstrOld->nSize; nSteps--)
+   {
+      if (pstrHash->nEngine == ENGINE_OPEN)
+      {
+         for (nIndex=0; nIndex<HASH_GROUP; nIndex++)
+         {
+            nSlot = pstrHash->nMigrated + nIndex;
+
+            if ((pstrOld->pachControl[nSlot] & HASH_CTRL_EMPTY) == 0)
+            {
+               ulHash = pstrOld->pastrSlots[nSlot].ulHash;
+               nSlot  = FreeOpenSlot(pstrArray, ulHash);
+
+               if (pstrArray->pachControl[nSlot] == HASH_CTRL_DELETED)
+               {
+                  pstrArray->lnDeleted--;
+               }
+
+               pstrArray->pastrSlots[nSlot]  = pstrOld->pastrSlots[pstrHash->nMigrated + nIndex];
+               pstrArray->pachControl[nSlot] = (unsigned char) (ulHash & 0x7F);
+
+               pstrOld->pachControl[pstrHash->nMigrated + nIndex] = HASH_CTRL_DELETED;
+            }
+         }
+
+         pstrHash->nMigrated += HASH_GROUP;
+         nSteps -= HASH_GROUP - 1;
+         continue;
+      }
+
+
+      /*************************************************************************
+       * Chain nodes after the head never need memory, so move them first.  If
+       * the head key cannot get a node, the bucket stays and is retried later,
+       * so its index must already be gone.
+       *************************************************************************/
+      DropChainIndex(pstrOld, pstrHash->nMigrated);
+
+      pstrHead = &pstrOld->pastrBuckets[pstrHash->nMigrated];
+
+      for (pstrCurrent = pstrHead->pstrNext; pstrCurrent != NULL; pstrCurrent = pstrNext)
+      {
+         pstrNext = pstrCurrent->pstrNext;
+         ulHash   = pstrCurrent->strKey.ulHash;
+
+         if (pstrArray->pastrBuckets[ulHash % pstrArray->nSize].strKey.nLength == 0)
+         {
+            LinkChainKey(pstrHash, pstrArray, ulHash, &pstrCurrent->strKey);
+            NodeFree(&pstrHash->strNodes, pstrCurrent);
+            pstrHash->lnChainNodes--;
+         }
+         else
+         {
+            pstrHead = &pstrArray->pastrBuckets[ulHash % pstrArray->nSize];
+            pstrCurrent->pstrNext = pstrHead->pstrNext;
+            pstrHead->pstrNext    = pstrCurrent;
+
+            IndexChainNode(pstrArray, (int) (ulHash % pstrArray->nSize), pstrCurrent);
+         }
+      }
+
+      pstrHead = &pstrOld->pastrBuckets[pstrHash->nMigrated];
+      pstrHead->pstrNext = NULL;
+
+      if (pstrHead->strKey.nLength != 0)
+      {
+         ulHash = pstrHead->strKey.ulHash;
+
+         if (LinkChainKey(pstrHash, pstrArray, ulHash, &pstrHead->strKey) != 0)
+         {
+            return(-1);
+         }
+
+         memset(&pstrHead->strKey, 0, sizeof(strHashKey));
+      }
+
+      pstrHash->nMigrated++;
+   }
+
+
+   if (pstrOld->nSize != 0 && pstrHash->nMigrated >= pstrOld->nSize)
+   {
+      Debug("Resize to %d done\n", pstrArray->nSize);
+
+      FreeHashArray(pstrOld);
+      pstrHash->nMigrated = 0;
+   }
+
+
+   return(pstrOld->nSize - pstrHash->nMigrated);
+}
+
+
+
+
+/********************************************************************************
+ * Function: MixFilterHash
+ * Params:   ulHash - HashKey() of a key
+ * Returns:  Hash with every bit depending on every bit of ulHash
+ * Call by:  CountFilterKey()
+ *           PrefetchBuckets()
+ *           TestFilterKey()
+ * Call to:  HashWyMix()
+ * Overview: The low bits pick the block of the filter, the high 32 bits the
+ *           counters inside the block.
+ * Notes:    The bucket only depends on the low bits of ulHash, so the filter
+ *           mixes them first rather than reuse them.
+ ********************************************************************************/
+static unsigned long MixFilterHash(unsigned long ulHash)
+{
+   return(HashWyMix(ulHash, 0x9e3779b97f4a7c15UL));
+}
+
+
+
+
+/********************************************************************************
+ * Function: NextHashEntry
+ * Params:   pstrHash - hash table
+ *           pstrCursor - position in the table, all 0 to start
+ * Returns:  Key of the next entry
+ *           NULL - no more entries
+ * Call by:  BuildHashFilter()
+ *           CompactJournal()
+ *           CompactKeyArena()
+ *           FreezeHashTable()
+ *           SaveSnapshot()
+ * Call to:  None
+ * Overview: Walks every entry of the current array, then of the old array,
+ *           for either engine.
+ * Notes:    The table must not change during the walk.  Buckets and slots of
+ *           the old array that were already migrated are empty, so they are
+ *           not returned twice.
+ ********************************************************************************/
+static const strHashKey *NextHashEntry(const strHash *pstrHash, strHashCursor *pstrCursor)
+{
+   int                 nSlot     = 0;
+   const strHashArray *pstrArray = NULL;
+   const strHashKey   *pstrKey   = NULL;
+
+
+
+   for (; pstrCursor->nArray < 2; pstrCursor->nArray++, pstrCursor->nIndex = 0)
+   {
+      pstrArray = pstrCursor->nArray == 0 ? &pstrHash->strArray : &pstrHash->strOldArray;
+
+      if (pstrHash->nEngine == ENGINE_OPEN)
+      {
+         while (pstrCursor->nIndex < pstrArray->nSize)
+         {
+            nSlot = pstrCursor->nIndex++;
+
+            if ((pstrArray->pachControl[nSlot] & HASH_CTRL_EMPTY) == 0)
+            {
+               return(&pstrArray->pastrSlots[nSlot]);
+            }
+         }
+
+         continue;
+      }
+
+      while (pstrCursor->pstrNode != NULL || pstrCursor->nIndex < pstrArray->nSize)
+      {
+         if (pstrCursor->pstrNode == NULL)
+         {
+            pstrCursor->pstrNode = &pstrArray->pastrBuckets[pstrCursor->nIndex++];
+         }
+
+         pstrKey              = &pstrCursor->pstrNode->strKey;
+         pstrCursor->pstrNode = pstrCursor->pstrNode->pstrNext;
+
+         if (pstrKey->nLength != 0)
+         {
+            return(pstrKey);
+         }
+      }
+   }
+
+
+   return(NULL);
+}
+
+
+
+
+/********************************************************************************
+ * Function: NextTraceRecord
+ * Params:   pstrTrace - trace mapped by MapHashTrace()
+ *           pstrRecord - receives the next operation of the trace
+ * Returns:  1 - record read
+ *           0 - no records left
+ *           <0 - the trace ends in a torn record, or a record is not valid
+ * Call by:  RunReplay()
+ * Call to:  ReadTraceNumber()
+ * Overview: Decodes the record at the current offset and moves past it.  The
+ *           key and value are not copied.
+ * Notes:    A trace of a process that was killed ends where its buffer was
+ *           last written, which may be in the middle of a record.
+ ********************************************************************************/
+int NextTraceRecord(strHashTrace *pstrTrace, strTraceRecord *pstrRecord)
+{
+   size_t         nOffset = pstrTrace->nOffset;
+   unsigned long  ulDelta = 0;
+   unsigned long  ulValue = 0;
+
+
+
+   if (nOffset >= pstrTrace->nSize)
+   {
+      return(0);
+   }
+
+   memset(pstrRecord, 0, sizeof(strTraceRecord));
+   pstrRecord->nOp = (traceop) (unsigned char) pstrTrace->pchMap[nOffset++];
+
+   if (pstrRecord->nOp < TRACE_ADD || pstrRecord->nOp > TRACE_PUT ||
+       ReadTraceNumber(pstrTrace, &nOffset, &ulDelta) != 0 ||
+       ReadTraceNumber(pstrTrace, &nOffset, &ulValue) != 0 ||
+       ulValue >= pstrTrace->nSize - nOffset ||
+       pstrTrace->pchMap[nOffset + ulValue] != '\0')
+   {
+      return(-1);
+   }
+
+   pstrRecord->pszData = pstrTrace->pchMap + nOffset;
+   pstrRecord->nLength = ulValue;
+   nOffset            += ulValue + 1;
+
+   if (pstrRecord->nOp == TRACE_PUT)
+   {
+      if (ReadTraceNumber(pstrTrace, &nOffset, &ulValue) != 0 ||
+          ulValue > pstrTrace->nSize - nOffset)
+      {
+         return(-1);
+      }
+
+      pstrRecord->pchValue     = pstrTrace->pchMap + nOffset;
+      pstrRecord->nValueLength = ulValue;
+      nOffset                 += ulValue;
+   }
+
+   pstrTrace->ulTime  += ulDelta;
+   pstrTrace->nOffset  = nOffset;
+   pstrRecord->ulTime  = pstrTrace->ulTime;
+
+
+   return(1);
+}
+
+
+
+
+/********************************************************************************
+ * Function: NodeAlloc
+ * Params:   pstrPool - node pool of the table
+ * Returns:  Zeroed chain node
+ *           NULL - cannot allocate memory
+ * Call by:  AddEntryToChainTable()
+ *           BuildChainPartition()
+ *           LinkChainKey()
+ * Call to:  HugePageSize()
+ *           PageAlloc()
+ * Overview: Takes a node from the free list, or else the next unused node of
+ *           the current slab.  Starts a new slab when the current one is full.
+ * Notes:    Memory is only released by FreeHashTable().  Outside
+ *           PAGES_DEFAULT, slabs grow to a huge page, and a slab gets as many
+ *           nodes as its mapping holds.
+ ********************************************************************************/
+static strHashTable *NodeAlloc(strNodePool *pstrPool)
+{
+   size_t        nSlabSize = HASH_SLAB_FIRST;
+   size_t        nMaxSize  = HASH_SLAB_NODES;
+   strNodeSlab  *pstrSlab  = pstrPool->pstrSlabs;
+   strHashTable *pstrNode  = NULL;
+   strPageMap    strMap;
+
+
+
+   if ((pstrNode = pstrPool->pstrFree) != NULL)
+   {
+      pstrPool->pstrFree = pstrNode->pstrNext;
+      pstrPool->lnFree--;
+   }
+   else
+   {
+      if (pstrSlab == NULL || pstrSlab->nUsed == pstrSlab->nSize)
+      {
+         if (pstrPool->pstrPages != NULL && pstrPool->pstrPages->nPolicy != PAGES_DEFAULT)
+         {
+            nMaxSize = (HugePageSize() - sizeof(strNodeSlab)) / sizeof(strHashTable);
+         }
+
+         if (pstrSlab != NULL && pstrSlab->nSize * 2 < nMaxSize)
+         {
+            nSlabSize = pstrSlab->nSize * 2;
+         }
+         else if (pstrSlab != NULL)
+         {
+            nSlabSize = nMaxSize;
+         }
+
+         pstrSlab = (strNodeSlab *) PageAlloc(pstrPool->pstrPages, sizeof(strNodeSlab) +
+                                              nSlabSize * sizeof(strHashTable), &strMap);
+
+         if (pstrSlab == NULL)
+         {
+            fprintf(stderr, "Failed allocation in NodeAlloc(). errno=%d.\n", errno);
+            return(NULL);
+         }
+
+         if (strMap.nMapped != 0)
+         {
+            nSlabSize = (strMap.nMapped - sizeof(strNodeSlab)) / sizeof(strHashTable);
+         }
+
+         pstrSlab->nSize      = nSlabSize;
+         pstrSlab->nUsed      = 0;
+         pstrSlab->strMap     = strMap;
+         pstrSlab->pstrNext   = pstrPool->pstrSlabs;
+         pstrPool->pstrSlabs  = pstrSlab;
+         pstrPool->nReserved += sizeof(strNodeSlab) + nSlabSize * sizeof(strHashTable);
+      }
+
+      pstrNode = &pstrSlab->astrNodes[pstrSlab->nUsed++];
+   }
+
+
+   memset(pstrNode, 0, sizeof(strHashTable));
+
+
+   return(pstrNode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: NodeFree
+ * Params:   pstrPool - node pool of the table
+ *           pstrNode - chain node no longer linked in any bucket
+ * Returns:  None
+ * Call by:  AddEntryToChainTable()
+ *           MigrateHashTable()
+ *           UnlinkChainEntry()
+ * Call to:  None
+ * Overview: Puts the node on the free list for the next NodeAlloc().
+ * Notes:    The key of a node is not released here.  Long keys stay in the
+ *           arena, counted as dead by the caller.
+ ********************************************************************************/
+static void NodeFree(strNodePool *pstrPool, strHashTable *pstrNode)
+{
+   pstrNode->pstrNext = pstrPool->pstrFree;
+   pstrPool->pstrFree = pstrNode;
+   pstrPool->lnFree++;
+}
+
+
+
+
+/********************************************************************************
+ * Function: NumaNodes
+ * Params:   None
+ * Returns:  Bit mask of the NUMA nodes online
+ * Call by:  PlacePages()
+ *           SetHashPages()
+ * Call to:  None
+ * Overview: Reads /sys/devices/system/node/online on the first call.  The
+ *           file lists nodes and ranges of nodes, as in "0" or "0-1,4".
+ * Notes:    Only the first HASH_NUMA_NODES nodes are kept.  Node 0 alone when
+ *           the file cannot be read, as on a kernel without NUMA.  Kept in a
+ *           static of the function like HugePageSize().
+ ********************************************************************************/
+static unsigned long NumaNodes(void)
+{
+   static unsigned long  ulNodes  = 0;
+   unsigned long         ulNow    = __atomic_load_n(&ulNodes, __ATOMIC_RELAXED);
+   char                 *pszNext  = NULL;
+   char                 *pszEnd   = NULL;
+   long                  lnFirst  = 0;
+   long                  lnLast   = 0;
+   FILE                 *pFile    = NULL;
+   char                  szLine[256];
+
+
+
+   if (ulNow != 0)
+   {
+      return(ulNow);
+   }
+
+   if ((pFile = fopen("/sys/devices/system/node/online", "r")) != NULL)
+   {
+      pszNext = fgets(szLine, sizeof(szLine), pFile);
+
+      while (pszNext != NULL)
+      {
+         lnFirst = strtol(pszNext, &pszEnd, 10);
+
+         if (pszEnd == pszNext || lnFirst < 0)
+         {
+            break;
+         }
+
+         lnLast = lnFirst;
+
+         if (*pszEnd == '-')
+         {
+            lnLast = strtol(pszEnd + 1, &pszEnd, 10);
+         }
+
+         for (; lnFirst<=lnLast && lnFirst<HASH_NUMA_NODES; lnFirst++)
+         {
+            ulNow |= 1UL << lnFirst;
+         }
+
+         pszNext = *pszEnd == ',' ? pszEnd + 1 : NULL;
+      }
+
+      fclose(pFile);
+   }
+
+   if (ulNow == 0)
+   {
+      ulNow = 1;
+   }
+
+   __atomic_store_n(&ulNodes, ulNow, __ATOMIC_RELAXED);
+
+
+   return(ulNow);
+}
+
+
+
+
+/********************************************************************************
+ * Function: NumaPolicyName
+ * Params:   nNuma - NUMA placement of the table storage
+ * Returns:  Name of the policy, as given to --numa and printed by --stats
+ * Call by:  ProcessCommandLine()
+ *           StatsHashTable()
+ * Call to:  None
+ * Overview: Maps a NUMA policy to its name.
+ * Notes:    Returns NULL past the last policy, so callers can loop over all of
+ *           them.
+ ********************************************************************************/
+const char *NumaPolicyName(numapolicy nNuma)
+{
+   switch (nNuma)
+   {
+      case NUMA_LOCAL:      return("local");
+      case NUMA_INTERLEAVE: return("interleave");
+      case NUMA_BIND:       return("bind");
+      default:              return(NULL);
+   }
+}
+
+
+
+
+/********************************************************************************
+ * Function: OpenHashJournal
+ * Params:   pstrHash - hash table
+ *           pszFile - journal file, created if it does not exist
+ *           nSync - JOURNAL_ALWAYS, JOURNAL_GROUP or JOURNAL_NEVER
+ *           lnGroupMs - with JOURNAL_GROUP, longest time between syncs in
+ *                       milliseconds, or 0
+ *           lnGroupOps - with JOURNAL_GROUP, most records between syncs, or 0
+ * Returns:  >=0 - journal open, number of records replayed from it
+ *           <0 - cannot open, read or replay the journal
+ * Call by:  OpenJournal()
+ * Call to:  CompactJournal()
+ *           JournalClock()
+ *           ReplayJournal()
+ *           TornJournalTail()
+ *           WriteJournal()
+ * Overview: Replays the records of the journal into the table, then keeps the
+ *           journal open: from then on every add, put and delete that changes
+ *           the table is appended to it, and synced as nSync asks.  A journal
+ *           with too many records of keys since changed or deleted is
+ *           rewritten with the live keys only, see CompactJournal().
+ * Notes:    The journal is mapped for the replay, and the keys are added from
+ *           the map without being copied.  A last record torn by a crash ends
+ *           the replay, and the journal is cut before it.  A damaged record
+ *           with more bytes after it fails the open and leaves the file as it
+ *           is, since valid records may follow.  The records are replayed on
+ *           top of the keys the table already holds, such as a snapshot.
+ ********************************************************************************/
+long OpenHashJournal(strHash *pstrHash, const char *pszFile, journalsync nSync,
+                     long lnGroupMs, long lnGroupOps)
+{
+   int               nFile       = -1;
+   long              lnRecords   = 0;
+   size_t            nGood       = sizeof(strJournalHeader);
+   char             *pchMap      = NULL;
+   const char       *pszError    = NULL;
+   strJournal       *pstrJournal = &pstrHash->strJournal;
+   strJournalHeader  strHeader;
+   struct stat       strStat;
+
+
+
+   if (pstrJournal->pchBuffer != NULL)
+   {
+      fprintf(stderr, "The table already has a journal.\n");
+      return(-1);
+   }
+
+   if (nSync == JOURNAL_GROUP && lnGroupMs <= 0 && lnGroupOps <= 0)
+   {
+      fprintf(stderr, "A group commit needs a time or a number of records.\n");
+      return(-1);
+   }
+
+   if (snprintf(pstrJournal->szFile, sizeof(pstrJournal->szFile), "%s.tmp", pszFile) >=
+       (int) sizeof(pstrJournal->szFile))
+   {
+      fprintf(stderr, "Journal name [%s] is too long.\n", pszFile);
+      return(-1);
+   }
+
+   strcpy(pstrJournal->szFile, pszFile);
+
+   if ((nFile = open(pszFile, O_RDWR | O_CREAT | O_APPEND, 0644)) < 0 ||
+       fstat(nFile, &strStat) != 0)
+   {
+      fprintf(stderr, "Cannot open [%s]. errno=%d.\n", pszFile, errno);
+
+      if (nFile >= 0)
+      {
+         close(nFile);
+      }
+
+      return(-1);
+   }
+
+   pstrJournal->nFile = nFile;
+
+
+   /****************************************************************************
+    * pchBuffer is still NULL, so the changes of the replay are not journaled
+    * again.
+    ****************************************************************************/
+   memset(&strHeader, 0, sizeof(strHeader));
+   memcpy(strHeader.achMagic, HASH_JOURNAL_MAGIC, sizeof(strHeader.achMagic));
+   strHeader.nVersion = HASH_JOURNAL_VERSION;
+
+   if (strStat.st_size == 0)
+   {
+      if (WriteJournal(pstrJournal, (const char *) &strHeader, sizeof(strHeader)) != 0)
+      {
+         pszError = "cannot be written";
+      }
+   }
+   else if ((size_t) strStat.st_size < sizeof(strJournalHeader) ||
+            (pchMap = (char *) mmap(NULL, strStat.st_size, PROT_READ, MAP_PRIVATE,
+                                    nFile, 0)) == MAP_FAILED)
+   {
+      pchMap   = NULL;
+      pszError = "cannot be read";
+   }
+   else if (memcmp(pchMap, &strHeader, sizeof(strHeader)) != 0)
+   {
+      pszError = "is not a journal of this version";
+   }
+   else if ((lnRecords = ReplayJournal(pstrHash, pchMap, strStat.st_size, &nGood)) < 0)
+   {
+      pszError = "cannot be replayed";
+   }
+   else if (nGood < (size_t) strStat.st_size &&
+            TornJournalTail(pchMap, strStat.st_size, nGood) == FALSE)
+   {
+      fprintf(stderr, "Journal [%s] has a damaged record at byte %zu, with %zu more bytes "
+              "after it.\n", pszFile, nGood, (size_t) strStat.st_size - nGood);
+      pszError = "is kept as it is, move it away or cut it at the damaged record";
+   }
+
+   if (pchMap != NULL)
+   {
+      munmap(pchMap, strStat.st_size);
+   }
+
+   if (pszError == NULL && strStat.st_size > 0 && nGood < (size_t) strStat.st_size)
+   {
+      fprintf(stderr, "Journal [%s] ends with %zu bytes of a torn record, dropped.\n",
+              pszFile, (size_t) strStat.st_size - nGood);
+
+      if (ftruncate(nFile, nGood) != 0)
+      {
+         pszError = "cannot be cut";
+      }
+   }
+
+   if (pszError == NULL &&
+       (pstrJournal->pchBuffer = (char *) malloc(HASH_JOURNAL_BUFFER)) == NULL)
+   {
+      pszError = "has no memory for its buffer";
+   }
+
+   if (pszError != NULL)
+   {
+      fprintf(stderr, "Journal [%s] %s.\n", pszFile, pszError);
+      close(nFile);
+      memset(pstrJournal, 0, sizeof(strJournal));
+      return(-1);
+   }
+
+
+   pstrJournal->nSync      = nSync;
+   pstrJournal->lnGroupMs  = lnGroupMs;
+   pstrJournal->lnGroupOps = lnGroupOps;
+   pstrJournal->lnRecords  = lnRecords;
+   pstrJournal->ulSyncMs   = JournalClock();
+
+   Debug("Replayed %ld records of journal [%s]\n", lnRecords, pszFile);
+
+   if (lnRecords > HASH_JOURNAL_DEAD * pstrHash->lnEntries + HASH_JOURNAL_SLACK)
+   {
+      CompactJournal(pstrHash);
+   }
+
+
+   return(lnRecords);
+}
+
+
+
+
+/********************************************************************************
+ * Function: OpenHashTrace
+ * Params:   pstrHash - hash table
+ *           pszFile - trace file, replaced if it exists
+ * Returns:  0 - trace open
+ *           <0 - cannot create or write the trace
+ * Call by:  main()
+ * Call to:  TraceClock()
+ *           WriteTrace()
+ * Overview: From now on every add, search, delete and put called on the table
+ *           is appended to the trace with the time since the previous one,
+ *           whether it changes the table or not, so the workload can be
+ *           replayed on another table with the same timing.
+ * Notes:    Batched calls record one operation per key.  TTLs, and keys
+ *           evicted or expired in cache mode, are not recorded; a replay on a
+ *           cache evicts them again.  The trace is closed by FreeHashTable().
+ ********************************************************************************/
+int OpenHashTrace(strHash *pstrHash, const char *pszFile)
+{
+   strTrace        *pstrTrace = &pstrHash->strTrace;
+   strTraceHeader   strHeader;
+   struct timespec  strNow;
+
+
+
+   if (pstrTrace->pchBuffer != NULL)
+   {
+      fprintf(stderr, "The table is already traced.\n");
+      return(-1);
+   }
+
+   if ((pstrTrace->nFile = open(pszFile, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+   {
+      fprintf(stderr, "Cannot open [%s]. errno=%d.\n", pszFile, errno);
+      memset(pstrTrace, 0, sizeof(strTrace));
+      return(-1);
+   }
+
+   clock_gettime(CLOCK_REALTIME, &strNow);
+
+   memset(&strHeader, 0, sizeof(strHeader));
+   memcpy(strHeader.achMagic, HASH_TRACE_MAGIC, sizeof(strHeader.achMagic));
+   strHeader.nVersion = HASH_TRACE_VERSION;
+   strHeader.ulStart  = (unsigned long) strNow.tv_sec * 1000000000UL + strNow.tv_nsec;
+
+   if (WriteTrace(pstrTrace, (const char *) &strHeader, sizeof(strHeader)) != 0 ||
+       (pstrTrace->pchBuffer = (char *) malloc(HASH_TRACE_BUFFER)) == NULL)
+   {
+      fprintf(stderr, "Trace [%s] cannot be started.\n", pszFile);
+      close(pstrTrace->nFile);
+      memset(pstrTrace, 0, sizeof(strTrace));
+      return(-1);
+   }
+
+   pstrTrace->ulLast = TraceClock();
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: OpenSharedTable
+ * Params:   pszName - name of the shared memory segment, such as "/hash"
+ *           nHash - hash function used for keys, when creating
+ *           aulSeed - key for siphash, when creating
+ *           lnCapacity - most keys the table holds, when creating
+ *           nKeyMax - longest key in bytes, when creating
+ *           pbCreated - set to TRUE when the segment was created, FALSE when
+ *                       it already existed
+ * Returns:  Handle on the shared table
+ *           NULL - invalid size, or cannot create, map or attach the segment
+ * Call by:  RunShared()
+ * Call to:  None
+ * Overview: Creates the segment, sizes it for lnCapacity keys, fills in the
+ *           header and initializes the writers' lock as robust and process
+ *           shared.  If another process created it first, attaches to it
+ *           instead, and the table keeps the hash, seed and sizes it was
+ *           created with.
+ * Notes:    nVersion is stored last, so a process attaching while the table is
+ *           being created waits for it, for up to HASH_SHARED_WAIT ms.  The
+ *           segment outlives the processes, until RemoveSharedTable().  Release
+ *           the handle with CloseSharedTable().
+ ********************************************************************************/
+strSharedHash *OpenSharedTable(const char *pszName, hashfn nHash, const unsigned long *aulSeed,
+                               long lnCapacity, int nKeyMax, boolean *pbCreated)
+{
+   int                  nFile      = -1;
+   int                  nWait      = 0;
+   size_t               nNodeSize  = 0;
+   size_t               nBuckets   = 0;
+   size_t               nNodeStart = 0;
+   size_t               nSize      = 0;
+   unsigned long        ulBuckets  = HASH_SHARED_BUCKETS;
+   char                *pchMap     = MAP_FAILED;
+   strSharedHeader     *pstrHeader = NULL;
+   strSharedHash       *pstrShared = NULL;
+   pthread_mutexattr_t  strAttr;
+   struct stat          strStat;
+   struct timespec      strPause;
+
+
+
+   *pbCreated = FALSE;
+
+   if (lnCapacity < 1 || lnCapacity > INT_MAX / 2 || nKeyMax < 1 || nKeyMax > USHRT_MAX)
+   {
+      fprintf(stderr, "Invalid shared table of %ld keys of %d bytes.\n", lnCapacity, nKeyMax);
+      return(NULL);
+   }
+
+   while (ulBuckets < (unsigned long) lnCapacity)
+   {
+      ulBuckets = ulBuckets * 2;
+   }
+
+   nNodeSize  = (offsetof(strSharedNode, achKey) + nKeyMax + 1 + 7) & ~(size_t) 7;
+   nBuckets   = (sizeof(strSharedHeader) + HASH_CACHE_LINE - 1) & ~(size_t) (HASH_CACHE_LINE-1);
+   nNodeStart = (nBuckets + ulBuckets * sizeof(unsigned int) + HASH_CACHE_LINE - 1) &
+                ~(size_t) (HASH_CACHE_LINE-1);
+   nSize      = nNodeStart + (size_t) lnCapacity * nNodeSize;
+
+   strPause.tv_sec  = 0;
+   strPause.tv_nsec = 1000000;
+
+
+   /****************************************************************************
+    * Create the segment, or attach to it when it already exists.  The creator
+    * sizes it before anything else, so its size is final once it is not 0.
+    ****************************************************************************/
+   if ((nFile = shm_open(pszName, O_RDWR | O_CREAT | O_EXCL, 0600)) >= 0)
+   {
+      *pbCreated = TRUE;
+
+      if (ftruncate(nFile, (off_t) nSize) != 0 ||
+          (pchMap = (char *) mmap(NULL, nSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                  nFile, 0)) == MAP_FAILED)
+      {
+         fprintf(stderr, "Cannot size shared table [%s]. errno=%d.\n", pszName, errno);
+         close(nFile);
+         shm_unlink(pszName);
+         return(NULL);
+      }
+   }
+   else if (errno == EEXIST && (nFile = shm_open(pszName, O_RDWR, 0)) >= 0)
+   {
+      for (nWait=0; fstat(nFile, &strStat) == 0 && strStat.st_size == 0 &&
+                    nWait < HASH_SHARED_WAIT; nWait++)
+      {
+         nanosleep(&strPause, NULL);
+      }
+
+      nSize = (size_t) strStat.st_size;
+
+      if (nSize >= sizeof(strSharedHeader))
+      {
+         pchMap = (char *) mmap(NULL, nSize, PROT_READ | PROT_WRITE, MAP_SHARED, nFile, 0);
+      }
+
+      if (pchMap == MAP_FAILED)
+      {
+         fprintf(stderr, "Shared table [%s] cannot be mapped.\n", pszName);
+         close(nFile);
+         return(NULL);
+      }
+   }
+   else
+   {
+      fprintf(stderr, "Cannot open shared table [%s]. errno=%d.\n", pszName, errno);
+      return(NULL);
+   }
+
+   close(nFile);
+
+   pstrHeader = (strSharedHeader *) pchMap;
+
+
+   if (*pbCreated == TRUE)
+   {
+      memcpy(pstrHeader->achMagic, HASH_SHARED_MAGIC, sizeof(pstrHeader->achMagic));
+      pstrHeader->nHash      = nHash;
+      pstrHeader->aulSeed[0] = aulSeed[0];
+      pstrHeader->aulSeed[1] = aulSeed[1];
+      pstrHeader->ulBuckets  = ulBuckets;
+      pstrHeader->nCapacity  = (unsigned int) lnCapacity;
+      pstrHeader->nKeyMax    = (unsigned int) nKeyMax;
+      pstrHeader->nNodeSize  = nNodeSize;
+      pstrHeader->nBuckets   = nBuckets;
+      pstrHeader->nNodeStart = nNodeStart;
+      pstrHeader->nSize      = nSize;
+
+      pthread_mutexattr_init(&strAttr);
+      pthread_mutexattr_setpshared(&strAttr, PTHREAD_PROCESS_SHARED);
+      pthread_mutexattr_setrobust(&strAttr, PTHREAD_MUTEX_ROBUST);
+      pthread_mutex_init(&pstrHeader->strMutex, &strAttr);
+      pthread_mutexattr_destroy(&strAttr);
+
+      __atomic_store_n(&pstrHeader->nVersion, HASH_SHARED_VERSION, __ATOMIC_RELEASE);
+   }
+
+   for (nWait=0; __atomic_load_n(&pstrHeader->nVersion, __ATOMIC_ACQUIRE) == 0 &&
+                 nWait < HASH_SHARED_WAIT; nWait++)
+   {
+      nanosleep(&strPause, NULL);
+   }
+
+   if (memcmp(pstrHeader->achMagic, HASH_SHARED_MAGIC, sizeof(pstrHeader->achMagic)) != 0 ||
+       pstrHeader->nVersion != HASH_SHARED_VERSION || pstrHeader->nSize != nSize ||
+       pstrHeader->nBuckets + pstrHeader->ulBuckets * sizeof(unsigned int) >
+       pstrHeader->nNodeStart ||
+       pstrHeader->nNodeStart + (size_t) pstrHeader->nCapacity * pstrHeader->nNodeSize > nSize)
+   {
+      fprintf(stderr, "Shared table [%s] is not a table of this version.\n", pszName);
+      munmap(pchMap, nSize);
+      return(NULL);
+   }
+
+
+   if ((pstrShared = (strSharedHash *) calloc(1, sizeof(strSharedHash))) == NULL)
+   {
+      fprintf(stderr, "Failed calloc() in OpenSharedTable(). errno=%d.\n", errno);
+      munmap(pchMap, nSize);
+
+      if (*pbCreated == TRUE)
+      {
+         shm_unlink(pszName);
+      }
+
+      return(NULL);
+   }
+
+   pstrShared->pstrHeader = pstrHeader;
+   pstrShared->anBuckets  = (unsigned int *) (pchMap + pstrHeader->nBuckets);
+   pstrShared->pchNodes   = pchMap + pstrHeader->nNodeStart;
+   pstrShared->nSize      = nSize;
+
+
+   return(pstrShared);
+}
+
+
+
+
+/********************************************************************************
+ * Function: PageAlloc
+ * Params:   pstrPages - page size and NUMA policy, or NULL for the heap
+ *           nBytes - number of bytes needed
+ *           pstrMap - returns how the storage was obtained
+ * Returns:  Pointer to at least nBytes of zeroed storage
+ *           NULL - cannot allocate memory
+ * Call by:  AllocateHashArray()
+ *           ArenaAlloc()
+ *           NodeAlloc()
+ * Call to:  HugePageSize()
+ *           PlacePages()
+ * Overview: Under PAGES_DEFAULT and NUMA_LOCAL the storage comes from calloc()
+ *           as before.  Otherwise it is mapped: PAGES_HUGETLB first asks for
+ *           pages from the hugetlbfs pool, and when none are free falls back
+ *           to PAGES_THP.  PAGES_THP maps a block of at least half a huge page
+ *           in whole huge pages aligned to one, and advises the kernel to back
+ *           it with transparent huge pages.  Smaller blocks and PAGES_DEFAULT
+ *           are mapped in base pages.  The NUMA policy is then applied to the
+ *           mapping before any page of it is touched.
+ * Notes:    pstrMap->nMapped is 0 for calloc() storage, else the bytes mapped,
+ *           which callers may use whole.  A NUMA policy the kernel refuses
+ *           leaves the pages local, and pstrMap->bPlaced FALSE.  Free with
+ *           PageFree().
+ ********************************************************************************/
+static void *PageAlloc(const strHashPages *pstrPages, size_t nBytes, strPageMap *pstrMap)
+{
+   char   *pchMap  = MAP_FAILED;
+   size_t  nPage   = (size_t) sysconf(_SC_PAGESIZE);
+   size_t  nHuge   = HugePageSize();
+   size_t  nAlign  = nPage;
+   size_t  nHead   = 0;
+
+
+
+   memset(pstrMap, 0, sizeof(strPageMap));
+
+   if (pstrPages == NULL || (pstrPages->nPolicy == PAGES_DEFAULT && pstrPages->nNuma == NUMA_LOCAL))
+   {
+      return(calloc(1, nBytes));
+   }
+
+   if (pstrPages->nPolicy == PAGES_HUGETLB)
+   {
+      pstrMap->nMapped  = (nBytes + nHuge - 1) / nHuge * nHuge;
+      pstrMap->nBacking = BACKING_HUGETLB;
+      pchMap            = mmap(NULL, pstrMap->nMapped, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+      if (pchMap == MAP_FAILED)
+      {
+         Debug("No hugetlbfs pages for %zu bytes, errno=%d\n", pstrMap->nMapped, errno);
+      }
+   }
+
+
+   /****************************************************************************
+    * Base pages, advised for THP when the block spans huge pages.  The mapping
+    * is over sized by a huge page, less a base page, and trimmed to the
+    * alignment at both ends.
+    ****************************************************************************/
+   if (pchMap == MAP_FAILED)
+   {
+      if (pstrPages->nPolicy != PAGES_DEFAULT && nBytes >= nHuge / 2)
+      {
+         nAlign = nHuge;
+      }
+
+      pstrMap->nMapped  = (nBytes + nAlign - 1) / nAlign * nAlign;
+      pstrMap->nBacking = BACKING_PAGES;
+      pchMap            = mmap(NULL, pstrMap->nMapped + nAlign - nPage, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+      if (pchMap == MAP_FAILED)
+      {
+         memset(pstrMap, 0, sizeof(strPageMap));
+         return(NULL);
+      }
+
+      nHead = (nAlign - (unsigned long) pchMap % nAlign) % nAlign;
+
+      if (nHead > 0)
+      {
+         munmap(pchMap, nHead);
+      }
+
+      if (nAlign - nPage > nHead)
+      {
+         munmap(pchMap + nHead + pstrMap->nMapped, nAlign - nPage - nHead);
+      }
+
+      pchMap += nHead;
+
+      if (nAlign == nHuge && madvise(pchMap, pstrMap->nMapped, MADV_HUGEPAGE) == 0)
+      {
+         pstrMap->nBacking = BACKING_THP;
+      }
+   }
+
+   if (pstrPages->nNuma != NUMA_LOCAL)
+   {
+      pstrMap->bPlaced = PlacePages(pchMap, pstrMap->nMapped, pstrPages) == 0 ? TRUE : FALSE;
+   }
+
+
+   return(pchMap);
+}
+
+
+
+
+/********************************************************************************
+ * Function: PageFree
+ * Params:   pMemory - storage from PageAlloc(), or NULL
+ *           pstrMap - how the storage was obtained
+ * Returns:  None
+ * Call by:  CompactKeyArena()
+ *           FreeEntryStorage()
+ *           FreeHashArray()
+ * Call to:  None
+ * Overview: Releases storage with free() or munmap(), whichever matches
+ *           PageAlloc().
+ * Notes:    pstrMap may lie inside the storage, so it is read first.
+ ********************************************************************************/
+static void PageFree(void *pMemory, const strPageMap *pstrMap)
+{
+   size_t nMapped = 0;
+
+
+
+   if (pMemory == NULL)
+   {
+      return;
+   }
+
+   nMapped = pstrMap->nMapped;
+
+   if (nMapped == 0)
+   {
+      free(pMemory);
+   }
+   else
+   {
+      munmap(pMemory, nMapped);
+   }
+}
+
+
+
+
+/********************************************************************************
+ * Function: PagePolicyName
+ * Params:   nPages - page size policy of the table storage
+ * Returns:  Name of the policy, as given to --pages and printed by --stats
+ * Call by:  ProcessCommandLine()
+ *           StatsHashTable()
+ * Call to:  None
+ * Overview: Maps a page size policy to its name.
+ * Notes:    Returns NULL past the last policy, so callers can loop over all of
+ *           them.
+ ********************************************************************************/
+const char *PagePolicyName(pagepolicy nPages)
+{
+   switch (nPages)
+   {
+      case PAGES_DEFAULT: return("default");
+      case PAGES_THP:     return("thp");
+      case PAGES_HUGETLB: return("hugetlb");
+      default:            return(NULL);
+   }
+}
+
+
+
+
+/********************************************************************************
+ * Function: PageUsage
+ * Params:   pstrHash - hash table
+ *           pstrInfo - filled with the pages behind the table storage
+ * Returns:  None
+ * Call by:  GetHashInfo()
+ * Call to:  CountPageBlock()
+ *           HugePageSize()
+ *           ThpBackedBytes()
+ * Overview: Walks the bucket arrays, node slabs and key arena blocks, and adds
+ *           each to the count of the pages that took effect for it, so a
+ *           hugetlb request that fell back shows as THP or base pages.
+ * Notes:    The THP bytes backed by huge pages are read from the kernel, and
+ *           only when some storage was advised for THP.  They cannot be more
+ *           than the bytes advised.
+ ********************************************************************************/
+static void PageUsage(const strHash *pstrHash, strHashInfo *pstrInfo)
+{
+   const strHashArray  *apstrArrays[2] = {&pstrHash->strArray, &pstrHash->strOldArray};
+   const strNodeSlab   *pstrSlab       = NULL;
+   const strArenaBlock *pstrBlock      = NULL;
+   const strHashArray  *pstrArray      = NULL;
+   size_t               nPerSlot       = 0;
+   int                  nArray         = 0;
+
+
+
+   pstrInfo->lnHugePage = (long) HugePageSize();
+
+   for (nArray=0; nArray<2; nArray++)
+   {
+      pstrArray = apstrArrays[nArray];
+      nPerSlot  = pstrArray->pastrBuckets != NULL ? sizeof(strHashTable)
+                                                  : sizeof(strHashKey) + 1;
+
+      if (pstrArray->nSize > 0)
+      {
+         CountPageBlock(pstrInfo, &pstrArray->strMap, (size_t) pstrArray->nSize * nPerSlot);
+      }
+   }
+
+   for (pstrSlab=pstrHash->strNodes.pstrSlabs; pstrSlab!=NULL; pstrSlab=pstrSlab->pstrNext)
+   {
+      CountPageBlock(pstrInfo, &pstrSlab->strMap,
+                     sizeof(strNodeSlab) + pstrSlab->nSize * sizeof(strHashTable));
+   }
+
+   for (pstrBlock=pstrHash->strKeys.pstrBlocks; pstrBlock!=NULL; pstrBlock=pstrBlock->pstrNext)
+   {
+      CountPageBlock(pstrInfo, &pstrBlock->strMap, sizeof(strArenaBlock) + pstrBlock->nSize);
+   }
+
+   if (pstrInfo->lnThpBytes > 0)
+   {
+      pstrInfo->lnThpBacked = ThpBackedBytes();
+
+      if (pstrInfo->lnThpBacked > pstrInfo->lnThpBytes)
+      {
+         pstrInfo->lnThpBacked = pstrInfo->lnThpBytes;
+      }
+   }
+}
+
+
+
+
+/********************************************************************************
+ * Function: PartitionOfHash
+ * Params:   pstrHash - hash table being built
+ *           ulHash - HashKey() of a key
+ *           nPartitions - number of partitions of the build
+ * Returns:  Partition of the key, from 0 to nPartitions-1
+ * Call by:  BuildHashThread()
+ * Call to:  None
+ * Overview: Splits the buckets, or the slot groups of open addressing, into
+ *           nPartitions ranges of consecutive ones, and picks the range of the
+ *           key's bucket or home group.
+ * Notes:    Same bucket and group as AddEntryToChainTable() and
+ *           FreeOpenSlot().
+ ********************************************************************************/
+static int PartitionOfHash(const strHash *pstrHash, unsigned long ulHash, int nPartitions)
+{
+   long lnUnits = pstrHash->strArray.nSize;
+   long lnUnit  = 0;
+
+
+
+   if (pstrHash->nEngine == ENGINE_OPEN)
+   {
+      lnUnits /= HASH_GROUP;
+      lnUnit   = (long) ((ulHash >> 7) & (unsigned long) (lnUnits-1));
+   }
+   else
+   {
+      lnUnit   = (long) (ulHash % (unsigned long) lnUnits);
+   }
+
+
+   return((int) (lnUnit * nPartitions / lnUnits));
+}
+
+
+
+
+/********************************************************************************
+ * Function: PerfectBucket
+ * Params:   ulHash - HashKey() of a key
+ *           ulSeed - seed of the perfect hash
+ *           ulPilots - number of buckets of the perfect hash
+ * Returns:  Bucket of the key, below ulPilots
+ * Call by:  BuildPerfectHash()
+ *           FreezeHashTable()
+ *           PrefetchBuckets()
+ *           SnapshotBucket()
+ * Call to:  HashWyMix()
+ * Overview: Mixes the hash with the seed and scales it to the number of
+ *           buckets with a multiply, so any number of buckets works.
+ * Notes:    None
+ ********************************************************************************/
+static unsigned long PerfectBucket(unsigned long ulHash, unsigned long ulSeed,
+                                   unsigned long ulPilots)
+{
+   return((unsigned long) (((unsigned __int128) HashWyMix(ulHash ^ ulSeed, 0x9e3779b97f4a7c15UL) *
+                            ulPilots) >> 64));
+}
+
+
+
+
+/********************************************************************************
+ * Function: PerfectSlot
+ * Params:   ulHash - HashKey() of a key
+ *           ulSeed - seed of the perfect hash
+ *           nPilot - pilot of the key's bucket
+ *           ulSlots - number of slots
+ * Returns:  Slot of the key, below ulSlots
+ * Call by:  BuildPerfectHash()
+ *           FreezeHashTable()
+ *           SnapshotBucket()
+ * Call to:  HashWyMix()
+ * Overview: Mixes the hash with the seed and the pilot, and scales it to the
+ *           number of slots.  Each pilot gives the keys of a bucket another,
+ *           independent set of slots.
+ * Notes:    The mixing constants differ from those of PerfectBucket(), so the
+ *           slot does not follow from the bucket.
+ ********************************************************************************/
+static unsigned long PerfectSlot(unsigned long ulHash, unsigned long ulSeed, unsigned int nPilot,
+                                 unsigned long ulSlots)
+{
+   return((unsigned long) (((unsigned __int128)
+                            HashWyMix(ulHash ^ ulSeed ^ ((nPilot + 1UL) * 0xbf58476d1ce4e5b9UL),
+                                      0x94d049bb133111ebUL) * ulSlots) >> 64));
+}
+
+
+
+
+/********************************************************************************
+ * Function: PlacePages
+ * Params:   pMemory - mapping from PageAlloc(), not yet touched
+ *           nBytes - bytes in the mapping
+ *           pstrPages - NUMA policy to apply
+ * Returns:  0 - pages will be placed by the policy
+ *           <0 - the kernel refused the policy
+ * Call by:  PageAlloc()
+ * Call to:  NumaNodes()
+ * Overview: NUMA_INTERLEAVE spreads the pages over every node online, so
+ *           threads on any node see the same average latency.  NUMA_BIND puts
+ *           them all on one node.
+ * Notes:    Calls mbind() through syscall(), so the library does not need
+ *           libnuma.  Kernels without NUMA, and containers without the right
+ *           to set a memory policy, refuse it.
+ ********************************************************************************/
+static int PlacePages(void *pMemory, size_t nBytes, const strHashPages *pstrPages)
+{
+   unsigned long ulMask = NumaNodes();
+   int           nMode  = MPOL_INTERLEAVE;
+
+
+
+   if (pstrPages->nNuma == NUMA_BIND)
+   {
+      ulMask = 1UL << pstrPages->nNode;
+      nMode  = MPOL_BIND;
+   }
+
+   if (syscall(SYS_mbind, pMemory, nBytes, nMode, &ulMask, HASH_NUMA_NODES + 1, 0) != 0)
+   {
+      Debug("mbind() of %zu bytes refused, errno=%d\n", nBytes, errno);
+      return(-1);
+   }
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: PrefetchBuckets
+ * Params:   pstrHash - hash table
+ *           aulHash - HashKey() of the keys about to be looked up
+ *           nKeys - number of hashes
+ * Returns:  None
+ * Call by:  AddEntriesToHashTable()
+ *           SearchEntriesInHashTable()
+ * Call to:  MatchGroup()
+ *           MixFilterHash()
+ *           PerfectBucket()
+ *           SnapshotBucket()
+ * Overview: Issues the loads of every key first, then a second round for what
+ *           the first round pointed to: the first chain node after each bucket
+ *           head, the first slot whose hash fragment matches, the first record
+ *           of a snapshot bucket, or the slot offset picked by the pilot of a
+ *           frozen snapshot.  By the second round the first loads have had the
+ *           time of the others to arrive.  The filter blocks, if any, go with
+ *           the first round.
+ * Notes:    Only the current array is prefetched; keys still in the old array
+ *           of a resize miss the cache as before.  Prefetches never fault, so
+ *           a stale address only wastes the prefetch.
+ ********************************************************************************/
+static void PrefetchBuckets(const strHash *pstrHash, const unsigned long *aulHash, int nKeys)
+{
+   int                  nIndex    = 0;
+   int                  nGroups   = pstrHash->strArray.nSize / HASH_GROUP;
+   unsigned int         nMatch    = 0;
+   unsigned long        ulBucket  = 0;
+   unsigned long        ulOffset  = 0;
+   const unsigned char *puchGroup = NULL;
+   const strHashArray  *pstrArray = &pstrHash->strArray;
+   const strSnapshot   *pstrSnap  = &pstrHash->strSnap;
+
+
+
+   if (pstrSnap->puchMap != NULL && pstrSnap->pstrHeader->ulPilots != 0)
+   {
+      for (nIndex=0; nIndex<nKeys; nIndex++)
+      {
+         __builtin_prefetch(&pstrSnap->anPilots[PerfectBucket(aulHash[nIndex],
+                                                              pstrSnap->pstrHeader->ulPilotSeed,
+                                                              pstrSnap->pstrHeader->ulPilots)]);
+      }
+
+      for (nIndex=0; nIndex<nKeys; nIndex++)
+      {
+         __builtin_prefetch(&pstrSnap->aulBuckets[SnapshotBucket(pstrSnap, aulHash[nIndex])]);
+      }
+
+      return;
+   }
+
+   if (pstrSnap->puchMap != NULL)
+   {
+      for (nIndex=0; nIndex<nKeys; nIndex++)
+      {
+         ulBucket = SnapshotBucket(pstrSnap, aulHash[nIndex]);
+         __builtin_prefetch(&pstrSnap->aulBuckets[ulBucket]);
+      }
+
+      for (nIndex=0; nIndex<nKeys; nIndex++)
+      {
+         ulBucket = SnapshotBucket(pstrSnap, aulHash[nIndex]);
+         ulOffset = pstrSnap->aulBuckets[ulBucket];
+
+         if (ulOffset != 0 && ulOffset < pstrSnap->nSize)
+         {
+            __builtin_prefetch(pstrSnap->puchMap + ulOffset);
+         }
+      }
+
+      return;
+   }
+
+   if (pstrArray->nSize == 0)
+   {
+      return;
+   }
+
+   for (nIndex=0; pstrHash->strFilter.puchCounters != NULL && nIndex<nKeys; nIndex++)
+   {
+      __builtin_prefetch(pstrHash->strFilter.puchCounters +
+                         (MixFilterHash(aulHash[nIndex]) & (pstrHash->strFilter.ulBlocks - 1)) *
+                         HASH_CACHE_LINE);
+   }
+
+
+   if (pstrHash->nEngine == ENGINE_OPEN)
+   {
+      for (nIndex=0; nIndex<nKeys; nIndex++)
+      {
+         ulBucket = (aulHash[nIndex] >> 7) & (unsigned long) (nGroups-1);
+         __builtin_prefetch(&pstrArray->pachControl[ulBucket*HASH_GROUP]);
+      }
+
+      for (nIndex=0; nIndex<nKeys; nIndex++)
+      {
+         ulBucket  = (aulHash[nIndex] >> 7) & (unsigned long) (nGroups-1);
+         puchGroup = &pstrArray->pachControl[ulBucket*HASH_GROUP];
+         nMatch    = MatchGroup(puchGroup, (unsigned char) (aulHash[nIndex] & 0x7F));
+
+         if (nMatch != 0)
+         {
+            __builtin_prefetch(&pstrArray->pastrSlots[ulBucket*HASH_GROUP +
+                                                      __builtin_ctz(nMatch)]);
+         }
+      }
+
+      return;
+   }
+
+
+   for (nIndex=0; nIndex<nKeys; nIndex++)
+   {
+      __builtin_prefetch(&pstrArray->pastrBuckets[aulHash[nIndex] % pstrArray->nSize]);
+   }
+
+   for (nIndex=0; nIndex<nKeys; nIndex++)
+   {
+      if (pstrArray->pastrBuckets[aulHash[nIndex] % pstrArray->nSize].pstrNext != NULL)
+      {
+         __builtin_prefetch(pstrArray->pastrBuckets[aulHash[nIndex] %
+                                                    pstrArray->nSize].pstrNext);
+      }
+   }
+}
+
+
+
+
+/********************************************************************************
+ * Function: PutEntryInHashTable
+ * Params:   pstrHash - hash table
+ *           pszData - data to add or update
+ *           pchValue - value to store with the data, may be NULL when
+ *                      nValueLength is 0
+ *           nValueLength - bytes of pchValue
+ * Returns:  0 - data added with its value
+ *           greater than 0 - data already exists and its value was replaced,
+ *                            or the data is empty
+ *           less than 0 - error, normally cannot allocate memory
+ * Call by:  main()
+ *           ProcessBatchLine()
+ *           ReplayJournal()
+ *           RunReplay()
+ *           ServerCommand()
+ * Call to:  AddEntryToChainTable()
+ *           AddEntryToOpenTable()
+ *           AppendJournal()
+ *           AppendTrace()
+ *           CacheExpiry()
+ *           CacheFull()
+ *           CommitJournal()
+ *           FindHashedKey()
+ *           HashKey()
+ *           ImportSnapshot()
+ *           MakeCacheRoom()
+ *           RemoveCacheEntry()
+ *           SetEntryValue()
+ *           TestFilterKey()
+ *           TouchCacheEntry()
+ * Overview: Upsert.  Data already in the table gets the new value in place,
+ *           in its entry or over the arena bytes of its old value when they
+ *           are enough, so the key is neither deleted nor hashed into the table
+ *           again.  Other data is added with the value, like AddEntryToHashTable()
+ *           would.
+ * Notes:    Replacing a value counts as an update, not an insert, and keeps
+ *           the TTL of the key.  In cache mode, a value that needs more arena
+ *           bytes while the cache is full is the one exception: the key is
+ *           removed and added again, so keys are evicted to make room for it.
+ ********************************************************************************/
+int PutEntryInHashTable(strHash *pstrHash, const char *pszData, const char *pchValue,
+                        size_t nValueLength)
+{
+   boolean        bReplaced   = FALSE;
+   int            nReturnCode = 0;
+   unsigned int   nExpire     = 0;
+   size_t         nLength     = strlen(pszData);
+   unsigned long  ulHash      = 0;
+   strHashKey    *pstrKey     = NULL;
+
+
+
+   Debug("Inside PutEntryInHashTable()\n");
+
+   AppendTrace(pstrHash, TRACE_PUT, pszData, pchValue, nValueLength);
+
+   if (nLength == 0)
+   {
+      return(1);                              /* Empty data is never stored      */
+   }
+
+   if (nValueLength > UINT_MAX)
+   {
+      fprintf(stderr, "Value of %zu bytes is too long to store.\n", nValueLength);
+      return(-1);
+   }
+
+   if (pstrHash->strSnap.puchMap != NULL && ImportSnapshot(pstrHash) != 0)
+   {
+      return(-1);
+   }
+
+   ulHash  = HashKey(pstrHash, pszData, nLength);
+   nExpire = CacheExpiry(pstrHash, pstrHash->strCache.lnTtl);
+
+
+   /****************************************************************************
+    * The key is there, and has not expired: replace its value.
+    ****************************************************************************/
+   if (TestFilterKey(&pstrHash->strFilter, ulHash) == TRUE &&
+       (pstrKey = FindHashedKey(pstrHash, pszData, nLength, ulHash)) != NULL &&
+       (pstrHash->strCache.bOn == FALSE || TouchCacheEntry(pstrHash, pstrKey) == 0))
+   {
+      if (pstrHash->strCache.bOn == TRUE && nValueLength > HASH_INLINE_VALUE &&
+          nValueLength > pstrKey->nValueLength &&
+          CacheFull(pstrHash, 0, nValueLength) == TRUE)
+      {
+         nExpire   = pstrKey->nExpire;
+         bReplaced = TRUE;
+         RemoveCacheEntry(pstrHash, pstrKey);
+      }
+      else if (SetEntryValue(&pstrHash->strKeys, pstrKey, pchValue, nValueLength) != 0)
+      {
+         return(-1);
+      }
+      else
+      {
+         pstrHash->strStats.lnUpdates++;
+
+         AppendJournal(pstrHash, HASH_JOURNAL_PUT, pszData, pchValue, nValueLength);
+         CommitJournal(pstrHash);
+         return(1);
+      }
+   }
+
+
+   if (pstrHash->strCache.bOn == TRUE)
+   {
+      MakeCacheRoom(pstrHash, pszData, nLength, ulHash, nValueLength);
+   }
+
+   if (pstrHash->nEngine == ENGINE_OPEN)
+   {
+      nReturnCode = AddEntryToOpenTable(pstrHash, pszData, nLength, ulHash, nExpire,
+                                        pchValue, nValueLength);
+   }
+   else
+   {
+      nReturnCode = AddEntryToChainTable(pstrHash, pszData, nLength, ulHash, nExpire,
+                                         pchValue, nValueLength);
+   }
+
+   if (nReturnCode == 0)
+   {
+      AppendJournal(pstrHash, HASH_JOURNAL_PUT, pszData, pchValue, nValueLength);
+      CommitJournal(pstrHash);
+   }
+
+   if (nReturnCode == 0 && bReplaced == TRUE)
+   {
+      pstrHash->strStats.lnUpdates++;
+      nReturnCode = 1;
+   }
+   else if (nReturnCode == 0)
+   {
+      pstrHash->strStats.lnInserts++;
+   }
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: PutTraceNumber
+ * Params:   pchRecord - receives the number, at most 10 bytes
+ *           ulValue - number to store
+ * Returns:  Bytes stored
+ * Call by:  AppendTrace()
+ * Call to:  None
+ * Overview: Stores 7 bits per byte, low bits first, with the top bit set on
+ *           every byte but the last, so the small numbers of a trace, a key
+ *           length or a gap of a few microseconds, take one or two bytes.
+ * Notes:    Read back with ReadTraceNumber().
+ ********************************************************************************/
+static size_t PutTraceNumber(char *pchRecord, unsigned long ulValue)
+{
+   size_t nUsed = 0;
+
+
+
+   while (ulValue >= 0x80)
+   {
+      pchRecord[nUsed++] = (char) (ulValue | 0x80);
+      ulValue          >>= 7;
+   }
+
+   pchRecord[nUsed++] = (char) ulValue;
+
+
+   return(nUsed);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ReadTraceNumber
+ * Params:   pstrTrace - trace mapped by MapHashTrace()
+ *           pnOffset - offset of the number, moved past it
+ *           pulValue - receives the number
+ * Returns:  0 - number read
+ *           <0 - the number runs past the end of the trace, or past 64 bits
+ * Call by:  NextTraceRecord()
+ * Call to:  None
+ * Overview: Reads a number stored by PutTraceNumber().
+ * Notes:    None
+ ********************************************************************************/
+static int ReadTraceNumber(const strHashTrace *pstrTrace, size_t *pnOffset,
+                           unsigned long *pulValue)
+{
+   unsigned char  uchByte = 0x80;
+   int            nShift  = 0;
+
+
+
+   *pulValue = 0;
+
+   while ((uchByte & 0x80) != 0)
+   {
+      if (*pnOffset >= pstrTrace->nSize || nShift > 63)
+      {
+         return(-1);
+      }
+
+      uchByte    = (unsigned char) pstrTrace->pchMap[(*pnOffset)++];
+      *pulValue |= (unsigned long) (uchByte & 0x7F) << nShift;
+      nShift    += 7;
+   }
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ReclaimMemory
+ * Params:   pstrConc - concurrent hash table
+ *           pstrThread - epoch record of the calling thread
+ * Returns:  Number of retired blocks freed
+ * Call by:  RetireMemory()
+ * Call to:  FreeRetired()
+ * Overview: Moves the global epoch on when every reading thread is in the
+ *           current epoch, then frees what this thread retired at least two
+ *           epochs ago.
+ * Notes:    A block retired in epoch E was unlinked before E ended.  Once the
+ *           global epoch is E+2, every reader has left and entered again since
+ *           E+1, after the unlink, so none of them can reach the block.
+ ********************************************************************************/
+static int ReclaimMemory(strConcurrentHash *pstrConc, strEpochThread *pstrThread)
+{
+   int           nIndex    = 0;
+   int           nFreed    = 0;
+   size_t        nItem     = 0;
+   size_t        nKept     = 0;
+   unsigned long ulEpoch   = __atomic_load_n(&pstrConc->ulEpoch, __ATOMIC_SEQ_CST);
+   unsigned long ulReading = 0;
+
+
+
+   for (nIndex=0; nIndex<HASH_MAX_THREADS; nIndex++)
+   {
+      ulReading = __atomic_load_n(&pstrConc->astrThreads[nIndex].ulEpoch, __ATOMIC_SEQ_CST);
+
+      if (ulReading != 0 && ulReading != ulEpoch)
+      {
+         break;
+      }
+   }
+
+   if (nIndex == HASH_MAX_THREADS)
+   {
+      __atomic_compare_exchange_n(&pstrConc->ulEpoch, &ulEpoch, ulEpoch + 1, FALSE,
+                                  __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+   }
+
+   ulEpoch = __atomic_load_n(&pstrConc->ulEpoch, __ATOMIC_SEQ_CST);
+
+
+   for (nItem=0; nItem<pstrThread->nRetired; nItem++)
+   {
+      if (pstrThread->pastrRetired[nItem].ulEpoch + 2 <= ulEpoch)
+      {
+         FreeRetired(&pstrThread->pastrRetired[nItem]);
+         nFreed++;
+      }
+      else
+      {
+         pstrThread->pastrRetired[nKept++] = pstrThread->pastrRetired[nItem];
+      }
+   }
+
+   pstrThread->nRetired = nKept;
+
+
+   return(nFreed);
+}
+
+
+
+
+/********************************************************************************
+ * Function: RecoverSharedTable
+ * Params:   pstrShared - shared hash table, locked after its writer died
+ * Returns:  None
+ * Call by:  LockSharedTable()
+ * Call to:  SharedNode()
+ * Overview: Walks every chain, marking the nodes reached and counting the keys,
+ *           then rebuilds the free list from the nodes not reached.
+ * Notes:    A node is linked or unlinked with one store, so the chains are whole
+ *           wherever the writer died.  What it may leave behind is a node taken
+ *           but not linked yet, a node unlinked but not freed yet, a half
+ *           changed free list or an entry count off by one, and all of them are
+ *           rebuilt here.  A link to a node out of range or reached twice is
+ *           cut, ending the chain there.
+ ********************************************************************************/
+static void RecoverSharedTable(strSharedHash *pstrShared)
+{
+   unsigned long    ulBucket   = 0;
+   unsigned int     nNode      = 0;
+   unsigned int    *pnLink     = NULL;
+   strSharedHeader *pstrHeader = pstrShared->pstrHeader;
+   strSharedNode   *pstrNode   = NULL;
+
+
+
+   if (pstrHeader->nUsed > pstrHeader->nCapacity)
+   {
+      pstrHeader->nUsed = pstrHeader->nCapacity;
+   }
+
+   for (nNode=1; nNode<=pstrHeader->nUsed; nNode++)
+   {
+      SharedNode(pstrShared, nNode)->uchMark = 0;
+   }
+
+   pstrHeader->lnEntries = 0;
+
+   for (ulBucket=0; ulBucket<pstrHeader->ulBuckets; ulBucket++)
+   {
+      for (pnLink = &pstrShared->anBuckets[ulBucket]; *pnLink != 0; pnLink = &pstrNode->nNext)
+      {
+         if (*pnLink > pstrHeader->nUsed || SharedNode(pstrShared, *pnLink)->uchMark != 0)
+         {
+            __atomic_store_n(pnLink, 0, __ATOMIC_RELEASE);
+            break;
+         }
+
+         pstrNode          = SharedNode(pstrShared, *pnLink);
+         pstrNode->uchMark = 1;
+         pstrHeader->lnEntries++;
+      }
+   }
+
+
+   /****************************************************************************
+    * Readers may be on a node about to go on the free list, so they are told
+    * to search again before its link changes.
+    ****************************************************************************/
+   __atomic_fetch_add(&pstrHeader->ulSequence, 1, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+
+   pstrHeader->nFree = 0;
+
+   for (nNode=pstrHeader->nUsed; nNode>0; nNode--)
+   {
+      pstrNode = SharedNode(pstrShared, nNode);
+
+      if (pstrNode->uchMark == 0)
+      {
+         pstrNode->nNext   = pstrHeader->nFree;
+         pstrHeader->nFree = nNode;
+      }
+   }
+
+   pstrHeader->lnRecovered++;
+}
+
+
+
+
+/********************************************************************************
+ * Function: RegisterEpochThread
+ * Params:   pstrConc - concurrent hash table
+ * Returns:  Epoch record for the calling thread
+ *           NULL - HASH_MAX_THREADS threads already use the table
+ * Call by:  BenchConcurrentThread()
+ * Call to:  None
+ * Overview: Claims a free epoch record.  Every thread passes its record to the
+ *           table functions.
+ * Notes:    Memory retired by an earlier owner of the record stays in it, and
+ *           the new owner frees it.  Release with UnregisterEpochThread().
+ ********************************************************************************/
+strEpochThread *RegisterEpochThread(strConcurrentHash *pstrConc)
+{
+   int nIndex  = 0;
+   int bUnused = 0;
+
+
+
+   for (nIndex=0; nIndex<HASH_MAX_THREADS; nIndex++)
+   {
+      bUnused = FALSE;
+
+      if (__atomic_compare_exchange_n(&pstrConc->astrThreads[nIndex].bInUse, &bUnused, TRUE,
+                                      FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      {
+         return(&pstrConc->astrThreads[nIndex]);
+      }
+   }
+
+
+   fprintf(stderr, "More than %d threads in RegisterEpochThread().\n", HASH_MAX_THREADS);
+
+
+   return(NULL);
+}
+
+
+
+
+/********************************************************************************
+ * Function: RemoveCacheEntry
+ * Params:   pstrHash - hash table
+ *           pstrKey - key of an entry of the table
+ * Returns:  0 - entry removed
+ *           >0 - the entry was not found again
+ * Call by:  EvictCacheEntry()
+ *           PutEntryInHashTable()
+ *           TouchCacheEntry()
+ * Call to:  AppendJournal()
+ *           CompactKeyArena()
+ *           CountFilterKey()
+ *           KeyOfEntry()
+ *           UnlinkChainEntry()
+ *           UnlinkOpenEntry()
+ * Overview: Unlinks the entry like DeleteEntryFromHashTable() would, without
+ *           counting a delete.  Compacts the key arena once more than half of
+ *           it is dead.
+ * Notes:    A short key is copied first, since unlinking clears the entry that
+ *           holds it.  The table is not shrunk, the next add is about to fill
+ *           the room again.  The journal gets a delete, committed with the
+ *           next change of the table.
+ ********************************************************************************/
+static int RemoveCacheEntry(strHash *pstrHash, strHashKey *pstrKey)
+{
+   int            nReturnCode = 0;
+   size_t         nLength     = pstrKey->nLength;
+   unsigned long  ulHash      = pstrKey->ulHash;
+   const char    *pszKey      = KeyOfEntry(pstrKey);
+   char           szKey[HASH_INLINE_KEY];
+
+
+
+   if (nLength < HASH_INLINE_KEY)
+   {
+      memcpy(szKey, pszKey, nLength + 1);
+      pszKey = szKey;
+   }
+
+   Debug("Removing [%s] from the cache\n", pszKey);
+
+
+   if (pstrHash->nEngine == ENGINE_OPEN)
+   {
+      if ((nReturnCode = UnlinkOpenEntry(pstrHash, &pstrHash->strArray, pszKey, nLength,
+                                         ulHash)) != 0)
+      {
+         nReturnCode = UnlinkOpenEntry(pstrHash, &pstrHash->strOldArray, pszKey, nLength, ulHash);
+      }
+   }
+   else
+   {
+      if ((nReturnCode = UnlinkChainEntry(pstrHash, &pstrHash->strArray, pszKey, nLength,
+                                          ulHash)) != 0)
+      {
+         nReturnCode = UnlinkChainEntry(pstrHash, &pstrHash->strOldArray, pszKey, nLength,
+                                        ulHash);
+      }
+   }
+
+   if (nReturnCode != 0)
+   {
+      return(nReturnCode);
+   }
+
+   CountFilterKey(&pstrHash->strFilter, ulHash, -1);
+
+   AppendJournal(pstrHash, HASH_JOURNAL_DELETE, pszKey, NULL, 0);
+
+
+   if (pstrHash->strKeys.nDead > HASH_ARENA_BLOCK &&
+       pstrHash->strKeys.nDead > pstrHash->strKeys.nUsed / 2)
+   {
+      CompactKeyArena(pstrHash);
+   }
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: RemoveSharedTable
+ * Params:   pszName - name of the shared memory segment
+ * Returns:  0 - segment removed
+ *           <0 - cannot remove the segment
+ * Call by:  RunShared()
+ * Call to:  None
+ * Overview: Removes the name of the segment, so the next OpenSharedTable()
+ *           creates a new, empty table.
+ * Notes:    Processes that have the table open keep using it until they close
+ *           it, then its memory is released.
+ ********************************************************************************/
+int RemoveSharedTable(const char *pszName)
+{
+   if (shm_unlink(pszName) != 0)
+   {
+      fprintf(stderr, "Cannot remove shared table [%s]. errno=%d.\n", pszName, errno);
+      return(-1);
+   }
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ReplayJournal
+ * Params:   pstrHash - hash table
+ *           pchMap - journal mapped in memory
+ *           nSize - bytes of pchMap
+ *           pnGood - receives the offset after the last whole record
+ * Returns:  >=0 - number of records replayed
+ *           <0 - cannot change the table
+ * Call by:  OpenHashJournal()
+ * Call to:  AddEntriesToHashTable()
+ *           DeleteEntryFromHashTable()
+ *           HashWy()
+ *           PutEntryInHashTable()
+ * Overview: Applies each record to the table in order.  Runs of adds are
+ *           passed HASH_JOURNAL_BATCH at a time to AddEntriesToHashTable(),
+ *           which prefetches their buckets, and every key is passed straight
+ *           from the map, since records keep the terminator of the key.
+ * Notes:    Stops at the first record that is cut short or fails its check,
+ *           and leaves it to the caller to tell a torn tail from damage.
+ ********************************************************************************/
+static long ReplayJournal(strHash *pstrHash, const char *pchMap, size_t nSize, size_t *pnGood)
+{
+   int               nKeys     = 0;
+   long              lnRecords = 0;
+   size_t            nOffset   = sizeof(strJournalHeader);
+   size_t            nBytes    = 0;
+   const char       *pszKey    = NULL;
+   const char       *apszKeys[HASH_JOURNAL_BATCH];
+   strJournalRecord  strRecord;
+
+
+
+   while (nSize - nOffset >= sizeof(strJournalRecord))
+   {
+      memcpy(&strRecord, pchMap + nOffset, sizeof(strJournalRecord));
+
+      nBytes = (size_t) strRecord.nLength + 1 + strRecord.nValueLength;
+      pszKey = pchMap + nOffset + sizeof(strJournalRecord);
+
+      if (nBytes > nSize - nOffset - sizeof(strJournalRecord) || strRecord.nLength == 0 ||
+          strRecord.nOp < HASH_JOURNAL_ADD || strRecord.nOp > HASH_JOURNAL_DELETE ||
+          pszKey[strRecord.nLength] != '\0' ||
+          (unsigned int) HashWy(pszKey, nBytes, ((unsigned long) strRecord.nOp << 32) |
+                                                strRecord.nValueLength) != strRecord.nCheck)
+      {
+         break;                               /* Torn or damaged record          */
+      }
+
+      if ((strRecord.nOp != HASH_JOURNAL_ADD || nKeys == HASH_JOURNAL_BATCH) && nKeys > 0)
+      {
+         if (AddEntriesToHashTable(pstrHash, apszKeys, nKeys, NULL) < 0)
+         {
+            return(-1);
+         }
+
+         nKeys = 0;
+      }
+
+      if (strRecord.nOp == HASH_JOURNAL_ADD)
+      {
+         apszKeys[nKeys++] = pszKey;
+      }
+      else if (strRecord.nOp == HASH_JOURNAL_PUT &&
+               PutEntryInHashTable(pstrHash, pszKey, pszKey + strRecord.nLength + 1,
+                                   strRecord.nValueLength) < 0)
+      {
+         return(-1);
+      }
+      else if (strRecord.nOp == HASH_JOURNAL_DELETE &&
+               DeleteEntryFromHashTable(pstrHash, pszKey) < 0)
+      {
+         return(-1);
+      }
+
+      nOffset += sizeof(strJournalRecord) + nBytes;
+      lnRecords++;
+   }
+
+   if (nKeys > 0 && AddEntriesToHashTable(pstrHash, apszKeys, nKeys, NULL) < 0)
+   {
+      return(-1);
+   }
+
+   *pnGood = nOffset;
+
+
+   return(lnRecords);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ResizeConcurrentTable
+ * Params:   pstrConc - concurrent hash table
+ *           pstrThread - epoch record of the calling thread
+ *           ulSize - number of buckets the caller saw when it asked to grow
+ * Returns:  0 - table doubled, or another thread already did
+ *           <0 - cannot allocate memory, the table is unchanged
+ * Call by:  AddEntryToConcurrentTable()
+ * Call to:  FreeRetired()
+ *           RetireMemory()
+ * Overview: Takes every stripe lock, in order, so no writer changes a chain,
+ *           then copies every node into an array twice the size and swaps the
+ *           array pointer.  Readers walking the old array still find every
+ *           key there, so they never miss a key because of the resize.
+ * Notes:    Nodes are copied, not relinked, because a reader may be standing on
+ *           any of them.  The old array and its nodes are retired together.
+ ********************************************************************************/
+static int ResizeConcurrentTable(strConcurrentHash *pstrConc, strEpochThread *pstrThread,
+                                 unsigned long ulSize)
+{
+   int                 nIndex      = 0;
+   int                 nReturnCode = 0;
+   unsigned long       ulBucket    = 0;
+   strConcurrentArray *pstrOld     = NULL;
+   strConcurrentArray *pstrNew     = NULL;
+   strConcurrentNode  *pstrCurrent = NULL;
+   strConcurrentNode  *pstrCopy    = NULL;
+   strRetired          strUnused;
+
+
+
+   for (nIndex=0; nIndex<HASH_LOCK_STRIPES; nIndex++)
+   {
+      pthread_mutex_lock(&pstrConc->astrStripes[nIndex].strMutex);
+   }
+
+   pstrOld = pstrConc->pstrArray;
+
+   if (pstrOld->ulSize != ulSize)
+   {
+      pstrOld = NULL;                         /* Another thread resized first    */
+   }
+   else if ((pstrNew = (strConcurrentArray *) calloc(1, sizeof(strConcurrentArray) +
+                                             ulSize * 2 * sizeof(strConcurrentNode *))) == NULL)
+   {
+      fprintf(stderr, "Failed calloc() in ResizeConcurrentTable(). errno=%d.\n", errno);
+      nReturnCode = -1;
+   }
+   else
+   {
+      pstrNew->ulSize = ulSize * 2;
+
+      for (ulBucket=0; ulBucket<ulSize && nReturnCode == 0; ulBucket++)
+      {
+         for (pstrCurrent = pstrOld->apstrBuckets[ulBucket];
+              pstrCurrent != NULL;
+              pstrCurrent = pstrCurrent->pstrNext)
+         {
+            pstrCopy = (strConcurrentNode *) malloc(sizeof(strConcurrentNode) +
+                                                    pstrCurrent->nLength + 1);
+
+            if (pstrCopy == NULL)
+            {
+               fprintf(stderr, "Failed malloc() in ResizeConcurrentTable(). errno=%d.\n", errno);
+               nReturnCode = -1;
+               break;
+            }
+
+            memcpy(pstrCopy, pstrCurrent, sizeof(strConcurrentNode) + pstrCurrent->nLength + 1);
+
+            pstrCopy->pstrNext = pstrNew->apstrBuckets[pstrCopy->ulHash & (ulSize*2-1)];
+            pstrNew->apstrBuckets[pstrCopy->ulHash & (ulSize*2-1)] = pstrCopy;
+         }
+      }
+
+      if (nReturnCode == 0)
+      {
+         __atomic_store_n(&pstrConc->pstrArray, pstrNew, __ATOMIC_RELEASE);
+         pstrConc->lnResizes++;
+      }
+   }
+
+   for (nIndex=HASH_LOCK_STRIPES-1; nIndex>=0; nIndex--)
+   {
+      pthread_mutex_unlock(&pstrConc->astrStripes[nIndex].strMutex);
+   }
+
+
+   if (nReturnCode != 0 && pstrNew != NULL)
+   {
+      strUnused.pMemory = pstrNew;            /* Never visible, free it now      */
+      strUnused.bArray  = TRUE;
+      FreeRetired(&strUnused);
+   }
+   else if (nReturnCode == 0 && pstrOld != NULL)
+   {
+      RetireMemory(pstrConc, pstrThread, pstrOld, TRUE);
+   }
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ResizeHashTable
+ * Params:   pstrHash - hash table
+ *           nSize - new number of buckets, or slots for open addressing
+ * Returns:  0 - resize started
+ *           <0 - cannot allocate memory, the table is unchanged
+ * Call by:  CheckHashLoad()
+ * Call to:  AllocateHashArray()
+ *           MigrateHashTable()
+ * Overview: Makes the current array the old array and allocates a new current
+ *           array.  Entries are moved over later by MigrateHashTable().
+ * Notes:    A resize still in progress is finished first, so there is never
+ *           more than one old array.
+ ********************************************************************************/
+static int ResizeHashTable(strHash *pstrHash, int nSize)
+{
+   strHashArray strNewArray;
+
+
+
+   if (MigrateHashTable(pstrHash, INT_MAX) != 0)
+   {
+      return(-1);
+   }
+
+   if (AllocateHashArray(&strNewArray, &pstrHash->strPages, pstrHash->nEngine, nSize) != 0)
+   {
+      return(-1);
+   }
+
+
+   Debug("Resizing from %d to %d, %ld entries\n",
+         pstrHash->strArray.nSize, nSize, pstrHash->lnEntries);
+
+   pstrHash->strOldArray = pstrHash->strArray;
+   pstrHash->strArray    = strNewArray;
+   pstrHash->nMigrated   = 0;
+   pstrHash->lnResizes++;
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: RetireMemory
+ * Params:   pstrConc - concurrent hash table
+ *           pstrThread - epoch record of the calling thread
+ *           pMemory - node, or array, already unlinked from the table
+ *           bArray - TRUE when pMemory is an old array with its nodes
+ * Returns:  0 - memory will be freed later
+ *           <0 - cannot grow the list, the memory is leaked
+ * Call by:  DeleteEntryFromConcurrentTable()
+ *           ResizeConcurrentTable()
+ * Call to:  ReclaimMemory()
+ * Overview: Records the memory with the current global epoch, and every
+ *           HASH_RECLAIM_BATCH blocks tries to free the older ones.
+ * Notes:    Only the owning thread touches its list, so no lock is needed.
+ ********************************************************************************/
+static int RetireMemory(strConcurrentHash *pstrConc, strEpochThread *pstrThread, void *pMemory,
+                        boolean bArray)
+{
+   size_t      nCapacity = 0;
+   strRetired *pastrNew  = NULL;
+
+
+
+   if (pstrThread->nRetired == pstrThread->nCapacity)
+   {
+      nCapacity = pstrThread->nCapacity * 2 + HASH_RECLAIM_BATCH;
+      pastrNew  = (strRetired *) realloc(pstrThread->pastrRetired,
+                                         nCapacity * sizeof(strRetired));
+
+      if (pastrNew == NULL)
+      {
+         fprintf(stderr, "Failed realloc() in RetireMemory(). errno=%d.\n", errno);
+         return(-1);
+      }
+
+      pstrThread->pastrRetired = pastrNew;
+      pstrThread->nCapacity    = nCapacity;
+   }
+
+
+   pstrThread->pastrRetired[pstrThread->nRetired].pMemory = pMemory;
+   pstrThread->pastrRetired[pstrThread->nRetired].bArray  = bArray;
+   pstrThread->pastrRetired[pstrThread->nRetired].ulEpoch =
+      __atomic_load_n(&pstrConc->ulEpoch, __ATOMIC_SEQ_CST);
+   pstrThread->nRetired++;
+
+   if (pstrThread->nRetired % HASH_RECLAIM_BATCH == 0)
+   {
+      ReclaimMemory(pstrConc, pstrThread);
+   }
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: RunBuildPhase
+ * Params:   astrWork - share of each thread
+ *           nThreads - number of threads
+ *           nPhase - 0 hash, 1 move, 2 build
+ * Returns:  None
+ * Call by:  BuildHashTable()
+ * Call to:  BuildHashThread(), also through pthread_create()
+ * Overview: Starts a thread for every share but the first, runs the first in
+ *           the calling thread, and waits for the others.
+ * Notes:    A share whose thread cannot be started is run in the calling
+ *           thread too, so the build only gets slower.
+ ********************************************************************************/
+static void RunBuildPhase(strBuildThread *astrWork, int nThreads, int nPhase)
+{
+   int        nThread = 0;
+   boolean    abStarted[HASH_MAX_THREADS];
+   pthread_t  aThreads[HASH_MAX_THREADS];
+
+
+
+   for (nThread=0; nThread<nThreads; nThread++)
+   {
+      astrWork[nThread].nPhase = nPhase;
+      abStarted[nThread]       = nThread > 0 &&
+                                 pthread_create(&aThreads[nThread], NULL, BuildHashThread,
+                                                &astrWork[nThread]) == 0 ? TRUE : FALSE;
+   }
+
+   for (nThread=0; nThread<nThreads; nThread++)
+   {
+      if (abStarted[nThread] == TRUE)
+      {
+         pthread_join(aThreads[nThread], NULL);
+      }
+      else
+      {
+         BuildHashThread(&astrWork[nThread]);
+      }
+   }
+}
+
+
+
+
+/********************************************************************************
+ * Function: SaveFrozenSnapshot
+ * Params:   pstrSnap - frozen snapshot of a table
+ *           pszFile - snapshot file to write
+ * Returns:  >=0 - snapshot written, size of the file in bytes
+ *           <0 - cannot write the file
+ * Call by:  SaveSnapshot()
+ * Call to:  None
+ * Overview: Writes the frozen snapshot byte for byte: its offsets are already
+ *           from the start of the image, so the file maps as it is.
+ * Notes:    Written as pszFile.tmp and renamed, as SaveSnapshot() does.
+ ********************************************************************************/
+static long SaveFrozenSnapshot(const strSnapshot *pstrSnap, const char *pszFile)
+{
+   int     nFile     = -1;
+   size_t  nWritten  = 0;
+   ssize_t nBytes    = 0;
+   char    szTemp[PATH_MAX];
+
+
+
+   if (snprintf(szTemp, sizeof(szTemp), "%s.tmp", pszFile) >= (int) sizeof(szTemp))
+   {
+      fprintf(stderr, "Snapshot name [%s] is too long.\n", pszFile);
+      return(-1);
+   }
+
+   if ((nFile = open(szTemp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+   {
+      fprintf(stderr, "Cannot create [%s]. errno=%d.\n", szTemp, errno);
+      return(-1);
+   }
+
+   while (nWritten < pstrSnap->nSize &&
+          ((nBytes = write(nFile, pstrSnap->puchMap + nWritten,
+                           pstrSnap->nSize - nWritten)) > 0 || errno == EINTR))
+   {
+      nWritten += nBytes > 0 ? (size_t) nBytes : 0;
+   }
+
+   if (nWritten < pstrSnap->nSize || fsync(nFile) != 0)
+   {
+      fprintf(stderr, "Failed to write [%s]. errno=%d.\n", szTemp, errno);
+   }
+   else if (rename(szTemp, pszFile) != 0)
+   {
+      fprintf(stderr, "Cannot rename [%s] to [%s]. errno=%d.\n", szTemp, pszFile, errno);
+   }
+   else
+   {
+      close(nFile);
+      return((long) nWritten);
+   }
+
+   close(nFile);
+   unlink(szTemp);
+
+
+   return(-1);
+}
+
+
+
+
+/********************************************************************************
+ * Function: SaveSnapshot
+ * Params:   pstrHash - hash table
+ *           pszFile - snapshot file to write
+ * Returns:  >=0 - snapshot written, size of the file in bytes
+ *           <0 - cannot write the file or allocate memory
+ * Call by:  main()
+ * Call to:  HashWy()
+ *           ImportSnapshot()
+ *           KeyOfEntry()
+ *           NextHashEntry()
+ *           SaveFrozenSnapshot()
+ *           SnapshotRecordSize()
+ *           ValueOfEntry()
+ * Overview: Writes every entry of the table, with its value, into a snapshot
+ *           that LoadSnapshot() can map.  A first walk adds up the size of each bucket's records,
+ *           so a second walk can write the records of a bucket next to each
+ *           other, and a chain walk stays within a few cache lines.
+ * Notes:    The file is written as pszFile.tmp and renamed over pszFile once it
+ *           is on disk, so a crash never leaves a partial snapshot behind.
+ *           The hash stored with each entry is written as is.  A frozen table
+ *           writes its frozen snapshot instead, which stays frozen.
+ ********************************************************************************/
+long SaveSnapshot(strHash *pstrHash, const char *pszFile)
+{
+   int                 nFile        = -1;
+   long                lnReturnCode = -1;
+   char                szTemp[PATH_MAX];
+   unsigned char      *puchMap      = NULL;
+   unsigned long      *aulNext      = NULL;
+   unsigned long      *aulBuckets   = NULL;
+   unsigned long       ulBuckets    = 1;
+   unsigned long       ulBucket     = 0;
+   unsigned long       ulOffset     = 0;
+   unsigned long       ulSize       = 0;
+   strSnapshotHeader  *pstrHeader   = NULL;
+   strSnapshotRecord  *pstrRecord   = NULL;
+   const strHashKey   *pstrKey      = NULL;
+   strHashCursor       strCursor;
+
+
+
+   if (pstrHash->strSnap.puchMap != NULL && pstrHash->strSnap.pstrHeader->ulPilots != 0)
+   {
+      return(SaveFrozenSnapshot(&pstrHash->strSnap, pszFile));
+   }
+
+   if (pstrHash->strSnap.puchMap != NULL && ImportSnapshot(pstrHash) != 0)
+   {
+      return(-1);
+   }
+
+   if (snprintf(szTemp, sizeof(szTemp), "%s.tmp", pszFile) >= (int) sizeof(szTemp))
+   {
+      fprintf(stderr, "Snapshot name [%s] is too long.\n", pszFile);
+      return(-1);
+   }
+
+   while (ulBuckets < (unsigned long) pstrHash->lnEntries)
+   {
+      ulBuckets = ulBuckets * 2;
+   }
+
+   if ((aulNext = (unsigned long *) calloc(ulBuckets, sizeof(unsigned long))) == NULL)
+   {
+      fprintf(stderr, "Failed calloc() in SaveSnapshot(). errno=%d.\n", errno);
+      return(-1);
+   }
+
+
+   /****************************************************************************
+    * First walk: bytes of records per bucket, turned into the offset where each
+    * bucket's records start.
+    ****************************************************************************/
+   memset(&strCursor, 0, sizeof(strCursor));
+
+   while ((pstrKey = NextHashEntry(pstrHash, &strCursor)) != NULL)
+   {
+      aulNext[pstrKey->ulHash & (ulBuckets-1)] += SnapshotRecordSize(pstrKey->nLength,
+                                                                     pstrKey->nValueLength);
+   }
+
+   ulOffset = sizeof(strSnapshotHeader) + ulBuckets * sizeof(unsigned long);
+
+   for (ulBucket=0; ulBucket<ulBuckets; ulBucket++)
+   {
+      ulSize             = aulNext[ulBucket];
+      aulNext[ulBucket]  = ulOffset;
+      ulOffset          += ulSize;
+   }
+
+
+   /****************************************************************************
+    * ftruncate() fills the file with zeros, so padding and empty buckets need
+    * no writes, and the same table always gives the same file.
+    ****************************************************************************/
+   if ((nFile = open(szTemp, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+   {
+      fprintf(stderr, "Cannot create [%s]. errno=%d.\n", szTemp, errno);
+      free(aulNext);
+      return(-1);
+   }
+
+   if (ftruncate(nFile, ulOffset) != 0 ||
+       (puchMap = (unsigned char *) mmap(NULL, ulOffset, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                         nFile, 0)) == MAP_FAILED)
+   {
+      fprintf(stderr, "Cannot map [%s]. errno=%d.\n", szTemp, errno);
+      close(nFile);
+      unlink(szTemp);
+      free(aulNext);
+      return(-1);
+   }
+
+
+   pstrHeader = (strSnapshotHeader *) puchMap;
+   aulBuckets = (unsigned long *) (puchMap + sizeof(strSnapshotHeader));
+
+   memcpy(pstrHeader->achMagic, HASH_SNAPSHOT_MAGIC, sizeof(pstrHeader->achMagic));
+   pstrHeader->nVersion   = HASH_SNAPSHOT_VERSION;
+   pstrHeader->nHash      = pstrHash->nHash;
+   pstrHeader->aulSeed[0] = pstrHash->aulSeed[0];
+   pstrHeader->aulSeed[1] = pstrHash->aulSeed[1];
+   pstrHeader->ulBuckets  = ulBuckets;
+   pstrHeader->ulEntries  = pstrHash->lnEntries;
+   pstrHeader->ulFileSize = ulOffset;
+
+
+   /****************************************************************************
+    * Second walk: write each record at its bucket's next offset, and push it
+    * on the front of the bucket's chain.
+    ****************************************************************************/
+   memset(&strCursor, 0, sizeof(strCursor));
+
+   while ((pstrKey = NextHashEntry(pstrHash, &strCursor)) != NULL)
+   {
+      ulBucket   = pstrKey->ulHash & (ulBuckets-1);
+      pstrRecord = (strSnapshotRecord *) (puchMap + aulNext[ulBucket]);
+
+      pstrRecord->ulHash       = pstrKey->ulHash;
+      pstrRecord->ulNext       = aulBuckets[ulBucket];
+      pstrRecord->nLength      = pstrKey->nLength;
+      pstrRecord->nValueLength = pstrKey->nValueLength;
+      memcpy(pstrRecord->achKey, KeyOfEntry(pstrKey), pstrKey->nLength + 1);
+      memcpy(pstrRecord->achKey + pstrKey->nLength + 1, ValueOfEntry(pstrKey),
+             pstrKey->nValueLength);
+
+      aulBuckets[ulBucket]  = aulNext[ulBucket];
+      aulNext[ulBucket]    += SnapshotRecordSize(pstrKey->nLength, pstrKey->nValueLength);
+   }
+
+   pstrHeader->ulChecksum = HashWy((const char *) puchMap + sizeof(strSnapshotHeader),
+                                   ulOffset - sizeof(strSnapshotHeader), 0);
+
+
+   if (msync(puchMap, ulOffset, MS_SYNC) != 0 || fsync(nFile) != 0)
+   {
+      fprintf(stderr, "Failed to write [%s]. errno=%d.\n", szTemp, errno);
+   }
+   else if (rename(szTemp, pszFile) != 0)
+   {
+      fprintf(stderr, "Cannot rename [%s] to [%s]. errno=%d.\n", szTemp, pszFile, errno);
+   }
+   else
+   {
+      lnReturnCode = 0;
+   }
+
+   munmap(puchMap, ulOffset);
+   close(nFile);
+   free(aulNext);
+
+   if (lnReturnCode != 0)
+   {
+      unlink(szTemp);
+      return(lnReturnCode);
+   }
+
+   Debug("Saved %ld entries in %lu buckets to [%s]\n", pstrHash->lnEntries, ulBuckets, pszFile);
+
+
+   return((long) ulOffset);
+}
+
+
+
+
+/********************************************************************************
+ * Function: SearchChainIndex
+ * Params:   pstrIndex - index of a long chain
+ *           pszData - data to look for
+ *           nLength - strlen() of pszData
+ *           ulHash - HashKey() of pszData
+ *           pnSteps - if not NULL, receives the number of nodes compared
+ * Returns:  >=0 - position of the node holding the data in the index
+ *           <0 - not found, -1 - the position where it would be inserted
+ * Call by:  FindChainEntry()
+ *           IndexChainNode()
+ *           UnlinkChainEntry()
+ * Call to:  KeyOfEntry()
+ * Overview: Binary search of the index, ordered by hash, then by key length,
+ *           then by key bytes.
+ * Notes:    memcmp() is only called when the stored hash and length match, so
+ *           keys that only share a bucket cost one compare of hashes each.
+ ********************************************************************************/
+static int SearchChainIndex(const strChainIndex *pstrIndex, const char *pszData, size_t nLength,
+                            unsigned long ulHash, int *pnSteps)
+{
+   int               nLow     = 0;
+   int               nHigh    = pstrIndex->nCount;
+   int               nMiddle  = 0;
+   int               nCompare = 0;
+   int               nSteps   = 0;
+   const strHashKey *pstrKey  = NULL;
+
+
+
+   while (nLow < nHigh)
+   {
+      nMiddle = nLow + (nHigh - nLow) / 2;
+      pstrKey = &pstrIndex->apstrNodes[nMiddle]->strKey;
+      nSteps++;
+
+      if (pstrKey->ulHash != ulHash)
+      {
+         nCompare = pstrKey->ulHash < ulHash ? -1 : 1;
+      }
+      else if (pstrKey->nLength != nLength)
+      {
+         nCompare = pstrKey->nLength < nLength ? -1 : 1;
+      }
+      else if ((nCompare = memcmp(KeyOfEntry(pstrKey), pszData, nLength)) == 0)
+      {
+         break;
+      }
+
+      if (nCompare < 0)
+      {
+         nLow  = nMiddle + 1;
+      }
+      else
+      {
+         nHigh = nMiddle;
+      }
+   }
+
+
+   if (pnSteps != NULL)
+   {
+      *pnSteps = nSteps;
+   }
+
+
+   return(nLow < nHigh ? nMiddle : -1 - nLow);
+}
+
+
+
+
+/********************************************************************************
+ * Function: SearchConcurrentTable
+ * Params:   pstrConc - concurrent hash table
+ *           pstrThread - epoch record of the calling thread
+ *           pszData - data to search for
+ * Returns:  -1 - not found
+ *           >=0 - bucket index where found
+ * Call by:  BenchConcurrentThread()
+ * Call to:  EnterEpoch()
+ *           HashBytes()
+ *           LeaveEpoch()
+ *           MatchBytes()
+ * Overview: Walks the chain without taking any lock.  Acquire loads pair with
+ *           the release stores of the writers, so every node reached is
+ *           complete.
+ * Notes:    Inside the epoch, no node or array it reaches can be freed.
+ ********************************************************************************/
+int SearchConcurrentTable(strConcurrentHash *pstrConc, strEpochThread *pstrThread,
+                          const char *pszData)
+{
+   int                 nReturnCode = -1;
+   size_t              nLength     = strlen(pszData);
+   unsigned long       ulHash      = 0;
+   strConcurrentArray *pstrArray   = NULL;
+   strConcurrentNode  *pstrCurrent = NULL;
+
+
+
+   ulHash = HashBytes(pstrConc->nHash, pstrConc->aulSeed, pszData, nLength);
+
+   EnterEpoch(pstrConc, pstrThread);
+
+   pstrArray   = __atomic_load_n(&pstrConc->pstrArray, __ATOMIC_ACQUIRE);
+   pstrCurrent = __atomic_load_n(&pstrArray->apstrBuckets[ulHash & (pstrArray->ulSize-1)],
+                                 __ATOMIC_ACQUIRE);
+
+   for (; pstrCurrent != NULL; pstrCurrent = __atomic_load_n(&pstrCurrent->pstrNext,
+                                                             __ATOMIC_ACQUIRE))
+   {
+      if (pstrCurrent->ulHash == ulHash && pstrCurrent->nLength == nLength &&
+          MatchBytes(pstrCurrent->achKey, pszData, nLength) == TRUE)
+      {
+         nReturnCode = (int) (ulHash & (pstrArray->ulSize-1));
+         break;
+      }
+   }
+
+   LeaveEpoch(pstrThread);
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: SearchEntriesInHashTable
+ * Params:   pstrHash - hash table
+ *           apszData - data to search for
+ *           nCount - number of entries in apszData
+ *           anResults - if not NULL, receives what SearchHashTable() would
+ *                       return for each entry
+ * Returns:  Number of entries found
+ * Call by:  RunBenchmark()
+ * Call to:  AppendTrace()
+ *           HashKeys()
+ *           PrefetchBuckets()
+ *           SearchHashedEntry()
+ * Overview: Searches the entries HASH_PREFETCH_KEYS at a time: hashes them all,
+ *           prefetches their buckets, then resolves them one by one, so the
+ *           cache misses of the group are waited for together.
+ * Notes:    Counted in the statistics like the same number of single searches.
+ ********************************************************************************/
+int SearchEntriesInHashTable(strHash *pstrHash, const char **apszData, int nCount,
+                             int *anResults)
+{
+   int           nIndex      = 0;
+   int           nFirst      = 0;
+   int           nKeys       = 0;
+   int           nFound      = 0;
+   int           nReturnCode = 0;
+   unsigned long aulHash[HASH_PREFETCH_KEYS];
+   size_t        anLength[HASH_PREFETCH_KEYS];
+
+
+
+   for (nFirst=0; nFirst<nCount; nFirst+=HASH_PREFETCH_KEYS)
+   {
+      nKeys = nCount - nFirst < HASH_PREFETCH_KEYS ? nCount - nFirst : HASH_PREFETCH_KEYS;
+
+      HashKeys(pstrHash->nHash, pstrHash->aulSeed, &apszData[nFirst], nKeys, aulHash, anLength);
+
+      PrefetchBuckets(pstrHash, aulHash, nKeys);
+
+      for (nIndex=0; nIndex<nKeys; nIndex++)
+      {
+         AppendTrace(pstrHash, TRACE_SEARCH, apszData[nFirst+nIndex], NULL, 0);
+
+         nReturnCode = SearchHashedEntry(pstrHash, apszData[nFirst+nIndex], anLength[nIndex],
+                                         aulHash[nIndex], NULL, NULL, NULL);
+         nFound     += nReturnCode >= 0;
+
+         if (anResults != NULL)
+         {
+            anResults[nFirst+nIndex] = nReturnCode;
+         }
+      }
+   }
+
+
+   return(nFound);
+}
+
+
+
+
+/********************************************************************************
+ * Function: SearchHashTable
+ * Params:   pstrHash
+ *           pszData
+ *           pnChain - receives the position in the chain, or the number of
+ *                     group probes with open addressing; may be NULL
+ * Returns:  -1 - not found
+ *           >0 - bucket index where found
+ * Call by:  ProcessBatchLine()
+ *           RunBenchmark()
+ *           RunReplay()
+ *           ServerCommand()
+ * Call to:  AppendTrace()
+ *           HashKey()
+ *           SearchHashedEntry()
+ * Overview: Search a value in the hash table after finding the proper bucket.
+ * Notes:    SearchEntriesInHashTable() searches many values at once.
+ ********************************************************************************/
+int SearchHashTable(strHash *pstrHash, const char *pszData, int *pnChain)
+{
+   size_t nLength = strlen(pszData);
+
+
+
+   Debug("Inside SearchHashTable()\n");
+
+   AppendTrace(pstrHash, TRACE_SEARCH, pszData, NULL, 0);
+
+
+   return(SearchHashedEntry(pstrHash, pszData, nLength, HashKey(pstrHash, pszData, nLength),
+                            pnChain, NULL, NULL));
+}
+
+
+
+
+/********************************************************************************
+ * Function: SearchHashedEntry
+ * Params:   pstrHash - hash table
+ *           pszData - data to search for
+ *           nLength - strlen() of pszData
+ *           ulHash - HashKey() of pszData
+ *           pnChain - receives the position in the chain, or the number of
+ *                     group probes with open addressing; may be NULL
+ *           ppchValue - receives the stored value when found, may be NULL
+ *           pnValueLength - receives the bytes of the value, may be NULL
+ * Returns:  -1 - not found
+ *           >=0 - bucket index where found
+ * Call by:  GetValueFromHashTable()
+ *           SearchEntriesInHashTable()
+ *           SearchHashTable()
+ * Call to:  FindChainEntry()
+ *           SearchOpenTable()
+ *           SearchSnapshot()
+ *           TestFilterKey()
+ *           TouchCacheEntry()
+ *           ValueOfEntry()
+ * Overview: Looks for the already hashed value with the engine of the table,
+ *           unless the filter of the table knows it is not there.  Counts the
+ *           search as a hit or a miss, the nodes (or groups) it looked at, and
+ *           how the filter did, for StatsHashTable().
+ *           In cache mode, a hit marks the key for the clock, and a key past
+ *           its TTL is dropped and counted as a miss.
+ * Notes:    While the table is resizing, a value not in the current array is
+ *           looked for in the old array.  The bucket index is then the old one.
+ *           While a snapshot is mapped, the value is looked for in the snapshot,
+ *           and the stored value is read from the mapped record.
+ ********************************************************************************/
+static int SearchHashedEntry(strHash *pstrHash, const char *pszData, size_t nLength,
+                             unsigned long ulHash, int *pnChain, const char **ppchValue,
+                             size_t *pnValueLength)
+{
+   boolean                  bFiltered   = FALSE;
+   int                      nChain      = 0;
+   int                      nWalked     = 0;
+   int                      nReturnCode = -1;
+   const strHashArray      *pstrArray   = &pstrHash->strArray;
+   strHashTable            *pstrNode    = NULL;
+   strHashKey              *pstrKey     = NULL;
+   const strSnapshotRecord *pstrRecord  = NULL;
+
+
+
+   if (pstrHash->strSnap.puchMap == NULL &&
+       TestFilterKey(&pstrHash->strFilter, ulHash) == FALSE)
+   {
+      bFiltered = TRUE;
+   }
+
+
+   if (pstrHash->strSnap.puchMap != NULL)
+   {
+      nReturnCode = SearchSnapshot(pstrHash, pszData, nLength, ulHash, &nChain, &pstrRecord);
+      nWalked     = nReturnCode >= 0 ? nChain + 1 : nChain;
+   }
+   else if (bFiltered == TRUE)
+   {
+      pstrHash->strStats.lnFiltered++;
+   }
+   else if (pstrHash->nEngine == ENGINE_OPEN)
+   {
+      nReturnCode = SearchOpenTable(pstrHash, pszData, nLength, ulHash, &nChain, &pstrKey);
+      nWalked     = nChain;
+   }
+   else
+   {
+      if ((pstrNode = FindChainEntry(pstrArray, pszData, nLength, ulHash, &nChain)) == NULL)
+      {
+         nWalked   = nChain;
+         pstrArray = &pstrHash->strOldArray;
+
+         if ((pstrNode = FindChainEntry(pstrArray, pszData, nLength, ulHash, &nChain)) == NULL)
+         {
+            pstrArray = NULL;
+         }
+      }
+
+      if (pstrArray != NULL)
+      {
+         nReturnCode = (int) (ulHash % pstrArray->nSize);
+         nWalked    += nChain + 1;
+         pstrKey     = &pstrNode->strKey;
+      }
+      else
+      {
+         nWalked    += nChain;
+      }
+   }
+
+
+   pstrHash->strStats.lnWalked += nWalked;
+
+   if (pstrKey != NULL && (pstrHash->strCache.bOn == TRUE || pstrKey->nExpire != 0) &&
+       TouchCacheEntry(pstrHash, pstrKey) != 0)
+   {
+      pstrHash->strStats.lnMisses++;
+      return(-1);                             /* Expired, not a false positive   */
+   }
+
+   if (nReturnCode < 0)
+   {
+      pstrHash->strStats.lnMisses++;
+
+      if (bFiltered == FALSE && pstrHash->strFilter.puchCounters != NULL &&
+          pstrHash->strSnap.puchMap == NULL)
+      {
+         pstrHash->strStats.lnFalse++;
+      }
+
+      return(nReturnCode);
+   }
+
+   pstrHash->strStats.lnHits++;
+
+   if (pnChain != NULL)
+   {
+      *pnChain = nChain;
+   }
+
+   if (ppchValue != NULL)
+   {
+      *ppchValue = pstrKey != NULL ? ValueOfEntry(pstrKey) :
+                                     pstrRecord->achKey + pstrRecord->nLength + 1;
+   }
+
+   if (pnValueLength != NULL)
+   {
+      *pnValueLength = pstrKey != NULL ? pstrKey->nValueLength : pstrRecord->nValueLength;
+   }
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: SearchOpenTable
+ * Params:   pstrHash - open addressing hash table
+ *           pszData - data to search for
+ *           nLength - strlen() of pszData
+ *           ulHash - HashKey() of pszData
+ *           pnProbes - receives the number of group probes, may be NULL
+ *           ppstrKey - receives the key of the slot found, or NULL
+ * Returns:  -1 - not found
+ *           >=0 - slot index where found
+ * Call by:  SearchHashedEntry()
+ * Call to:  FindOpenSlot()
+ * Overview: Search a value in the hash table by probing groups of slots.
+ * Notes:    While the table is resizing, a value not in the current array is
+ *           looked for in the old array.  The slot index is then the old one,
+ *           and the probes of both arrays are counted.
+ ********************************************************************************/
+static int SearchOpenTable(const strHash *pstrHash, const char *pszData, size_t nLength,
+                           unsigned long ulHash, int *pnProbes, strHashKey **ppstrKey)
+{
+   int                 nProbes     = 0;
+   int                 nOldProbes  = 0;
+   int                 nReturnCode = -1;
+   const strHashArray *pstrArray   = &pstrHash->strArray;
+
+
+
+   nReturnCode = FindOpenSlot(pstrArray, pszData, nLength, ulHash, &nProbes);
+
+   if (nReturnCode < 0)
+   {
+      pstrArray   = &pstrHash->strOldArray;
+      nReturnCode = FindOpenSlot(pstrArray, pszData, nLength, ulHash, &nOldProbes);
+      nProbes    += nOldProbes;
+   }
+
+   if (pnProbes != NULL)
+   {
+      *pnProbes = nProbes;
+   }
+
+   *ppstrKey = nReturnCode >= 0 ? &pstrArray->pastrSlots[nReturnCode] : NULL;
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: SearchSharedTable
+ * Params:   pstrShared - shared hash table
+ *           pszData - data to search for
+ * Returns:  -1 - not found
+ *           >=0 - bucket index where found
+ * Call by:  ProcessBatchLine()
+ * Call to:  HashBytes()
+ *           LockSharedTable()
+ *           MatchBytes()
+ *           SharedNode()
+ * Overview: Walks the chain without taking any lock, like a seqlock reader:
+ *           reads ulSequence, walks, then reads it again, and walks again if a
+ *           delete changed it in between, since the node it was on may have
+ *           been reused.  After HASH_SHARED_RETRIES tries, walks holding the
+ *           writers' lock instead.
+ * Notes:    Node numbers are checked against the capacity and the walk against
+ *           the number of nodes, so even a torn read stays inside the segment.
+ *           Only the handle is written, never the segment.
+ ********************************************************************************/
+int SearchSharedTable(strSharedHash *pstrShared, const char *pszData)
+{
+   int              nReturnCode = -1;
+   int              nTry        = 0;
+   size_t           nLength     = strlen(pszData);
+   unsigned int     nNode       = 0;
+   unsigned int     nSteps      = 0;
+   unsigned long    ulHash      = 0;
+   unsigned long    ulBucket    = 0;
+   unsigned long    ulSequence  = 0;
+   strSharedHeader *pstrHeader  = pstrShared->pstrHeader;
+   strSharedNode   *pstrNode    = NULL;
+
+
+
+   if (nLength > pstrHeader->nKeyMax)
+   {
+      pstrShared->lnMisses++;
+      return(-1);
+   }
+
+   ulHash   = HashBytes(pstrHeader->nHash, pstrHeader->aulSeed, pszData, nLength);
+   ulBucket = ulHash & (pstrHeader->ulBuckets-1);
+
+   for (nTry=0; nTry<=HASH_SHARED_RETRIES; nTry++)
+   {
+      if (nTry == HASH_SHARED_RETRIES && LockSharedTable(pstrShared) != 0)
+      {
+         return(-1);
+      }
+
+      nReturnCode = -1;
+      ulSequence  = __atomic_load_n(&pstrHeader->ulSequence, __ATOMIC_ACQUIRE);
+      nNode       = __atomic_load_n(&pstrShared->anBuckets[ulBucket], __ATOMIC_ACQUIRE);
+
+      for (nSteps=0; nNode != 0 && nNode <= pstrHeader->nCapacity &&
+                     nSteps < pstrHeader->nCapacity; nSteps++)
+      {
+         pstrNode = SharedNode(pstrShared, nNode);
+         pstrShared->lnWalked++;
+
+         if (pstrNode->ulHash == ulHash && pstrNode->nLength == nLength &&
+             MatchBytes(pstrNode->achKey, pszData, nLength) == TRUE)
+         {
+            nReturnCode = (int) ulBucket;
+            break;
+         }
+
+         nNode = __atomic_load_n(&pstrNode->nNext, __ATOMIC_ACQUIRE);
+      }
+
+      if (nTry == HASH_SHARED_RETRIES)
+      {
+         pthread_mutex_unlock(&pstrHeader->strMutex);
+         break;
+      }
+
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+      if (__atomic_load_n(&pstrHeader->ulSequence, __ATOMIC_RELAXED) == ulSequence)
+      {
+         break;
+      }
+
+      pstrShared->lnRetries++;
+   }
+
+   if (nReturnCode >= 0)
+   {
+      pstrShared->lnHits++;
+   }
+   else
+   {
+      pstrShared->lnMisses++;
+   }
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: SearchSnapshot
+ * Params:   pstrHash - hash table with a mapped snapshot
+ *           pszData - data to search for
+ *           nLength - strlen() of pszData
+ *           ulHash - HashKey() of pszData
+ *           pnChain - receives the position in the chain, or the number of
+ *                     records looked at when not found; may be NULL
+ *           ppstrRecord - receives the record found, or NULL
+ * Returns:  -1 - not found
+ *           >=0 - snapshot bucket index where found
+ * Call by:  SearchHashedEntry()
+ * Call to:  MatchBytes()
+ *           SnapshotBucket()
+ *           SnapshotRecord()
+ * Overview: Follows the offsets of the bucket's chain in the mapped file, and
+ *           only compares keys whose stored hash matches.  In a frozen
+ *           snapshot, the chain is the one record of the key's slot.
+ * Notes:    A damaged record ends the search as not found.
+ ********************************************************************************/
+static int SearchSnapshot(const strHash *pstrHash, const char *pszData, size_t nLength,
+                          unsigned long ulHash, int *pnChain,
+                          const strSnapshotRecord **ppstrRecord)
+{
+   long                     lnChain     = 0;
+   unsigned long            ulBucket    = 0;
+   unsigned long            ulOffset    = 0;
+   const strSnapshot       *pstrSnap    = &pstrHash->strSnap;
+   const strSnapshotRecord *pstrRecord  = NULL;
+
+
+
+   ulBucket = SnapshotBucket(pstrSnap, ulHash);
+   ulOffset = pstrSnap->aulBuckets[ulBucket];
+
+   *ppstrRecord = NULL;
+
+
+   for (lnChain=0; ulOffset != 0; lnChain++)
+   {
+      if ((pstrRecord = SnapshotRecord(pstrSnap, ulOffset)) == NULL ||
+          lnChain >= (long) pstrSnap->pstrHeader->ulEntries)
+      {
+         fprintf(stderr, "Snapshot record at offset %lu is damaged.\n", ulOffset);
+         return(-1);
+      }
+
+      if (pstrRecord->ulHash == ulHash &&
+          pstrRecord->nLength == nLength &&
+          MatchBytes(pstrRecord->achKey, pszData, nLength) == TRUE)
+      {
+         if (pnChain != NULL)
+         {
+            *pnChain = (int) lnChain;
+         }
+
+         *ppstrRecord = pstrRecord;
+
+         return((int) ulBucket);
+      }
+
+      ulOffset = pstrRecord->ulNext;
+   }
+
+
+   if (pnChain != NULL)
+   {
+      *pnChain = (int) lnChain;
+   }
+
+
+   return(-1);
+}
+
+
+
+
+/********************************************************************************
+ * Function: SetEntryKey
+ * Params:   pstrArena - key arena of the table
+ *           pstrEntry - chain node or slot key to store the key in
+ *           pszData - key to store
+ *           nLength - strlen() of pszData
+ *           ulHash - HashKey() of pszData
+ *           nExpire - CacheExpiry() of the key, 0 if it never expires
+ *           pchValue - value stored with the key, may be NULL
+ *           nValueLength - bytes of pchValue, 0 for no value
+ * Returns:  0 - key stored
+ *           <0 - cannot allocate memory
+ * Call by:  AddEntryToChainTable()
+ *           AddEntryToOpenTable()
+ *           BuildChainPartition()
+ *           BuildOpenPartition()
+ * Call to:  ArenaAlloc()
+ *           SetEntryValue()
+ * Overview: Copies a short key into the entry, or a long key into the arena,
+ *           then stores the value the same way.
+ * Notes:    A new key starts without the hit bit of the clock, see strHashCache.
+ *           When the value cannot be stored, the arena bytes of the key are
+ *           counted as dead.
+ ********************************************************************************/
+static int SetEntryKey(strArena *pstrArena, strHashKey *pstrEntry, const char *pszData,
+                       size_t nLength, unsigned long ulHash, unsigned int nExpire,
+                       const char *pchValue, size_t nValueLength)
+{
+   char *pszKey = NULL;
+
+
+
+   if (nLength < HASH_INLINE_KEY)
+   {
+      memcpy(pstrEntry->uKey.szInline, pszData, nLength+1);
+   }
+   else
+   {
+      if ((pszKey = ArenaAlloc(pstrArena, nLength+1)) == NULL)
+      {
+         return(-1);
+      }
+
+      memcpy(pszKey, pszData, nLength+1);
+      pstrEntry->uKey.pszExternal = pszKey;
+   }
+
+   pstrEntry->nValueLength = 0;
+
+   if (SetEntryValue(pstrArena, pstrEntry, pchValue, nValueLength) != 0)
+   {
+      if (pszKey != NULL)
+      {
+         pstrArena->nDead += nLength + 1;
+      }
+
+      return(-1);
+   }
+
+   pstrEntry->nLength = (unsigned int) nLength;
+   pstrEntry->ulHash  = ulHash;
+   pstrEntry->nExpire = nExpire;
+   pstrEntry->bRecent = 0;
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: SetEntryValue
+ * Params:   pstrArena - key arena of the table
+ *           pstrEntry - key of a chain node or slot
+ *           pchValue - value to store, may be NULL when nValueLength is 0
+ *           nValueLength - bytes of pchValue
+ * Returns:  0 - value stored
+ *           <0 - cannot allocate memory, the entry keeps its value
+ * Call by:  PutEntryInHashTable()
+ *           SetEntryKey()
+ * Call to:  ArenaAlloc()
+ * Overview: Copies a short value into the entry.  A long value overwrites the
+ *           arena bytes of the current value when they are enough, otherwise
+ *           it is copied to new arena bytes and the old ones count as dead.
+ * Notes:    The copy is a memmove(), so pchValue may be the value the entry
+ *           holds now, as returned by GetValueFromHashTable().  Bytes left over
+ *           by a shorter value count as dead right away.
+ ********************************************************************************/
+static int SetEntryValue(strArena *pstrArena, strHashKey *pstrEntry, const char *pchValue,
+                         size_t nValueLength)
+{
+   char   *pchStored = NULL;
+   size_t  nDead     = 0;
+
+
+
+   if (pstrEntry->nValueLength > HASH_INLINE_VALUE)
+   {
+      nDead = pstrEntry->nValueLength;       /* Unless overwritten below       */
+   }
+
+   if (nValueLength <= HASH_INLINE_VALUE)
+   {
+      pchStored = pstrEntry->uValue.achInline;
+   }
+   else if (nValueLength <= pstrEntry->nValueLength)
+   {
+      pchStored = pstrEntry->uValue.pchExternal;
+      nDead     = pstrEntry->nValueLength - nValueLength;
+   }
+   else if ((pchStored = ArenaAlloc(pstrArena, nValueLength)) == NULL)
+   {
+      return(-1);
+   }
+
+
+   /****************************************************************************
+    * achInline overlaps pchExternal, so pchStored was taken before the copy
+    * overwrites either of them.
+    ****************************************************************************/
+   if (nValueLength > 0)
+   {
+      memmove(pchStored, pchValue, nValueLength);
+   }
+
+   if (nValueLength > HASH_INLINE_VALUE)
+   {
+      pstrEntry->uValue.pchExternal = pchStored;
+   }
+
+   pstrEntry->nValueLength = (unsigned int) nValueLength;
+   pstrArena->nDead       += nDead;
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: SetHashCache
+ * Params:   pstrHash - hash table
+ *           lnMaxEntries - most keys kept, 0 for no limit
+ *           nMaxBytes - most bytes held by the keys, 0 for no limit
+ *           lnTtl - seconds added keys live, 0 for as long as they are not
+ *                   evicted
+ * Returns:  0 - done
+ *           <0 - a negative limit or TTL
+ * Call by:  main()
+ * Call to:  CacheFull()
+ *           EvictCacheEntry()
+ * Overview: Turns cache mode on, or off when every argument is 0.  In cache
+ *           mode, adds evict keys with the CLOCK algorithm to stay within the
+ *           limits, and keys past their TTL are dropped when a lookup finds
+ *           them.  Keys are evicted at once if the table is already too big.
+ * Notes:    The byte limit counts what CacheBytes() does: buckets, nodes in
+ *           use, live long keys and the filter.  The arrays only double and
+ *           halve, so a byte limit that an array alone crosses empties the
+ *           table.  Keys added before keep their TTL, or lack of one.
+ ********************************************************************************/
+int SetHashCache(strHash *pstrHash, long lnMaxEntries, size_t nMaxBytes, long lnTtl)
+{
+   strHashCache *pstrCache = &pstrHash->strCache;
+
+
+
+   if (lnMaxEntries < 0 || lnTtl < 0)
+   {
+      fprintf(stderr, "Cache limits and TTL cannot be negative.\n");
+      return(-1);
+   }
+
+   pstrCache->lnMaxEntries = lnMaxEntries;
+   pstrCache->nMaxBytes    = nMaxBytes;
+   pstrCache->lnTtl        = lnTtl;
+   pstrCache->bOn          = lnMaxEntries > 0 || nMaxBytes > 0 || lnTtl > 0 ? TRUE : FALSE;
+
+
+   while (pstrCache->bOn == TRUE && CacheFull(pstrHash, 0, 0) == TRUE &&
+          EvictCacheEntry(pstrHash) == 0)
+   {
+      ;
+   }
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: SetHashFilter
+ * Params:   pstrHash - hash table
+ *           bOn - TRUE to keep a filter in front of the table, FALSE to drop it
+ * Returns:  0 - done
+ *           <0 - cannot allocate memory, the table has no filter
+ * Call by:  main()
+ *           BuildHashTable()
+ * Call to:  BuildHashFilter()
+ * Overview: With the filter on, searches, adds and deletes of a key the filter
+ *           has never counted return at once, without reading the buckets.
+ *           The filter is built from the keys already in the table, with room
+ *           for twice as many or for one per bucket, whichever is more.
+ * Notes:    While a snapshot is mapped, searches go to the snapshot and do not
+ *           use the filter; its keys are counted as they are copied into the
+ *           table.
+ ********************************************************************************/
+int SetHashFilter(strHash *pstrHash, boolean bOn)
+{
+   long lnCapacity = pstrHash->lnEntries * 2;
+
+
+
+   if (bOn == FALSE)
+   {
+      free(pstrHash->strFilter.puchCounters);
+      memset(&pstrHash->strFilter, 0, sizeof(strHashFilter));
+      return(0);
+   }
+
+   if (lnCapacity < pstrHash->strArray.nSize)
+   {
+      lnCapacity = pstrHash->strArray.nSize;
+   }
+
+
+   return(BuildHashFilter(pstrHash, lnCapacity));
+}
+
+
+
+
+/********************************************************************************
+ * Function: SetHashPages
+ * Params:   pstrHash - hash table
+ *           nPages - PAGES_DEFAULT, PAGES_THP or PAGES_HUGETLB
+ *           nNuma - NUMA_LOCAL, NUMA_INTERLEAVE or NUMA_BIND
+ *           nNode - node of NUMA_BIND
+ * Returns:  0 - storage allocated from now on follows the policy
+ *           <0 - unknown policy, or a node that is not online
+ * Call by:  main()
+ * Call to:  AllocateHashArray()
+ *           FreeHashArray()
+ *           NumaNodes()
+ * Overview: Picks the pages behind the bucket array, the node slabs and the
+ *           key arena.  PAGES_THP backs large blocks with transparent huge
+ *           pages, and PAGES_HUGETLB with pages of the hugetlbfs pool, falling
+ *           back to PAGES_THP when the pool is empty.  Fewer pages to map a
+ *           large table means fewer TLB misses on random lookups.
+ *           NUMA_INTERLEAVE spreads the pages over all nodes, NUMA_BIND puts
+ *           them on nNode.
+ * Notes:    Call right after CreateHashTable(): an empty table gets its array
+ *           again under the policy at once, else only later storage follows
+ *           it, as on the next resize.  When the new array cannot be
+ *           allocated, the table keeps the old one.  GetHashInfo() reports
+ *           which pages took effect.
+ ********************************************************************************/
+int SetHashPages(strHash *pstrHash, pagepolicy nPages, numapolicy nNuma, int nNode)
+{
+   strHashArray strArray;
+
+
+
+   if ((unsigned int) nPages > PAGES_HUGETLB)
+   {
+      fprintf(stderr, "Invalid page policy %d.\n", (int) nPages);
+      return(-1);
+   }
+
+   if ((unsigned int) nNuma > NUMA_BIND)
+   {
+      fprintf(stderr, "Invalid NUMA policy %d.\n", (int) nNuma);
+      return(-1);
+   }
+
+   if (nNuma == NUMA_BIND &&
+       (nNode < 0 || nNode >= HASH_NUMA_NODES || (NumaNodes() & (1UL << nNode)) == 0))
+   {
+      fprintf(stderr, "Invalid NUMA node %d, it is not online.\n", nNode);
+      return(-1);
+   }
+
+   pstrHash->strPages.nPolicy = nPages;
+   pstrHash->strPages.nNuma   = nNuma;
+   pstrHash->strPages.nNode   = nNuma == NUMA_BIND ? nNode : 0;
+
+   if (pstrHash->lnEntries == 0 && pstrHash->strOldArray.nSize == 0 &&
+       pstrHash->strSnap.puchMap == NULL &&
+       AllocateHashArray(&strArray, &pstrHash->strPages, pstrHash->nEngine,
+                         pstrHash->strArray.nSize) == 0)
+   {
+      FreeHashArray(&pstrHash->strArray);
+      pstrHash->strArray = strArray;
+   }
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: SetKeyKernel
+ * Params:   nKernel - KERNEL_SCALAR, KERNEL_SSE2 or KERNEL_AVX2
+ * Returns:  Kernel now in use, lower than nKernel when the processor or the
+ *           build does not have it
+ * Call by:  RunKernelBenchmark()
+ * Call to:  KeyKernel()
+ * Overview: Picks the kernel MatchBytes() compares keys with, for all tables.
+ * Notes:    Without a call, the widest kernel available is used.  The kernel
+ *           only changes how fast keys are compared, never the result.
+ ********************************************************************************/
+keykernel SetKeyKernel(keykernel nKernel)
+{
+   return(KeyKernel((int) nKernel));
+}
+
+
+
+
+/********************************************************************************
+ * Function: SharedNode
+ * Params:   pstrShared - shared hash table
+ *           nNode - node number, as stored in a link, from 1 to nCapacity
+ * Returns:  The node
+ * Call by:  AddEntryToSharedTable()
+ *           DeleteEntryFromSharedTable()
+ *           RecoverSharedTable()
+ *           SearchSharedTable()
+ * Call to:  None
+ * Overview: Turns a link into the address of the node in this process's map.
+ * Notes:    Links are one more than the node index, so 0 can end a chain.
+ ********************************************************************************/
+static strSharedNode *SharedNode(const strSharedHash *pstrShared, unsigned int nNode)
+{
+   return((strSharedNode *) (pstrShared->pchNodes +
+                             (size_t) (nNode - 1) * pstrShared->pstrHeader->nNodeSize));
+}
+
+
+
+
+/********************************************************************************
+ * Function: SnapshotBucket
+ * Params:   pstrSnap - mapped snapshot
+ *           ulHash - HashKey() of a key
+ * Returns:  Bucket of the key in the snapshot
+ * Call by:  PrefetchBuckets()
+ *           SearchSnapshot()
+ * Call to:  PerfectBucket()
+ *           PerfectSlot()
+ * Overview: Masks the hash with the bucket count, or in a frozen snapshot
+ *           picks the slot with the pilot of the key's perfect hash bucket.
+ * Notes:    Pilots are not checked: any pilot gives a slot below ulBuckets.
+ ********************************************************************************/
+static unsigned long SnapshotBucket(const strSnapshot *pstrSnap, unsigned long ulHash)
+{
+   const strSnapshotHeader *pstrHeader = pstrSnap->pstrHeader;
+
+
+
+   if (pstrHeader->ulPilots == 0)
+   {
+      return(ulHash & (pstrHeader->ulBuckets - 1));
+   }
+
+
+   return(PerfectSlot(ulHash, pstrHeader->ulPilotSeed,
+                      pstrSnap->anPilots[PerfectBucket(ulHash, pstrHeader->ulPilotSeed,
+                                                       pstrHeader->ulPilots)],
+                      pstrHeader->ulBuckets));
+}
+
+
+
+
+/********************************************************************************
+ * Function: SnapshotRecord
+ * Params:   pstrSnap - mapped snapshot
+ *           ulOffset - offset of a record from the start of the file
+ * Returns:  The record at ulOffset
+ *           NULL - the offset or the record does not fit in the file
+ * Call by:  ImportSnapshot()
+ *           ListSnapshot()
+ *           SearchSnapshot()
+ * Call to:  SnapshotRecordStart()
+ * Overview: Checks that a whole record, including its key, terminator and value,
+ *           lies after the bucket array and inside the file before it is read.
+ * Notes:    A damaged file can then at worst give wrong answers, never read
+ *           outside the mapping.
+ ********************************************************************************/
+static const strSnapshotRecord *SnapshotRecord(const strSnapshot *pstrSnap,
+                                               unsigned long ulOffset)
+{
+   unsigned long            ulStart    = 0;
+   const strSnapshotRecord *pstrRecord = NULL;
+
+
+
+   ulStart = SnapshotRecordStart(pstrSnap->pstrHeader);
+
+   if (ulOffset < ulStart || ulOffset % HASH_SNAPSHOT_ALIGN != 0 ||
+       ulOffset > pstrSnap->nSize - offsetof(strSnapshotRecord, achKey))
+   {
+      return(NULL);
+   }
+
+   pstrRecord = (const strSnapshotRecord *) (pstrSnap->puchMap + ulOffset);
+
+   if (pstrRecord->nLength >= pstrSnap->nSize - ulOffset - offsetof(strSnapshotRecord, achKey) ||
+       pstrRecord->nValueLength > pstrSnap->nSize - ulOffset - offsetof(strSnapshotRecord, achKey) -
+                                  pstrRecord->nLength - 1 ||
+       pstrRecord->achKey[pstrRecord->nLength] != '\0')
+   {
+      return(NULL);
+   }
+
+
+   return(pstrRecord);
+}
+
+
+
+
+/********************************************************************************
+ * Function: SnapshotRecordSize
+ * Params:   nLength - key length
+ *           nValueLength - value length
+ * Returns:  Bytes taken by a snapshot record with that key and value
+ * Call by:  FreezeHashTable()
+ *           SaveSnapshot()
+ * Call to:  None
+ * Overview: Record fields, key, terminator and value, rounded up to
+ *           HASH_SNAPSHOT_ALIGN so the next record is aligned.
+ * Notes:    None
+ ********************************************************************************/
+static size_t SnapshotRecordSize(unsigned int nLength, unsigned int nValueLength)
+{
+   return((offsetof(strSnapshotRecord, achKey) + (size_t) nLength + 1 + nValueLength +
+           HASH_SNAPSHOT_ALIGN - 1) & ~(size_t) (HASH_SNAPSHOT_ALIGN - 1));
+}
+
+
+
+
+/********************************************************************************
+ * Function: SnapshotRecordStart
+ * Params:   pstrHeader - snapshot header
+ * Returns:  Offset of the first record from the start of the file
+ * Call by:  FreezeHashTable()
+ *           LoadSnapshot()
+ *           SnapshotRecord()
+ * Call to:  None
+ * Overview: Skips the header, the bucket offsets and the pilots of a frozen
+ *           snapshot, padded to HASH_SNAPSHOT_ALIGN.
+ * Notes:    The counts must already be known to fit in the file.
+ ********************************************************************************/
+static unsigned long SnapshotRecordStart(const strSnapshotHeader *pstrHeader)
+{
+   return(sizeof(strSnapshotHeader) + pstrHeader->ulBuckets * sizeof(unsigned long) +
+          ((pstrHeader->ulPilots * sizeof(unsigned int) + HASH_SNAPSHOT_ALIGN - 1) &
+           ~(unsigned long) (HASH_SNAPSHOT_ALIGN - 1)));
+}
+
+
+
+
+/********************************************************************************
+ * Function: StatsHashTable
+ * Params:   pstrHash - hash table
+ *           pFile - stream to print the report on
+ *           bJson - TRUE for one line of JSON, FALSE for text
+ * Returns:  0
+ * Call by:  main()
+ *           ServerCommand()
+ * Call to:  GetHashInfo()
+ *           HashName()
+ *           HistogramHashTable()
+ *           MemoryInUse()
+ *           NumaPolicyName()
+ *           PagePolicyName()
+ * Overview: Prints the operation counters with the shape of the table: load
+ *           factor, buckets in use, longest chain and the histogram of chain
+ *           lengths, or of groups probed with open addressing, the chains
+ *           with an index, the filter's false positive rate among the misses,
+ *           the hit rate, evictions and expirations of cache mode, the records
+ *           and syncs of the journal, the memory in use and the pages behind
+ *           it.  A poor --hashsize shows as long chains at a high load
+ *           factor, a poor hash as long chains with many empty buckets.
+ * Notes:    Counters are kept on every call; the histogram walks the whole
+ *           table when the report is asked for.
+ ********************************************************************************/
+int StatsHashTable(const strHash *pstrHash, FILE *pFile, boolean bJson)
+{
+   int                 nIndex     = 0;
+   long                lnMax      = 0;
+   long                lnUsed     = 0;
+   long                lnBuckets  = 0;
+   long                lnSearches = 0;
+   int                 nIndexed   = 0;
+   boolean             bFrozen    = FALSE;
+   double              dLoad      = 0;
+   const char         *pszLength  = "chain";
+   const strHashStats *pstrStats  = &pstrHash->strStats;
+   strHashInfo         strInfo;
+   long                alnLengths[HASH_STATS_LENGTHS];
+
+
+
+   GetHashInfo(pstrHash, &strInfo);
+
+   lnMax      = HistogramHashTable(pstrHash, alnLengths, &lnUsed, &lnBuckets);
+   lnSearches = pstrStats->lnHits + pstrStats->lnMisses;
+   dLoad      = lnBuckets > 0 ? (double) pstrHash->lnEntries / lnBuckets : 0;
+   nIndexed   = pstrHash->strArray.nIndexes + pstrHash->strOldArray.nIndexes;
+   bFrozen    = (pstrHash->strSnap.puchMap != NULL &&
+                 pstrHash->strSnap.pstrHeader->ulPilots != 0) ? TRUE : FALSE;
+
+   if (pstrHash->nEngine == ENGINE_OPEN && pstrHash->strSnap.puchMap == NULL)
+   {
+      pszLength = "probe";
+   }
+
+
+   if (bJson == TRUE)
+   {
+      fprintf(pFile, "{\"engine\":\"%s\",\"hash\":\"%s\",\"entries\":%ld,\"size\":%ld,"
+              "\"load_factor\":%.3f,\"used\":%ld,\"max_%s\":%ld,\"%s_lengths\":[",
+              pstrHash->nEngine == ENGINE_OPEN ? "open" : "chain",
+              HashName(pstrHash->nHash),
+              pstrHash->lnEntries,
+              lnBuckets,
+              dLoad,
+              lnUsed,
+              pszLength,
+              lnMax,
+              pszLength);
+
+      for (nIndex=0; nIndex<HASH_STATS_LENGTHS; nIndex++)
+      {
+         fprintf(pFile, "%s%ld", nIndex > 0 ? "," : "", alnLengths[nIndex]);
+      }
+
+      fprintf(pFile, "],\"indexed\":%d,\"frozen\":%s,\"inserts\":%ld,\"updates\":%ld,\"hits\":%ld,"
+              "\"misses\":%ld,\"deletes\":%ld,\"walked\":%ld,\"filter\":%s,\"filtered\":%ld,"
+              "\"false_positives\":%ld,\"cache\":%s,\"hit_rate\":%.4f,\"evicted\":%ld,"
+              "\"expired\":%ld,\"journal\":%s,\"journal_records\":%ld,\"syncs\":%ld,"
+              "\"memory_bytes\":%zu,\"pages\":\"%s\",\"numa\":\"%s\",\"huge_page\":%ld,"
+              "\"base_bytes\":%ld,\"thp_bytes\":%ld,\"thp_backed_bytes\":%ld,"
+              "\"hugetlb_bytes\":%ld,\"numa_bytes\":%ld}\n",
+              nIndexed,
+              bFrozen == TRUE ? "true" : "false",
+              pstrStats->lnInserts,
+              pstrStats->lnUpdates,
+              pstrStats->lnHits,
+              pstrStats->lnMisses,
+              pstrStats->lnDeletes,
+              pstrStats->lnWalked,
+              pstrHash->strFilter.puchCounters != NULL ? "true" : "false",
+              pstrStats->lnFiltered,
+              pstrStats->lnFalse,
+              pstrHash->strCache.bOn == TRUE ? "true" : "false",
+              lnSearches > 0 ? (double) pstrStats->lnHits / lnSearches : 0,
+              pstrStats->lnEvicted,
+              pstrStats->lnExpired,
+              pstrHash->strJournal.pchBuffer != NULL ? "true" : "false",
+              pstrHash->strJournal.lnRecords,
+              pstrHash->strJournal.lnSyncs,
+              MemoryInUse(pstrHash),
+              PagePolicyName(strInfo.nPages),
+              NumaPolicyName(strInfo.nNuma),
+              strInfo.lnHugePage,
+              strInfo.lnBaseBytes,
+              strInfo.lnThpBytes,
+              strInfo.lnThpBacked,
+              strInfo.lnHugetlbBytes,
+              strInfo.lnPlacedBytes);
+
+      return(0);
+   }
+
+
+   fprintf(pFile, "Entries:          %ld\n", pstrHash->lnEntries);
+   fprintf(pFile, "Load factor:      %.3f\n", dLoad);
+   fprintf(pFile, "%s %ld of %ld (%.1f%%)\n",
+           pszLength[0] == 'p' ? "Slots used:      " : "Buckets used:    ",
+           lnUsed,
+           lnBuckets,
+           lnBuckets > 0 ? 100.0 * lnUsed / lnBuckets : 0);
+   fprintf(pFile, "%s %ld\n",
+           pszLength[0] == 'p' ? "Longest probe:   " : "Longest chain:   ",
+           lnMax);
+   fprintf(pFile, "%s",
+           pszLength[0] == 'p' ? "Groups probed:   " : "Chain lengths:   ");
+
+   for (nIndex=0; nIndex<HASH_STATS_LENGTHS; nIndex++)
+   {
+      fprintf(pFile, " %d%s:%ld",
+              nIndex,
+              nIndex == HASH_STATS_LENGTHS-1 ? "+" : "",
+              alnLengths[nIndex]);
+   }
+
+   fprintf(pFile, "\n");
+
+   if (pstrHash->nEngine == ENGINE_CHAIN)
+   {
+      fprintf(pFile, "Indexed chains:   %d\n", nIndexed);
+   }
+
+   if (bFrozen == TRUE)
+   {
+      fprintf(pFile, "Frozen:           one slot per key, %lu pilots\n",
+              pstrHash->strSnap.pstrHeader->ulPilots);
+   }
+
+   fprintf(pFile, "Inserts:          %ld\n", pstrStats->lnInserts);
+   fprintf(pFile, "Updates:          %ld\n", pstrStats->lnUpdates);
+   fprintf(pFile, "Searches:         %ld hits, %ld misses\n",
+           pstrStats->lnHits, pstrStats->lnMisses);
+   fprintf(pFile, "Deletes:          %ld\n", pstrStats->lnDeletes);
+   fprintf(pFile, "%s %ld (%.2f per search)\n",
+           pszLength[0] == 'p' ? "Groups searched: " : "Nodes searched:  ",
+           pstrStats->lnWalked,
+           lnSearches > 0 ? (double) pstrStats->lnWalked / lnSearches : 0);
+
+   if (pstrHash->strFilter.puchCounters != NULL)
+   {
+      fprintf(pFile, "Filter:           %ld misses answered, %ld false positives (%.2f%%)\n",
+              pstrStats->lnFiltered,
+              pstrStats->lnFalse,
+              pstrStats->lnFiltered + pstrStats->lnFalse > 0 ?
+              100.0 * pstrStats->lnFalse / (pstrStats->lnFiltered + pstrStats->lnFalse) : 0);
+   }
+
+   if (pstrHash->strCache.bOn == TRUE)
+   {
+      fprintf(pFile, "Cache:            %.2f%% hit rate, %ld evicted, %ld expired\n",
+              lnSearches > 0 ? 100.0 * pstrStats->lnHits / lnSearches : 0,
+              pstrStats->lnEvicted,
+              pstrStats->lnExpired);
+   }
+
+   if (pstrHash->strJournal.pchBuffer != NULL)
+   {
+      fprintf(pFile, "Journal:          %ld records, %ld syncs, %ld not synced\n",
+              pstrHash->strJournal.lnRecords,
+              pstrHash->strJournal.lnSyncs,
+              pstrHash->strJournal.lnPending);
+   }
+
+   fprintf(pFile, "Memory in use:    %zu bytes\n", MemoryInUse(pstrHash));
+   fprintf(pFile, "Pages:            %s, %ld base, %ld THP (%ld on huge pages), "
+           "%ld hugetlb bytes\n",
+           PagePolicyName(strInfo.nPages),
+           strInfo.lnBaseBytes,
+           strInfo.lnThpBytes,
+           strInfo.lnThpBacked,
+           strInfo.lnHugetlbBytes);
+
+   if (strInfo.nNuma == NUMA_BIND)
+   {
+      fprintf(pFile, "NUMA:             bind to node %d, %ld bytes placed\n",
+              strInfo.nNode, strInfo.lnPlacedBytes);
+   }
+   else if (strInfo.nNuma != NUMA_LOCAL)
+   {
+      fprintf(pFile, "NUMA:             %s, %ld bytes placed\n",
+              NumaPolicyName(strInfo.nNuma), strInfo.lnPlacedBytes);
+   }
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: SyncHashJournal
+ * Params:   pstrHash - hash table
+ * Returns:  0 - every change is on disk, or the table has no journal
+ *           <0 - cannot write or sync the journal
+ * Call by:  CloseJournal()
+ *           CommitJournal()
+ *           CompactJournal()
+ *           RunServer()
+ * Call to:  JournalClock()
+ *           WriteJournal()
+ * Overview: Writes the records in the buffer and waits for them to reach the
+ *           disk with fdatasync(), whatever the sync policy.
+ * Notes:    A server calls it when idle, so the last group of changes does
+ *           not wait for the next change to be synced.
+ ********************************************************************************/
+int SyncHashJournal(strHash *pstrHash)
+{
+   strJournal *pstrJournal = &pstrHash->strJournal;
+
+
+
+   if (pstrJournal->pchBuffer == NULL)
+   {
+      return(0);
+   }
+
+   if (pstrJournal->nBuffered > 0 &&
+       WriteJournal(pstrJournal, pstrJournal->pchBuffer, pstrJournal->nBuffered) != 0)
+   {
+      return(-1);
+   }
+
+   pstrJournal->nBuffered = 0;
+
+   if (fdatasync(pstrJournal->nFile) != 0)
+   {
+      fprintf(stderr, "Failed to sync journal [%s]. errno=%d.\n", pstrJournal->szFile, errno);
+      return(-1);
+   }
+
+   pstrJournal->lnPending = 0;
+   pstrJournal->ulSyncMs  = JournalClock();
+   pstrJournal->lnSyncs++;
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: TestFilterKey
+ * Params:   pstrFilter - filter of a table, may be off
+ *           ulHash - HashKey() of the key
+ * Returns:  FALSE - the key is not in the table
+ *           TRUE - the key may be in the table, or there is no filter
+ * Call by:  AddEntryToChainTable()
+ *           PutEntryInHashTable()
+ *           AddEntryToOpenTable()
+ *           DeleteEntryFromHashTable()
+ *           DeleteEntryFromOpenTable()
+ *           MakeCacheRoom()
+ *           SearchHashedEntry()
+ * Call to:  MixFilterHash()
+ * Overview: The key may be there only when none of its counters is 0.  All of
+ *           them are in one block, so this reads one cache line.
+ * Notes:    TRUE for a key that is not there is a false positive, counted by
+ *           SearchHashedEntry().
+ ********************************************************************************/
+static boolean TestFilterKey(const strHashFilter *pstrFilter, unsigned long ulHash)
+{
+   int                  nProbe    = 0;
+   unsigned int         nCounter  = 0;
+   unsigned long        ulMix     = 0;
+   const unsigned char *puchBlock = NULL;
+
+
+
+   if (pstrFilter->puchCounters == NULL)
+   {
+      return(TRUE);
+   }
+
+   ulMix     = MixFilterHash(ulHash);
+   puchBlock = pstrFilter->puchCounters +
+               (ulMix & (pstrFilter->ulBlocks - 1)) * HASH_CACHE_LINE;
+
+
+   for (nProbe=0, ulMix>>=32; nProbe<HASH_FILTER_PROBES; nProbe++, ulMix/=HASH_CACHE_LINE*2)
+   {
+      nCounter = (unsigned int) (ulMix % (HASH_CACHE_LINE * 2));
+
+      if (((puchBlock[nCounter / 2] >> ((nCounter & 1) * 4)) & 0x0F) == 0)
+      {
+         return(FALSE);
+      }
+   }
+
+
+   return(TRUE);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ThpBackedBytes
+ * Params:   None
+ * Returns:  Bytes of mappings advised for THP that are backed by huge pages
+ * Call by:  PageUsage()
+ * Call to:  None
+ * Overview: Adds up AnonHugePages in /proc/self/smaps over the mappings whose
+ *           VmFlags have "hg", set by madvise(MADV_HUGEPAGE).
+ * Notes:    Counts every such mapping of the process, not of one table.  0 when
+ *           smaps cannot be read.
+ ********************************************************************************/
+static long ThpBackedBytes(void)
+{
+   long  lnMapping = 0;
+   long  lnTotal   = 0;
+   long  lnKb      = 0;
+   FILE *pFile     = NULL;
+   char  szLine[512];
+
+
+
+   if ((pFile = fopen("/proc/self/smaps", "r")) == NULL)
+   {
+      return(0);
+   }
+
+   while (fgets(szLine, sizeof(szLine), pFile) != NULL)
+   {
+      if (sscanf(szLine, "AnonHugePages: %ld kB", &lnKb) == 1)
+      {
+         lnMapping = lnKb;
+      }
+      else if (strncmp(szLine, "VmFlags:", 8) == 0)
+      {
+         if (strstr(szLine, " hg") != NULL)
+         {
+            lnTotal += lnMapping;
+         }
+
+         lnMapping = 0;
+      }
+   }
+
+   fclose(pFile);
+
+
+   return(lnTotal * 1024);
+}
+
+
+
+
+/********************************************************************************
+ * Function: TornJournalTail
+ * Params:   pchMap - journal mapped in memory
+ *           nSize - bytes of pchMap
+ *           nOffset - offset of the first record ReplayJournal() rejected
+ * Returns:  TRUE - the rejected bytes are the tail of a write cut by a crash
+ *           FALSE - a record in the middle of the journal is damaged
+ * Call by:  OpenHashJournal()
+ * Call to:  None
+ * Overview: A crash can only tear the last record: its header is cut short,
+ *           its header claims more bytes than the file has, its bytes end the
+ *           file but were not all written, or the file system left the end of
+ *           the file zero filled.  Anything else means valid records may
+ *           follow the damaged one.
+ * Notes:    None
+ ********************************************************************************/
+static boolean TornJournalTail(const char *pchMap, size_t nSize, size_t nOffset)
+{
+   size_t            nBytes = 0;
+   size_t            nIndex = 0;
+   strJournalRecord  strRecord;
+
+
+
+   if (nSize - nOffset < sizeof(strJournalRecord))
+   {
+      return(TRUE);
+   }
+
+   memcpy(&strRecord, pchMap + nOffset, sizeof(strJournalRecord));
+
+   nBytes = sizeof(strJournalRecord) + (size_t) strRecord.nLength + 1 + strRecord.nValueLength;
+
+   if (nBytes >= nSize - nOffset)
+   {
+      return(TRUE);
+   }
+
+   for (nIndex=nOffset; nIndex<nSize && pchMap[nIndex] == '\0'; nIndex++)
+   {
+      ;
+   }
+
+
+   return(nIndex == nSize ? TRUE : FALSE);
+}
+
+
+
+
+/********************************************************************************
+ * Function: TouchCacheEntry
+ * Params:   pstrHash - hash table
+ *           pstrKey - key of an entry just found
+ * Returns:  0 - the key is live, and marked as hit for the clock
+ *           >0 - the key had expired and was removed
+ * Call by:  MakeCacheRoom()
+ *           PutEntryInHashTable()
+ *           SearchHashedEntry()
+ * Call to:  CacheClock()
+ *           RemoveCacheEntry()
+ * Overview: Lazy expiry: a key past its TTL is only noticed, and dropped, when
+ *           it is looked up or reached by the clock hand.
+ * Notes:    The hit bit is only written when it is not already set, so hot
+ *           keys do not dirty their cache line on every hit.
+ ********************************************************************************/
+static int TouchCacheEntry(strHash *pstrHash, strHashKey *pstrKey)
+{
+   if (pstrKey->nExpire != 0 && pstrKey->nExpire < CacheClock(pstrHash))
+   {
+      RemoveCacheEntry(pstrHash, pstrKey);
+      pstrHash->strStats.lnExpired++;
+      return(1);
+   }
+
+   if (pstrKey->bRecent == 0)
+   {
+      pstrKey->bRecent = 1;
+   }
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: TraceClock
+ * Params:   None
+ * Returns:  Nanoseconds of CLOCK_MONOTONIC
+ * Call by:  AppendTrace()
+ *           OpenHashTrace()
+ * Call to:  None
+ * Overview: Times the records of a trace.
+ * Notes:    None
+ ********************************************************************************/
+static unsigned long TraceClock(void)
+{
+   struct timespec strNow;
+
+
+
+   clock_gettime(CLOCK_MONOTONIC, &strNow);
+
+
+   return((unsigned long) strNow.tv_sec * 1000000000UL + strNow.tv_nsec);
+}
+
+
+
+
+/********************************************************************************
+ * Function: UnlinkChainEntry
+ * Params:   pstrHash - hash table
+ *           pstrArray - chained bucket array, may be empty
+ *           pszData - data to search for in the array to remove if found
+ *           nLength - strlen() of pszData
+ *           ulHash - HashKey() of pszData
+ * Returns:  0  - data found and deleted
+ *           >0 - data not found to delete
+ * Call by:  DeleteEntryFromHashTable()
+ *           RemoveCacheEntry()
+ * Call to:  ArenaBytesOfEntry()
+ *           DropChainIndex()
+ *           KeyOfEntry()
+ *           MatchKey()
+ *           NodeFree()
+ *           SearchChainIndex()
+ * Overview: Searchs the array by finding the correct bucket index, and then
+ *           traverse the linked list to find the data to delete.
+ *           Shift the linked list pointer around the deleted element and give
+ *           its node back to the node pool.
+ *           If the data is found in the first chain of the bucket, empty the
+ *           data, but do not free the memory of bucket head.
+ *           An indexed chain is binary searched instead.  Its node after the
+ *           head is the one given back, after moving its key into the node of
+ *           the deleted data, so no walk is needed to find a previous node.
+ * Notes:    Memory for each linked list chain is taken in AddEntryToChainTable().
+ *           The bucket head (first chain in linked list) is not freed.
+ ********************************************************************************/
+static int UnlinkChainEntry(strHash *pstrHash, strHashArray *pstrArray, const char *pszData,
+                            size_t nLength, unsigned long ulHash)
+{
+   boolean        bFirstChain  = TRUE;
+   int            nHashIndex   = 0;
+   int            nPosition    = 0;
+   int            nMoved       = 0;
+   strHashTable  *pstrCurrent  = NULL;
+   strHashTable  *pstrPrevious = NULL;
+   strHashTable  *pstrNext     = NULL;
+   strChainIndex *pstrIndex    = NULL;
+
+
+
+   if (pstrArray->nSize == 0)
+   {
+      return(1);
+   }
+
+   nHashIndex = (int) (ulHash % pstrArray->nSize);
+
+
+   if (pstrArray->papstrIndexes != NULL &&
+       (pstrIndex = pstrArray->papstrIndexes[nHashIndex]) != NULL)
+   {
+      if ((nPosition = SearchChainIndex(pstrIndex, pszData, nLength, ulHash, NULL)) < 0)
+      {
+         return(1);
+      }
+
+      Debug("Found [%s] in indexed bucket [%d]\n", pszData, nHashIndex);
+
+      pstrCurrent  = pstrIndex->apstrNodes[nPosition];
+      pstrPrevious = &pstrArray->pastrBuckets[nHashIndex];
+
+      pstrHash->strKeys.nDead += ArenaBytesOfEntry(&pstrCurrent->strKey);
+
+
+      /**************************************************************************
+       * The bucket head is emptied as usual.  Otherwise the node after the head
+       * takes the place of the deleted one in the chain and in the index.
+       **************************************************************************/
+      if (pstrCurrent == pstrPrevious)
+      {
+         memset(&pstrCurrent->strKey, 0, sizeof(pstrCurrent->strKey));
+      }
+      else
+      {
+         pstrNext = pstrPrevious->pstrNext;
+
+         if (pstrNext != pstrCurrent)
+         {
+            nMoved = SearchChainIndex(pstrIndex, KeyOfEntry(&pstrNext->strKey),
+                                      pstrNext->strKey.nLength, pstrNext->strKey.ulHash, NULL);
+
+            pstrIndex->apstrNodes[nMoved] = pstrCurrent;
+            pstrCurrent->strKey           = pstrNext->strKey;
+         }
+
+         pstrPrevious->pstrNext = pstrNext->pstrNext;
+         NodeFree(&pstrHash->strNodes, pstrNext);
+
+         pstrHash->lnChainNodes--;
+      }
+
+      memmove(&pstrIndex->apstrNodes[nPosition], &pstrIndex->apstrNodes[nPosition + 1],
+              (pstrIndex->nCount - nPosition - 1) * sizeof(strHashTable *));
+
+      if (--pstrIndex->nCount <= HASH_INDEX_CHAIN / 2)
+      {
+         DropChainIndex(pstrArray, nHashIndex);
+      }
+
+      pstrHash->lnEntries--;
+
+
+      return(0);
+   }
+
+
+   for (pstrCurrent  = &pstrArray->pastrBuckets[nHashIndex];
+        pstrCurrent != NULL;
+        pstrPrevious = pstrCurrent, pstrCurrent = pstrCurrent->pstrNext)
+   {
+      Debug("Comparing [%s] with [%s]\n", KeyOfEntry(&pstrCurrent->strKey), pszData);
+
+      if (pstrCurrent->strKey.ulHash != ulHash ||
+          MatchKey(&pstrCurrent->strKey, pszData, nLength) == FALSE)
+      {
+         bFirstChain = FALSE;
+         continue;
+      }
+
+      Debug("Found [%s] in bucket [%d]\n", pszData, nHashIndex);
+
+
+      /**************************************************************************
+       * Arena bytes of a long key or value are not reused, only counted as dead.
+       **************************************************************************/
+      pstrHash->strKeys.nDead += ArenaBytesOfEntry(&pstrCurrent->strKey);
+
+
+      /**************************************************************************
+       * If data is found in the bucket head, reset the data, but do not free
+       * any memory.  Each bucket head will always be around.
+       **************************************************************************/
+      if (bFirstChain == TRUE)
+      {
+         memset(&pstrCurrent->strKey, 0, sizeof(pstrCurrent->strKey));
+      }
+
+      /**************************************************************************
+       * If data is found anywhere in the linked list except the bucket head
+       * (first element of linked list), then rearrange linked list and give
+       * the node of data found back to the pool.
+       **************************************************************************/
+      else
+      {
+         pstrPrevious->pstrNext = pstrCurrent->pstrNext;
+         NodeFree(&pstrHash->strNodes, pstrCurrent);
+
+         pstrHash->lnChainNodes--;
+      }
+
+
+      pstrHash->lnEntries--;
+
+
+      return(0);
+   }
+
+
+   return(1);
+}
+
+
+
+
+/********************************************************************************
+ * Function: UnlinkOpenEntry
+ * Params:   pstrHash - open addressing hash table
+ *           pstrArray - open addressing array, may be empty
+ *           pszData - data to search for in the array to remove if found
+ *           nLength - strlen() of pszData
+ *           ulHash - HashKey() of pszData
+ * Returns:  0  - data found and deleted
+ *           >0 - data not found to delete
+ * Call by:  DeleteEntryFromOpenTable()
+ *           RemoveCacheEntry()
+ * Call to:  ArenaBytesOfEntry()
+ *           FindOpenSlot()
+ *           MatchGroup()
+ * Overview: Finds the slot holding the data and releases it.
+ * Notes:    A probe stops at the first group containing an empty slot, so a slot
+ *           can only be marked empty again when its group already has an empty
+ *           slot.  Otherwise it is marked deleted so later probes continue past
+ *           it.
+ ********************************************************************************/
+static int UnlinkOpenEntry(strHash *pstrHash, strHashArray *pstrArray, const char *pszData,
+                           size_t nLength, unsigned long ulHash)
+{
+   int nSlot  = 0;
+   int nGroup = 0;
+
+
+
+   nSlot = FindOpenSlot(pstrArray, pszData, nLength, ulHash, NULL);
+
+   if (nSlot < 0)
+   {
+      return(1);
+   }
+
+
+   pstrHash->strKeys.nDead += ArenaBytesOfEntry(&pstrArray->pastrSlots[nSlot]);
+
+   memset(&pstrArray->pastrSlots[nSlot], 0, sizeof(strHashKey));
+
+
+   nGroup = nSlot - (nSlot % HASH_GROUP);
+
+   if (MatchGroup(&pstrArray->pachControl[nGroup], HASH_CTRL_EMPTY) != 0)
+   {
+      pstrArray->pachControl[nSlot] = HASH_CTRL_EMPTY;
+   }
+   else
+   {
+      pstrArray->pachControl[nSlot] = HASH_CTRL_DELETED;
+      pstrArray->lnDeleted++;
+   }
+
+   pstrHash->lnEntries--;
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: UnmapHashTrace
+ * Params:   pstrTrace - trace mapped by MapHashTrace()
+ * Returns:  None
+ * Call by:  RunReplay()
+ * Call to:  None
+ * Overview: Unmaps the trace and frees it.
+ * Notes:    pstrTrace may be NULL.
+ ********************************************************************************/
+void UnmapHashTrace(strHashTrace *pstrTrace)
+{
+   if (pstrTrace == NULL)
+   {
+      return;
+   }
+
+   munmap(pstrTrace->pchMap, pstrTrace->nSize);
+   free(pstrTrace);
+}
+
+
+
+
+/********************************************************************************
+ * Function: UnregisterEpochThread
+ * Params:   pstrThread - epoch record from RegisterEpochThread()
+ * Returns:  None
+ * Call by:  BenchConcurrentThread()
+ * Call to:  None
+ * Overview: Gives the epoch record back, for another thread to use.
+ * Notes:    The thread must not be inside an epoch.
+ ********************************************************************************/
+void UnregisterEpochThread(strEpochThread *pstrThread)
+{
+   __atomic_store_n(&pstrThread->ulEpoch, 0, __ATOMIC_RELEASE);
+   __atomic_store_n(&pstrThread->bInUse, FALSE, __ATOMIC_RELEASE);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ValueOfEntry
+ * Params:   pstrEntry - key of a chain node or open addressing slot
+ * Returns:  The value stored with the key, nValueLength bytes long
+ * Call by:  CompactJournal()
+ *           FreezeHashTable()
+ *           SaveSnapshot()
+ *           SearchHashedEntry()
+ * Call to:  None
+ * Overview: Short values are inside the entry, long values are in the key
+ *           arena.
+ * Notes:    The value has no terminator.
+ ********************************************************************************/
+static const char *ValueOfEntry(const strHashKey *pstrEntry)
+{
+   if (pstrEntry->nValueLength > HASH_INLINE_VALUE)
+   {
+      return(pstrEntry->uValue.pchExternal);
+   }
+
+
+   return(pstrEntry->uValue.achInline);
+}
+
+
+
+
+/********************************************************************************
+ * Function: WriteJournal
+ * Params:   pstrJournal - journal of a table
+ *           pchData - bytes to append
+ *           nBytes - number of bytes in pchData
+ * Returns:  0 - all bytes written
+ *           <0 - cannot write the journal
+ * Call by:  AppendJournal()
+ *           CloseJournal()
+ *           CommitJournal()
+ *           CompactJournal()
+ *           OpenHashJournal()
+ *           SyncHashJournal()
+ * Call to:  None
+ * Overview: Writes until every byte is taken, retrying interrupted and short
+ *           writes.
+ * Notes:    None
+ ********************************************************************************/
+static int WriteJournal(const strJournal *pstrJournal, const char *pchData, size_t nBytes)
+{
+   ssize_t nWritten = 0;
+
+
+
+   while (nBytes > 0)
+   {
+      if ((nWritten = write(pstrJournal->nFile, pchData, nBytes)) < 0 && errno != EINTR)
+      {
+         fprintf(stderr, "Failed to write journal [%s]. errno=%d.\n", pstrJournal->szFile,
+                 errno);
+         return(-1);
+      }
+
+      if (nWritten > 0)
+      {
+         pchData += nWritten;
+         nBytes  -= (size_t) nWritten;
+      }
+   }
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: WriteTrace
+ * Params:   pstrTrace - trace of a table
+ *           pchData - bytes to append
+ *           nBytes - number of bytes in pchData
+ * Returns:  0 - all bytes written
+ *           <0 - cannot write the trace
+ * Call by:  AppendTrace()
+ *           CloseTrace()
+ *           OpenHashTrace()
+ * Call to:  None
+ * Overview: Writes until every byte is taken, retrying interrupted and short
+ *           writes.
+ * Notes:    None
+ ********************************************************************************/
+static int WriteTrace(const strTrace *pstrTrace, const char *pchData, size_t nBytes)
+{
+   ssize_t nWritten = 0;
+
+
+
+   while (nBytes > 0)
+   {
+      if ((nWritten = write(pstrTrace->nFile, pchData, nBytes)) < 0 && errno != EINTR)
+      {
+         fprintf(stderr, "Failed to write trace. errno=%d.\n", errno);
+         return(-1);
+      }
+
+      if (nWritten > 0)
+      {
+         pchData += nWritten;
+         nBytes  -= (size_t) nWritten;
+      }
+   }
+
+
+   return(0);
+}
+
+
+
+
+#ifdef HASH_DEBUG
+/********************************************************************************
+ * Function: Debug()
+ * Params:   pszFormat - Formatting of variable parameters.
+ *           ...
+ * Returns:  Returns the number of characters printed by vprintf()
+ * Call by:  most fuctions in this program
+ * Call to:  DebugOn()
+ * Overview: Debugging aid if needed, which prints messages to standard output.
+ * Notes:    va_start, va_end uses stdarg.h
+ *           DebugOn(0) the zero does not matter, it can be any value, but 0 for
+ *           simplicity.
+ *           Debug is enabled by calling the program with --debug.  Only built
+ *           when HASH_DEBUG is defined, see hash-lib.h.
+ ********************************************************************************/
+int Debug(const char *pszFormat, ...)
+{
+    int nReturnCode = 0;
+    va_list pstrList;
+
+
+
+    if (DebugOn(0) == TRUE)
+    {
+       printf("DEBUG ");
+
+       va_start(pstrList, pszFormat);
+       nReturnCode = vprintf(pszFormat, pstrList);
+       va_end(pstrList);
+    }
+
+
+    return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: DebugOn()
+ * Params:   bInit - value is either TRUE or FALSE on the first call.
+ *           On subsequent calls, bInit doesn't matter, but should be something
+             simple like 0.
+ * Returns:  TRUE
+ *           FALSE
+ * Call by:  main()
+ *           Debug()
+ * Call to:  None
+ * Overview: The first time DebugOn() is called, bDebug will always be -100.  The
+ *           value of bInit will determine whether bDebug will be TRUE or FALSE.
+ *           On subsequent calls to DebugOn(), bDebug will either have a value of
+ *           TRUE or FALSE, that is, it's only -100 on the first call only.
+ *
+ *           if bInit is FALSE on the first call, debugging is turned off.
+ *           if bInit is TRUE  on the first call, debugging is turned on.
+ *           Subsequent calls to DebugOn() checks whether debug messages should be
+ *            printed.
+ *           The argument on subsequent calls does not matter, but use 0 for
+ *           simplicity.
+ * Notes:    This keeps us from having to utilize a global variable.
+ ********************************************************************************/
+int DebugOn(int bInit)
+{
+   static int bDebug = -100;
+
+
+
+   if (bDebug == -100)
+   {
+      if (bInit == TRUE)
+      {
+         bDebug = TRUE;
+      }
+      else
+      {
+         bDebug = FALSE;
+      }
+   }
+
+
+   return(bDebug);
+}
+#endif
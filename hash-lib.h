@@ -0,0 +1,198 @@
+/*********************************************************************************
+ * Written by Lance N. Le
+ *
+ * Free to use.
+ * Free to distribute.
+ * No warranty, expressed or implied, comes with this program.
+ *********************************************************************************/
+#ifndef HASH_LIB_H
+#define HASH_LIB_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "hash-typed.h"
+
+
+
+
+/*********************************************************************************
+ * Structure definitions.
+ *********************************************************************************/
+typedef enum {FALSE, TRUE} boolean;
+typedef enum {ENGINE_CHAIN, ENGINE_OPEN} engine;
+typedef enum {HASHFN_SUM, HASHFN_FNV1A, HASHFN_WYHASH, HASHFN_SIPHASH} hashfn;
+typedef enum {JOURNAL_NEVER, JOURNAL_GROUP, JOURNAL_ALWAYS} journalsync;
+typedef enum {KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2} keykernel;
+typedef enum {NUMA_LOCAL, NUMA_INTERLEAVE, NUMA_BIND} numapolicy;
+typedef enum {PAGES_DEFAULT, PAGES_THP, PAGES_HUGETLB} pagepolicy;
+typedef enum {TRACE_ADD = 1, TRACE_SEARCH, TRACE_DELETE, TRACE_PUT} traceop;
+
+
+/*********************************************************************************
+ * At most HASH_MAX_THREADS threads use a concurrent table at the same time.
+ * Data written by one thread is kept HASH_CACHE_LINE bytes away from data
+ * written by another.
+ *********************************************************************************/
+#define HASH_MAX_THREADS    64
+#define HASH_CACHE_LINE     64
+
+
+/*********************************************************************************
+ * Tables are only used through these handles.  Their layout is private to
+ * hash-lib.c, so it can change without recompiling the programs using them.
+ *********************************************************************************/
+typedef struct _strHash           strHash;
+typedef struct _strConcurrentHash strConcurrentHash;
+typedef struct _strEpochThread    strEpochThread;
+typedef struct _strHashTrace      strHashTrace;
+typedef struct _strSharedHash     strSharedHash;
+
+
+/*********************************************************************************
+ * What GetHashInfo(), GetConcurrentInfo() and GetSharedInfo() report about a
+ * table.
+ *********************************************************************************/
+typedef struct
+{
+   engine         nEngine;                    /* Chaining or open addressing     */
+   hashfn         nHash;                      /* Hash function of the keys       */
+   unsigned long  aulSeed[2];                 /* Key for siphash                 */
+   long           lnEntries;                  /* Keys stored in the table        */
+   long           lnSize;                     /* Buckets or slots in use now     */
+   long           lnMinSize;                  /* Never shrinks below this size   */
+   long           lnResizes;                  /* Resizes started                 */
+   boolean        bResizing;                  /* Old array still being moved     */
+   boolean        bSnapshot;                  /* Served from a mapped snapshot   */
+   boolean        bFrozen;                    /* Snapshot has a perfect hash     */
+   long           lnInserts;                  /* Adds that stored a new key      */
+   long           lnUpdates;                  /* Puts that replaced a value      */
+   long           lnHits;                     /* Searches that found the key     */
+   long           lnMisses;                   /* Searches that did not           */
+   long           lnDeletes;                  /* Deletes that removed the key    */
+   long           lnWalked;                   /* Nodes or groups searched        */
+   boolean        bFilter;                    /* Filter kept in front            */
+   long           lnFiltered;                 /* Misses answered by the filter   */
+   long           lnFalse;                    /* Misses the filter let through   */
+   boolean        bCache;                     /* Cache mode is on                */
+   long           lnEvicted;                  /* Keys evicted to make room       */
+   long           lnExpired;                  /* Keys dropped past their TTL     */
+   boolean        bJournal;                   /* Changes are journaled           */
+   long           lnJournal;                  /* Records in the journal          */
+   long           lnSyncs;                    /* Times the journal was synced    */
+   long           lnUnsynced;                 /* Records not synced yet          */
+   boolean        bTrace;                     /* Operations are traced           */
+   long           lnTraced;                   /* Records in the trace            */
+   long           lnCapacity;                 /* Keys a shared table can hold    */
+   long           lnRecovered;                /* Locks taken from dead writers   */
+   pagepolicy     nPages;                     /* Pages asked for new storage     */
+   numapolicy     nNuma;                      /* Nodes asked for new storage     */
+   int            nNode;                      /* Node of NUMA_BIND               */
+   long           lnHugePage;                 /* Bytes of a huge page            */
+   long           lnBaseBytes;                /* Storage on base pages           */
+   long           lnThpBytes;                 /* Storage advised for THP         */
+   long           lnThpBacked;                /* Advised bytes on huge pages now */
+   long           lnHugetlbBytes;             /* Storage on hugetlbfs pages      */
+   long           lnPlacedBytes;              /* Storage under the NUMA policy   */
+} strHashInfo;
+
+
+/*********************************************************************************
+ * One operation read back from a trace by NextTraceRecord().  pszData and
+ * pchValue point into the mapped trace, and the key is terminated, so it can
+ * be given to the table as it is.  ulTime is in nanoseconds from the start of
+ * the trace.
+ *********************************************************************************/
+typedef struct
+{
+   traceop        nOp;                        /* Add, search, delete or put      */
+   unsigned long  ulTime;                     /* Nanoseconds since the start     */
+   const char    *pszData;                    /* Key, terminated                 */
+   size_t         nLength;                    /* Key length                      */
+   const char    *pchValue;                   /* Value of a put                  */
+   size_t         nValueLength;               /* Value length, 0 unless a put    */
+} strTraceRecord;
+
+
+/*********************************************************************************
+ * Typed tables of hash-typed.h compiled into the library: U64 maps 64 bit IDs
+ * and Uuid maps 16 byte UUIDs, both to an unsigned long.
+ *********************************************************************************/
+typedef struct
+{
+   unsigned long  aulWord[2];                 /* The 16 bytes as two words       */
+} strUuid;
+
+HASH_TYPED_DECLARE(U64, unsigned long, unsigned long)
+HASH_TYPED_DECLARE(Uuid, strUuid, unsigned long)
+
+
+/*********************************************************************************
+ * Debug() traces are only compiled in when HASH_DEBUG is defined.  Otherwise the
+ * calls, and the evaluation of their arguments, disappear from the build.
+ *********************************************************************************/
+#ifdef HASH_DEBUG
+int Debug(const char *, ...);
+int DebugOn(int);
+#else
+#define Debug(...)          ((void) 0)
+#define DebugOn(bInit)      ((void) (bInit))
+#endif
+
+
+/*********************************************************************************
+ * Function prototypes.
+ *********************************************************************************/
+int AddEntriesToHashTable(strHash *, const char **, int, int *);
+int AddEntryToHashTable(strHash *, const char *);
+int AddEntryToConcurrentTable(strConcurrentHash *, strEpochThread *, const char *);
+int AddEntryToSharedTable(strSharedHash *, const char *);
+int AddExpiringEntry(strHash *, const char *, long);
+long BuildHashTable(strHash *, const char **, long, int);
+void CloseSharedTable(strSharedHash *);
+strConcurrentHash *CreateConcurrentTable(hashfn, const unsigned long *, int);
+strHash *CreateHashTable(engine, hashfn, unsigned long, int);
+int DeleteEntryFromHashTable(strHash *, const char *);
+int DeleteEntryFromConcurrentTable(strConcurrentHash *, strEpochThread *, const char *);
+int DeleteEntryFromSharedTable(strSharedHash *, const char *);
+void FreeConcurrentTable(strConcurrentHash *);
+void FreeHashTable(strHash *);
+long FreezeHashTable(strHash *);
+void GetConcurrentInfo(const strConcurrentHash *, strHashInfo *);
+void GetHashInfo(const strHash *, strHashInfo *);
+void GetSharedInfo(const strSharedHash *, strHashInfo *);
+int GetValueFromHashTable(strHash *, const char *, int *, const char **, size_t *);
+unsigned long HashBytes(hashfn, const unsigned long *, const char *, size_t);
+void HashKeys(hashfn, const unsigned long *, const char **, int, unsigned long *, size_t *);
+const char *HashName(hashfn);
+const char *KeyKernelName(keykernel);
+int ListHashTable(const strHash *, FILE *);
+int LoadSnapshot(strHash *, const char *, boolean);
+strHashTrace *MapHashTrace(const char *);
+boolean MatchBytes(const char *, const char *, size_t);
+int MemoryHashTable(const strHash *, FILE *);
+int NextTraceRecord(strHashTrace *, strTraceRecord *);
+const char *NumaPolicyName(numapolicy);
+long OpenHashJournal(strHash *, const char *, journalsync, long, long);
+int OpenHashTrace(strHash *, const char *);
+strSharedHash *OpenSharedTable(const char *, hashfn, const unsigned long *, long, int, boolean *);
+const char *PagePolicyName(pagepolicy);
+int PutEntryInHashTable(strHash *, const char *, const char *, size_t);
+strEpochThread *RegisterEpochThread(strConcurrentHash *);
+int RemoveSharedTable(const char *);
+long SaveSnapshot(strHash *, const char *);
+int SearchConcurrentTable(strConcurrentHash *, strEpochThread *, const char *);
+int SearchEntriesInHashTable(strHash *, const char **, int, int *);
+int SearchHashTable(strHash *, const char *, int *);
+int SearchSharedTable(strSharedHash *, const char *);
+int SetHashCache(strHash *, long, size_t, long);
+int SetHashFilter(strHash *, boolean);
+int SetHashPages(strHash *, pagepolicy, numapolicy, int);
+keykernel SetKeyKernel(keykernel);
+int StatsHashTable(const strHash *, FILE *, boolean);
+int SyncHashJournal(strHash *);
+void UnmapHashTrace(strHashTrace *);
+void UnregisterEpochThread(strEpochThread *);
+
+
+#endif
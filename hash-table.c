@@ -6,20 +6,134 @@
  * No warranty, expressed or implied, comes with this program.
  *********************************************************************************/
 #include <errno.h>
-#include <stdarg.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
 #include <sys/types.h>
-#include <linux/limits.h>
+#include <sys/un.h>
 
+#include "hash-lib.h"
 
 
 
+
+/*********************************************************************************
+ * --batch and --load read their input HASH_BATCH_BUFFER bytes at a time.  --load
+ * adds the keys HASH_LOAD_KEYS at a time with AddEntriesToHashTable().
+ *********************************************************************************/
+#define HASH_BATCH_BUFFER   (1024 * 1024)
+#define HASH_LOAD_KEYS      64
+
+
+/*********************************************************************************
+ * --bench defaults.  The key set is fixed by the seed, so two builds run the
+ * same operations in the same order.
+ *********************************************************************************/
+#define HASH_BENCH_KEYS     1000000
+#define HASH_BENCH_KEY_MIN  8
+#define HASH_BENCH_KEY_MAX  32
+#define HASH_BENCH_HIT      0.9
+#define HASH_BENCH_ZIPF     0.99
+#define HASH_BENCH_SEED     1
+#define HASH_BENCH_WRITES   0.1
+#define HASH_BENCH_BATCH    16
+
+
+/*********************************************************************************
+ * --journal defaults.  With --fsync group, the journal is synced once
+ * HASH_GROUP_OPS changes are waiting, or HASH_GROUP_MS milliseconds after the
+ * last sync.
+ *********************************************************************************/
+#define HASH_GROUP_MS       10
+#define HASH_GROUP_OPS      1000
+
+
+/*********************************************************************************
+ * --replay --pace original sleeps until HASH_REPLAY_SPIN nanoseconds before an
+ * operation is due, then spins, since a sleep can overshoot by that much.
+ *********************************************************************************/
+#define HASH_REPLAY_SPIN    100000
+
+
+/*********************************************************************************
+ * --shared defaults: the keys a new shared table holds, and their longest
+ * length.  The segment is sized for both when it is created.
+ *********************************************************************************/
+#define HASH_SHARED_KEYS    1000000
+#define HASH_SHARED_KEYLEN  64
+
+
+/*********************************************************************************
+ * Server mode.  A connection reads up to HASH_SERVER_BUFFER bytes at a time; its
+ * input buffer doubles for a longer request, up to HASH_SERVER_LINE bytes.  The
+ * server stops reading from a connection while more than HASH_SERVER_OUTPUT
+ * bytes of its replies are waiting to be sent.  epoll_wait() returns at most
+ * HASH_SERVER_EVENTS events at a time.
+ *********************************************************************************/
+#define HASH_SERVER_BUFFER  65536
+#define HASH_SERVER_LINE    (1024 * 1024)
+#define HASH_SERVER_OUTPUT  (4 * 1024 * 1024)
+#define HASH_SERVER_EVENTS  64
+
+
+/*********************************************************************************
+ * Keys of the --bench table: strings in a strHash, or the typed tables of
+ * hash-typed.h, keyed by 64 bit IDs or 16 byte UUIDs.
+ *********************************************************************************/
+typedef enum {KEYTYPE_STRING, KEYTYPE_U64, KEYTYPE_UUID} keytype;
+
+
+/*********************************************************************************
+ * Workload of --bench.
+ *********************************************************************************/
+typedef struct
+{
+   long           lnKeys;                     /* Keys inserted, then deleted     */
+   long           lnOps;                      /* Searches to run                 */
+   int            nKeyMin;                    /* Shortest key                    */
+   int            nKeyMax;                    /* Longest key                     */
+   double         dHitRatio;                  /* Searches for a stored key       */
+   double         dZipf;                      /* Skew of searches, 0 for uniform */
+   unsigned long  ulSeed;                     /* Seed of the key generator       */
+   int            nThreads;                   /* 0 single threaded, else threads */
+   double         dWrites;                    /* Threaded ops that change a key  */
+   int            nBatch;                     /* Keys per batched call, 0 single */
+   keytype        nKeyType;                   /* String, U64 or Uuid keys        */
+   boolean        bKernels;                   /* Time the hash and key compares  */
+} strBenchOptions;
+
+
 /*********************************************************************************
- * Structure definitions.
+ * Result of one --bench phase, printed by ReportBenchPhase().
  *********************************************************************************/
-typedef enum {FALSE, TRUE} boolean;
+typedef struct
+{
+   const char    *pszPhase;                   /* insert, search, mixed or delete */
+   const char    *pszEngine;                  /* Engine name                     */
+   hashfn         nHash;                      /* Hash function                   */
+   int            nThreads;                   /* Threads running the phase       */
+   int            nBatch;                     /* Keys per call, 0 single         */
+   long           lnOps;                      /* Operations timed                */
+   long           lnSucceeded;                /* Operations that found their key */
+   long           lnEntries;                  /* Keys in the table afterwards    */
+   long           lnSize;                     /* Buckets or slots afterwards     */
+   double         dSeconds;                   /* Wall clock time of the phase    */
+   unsigned int  *anLatency;                  /* Nanoseconds of each operation   */
+   long           lnStartRss;                 /* Peak RSS in KB before timing    */
+} strBenchPhase;
 
 
 /*********************************************************************************
@@ -27,37 +141,160 @@ typedef enum {FALSE, TRUE} boolean;
  *********************************************************************************/
 typedef struct
 {
-   boolean bDebug;
-   int     nBucketSize;
+   boolean        bDebug;
+   int            nBucketSize;
+   engine         nEngine;
+   hashfn         nHash;
+   unsigned long  ulSeed;                     /* 0 picks a random seed           */
+   char          *pszHashReport;              /* Key file to report on, or NULL  */
+   char          *pszLoad;                    /* Key file to add, or NULL        */
+   char          *pszBuild;                   /* Key file to build from, or NULL */
+   int            nBuildThreads;              /* Threads of --build              */
+   char          *pszBatch;                   /* Command file to run, or NULL    */
+   char          *pszSnapshot;                /* Snapshot to map, or NULL        */
+   char          *pszSave;                    /* Snapshot to write, or NULL      */
+   boolean        bVerify;                    /* Check the snapshot checksum     */
+   boolean        bFreeze;                    /* Freeze the table before serving */
+   char          *pszJournal;                 /* Journal to replay and keep      */
+   journalsync    nSync;                      /* When the journal is synced      */
+   long           lnGroupMs;                  /* Longest wait of a group commit  */
+   long           lnGroupOps;                 /* Most changes of a group commit  */
+   char          *pszTrace;                   /* Trace to record, or NULL        */
+   char          *pszReplay;                  /* Trace to replay, or NULL        */
+   boolean        bPaced;                     /* Replay at the pace of the trace */
+   boolean        bFilter;                    /* Keep a filter of absent keys    */
+   long           lnCacheEntries;             /* Cache mode key limit, or 0      */
+   size_t         nCacheBytes;                /* Cache mode byte limit, or 0     */
+   long           lnTtl;                      /* Seconds added keys live, or 0   */
+   boolean        bStats;                     /* Report statistics at the end    */
+   boolean        bStatsJson;                 /* Statistics as JSON, not text    */
+   boolean        bBench;                     /* Run the benchmark and exit      */
+   strBenchOptions strBench;                  /* Workload of --bench             */
+   char          *pszListen;                  /* Unix socket to serve, or NULL   */
+   int            nPort;                      /* Loopback TCP port, or 0         */
+   char          *pszShared;                  /* Shared memory table, or NULL    */
+   long           lnSharedKeys;               /* Keys a new shared table holds   */
+   int            nSharedKeyLen;              /* Longest key of a new one        */
+   boolean        bSharedRemove;              /* Remove the segment at the end   */
+   pagepolicy     nPages;                     /* Pages of the table storage      */
+   numapolicy     nNuma;                      /* NUMA placement of the storage   */
+   int            nNode;                      /* Node of --numa n                */
 } strCommandLine;
 
 
 /*********************************************************************************
- * Basic hash table structure to store data for chaining.
- * This application stores the indexes as a linked list, thus, the hash table is
- * an array of linked lists and uses the bucket, element 0, to store data.
- *
- * We could optimize the linked list by making it bidirectional and sorted, then
- * use a binary search to look up data.  Perhaps a future update.
+ * Results of a --batch or --load run, printed as a summary at the end.
+ *********************************************************************************/
+typedef struct
+{
+   long lnOps;                                /* Commands or keys processed      */
+   long lnAdded;                              /* Adds that stored a new key      */
+   long lnExisting;                           /* Adds of a key already there     */
+   long lnUpdated;                            /* Puts that replaced a value      */
+   long lnFound;                              /* Searches that found the key     */
+   long lnNotFound;                           /* Searches that did not           */
+   long lnDeleted;                            /* Deletes that removed the key    */
+   long lnNotDeleted;                         /* Deletes of a missing key        */
+   long lnUnknown;                            /* Lines that are not a command    */
+   long lnErrors;                             /* Operations that failed          */
+} strBatchCounts;
+
+
+/*********************************************************************************
+ * One socket of the server: a listening socket, or a client connection with
+ * the bytes it sent that do not make a whole request yet, and the replies not
+ * sent yet.  Client connections are linked, so they can all be closed at exit.
+ *********************************************************************************/
+typedef struct _strServerConn
+{
+   struct _strServerConn *pstrPrev;           /* Previous client connection      */
+   struct _strServerConn *pstrNext;           /* Next client connection          */
+   int                    nSocket;            /* Socket descriptor               */
+   boolean                bListener;          /* Accepts connections             */
+   boolean                bClosing;           /* Peer is done sending            */
+   unsigned int           nEvents;            /* epoll events asked for          */
+   char                  *pchInput;           /* Bytes received, not handled     */
+   size_t                 nInputSize;         /* Room in pchInput                */
+   size_t                 nInputUsed;         /* Bytes in pchInput               */
+   char                  *pchOutput;          /* Replies to send                 */
+   size_t                 nOutputSize;        /* Room in pchOutput               */
+   size_t                 nOutputUsed;        /* Bytes in pchOutput              */
+   size_t                 nOutputSent;        /* Bytes of pchOutput already sent */
+} strServerConn;
+
+
+/*********************************************************************************
+ * State of --listen and --port: the table served, the epoll instance and the
+ * open client connections.
+ *********************************************************************************/
+typedef struct
+{
+   strHash       *pstrHash;                   /* Table the requests run against  */
+   int            nEpoll;                     /* epoll instance                  */
+   strServerConn *pstrConns;                  /* First open client connection    */
+   long           lnConnections;              /* Connections accepted            */
+   long           lnRequests;                 /* Requests answered               */
+} strServer;
+
+
+/*********************************************************************************
+ * Share of one thread in one phase of --bench --threads.  In the mixed phase,
+ * an order entry of -(k+1) deletes key k and adds it back.
  *********************************************************************************/
-typedef struct _strHashTable
+typedef struct
 {
-   char                  szData[BUFSIZ+1];    /* Data entered by user            */
-   struct _strHashTable *pstrNext;            /* Link to next linked list entry  */
-} strHashTable;
+   strConcurrentHash *pstrConc;               /* Table shared by the threads     */
+   pthread_barrier_t *pstrBarrier;            /* Start line of the phase         */
+   const char        *pszKeys;                /* Keys from MakeBenchKeys()       */
+   const size_t      *anOffsets;              /* Offset of each key              */
+   const long        *alnOrder;               /* Key of each op, NULL for 0..n   */
+   unsigned int      *anLatency;              /* Nanoseconds of each operation   */
+   long               lnFirst;                /* First op of the thread          */
+   long               lnLast;                 /* One past its last op            */
+   int                nPhase;                 /* 0 insert, 1 mixed, 2 delete     */
+   long               lnSucceeded;            /* Ops that stored or found a key  */
+} __attribute__((aligned(HASH_CACHE_LINE))) strBenchThread;
 
 
 /*********************************************************************************
  * Function prototypes.
  *********************************************************************************/
-int AddEntryToHashTable(strHashTable *, int, const char *);
-int Debug(const char *, ...);
-int DebugOn(int);
-int DeleteEntryFromHashTable(strHashTable *, int, const char *);
-int HashFunction(int, const char *);
-int ListHashTable(const strHashTable *, int);
+int BenchBatchKeys(const strBenchOptions *, long, const char *, const size_t *, const long *,
+                   long, const char **);
+void BenchBatchLatency(unsigned int *, int, unsigned long);
+void *BenchConcurrentThread(void *);
+unsigned long BenchRandom(unsigned long *);
+unsigned long BenchTime(void);
+int CompareLatency(const void *, const void *);
+int FlushLoadKeys(strHash *, strSharedHash *, const char **, int, strBatchCounts *);
+int FreezeTable(strHash *);
+int MakeBenchKeys(const strBenchOptions *, char **, size_t **);
+int MakeBenchSearches(const strBenchOptions *, long *, unsigned long *);
+int OpenJournal(strHash *, const strCommandLine *);
+int ProcessBatchLine(strHash *, strSharedHash *, char *, boolean, strBatchCounts *);
 strCommandLine *ProcessCommandLine(strCommandLine *, int, char **);
-int SearchHashTable(const strHashTable *, int, const char *);
+int ReportBenchPhase(const strBenchOptions *, strBenchPhase *);
+int ReportHashDistribution(const char *, int, const unsigned long *);
+int RunBatch(strHash *, strSharedHash *, const char *, boolean);
+int RunBenchmark(strHash *, const strBenchOptions *);
+int RunBuild(strHash *, const char *, int);
+int RunConcurrentBenchmark(const strHash *, const strBenchOptions *);
+int RunConcurrentPhase(strConcurrentHash *, strBenchThread *, int, int, const long *,
+                       strBenchPhase *);
+int RunKernelBenchmark(const strBenchOptions *, hashfn, const unsigned long *);
+int RunReplay(strHash *, const char *, boolean);
+int RunServer(strHash *, const char *, int, long);
+int RunShared(const strHash *, const strCommandLine *);
+int RunTypedBenchmark(const strBenchOptions *, unsigned long);
+int SaveHashTable(strHash *, const char *);
+int ServerAccept(strServer *, const strServerConn *);
+void ServerClose(strServer *, strServerConn *);
+int ServerCommand(strServer *, strServerConn *, char *);
+int ServerFlush(strServer *, strServerConn *);
+int ServerListen(const char *, int);
+int ServerRead(strServer *, strServerConn *);
+int ServerReply(strServerConn *, const char *, size_t);
+void ShuffleBenchKeys(long *, long, unsigned long *);
 
 
 
@@ -69,21 +306,81 @@ int SearchHashTable(const strHashTable *, int, const char *);
  * Returns:  0 - no errors
  *           Less than 0 means a problem, such as unable to allocate memory
  * Call by:  Shell
- * Call to:  Debug()
+ * Call to:  AddEntryToHashTable()
+ *           CreateHashTable()
+ *           Debug()
  *           DebugOn()
+ *           DeleteEntryFromHashTable()
+ *           FreeHashTable()
+ *           FreezeTable()
+ *           GetHashInfo()
+ *           GetValueFromHashTable()
+ *           ListHashTable()
+ *           LoadSnapshot()
+ *           MemoryHashTable()
+ *           OpenHashTrace()
+ *           OpenJournal()
  *           ProcessCommandLine()
+ *           PutEntryInHashTable()
+ *           ReportHashDistribution()
+ *           RunBatch()
+ *           RunBenchmark()
+ *           RunBuild()
+ *           RunConcurrentBenchmark()
+ *           RunKernelBenchmark()
+ *           RunReplay()
+ *           RunServer()
+ *           RunShared()
+ *           RunTypedBenchmark()
+ *           SaveHashTable()
+ *           SetHashCache()
+ *           SetHashFilter()
+ *           SetHashPages()
+ *           StatsHashTable()
  * Overview: Loops through a menu, and add, list, search, or delete from hash
  *           table.
+ *           With --hashreport, only reports how each hash function spreads the
+ *           keys of a file over the buckets.
+ *           With --shared, only runs --load and --batch on a table in shared
+ *           memory, which other processes can use at the same time.
+ *           With --bench, only times inserts, searches and deletes, on the
+ *           concurrent table when --threads is given, or only times the key
+ *           hash and compare kernels when --kernels is given.
+ *           With --pages or --numa, backs the table with huge pages, or spreads
+ *           it over NUMA nodes.
+ *           With --filter, keeps a filter of absent keys in front of the table.
+ *           With --cache-entries, --cache-bytes or --ttl, runs the table as a
+ *           cache that evicts and expires keys.
+ *           With --snapshot, starts from the keys of a snapshot file.
+ *           With --journal, replays the journal, then journals every change.
+ *           With --trace, records every operation on the table to a file.
+ *           With --build, builds the table from a key file with many threads.
+ *           With --build, --load or --batch, runs the file without the menu
+ *           and exits.
+ *           With --replay, runs the operations of a trace after them, and
+ *           reports their latency.
+ *           With --freeze, makes the table read only with a perfect hash after
+ *           them, before the menu or the server.
+ *           With --listen or --port, serves the table on a socket after them,
+ *           until interrupted, then exits.
+ *           With --save, writes a snapshot before exiting.
+ *           With --stats, reports the table statistics before exiting.
  * Notes:    None
  *********************************************************************************/
 int main(int argc, char *argv[])
 {
    strCommandLine  strRunOptions;
-   strHashTable   *pastrHash        = NULL;
-   char            szData[BUFSIZ+1] = "";
-   int             nBucketSize      = 0;
-   int             nExitCode        = 0;
-   int             nMenuChoice      = 0;
+   strHashInfo     strInfo;
+   strHash        *pstrTable         = NULL;
+   char            szData[BUFSIZ+1]  = "";
+   char            szValue[BUFSIZ+1] = "";
+   const char     *pchValue          = NULL;
+   size_t          nValueLength      = 0;
+   int             nBucketSize       = 0;
+   int             nChain            = 0;
+   int             nExitCode         = 0;
+   int             nMenuChoice       = 0;
+   int             nReturnCode       = 0;
 
 
 
@@ -91,8 +388,48 @@ int main(int argc, char *argv[])
    {
       printf("Not enough parameters\n\n");
       printf("Example: %s --hashsize 26 --debug\n", argv[0]);
-      printf("Example: %s --hashsize 5\n\n", argv[0]);
-      printf("--debug is the only optional argument.\n");
+      printf("Example: %s --hashsize 5\n", argv[0]);
+      printf("Example: %s --hashsize 1024 --engine open --hash siphash\n", argv[0]);
+      printf("Example: %s --hashsize 4096 --hashreport keys.txt\n", argv[0]);
+      printf("Example: %s --hashsize 1024 --load keys.txt --batch commands.txt\n", argv[0]);
+      printf("Example: %s --hashsize 1024 --load keys.txt --save keys.snap\n", argv[0]);
+      printf("Example: %s --hashsize 1024 --build keys.txt --build-threads 8\n", argv[0]);
+      printf("Example: %s --hashsize 1024 --load keys.txt --stats json\n", argv[0]);
+      printf("Example: %s --hashsize 4194304 --pages thp --numa interleave --load keys.txt\n",
+             argv[0]);
+      printf("Example: %s --hashsize 1024 --filter --load keys.txt --batch commands.txt\n",
+             argv[0]);
+      printf("Example: %s --hashsize 1024 --cache-entries 10000 --ttl 60 --batch commands.txt\n",
+             argv[0]);
+      printf("Example: %s --hashsize 1024 --snapshot keys.snap\n", argv[0]);
+      printf("Example: %s --hashsize 1024 --load keys.txt --freeze --save keys.frozen\n",
+             argv[0]);
+      printf("Example: %s --hashsize 1024 --listen /tmp/hash.sock --port 7070\n", argv[0]);
+      printf("Example: %s --hashsize 1024 --journal keys.jrnl --fsync group --group-ms 5\n",
+             argv[0]);
+      printf("Example: %s --hashsize 1024 --listen /tmp/hash.sock --trace prod.trace\n",
+             argv[0]);
+      printf("Example: %s --hashsize 65536 --replay prod.trace --pace original --stats json\n",
+             argv[0]);
+      printf("Example: %s --hashsize 1024 --bench --keys 1000000 --keylen 8-32 --zipf 0.99\n",
+             argv[0]);
+      printf("Example: %s --hashsize 1024 --bench --threads 8 --writes 0.1\n", argv[0]);
+      printf("Example: %s --hashsize 1024 --bench --keys 1000000 --keytype u64\n", argv[0]);
+      printf("Example: %s --hashsize 1024 --bench --kernels --keylen 64-128\n", argv[0]);
+      printf("Example: %s --hashsize 1024 --shared /hash --shared-keys 1000000 --load keys.txt\n",
+             argv[0]);
+      printf("Example: %s --hashsize 1024 --shared /hash --batch commands.txt\n\n", argv[0]);
+      printf("--debug, --engine chain|open, --hash sum|fnv1a|wyhash|siphash, --seed,\n");
+      printf("--pages default|thp|hugetlb, --numa local|interleave|n,\n");
+      printf("--filter, --cache-entries, --cache-bytes, --ttl, --hashreport,\n");
+      printf("--load file|-, --batch file|-, --build file|-, --build-threads n,\n");
+      printf("--listen socket, --port n, --snapshot file,\n");
+      printf("--save file, --verify, --freeze, --journal file, --fsync always|group|never,\n");
+      printf("--group-ms, --group-ops, --trace file, --replay file, --pace original|fast,\n");
+      printf("--stats text|json and --bench with --keys, --ops,\n");
+      printf("--keylen, --hit, --zipf, --lookup-batch, --threads, --writes and\n");
+      printf("--keytype string|u64|uuid, --kernels, --shared name with --shared-keys,\n");
+      printf("--shared-keylen and --shared-remove are optional arguments.\n");
       exit(1);
    }
 
@@ -106,13 +443,22 @@ int main(int argc, char *argv[])
     * messages for the rest of the program.
     *
     * If bDebug is FALSE then no logging messages are displayed when calling
-    * Debug(). 
+    * Debug().
     * If bDebug is TRUE then logging messages are displayed when calling Debug().
     ******************************************************************************/
    DebugOn(strRunOptions.bDebug);
 
-   Debug("Hash size: %d; Debug: %s.\n\n",
+#ifndef HASH_DEBUG
+   if (strRunOptions.bDebug == TRUE)
+   {
+      fprintf(stderr, "--debug has no effect, build with -DHASH_DEBUG (make debug).\n");
+   }
+#endif
+
+   Debug("Hash size: %d; Engine: %s; Hash: %s; Debug: %s.\n\n",
          strRunOptions.nBucketSize,
+         strRunOptions.nEngine==ENGINE_OPEN?"open":"chain",
+         HashName(strRunOptions.nHash),
          strRunOptions.bDebug==TRUE?"On":"Off");
 
 
@@ -122,12 +468,174 @@ int main(int argc, char *argv[])
    /******************I***********************************************************
     * Create the hash table based on the command line.
     * For example, if --hashsize 26, then create a hash table for 26 buckets.
+    * The table grows and shrinks from there, but never below 26 buckets.
+    *
+    * --hashreport only needs the siphash key of the table, not the table.
     ******************I***********************************************************/
-   pastrHash = (strHashTable *) calloc(nBucketSize, sizeof(strHashTable));
+   pstrTable = CreateHashTable(strRunOptions.nEngine, strRunOptions.nHash,
+                               strRunOptions.ulSeed, nBucketSize);
+
+   if (pstrTable == NULL)
+   {
+      exit(-1);
+   }
+
+   if ((strRunOptions.nPages != PAGES_DEFAULT || strRunOptions.nNuma != NUMA_LOCAL) &&
+       SetHashPages(pstrTable, strRunOptions.nPages, strRunOptions.nNuma,
+                    strRunOptions.nNode) != 0)
+   {
+      FreeHashTable(pstrTable);
+      exit(-1);
+   }
+
+   if (strRunOptions.bFilter == TRUE && SetHashFilter(pstrTable, TRUE) != 0)
+   {
+      FreeHashTable(pstrTable);
+      exit(-1);
+   }
+
+   if ((strRunOptions.lnCacheEntries != 0 || strRunOptions.nCacheBytes != 0 ||
+        strRunOptions.lnTtl != 0) &&
+       SetHashCache(pstrTable, strRunOptions.lnCacheEntries, strRunOptions.nCacheBytes,
+                    strRunOptions.lnTtl) != 0)
+   {
+      FreeHashTable(pstrTable);
+      exit(-1);
+   }
+
+   if (strRunOptions.pszHashReport != NULL)
+   {
+      GetHashInfo(pstrTable, &strInfo);
+      nExitCode = ReportHashDistribution(strRunOptions.pszHashReport, nBucketSize,
+                                         strInfo.aulSeed);
+      FreeHashTable(pstrTable);
+      exit(nExitCode);
+   }
+
+   if (strRunOptions.pszShared != NULL)
+   {
+      nExitCode = RunShared(pstrTable, &strRunOptions);
+      FreeHashTable(pstrTable);
+      exit(nExitCode);
+   }
+
+
+   if (strRunOptions.bBench == TRUE && strRunOptions.strBench.bKernels == TRUE)
+   {
+      GetHashInfo(pstrTable, &strInfo);
+      nExitCode = RunKernelBenchmark(&strRunOptions.strBench, strInfo.nHash, strInfo.aulSeed);
+      FreeHashTable(pstrTable);
+      exit(nExitCode);
+   }
+
+   if (strRunOptions.bBench == TRUE && strRunOptions.strBench.nThreads > 0)
+   {
+      nExitCode = RunConcurrentBenchmark(pstrTable, &strRunOptions.strBench);
+      FreeHashTable(pstrTable);
+      exit(nExitCode);
+   }
+
+   if (strRunOptions.bBench == TRUE && strRunOptions.strBench.nKeyType != KEYTYPE_STRING)
+   {
+      nExitCode = RunTypedBenchmark(&strRunOptions.strBench, strRunOptions.ulSeed);
+      FreeHashTable(pstrTable);
+      exit(nExitCode);
+   }
+
+   if (strRunOptions.bBench == TRUE)
+   {
+      nExitCode = RunBenchmark(pstrTable, &strRunOptions.strBench);
+      FreeHashTable(pstrTable);
+      exit(nExitCode);
+   }
+
+
+   /******************************************************************************
+    * The snapshot is mapped, not read, so searches can start right away.
+    ******************************************************************************/
+   if (strRunOptions.pszSnapshot != NULL &&
+       LoadSnapshot(pstrTable, strRunOptions.pszSnapshot, strRunOptions.bVerify) != 0)
+   {
+      FreeHashTable(pstrTable);
+      exit(-1);
+   }
+
+
+   /******************************************************************************
+    * The journal replays on top of the snapshot, and then records every change
+    * made by --load, --batch, the server or the menu.  The trace starts after
+    * it, so it only holds the operations of this run.
+    ******************************************************************************/
+   if (strRunOptions.pszJournal != NULL && OpenJournal(pstrTable, &strRunOptions) != 0)
+   {
+      FreeHashTable(pstrTable);
+      exit(-1);
+   }
+
+   if (strRunOptions.pszTrace != NULL && OpenHashTrace(pstrTable, strRunOptions.pszTrace) != 0)
+   {
+      FreeHashTable(pstrTable);
+      exit(-1);
+   }
+
+
+   /******************************************************************************
+    * Build the table from the keys, bulk load more keys, then run the commands and replay the trace, then serve
+    * the table, and skip the menu.  "-" reads standard input.
+    ******************************************************************************/
+   if (strRunOptions.pszBuild != NULL || strRunOptions.pszLoad != NULL ||
+       strRunOptions.pszBatch != NULL || strRunOptions.pszReplay != NULL ||
+       strRunOptions.pszListen != NULL || strRunOptions.nPort != 0)
+   {
+      if (strRunOptions.pszBuild != NULL)
+      {
+         nExitCode = RunBuild(pstrTable, strRunOptions.pszBuild, strRunOptions.nBuildThreads);
+      }
+
+      if (strRunOptions.pszLoad != NULL && nExitCode == 0)
+      {
+         nExitCode = RunBatch(pstrTable, NULL, strRunOptions.pszLoad, TRUE);
+      }
+
+      if (strRunOptions.pszBatch != NULL && nExitCode == 0)
+      {
+         nExitCode = RunBatch(pstrTable, NULL, strRunOptions.pszBatch, FALSE);
+      }
+
+      if (strRunOptions.pszReplay != NULL && nExitCode == 0)
+      {
+         nExitCode = RunReplay(pstrTable, strRunOptions.pszReplay, strRunOptions.bPaced);
+      }
+
+      if (strRunOptions.bFreeze == TRUE && nExitCode == 0)
+      {
+         nExitCode = FreezeTable(pstrTable);
+      }
+
+      if ((strRunOptions.pszListen != NULL || strRunOptions.nPort != 0) && nExitCode == 0)
+      {
+         nExitCode = RunServer(pstrTable, strRunOptions.pszListen, strRunOptions.nPort,
+                               strRunOptions.nSync == JOURNAL_GROUP ? strRunOptions.lnGroupMs : 0);
+      }
+
+      if (strRunOptions.pszSave != NULL && nExitCode == 0)
+      {
+         nExitCode = SaveHashTable(pstrTable, strRunOptions.pszSave);
+      }
+
+      if (strRunOptions.bStats == TRUE)
+      {
+         StatsHashTable(pstrTable, stdout, strRunOptions.bStatsJson);
+      }
+
+      FreeHashTable(pstrTable);
+      exit(nExitCode);
+   }
 
-   if (pastrHash == NULL)
+
+   if (strRunOptions.bFreeze == TRUE && FreezeTable(pstrTable) != 0)
    {
-      fprintf(stderr, "Failed calloc() in main(). errno=%d.\n", errno);
+      FreeHashTable(pstrTable);
       exit(-1);
    }
 
@@ -139,6 +647,10 @@ int main(int argc, char *argv[])
       printf("   [3] Search data\n");
       printf("   [4] Delete data\n");
       printf("   [5] Quit\n");
+      printf("   [6] Memory usage\n");
+      printf("   [7] Save snapshot\n");
+      printf("   [8] Statistics\n");
+      printf("   [9] Enter data with a value\n");
       printf("   Choice:  ");
 
 
@@ -160,12 +672,12 @@ int main(int argc, char *argv[])
 
                Debug("New data to add: [%s]\n", szData);
 
-               AddEntryToHashTable(pastrHash, nBucketSize, szData);
+               AddEntryToHashTable(pstrTable, szData);
             }
             break;
 
-         case 2: 
-            ListHashTable(pastrHash, nBucketSize);
+         case 2:
+            ListHashTable(pstrTable, stdout);
             break;
 
          case 3:
@@ -177,7 +689,34 @@ int main(int argc, char *argv[])
 
                Debug("Data to search: [%s]\n", szData);
 
-               SearchHashTable(pastrHash, nBucketSize, szData);
+               nReturnCode = GetValueFromHashTable(pstrTable, szData, &nChain,
+                                                   &pchValue, &nValueLength);
+               GetHashInfo(pstrTable, &strInfo);
+
+               if (nReturnCode >= 0 && strInfo.bFrozen == TRUE)
+               {
+                  printf("Data [%s] found in frozen slot [%d]\n", szData, nReturnCode);
+               }
+               else if (nReturnCode >= 0 && strInfo.bSnapshot == TRUE)
+               {
+                  printf("Data [%s] found in snapshot bucket [%d] in chain [%d]\n",
+                         szData, nReturnCode, nChain);
+               }
+               else if (nReturnCode >= 0 && strInfo.nEngine == ENGINE_OPEN)
+               {
+                  printf("Data [%s] found in slot [%d] after [%d] group probes\n",
+                         szData, nReturnCode, nChain);
+               }
+               else if (nReturnCode >= 0)
+               {
+                  printf("Data [%s] found in bucket [%d] in chain [%d]\n",
+                         szData, nReturnCode, nChain);
+               }
+
+               if (nReturnCode >= 0 && nValueLength > 0)
+               {
+                  printf("Value [%.*s]\n", (int) nValueLength, pchValue);
+               }
             }
             break;
 
@@ -190,12 +729,59 @@ int main(int argc, char *argv[])
 
                Debug("Data to delete: [%s]\n", szData);
 
-               DeleteEntryFromHashTable(pastrHash, nBucketSize, szData);
+               nReturnCode = DeleteEntryFromHashTable(pstrTable, szData);
+               printf("Data [%s] %s\n", szData, nReturnCode == 0 ? "deleted" : "not found");
             }
             break;
 
          case 5:
-            free(pastrHash);
+            if (strRunOptions.pszSave != NULL)
+            {
+               nExitCode = SaveHashTable(pstrTable, strRunOptions.pszSave);
+            }
+
+            FreeHashTable(pstrTable);
+            break;
+
+         case 6:
+            MemoryHashTable(pstrTable, stdout);
+            break;
+
+         case 7:
+            printf("Snapshot file:  ");
+
+            if (fgets(szData, sizeof(szData), stdin) != NULL)
+            {
+               szData[strcspn(szData, "\r\n")] = 0;
+
+               SaveHashTable(pstrTable, szData);
+            }
+            break;
+
+         case 8:
+            StatsHashTable(pstrTable, stdout, strRunOptions.bStatsJson);
+            break;
+
+         case 9:
+            printf("Enter data:  ");
+
+            if (fgets(szData, sizeof(szData), stdin) != NULL)
+            {
+               szData[strcspn(szData, "\r\n")] = 0;
+
+               printf("Enter value:  ");
+
+               if (fgets(szValue, sizeof(szValue), stdin) != NULL)
+               {
+                  szValue[strcspn(szValue, "\r\n")] = 0;
+
+                  Debug("Data to put: [%s] = [%s]\n", szData, szValue);
+
+                  nReturnCode = PutEntryInHashTable(pstrTable, szData, szValue, strlen(szValue));
+                  printf("Data [%s] %s\n", szData, nReturnCode == 0 ? "added" :
+                                                   nReturnCode > 0 ? "updated" : "not stored");
+               }
+            }
             break;
 
          default:
@@ -212,446 +798,3872 @@ int main(int argc, char *argv[])
 
 
 /********************************************************************************
- * Function: AddEntrytoHashTable
- * Params:   pastrHash - array of buckets
- *           nSize - number of buckets in hash table
- *           pszData - data to add
- * Returns:  0 - data added successfully
- *           greater than 0 - data already exists
- *           less than 0 - error, normally cannot allocate memory
- * Call by:  main()
- * Call to:  HashFunction()
- * Overview: Inserts the data into the hash table by finding the appropriate
- *           bucket. If data already exist, do not add.
- * Notes:    Freeing memory for each linked list chain is done by
- *           DeleteEntryFromHashTable().
+ * Function: BenchBatchKeys
+ * Params:   pstrBench - workload of --bench
+ *           lnLeft - operations left in the phase
+ *           pszKeys - keys made by MakeBenchKeys()
+ *           anOffsets - offset of each key in pszKeys
+ *           alnOrder - key of each operation, NULL for the keys in order
+ *           lnIndex - first operation of the group
+ *           apszBatch - receives the keys of the group
+ * Returns:  Number of keys in the group
+ * Call by:  RunBenchmark()
+ * Call to:  None
+ * Overview: Picks the keys of the next nBatch operations, or of the next
+ *           operation without --lookup-batch.
  ********************************************************************************/
-int AddEntryToHashTable(strHashTable *pastrHash, int nSize, const char *pszData)
+int BenchBatchKeys(const strBenchOptions *pstrBench, long lnLeft, const char *pszKeys,
+                   const size_t *anOffsets, const long *alnOrder, long lnIndex,
+                   const char **apszBatch)
 {
-   boolean       bFirstChainHasData = FALSE;
-   int           nHashIndex         = 0;
-   int           nReturnCode        = 0;
-   strHashTable *pstrCurrent        = NULL;
-   strHashTable *pstrNewChain       = NULL;
-   strHashTable *pstrPrevious       = NULL;
+   int nKeys  = pstrBench->nBatch > 0 ? pstrBench->nBatch : 1;
+   int nIndex = 0;
 
 
 
-   Debug("Inside AddEntryToHashTable()\n");
+   if (lnLeft < nKeys)
+   {
+      nKeys = (int) lnLeft;
+   }
 
-   nHashIndex = HashFunction(nSize, pszData);
+   for (nIndex=0; nIndex<nKeys; nIndex++)
+   {
+      apszBatch[nIndex] = pszKeys + anOffsets[alnOrder == NULL ? lnIndex + nIndex :
+                                                              alnOrder[lnIndex + nIndex]];
+   }
 
-   Debug("Hash index for [%s] is bucket [%d]\n", pszData, nHashIndex);
 
+   return(nKeys);
+}
 
-   /****************************************************************************
-    * Loop through through the linked list in the bucket until an empty entry is
-    * found.  The empty entry will be used to store the new data.
-    *
-    * If data already exists, the return immediately.
-    ****************************************************************************/
-   for (pstrCurrent  = &pastrHash[nHashIndex];
-        pstrCurrent != NULL;
-        pstrCurrent  = pstrCurrent->pstrNext)
-   {
-      pstrPrevious = pstrCurrent;
 
-      if (pstrCurrent->szData[0] == '\0')
-      {
-          break;                              /* This chain is available for new */
-      }
-      else if (strcmp(pstrCurrent->szData, pszData) == 0)
-      {
-          return(1);                          /* Data already exists             */
-      }
-      else
-      {
-          bFirstChainHasData = TRUE;
-      }
-   }
 
 
-   /****************************************************************************
-    * At this point, pstrCurrent should point to the first link without data.
-    * Allocate memory to store create a new linked list chain and store data.
-    *
-    * Freeing linked list chain memory is done by DeleteEntryFromHashTable().
-    ****************************************************************************/
-   pstrNewChain = (strHashTable *) calloc(1, sizeof(strHashTable));
+/********************************************************************************
+ * Function: BenchBatchLatency
+ * Params:   anLatency - latency of each operation of the group
+ *           nKeys - number of operations in the group
+ *           ulTime - nanoseconds taken by the group
+ * Returns:  None
+ * Call by:  RunBenchmark()
+ * Call to:  None
+ * Overview: Shares the time of a batched call evenly among its operations.
+ ********************************************************************************/
+void BenchBatchLatency(unsigned int *anLatency, int nKeys, unsigned long ulTime)
+{
+   int nIndex = 0;
 
-   if (pstrNewChain == NULL)
-   {
-      fprintf(stderr, "Failed calloc() in AddEntryToHashTable(). errno=%d.\n", errno);
-      nReturnCode = -1;
-   }
-   else
-   {
-      pstrNewChain->pstrNext = NULL;
-      strncpy(pstrNewChain->szData, pszData, sizeof(pstrNewChain->szData)-1);
 
 
-      /************************************************************************
-       * If the first chain/element in the bucket is empty, we want to copy the
-       * new content.  Otherwise, we link to it.
-       ************************************************************************/
-      if (bFirstChainHasData == FALSE)
-      {
-         memcpy(pstrPrevious, pstrNewChain, sizeof(strHashTable));
-      }
-      else
-      {
-         pstrPrevious->pstrNext = pstrNewChain;
-      }
+   for (nIndex=0; nIndex<nKeys; nIndex++)
+   {
+      anLatency[nIndex] = (unsigned int) (ulTime / nKeys);
    }
-
-
-   return(nReturnCode);
 }
 
 
 
 
 /********************************************************************************
- * Function: DeleteEntryFromHashTable
- * Params:   pastrHash - array of buckets
- *           nSize - number of buckets in hash table
- *           pszData - data to search for in hash table to remove if found
- * Returns:  0  - data found and deleted
- *           >0 - data not found to delete
- *           <0 - error attempting to delete, such as not able to free memory
- * Call by:  main()
- * Call to:  HashFunction()
- * Overview: Searchs the hash table by finding the correct bucket index, and then
- *           traverse the linked list to find the data to delete.
- *           Shift the linked list pointer around the deleted element and free
- *           the memory of deleted record.
- *           If the data is found in the first chain of the bucket, empty the
- *           data, but do not free the memory of bucket head.
- * Notes:    Memory for each linked list chain is done in AddEntryToHashTable().
- *           The bucket head (first chain in linked list) is not freed.
+ * Function: BenchConcurrentThread
+ * Params:   pArgument - strBenchThread of the thread
+ * Returns:  NULL
+ * Call by:  RunConcurrentPhase(), through pthread_create()
+ * Call to:  AddEntryToConcurrentTable()
+ *           BenchTime()
+ *           DeleteEntryFromConcurrentTable()
+ *           RegisterEpochThread()
+ *           SearchConcurrentTable()
+ *           UnregisterEpochThread()
+ * Overview: Runs the thread's share of one phase of the threaded benchmark,
+ *           and times each operation.  In the mixed phase, a negative entry in
+ *           the order array is a write: the key is deleted and added back.
+ * Notes:    Waits on the barrier first, so all threads start together.
  ********************************************************************************/
-int DeleteEntryFromHashTable(strHashTable *pastrHash, int nSize, const char *pszData)
+void *BenchConcurrentThread(void *pArgument)
 {
-   boolean       bFirstChain  = TRUE;
-   int           nHashIndex   = 0;
-   int           nReturnCode  = 1;
-   strHashTable *pstrCurrent  = NULL;
-   strHashTable *pstrPrevious = NULL;
+   strBenchThread *pstrWork   = (strBenchThread *) pArgument;
+   strEpochThread *pstrThread = NULL;
+   const char     *pszKey     = NULL;
+   long            lnIndex    = 0;
+   long            lnKey      = 0;
+   long            lnDone     = 0;
+   unsigned long   ulLast     = 0;
+   unsigned long   ulNow      = 0;
 
 
-   Debug("Inside DeleteEntryFromHashTable()\n");
 
+   pstrThread = RegisterEpochThread(pstrWork->pstrConc);
 
-   nHashIndex = HashFunction(nSize, pszData);
+   pthread_barrier_wait(pstrWork->pstrBarrier);
 
-
-   for (pstrCurrent  = &pastrHash[nHashIndex];
-        pstrCurrent != NULL;
-        pstrPrevious = pstrCurrent, pstrCurrent = pstrCurrent->pstrNext)
+   if (pstrThread == NULL)
    {
-      Debug("Comparing [%s] with [%s]\n", pstrCurrent->szData, pszData);
+      return(NULL);
+   }
 
-      if (strcmp(pstrCurrent->szData, pszData) != 0)
-      {
-         bFirstChain = FALSE;
-      }
-      else
-      {
-         Debug("Found [%s] in bucket [%d]\n", pszData, nHashIndex);
 
+   ulLast = BenchTime();
 
-         /***********************************************************************
-          * If data is found in the bucket head, reset the data, but do not free
-          * any memory.  Each bucket head will always be around.
-          ***********************************************************************/
-         if (bFirstChain == TRUE)
-         {
-            memset(pstrCurrent->szData, 0, sizeof(pstrCurrent->szData));
-         }
+   for (lnIndex=pstrWork->lnFirst; lnIndex<pstrWork->lnLast; lnIndex++)
+   {
+      lnKey  = pstrWork->alnOrder != NULL ? pstrWork->alnOrder[lnIndex] : lnIndex;
+      pszKey = pstrWork->pszKeys + pstrWork->anOffsets[lnKey < 0 ? -lnKey - 1 : lnKey];
 
-         /***********************************************************************
-          * If data is found anywhere in the linked list except the bucket head
-          * (first element of linked list), then rearrange linked list and free
-          * the memory of data found.
-          ***********************************************************************/
-         else
-         {
-            if ((pstrPrevious->pstrNext != NULL) && (pstrCurrent->pstrNext != NULL))
+      switch (pstrWork->nPhase)
+      {
+         case 0:
+            lnDone += AddEntryToConcurrentTable(pstrWork->pstrConc, pstrThread, pszKey) == 0;
+            break;
+
+         case 1:
+            if (lnKey < 0)
             {
-               pstrPrevious->pstrNext = pstrCurrent->pstrNext;
-               free(pstrCurrent);
+               lnDone += DeleteEntryFromConcurrentTable(pstrWork->pstrConc, pstrThread,
+                                                        pszKey) == 0;
+               AddEntryToConcurrentTable(pstrWork->pstrConc, pstrThread, pszKey);
             }
             else
             {
-               pstrPrevious->pstrNext = NULL;
-               free(pstrCurrent);
+               lnDone += SearchConcurrentTable(pstrWork->pstrConc, pstrThread, pszKey) >= 0;
             }
-         }
-
+            break;
 
-         nReturnCode = 0;
-         break;
+         default:
+            lnDone += DeleteEntryFromConcurrentTable(pstrWork->pstrConc, pstrThread,
+                                                     pszKey) == 0;
+            break;
       }
+
+      ulNow                        = BenchTime();
+      pstrWork->anLatency[lnIndex] = (unsigned int) (ulNow - ulLast);
+      ulLast                       = ulNow;
    }
 
 
-   if (nReturnCode == 0)
-   {
-      printf("Data [%s] deleted\n", pszData);
-   }
-   else
-   {
-      printf("Data [%s] not found\n", pszData);
-   }
+   pstrWork->lnSucceeded = lnDone;            /* Written once, no false sharing */
 
+   UnregisterEpochThread(pstrThread);
 
 
-   return(nReturnCode);
+   return(NULL);
 }
 
 
 
 
 /********************************************************************************
- * Function: HashFunction
- * Params:   nSize - Maximum buckets
- *           pszData - string to create determine bucket index
- * Returns:  Bucket index starting at 0 as the first index
- * Call by:  main()
+ * Function: BenchRandom
+ * Params:   pulState - generator state, updated
+ * Returns:  Next 64 bit pseudo random number
+ * Call by:  MakeBenchKeys()
+ *           MakeBenchSearches()
+ *           RunConcurrentBenchmark()
+ *           RunTypedBenchmark()
+ *           ShuffleBenchKeys()
  * Call to:  None
- * Overview: Adds up each character in a string and modular the sum to create a
- *           bucket index.
- * Notes:    None
+ * Overview: splitmix64 step, the same mixing CreateHashTable() uses to stretch
+ *           the seed.
+ * Notes:    Not for anything secret, only to make repeatable workloads.
  ********************************************************************************/
-int HashFunction(int nSize, const char *pszData)
+unsigned long BenchRandom(unsigned long *pulState)
 {
-   int  nIndex  = 0;
-   int  nLength = 0; 
-   long lnSum   = 0;
-
+   unsigned long ulMix = 0;
 
 
-   Debug("Inside HashFunction()\n");
 
-
-   for (nLength=strlen(pszData); nIndex<nLength; nIndex++)
-   {
-      lnSum = lnSum + pszData[nIndex];
-   }
+   *pulState += 0x9e3779b97f4a7c15UL;
+   ulMix      = *pulState;
+   ulMix      = (ulMix ^ (ulMix >> 30)) * 0xbf58476d1ce4e5b9UL;
+   ulMix      = (ulMix ^ (ulMix >> 27)) * 0x94d049bb133111ebUL;
 
 
-   return((int)(lnSum%nSize));
+   return(ulMix ^ (ulMix >> 31));
 }
 
 
 
 
 /********************************************************************************
- * Function: ListHashTable
- * Params:   pastrHash
- *           nSize
- * Returns:  Number of non-empty items in hash table.
- * Call by:  main()
+ * Function: BenchTime
+ * Params:   None
+ * Returns:  Monotonic clock in nanoseconds
+ * Call by:  BenchConcurrentThread()
+ *           RunBenchmark()
+ *           RunConcurrentPhase()
+ *           RunKernelBenchmark()
+ *           RunReplay()
+ *           RunServer()
+ *           RunTypedBenchmark()
  * Call to:  None
- * Overview: Lists all entries in the hash table that is non-NULL data.
+ * Overview: One clock_gettime() call, read through the vDSO on Linux.
  * Notes:    None
  ********************************************************************************/
-int ListHashTable(const strHashTable *pastrHash, int nSize)
+unsigned long BenchTime(void)
 {
-   int           nIndex       = 0;
-   int           nReturnCode  = 0;
-   strHashTable *pstrCurrent  = NULL;
+   struct timespec strNow;
 
 
 
-   Debug("Inside ListHashTable()\n");
+   clock_gettime(CLOCK_MONOTONIC, &strNow);
 
 
-   for (nIndex=0; nIndex<nSize; nIndex++)
-   {
-      for (pstrCurrent = (strHashTable *) &pastrHash[nIndex];
-           pstrCurrent != NULL;
-           pstrCurrent = pstrCurrent->pstrNext)
-      {
-         printf("Bucket[%d] data:  [%s]\n", nIndex, pstrCurrent->szData);
-         ++nReturnCode;
-      }
-   }
+   return((unsigned long) strNow.tv_sec * 1000000000UL + strNow.tv_nsec);
+}
 
 
-   return(nReturnCode);
+
+
+/********************************************************************************
+ * Function: CompareLatency
+ * Params:   pLeft, pRight - two latencies
+ * Returns:  <0, 0 or >0 as for qsort()
+ * Call by:  ReportBenchPhase()
+ *           RunReplay()
+ * Call to:  None
+ * Overview: Sorts latencies in increasing order.
+ * Notes:    None
+ ********************************************************************************/
+int CompareLatency(const void *pLeft, const void *pRight)
+{
+   unsigned int nLeft  = *(const unsigned int *) pLeft;
+   unsigned int nRight = *(const unsigned int *) pRight;
+
+
+
+   return((nLeft > nRight) - (nLeft < nRight));
+}
+
+
+
+
+/********************************************************************************
+ * Function: FlushLoadKeys
+ * Params:   pstrHash - hash table
+ *           pstrShared - shared table to add to instead, or NULL
+ *           apszKeys - keys read by --load, still in the read buffer
+ *           nKeys - number of keys, at most HASH_LOAD_KEYS
+ *           pstrCounts - counters updated for the summary
+ * Returns:  Number of keys added
+ *           <0 - cannot import the mapped snapshot
+ * Call by:  RunBatch()
+ * Call to:  AddEntriesToHashTable()
+ *           AddEntryToSharedTable()
+ * Overview: Adds the keys collected by RunBatch() with one batched call, so
+ *           their buckets are fetched from memory together.
+ * Notes:    Must run before the read buffer is moved or reused.  A shared
+ *           table takes the keys one by one.
+ ********************************************************************************/
+int FlushLoadKeys(strHash *pstrHash, strSharedHash *pstrShared, const char **apszKeys,
+                  int nKeys, strBatchCounts *pstrCounts)
+{
+   int nIndex      = 0;
+   int nReturnCode = 0;
+   int anResults[HASH_LOAD_KEYS];
+
+
+
+   if (nKeys == 0)
+   {
+      return(0);
+   }
+
+   if (pstrShared != NULL)
+   {
+      for (nIndex=0; nIndex<nKeys; nIndex++)
+      {
+         anResults[nIndex] = AddEntryToSharedTable(pstrShared, apszKeys[nIndex]);
+         nReturnCode      += anResults[nIndex] == 0;
+      }
+   }
+   else if ((nReturnCode = AddEntriesToHashTable(pstrHash, apszKeys, nKeys, anResults)) < 0)
+   {
+      pstrCounts->lnOps    += nKeys;
+      pstrCounts->lnErrors += nKeys;
+      return(nReturnCode);
+   }
+
+
+   for (nIndex=0; nIndex<nKeys; nIndex++)
+   {
+      pstrCounts->lnOps++;
+      pstrCounts->lnAdded    += anResults[nIndex] == 0;
+      pstrCounts->lnExisting += anResults[nIndex] > 0;
+      pstrCounts->lnErrors   += anResults[nIndex] < 0;
+   }
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: FreezeTable
+ * Params:   pstrHash - hash table
+ * Returns:  0 - table frozen
+ *           <0 - cannot freeze the table
+ * Call by:  main()
+ * Call to:  FreezeHashTable()
+ *           GetHashInfo()
+ * Overview: Freezes the table and tells the user how big the frozen table is.
+ * Notes:    The library does not print, so the message is printed here.
+ ********************************************************************************/
+int FreezeTable(strHash *pstrHash)
+{
+   long        lnBytes = 0;
+   strHashInfo strInfo;
+
+
+
+   if ((lnBytes = FreezeHashTable(pstrHash)) < 0)
+   {
+      return(-1);
+   }
+
+   GetHashInfo(pstrHash, &strInfo);
+
+   printf("Froze %ld entries into %ld bytes\n", strInfo.lnEntries, lnBytes);
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: MakeBenchKeys
+ * Params:   pstrBench - workload of --bench
+ *           ppszKeys - receives the keys, one after the other
+ *           panOffsets - receives the offset of each key in *ppszKeys
+ * Returns:  0 - 2 * lnKeys keys made
+ *           <0 - cannot allocate memory
+ * Call by:  RunBenchmark()
+ *           RunConcurrentBenchmark()
+ *           RunKernelBenchmark()
+ * Call to:  BenchRandom()
+ * Overview: Makes the keys that are inserted, followed by as many keys that are
+ *           never inserted, for searches that miss.  Each key is random letters
+ *           and digits ending with its index in base 62, so all keys differ.
+ *           Lengths are spread evenly between nKeyMin and nKeyMax.
+ * Notes:    Keys shorter than the index digits are made longer.  Release both
+ *           arrays with free().
+ ********************************************************************************/
+int MakeBenchKeys(const strBenchOptions *pstrBench, char **ppszKeys, size_t **panOffsets)
+{
+   const char    *pszDigits = "0123456789abcdefghijklmnopqrstuvwxyz"
+                              "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+   char          *pszKey    = NULL;
+   long           lnIndex   = 0;
+   long           lnValue   = 0;
+   int            nDigits   = 1;
+   int            nLength   = 0;
+   int            nChar     = 0;
+   size_t         nUsed     = 0;
+   unsigned long  ulState   = pstrBench->ulSeed;
+
+
+
+   for (lnValue = pstrBench->lnKeys * 2 - 1; lnValue >= 62; lnValue /= 62)
+   {
+      nDigits++;
+   }
+
+   nLength     = pstrBench->nKeyMax > nDigits ? pstrBench->nKeyMax : nDigits;
+   *ppszKeys   = (char *) malloc((size_t) pstrBench->lnKeys * 2 * (nLength + 1));
+   *panOffsets = (size_t *) malloc((size_t) pstrBench->lnKeys * 2 * sizeof(size_t));
+
+   if (*ppszKeys == NULL || *panOffsets == NULL)
+   {
+      fprintf(stderr, "Failed malloc() in MakeBenchKeys(). errno=%d.\n", errno);
+      free(*ppszKeys);
+      free(*panOffsets);
+      *ppszKeys   = NULL;
+      *panOffsets = NULL;
+      return(-1);
+   }
+
+
+   for (lnIndex=0; lnIndex<pstrBench->lnKeys*2; lnIndex++)
+   {
+      nLength = pstrBench->nKeyMin +
+                (int) (BenchRandom(&ulState) % (pstrBench->nKeyMax - pstrBench->nKeyMin + 1));
+
+      if (nLength < nDigits)
+      {
+         nLength = nDigits;
+      }
+
+      pszKey = *ppszKeys + nUsed;
+      (*panOffsets)[lnIndex] = nUsed;
+
+      for (nChar=0; nChar<nLength-nDigits; nChar++)
+      {
+         pszKey[nChar] = pszDigits[BenchRandom(&ulState) % 62];
+      }
+
+      for (nChar=nLength-1, lnValue=lnIndex; nChar>=nLength-nDigits; nChar--, lnValue/=62)
+      {
+         pszKey[nChar] = pszDigits[lnValue % 62];
+      }
+
+      pszKey[nLength] = '\0';
+      nUsed += nLength + 1;
+   }
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: MakeBenchSearches
+ * Params:   pstrBench - workload of --bench
+ *           alnOrder - receives the key index of each of the lnOps searches
+ *           pulState - generator state, updated
+ * Returns:  0 - searches made
+ *           <0 - cannot allocate memory
+ * Call by:  RunBenchmark()
+ *           RunConcurrentBenchmark()
+ *           RunTypedBenchmark()
+ * Call to:  BenchRandom()
+ * Overview: Picks the key of each search with a Zipf distribution of exponent
+ *           dZipf, and swaps it for a key never inserted with probability
+ *           1 - dHitRatio.  Indexes of keys never inserted are lnKeys and up.
+ * Notes:    Rank r is picked with probability proportional to 1/(r+1)^dZipf.
+ *           A draw is a binary search of the cumulative weights for a random
+ *           fraction of their total.
+ ********************************************************************************/
+int MakeBenchSearches(const strBenchOptions *pstrBench, long *alnOrder,
+                      unsigned long *pulState)
+{
+   double *adZipf  = NULL;
+   double  dTotal  = 0;
+   double  dDraw   = 0;
+   long    lnIndex = 0;
+   long    lnRank  = 0;
+   long    lnLow   = 0;
+   long    lnHigh  = 0;
+
+
+
+   adZipf = (double *) malloc(pstrBench->lnKeys * sizeof(double));
+
+   if (adZipf == NULL)
+   {
+      fprintf(stderr, "Failed malloc() in MakeBenchSearches(). errno=%d.\n", errno);
+      return(-1);
+   }
+
+   for (lnIndex=0; lnIndex<pstrBench->lnKeys; lnIndex++)
+   {
+      dTotal         += pow((double) (lnIndex + 1), -pstrBench->dZipf);
+      adZipf[lnIndex] = dTotal;
+   }
+
+
+   for (lnIndex=0; lnIndex<pstrBench->lnOps; lnIndex++)
+   {
+      dDraw  = (BenchRandom(pulState) >> 11) * (1.0 / 9007199254740992.0) * dTotal;
+      lnLow  = 0;
+      lnHigh = pstrBench->lnKeys - 1;
+
+      while (lnLow < lnHigh)
+      {
+         lnRank = (lnLow + lnHigh) / 2;
+
+         if (adZipf[lnRank] < dDraw)
+         {
+            lnLow = lnRank + 1;
+         }
+         else
+         {
+            lnHigh = lnRank;
+         }
+      }
+
+      alnOrder[lnIndex] = lnLow;
+
+      if ((BenchRandom(pulState) >> 11) * (1.0 / 9007199254740992.0) >= pstrBench->dHitRatio)
+      {
+         alnOrder[lnIndex] += pstrBench->lnKeys;      /* A key never inserted    */
+      }
+   }
+
+
+   free(adZipf);
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: OpenJournal
+ * Params:   pstrHash - hash table
+ *           pstrRunOptions - --journal, --fsync, --group-ms and --group-ops
+ * Returns:  0 - journal replayed and open
+ *           <0 - cannot open or replay the journal
+ * Call by:  main()
+ * Call to:  GetHashInfo()
+ *           OpenHashJournal()
+ * Overview: Opens the journal and tells the user how many changes were
+ *           replayed from it.
+ * Notes:    The library does not print, so the message is printed here.
+ ********************************************************************************/
+int OpenJournal(strHash *pstrHash, const strCommandLine *pstrRunOptions)
+{
+   long        lnRecords = 0;
+   strHashInfo strInfo;
+
+
+
+   if ((lnRecords = OpenHashJournal(pstrHash, pstrRunOptions->pszJournal,
+                                    pstrRunOptions->nSync, pstrRunOptions->lnGroupMs,
+                                    pstrRunOptions->lnGroupOps)) < 0)
+   {
+      return(-1);
+   }
+
+   GetHashInfo(pstrHash, &strInfo);
+
+   printf("Replayed %ld records of [%s], %ld entries now, %ld records kept\n", lnRecords,
+          pstrRunOptions->pszJournal, strInfo.lnEntries, strInfo.lnJournal);
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ProcessBatchLine
+ * Params:   pstrHash - hash table
+ *           pstrShared - shared table to run the line on instead, or NULL
+ *           pszLine - one line of input, without the new line
+ *           bKeysOnly - TRUE when every line is a key to add (--load)
+ *           pstrCounts - counters updated for the summary
+ * Returns:  0 - line processed
+ *           <0 - the operation failed, normally cannot allocate memory
+ * Call by:  RunBatch()
+ * Call to:  AddEntryToHashTable()
+ *           AddEntryToSharedTable()
+ *           AddExpiringEntry()
+ *           DeleteEntryFromHashTable()
+ *           DeleteEntryFromSharedTable()
+ *           GetValueFromHashTable()
+ *           PutEntryInHashTable()
+ *           SearchHashTable()
+ *           SearchSharedTable()
+ * Overview: Runs one batch command.  Commands are "add KEY", "search KEY",
+ *           "get KEY" and "delete KEY", where KEY is everything after the first
+ *           space, "addttl SECONDS KEY", which adds KEY to live SECONDS
+ *           seconds, and "put KEY VALUE", which stores VALUE, the rest of the
+ *           line, with KEY, a single word.
+ * Notes:    Empty lines and lines starting with # are skipped.  With bKeysOnly,
+ *           the whole line is the key, and only empty lines are skipped.  A
+ *           shared table holds keys only, so there "get" is a search, and
+ *           "addttl" and "put" are unknown commands.
+ ********************************************************************************/
+int ProcessBatchLine(strHash *pstrHash, strSharedHash *pstrShared, char *pszLine,
+                     boolean bKeysOnly, strBatchCounts *pstrCounts)
+{
+   int         nReturnCode  = 0;
+   long        lnTtl        = 0;
+   size_t      nValueLength = 0;
+   char       *pszKey       = NULL;
+   char       *pszTtlKey    = NULL;
+   char       *pszValue     = NULL;
+   const char *pchValue     = NULL;
+
+
+
+   if (pszLine[0] == '\0' || (bKeysOnly == FALSE && pszLine[0] == '#'))
+   {
+      return(0);
+   }
+
+   pstrCounts->lnOps++;
+
+
+   if (bKeysOnly == TRUE)
+   {
+      nReturnCode = pstrShared != NULL ? AddEntryToSharedTable(pstrShared, pszLine) :
+                                         AddEntryToHashTable(pstrHash, pszLine);
+      pstrCounts->lnAdded    += nReturnCode == 0;
+      pstrCounts->lnExisting += nReturnCode > 0;
+   }
+   else if ((pszKey = strchr(pszLine, ' ')) == NULL)
+   {
+      pstrCounts->lnUnknown++;
+   }
+   else if (pstrShared != NULL)
+   {
+      *pszKey++ = '\0';
+
+      if (strcmp(pszLine, "add") == 0)
+      {
+         nReturnCode = AddEntryToSharedTable(pstrShared, pszKey);
+         pstrCounts->lnAdded    += nReturnCode == 0;
+         pstrCounts->lnExisting += nReturnCode > 0;
+      }
+      else if (strcmp(pszLine, "search") == 0 || strcmp(pszLine, "get") == 0)
+      {
+         if (SearchSharedTable(pstrShared, pszKey) >= 0)
+         {
+            pstrCounts->lnFound++;
+         }
+         else
+         {
+            pstrCounts->lnNotFound++;
+         }
+      }
+      else if (strcmp(pszLine, "delete") == 0)
+      {
+         nReturnCode = DeleteEntryFromSharedTable(pstrShared, pszKey);
+         pstrCounts->lnDeleted    += nReturnCode == 0;
+         pstrCounts->lnNotDeleted += nReturnCode > 0;
+      }
+      else
+      {
+         pstrCounts->lnUnknown++;
+      }
+   }
+   else
+   {
+      *pszKey++ = '\0';
+
+      if (strcmp(pszLine, "add") == 0)
+      {
+         nReturnCode = AddEntryToHashTable(pstrHash, pszKey);
+         pstrCounts->lnAdded    += nReturnCode == 0;
+         pstrCounts->lnExisting += nReturnCode > 0;
+      }
+      else if (strcmp(pszLine, "addttl") == 0 &&
+               (lnTtl = strtol(pszKey, &pszTtlKey, 10)) > 0 && *pszTtlKey == ' ')
+      {
+         nReturnCode = AddExpiringEntry(pstrHash, pszTtlKey + 1, lnTtl);
+         pstrCounts->lnAdded    += nReturnCode == 0;
+         pstrCounts->lnExisting += nReturnCode > 0;
+      }
+      else if (strcmp(pszLine, "put") == 0 && (pszValue = strchr(pszKey, ' ')) != NULL)
+      {
+         *pszValue++ = '\0';
+
+         nReturnCode = PutEntryInHashTable(pstrHash, pszKey, pszValue, strlen(pszValue));
+         pstrCounts->lnAdded   += nReturnCode == 0;
+         pstrCounts->lnUpdated += nReturnCode > 0;
+      }
+      else if (strcmp(pszLine, "get") == 0)
+      {
+         if (GetValueFromHashTable(pstrHash, pszKey, NULL, &pchValue, &nValueLength) >= 0)
+         {
+            pstrCounts->lnFound++;
+         }
+         else
+         {
+            pstrCounts->lnNotFound++;
+         }
+      }
+      else if (strcmp(pszLine, "search") == 0)
+      {
+         if (SearchHashTable(pstrHash, pszKey, NULL) >= 0)
+         {
+            pstrCounts->lnFound++;
+         }
+         else
+         {
+            pstrCounts->lnNotFound++;
+         }
+      }
+      else if (strcmp(pszLine, "delete") == 0)
+      {
+         nReturnCode = DeleteEntryFromHashTable(pstrHash, pszKey);
+         pstrCounts->lnDeleted     += nReturnCode == 0;
+         pstrCounts->lnNotDeleted  += nReturnCode > 0;
+      }
+      else
+      {
+         pstrCounts->lnUnknown++;
+      }
+   }
+
+
+   if (nReturnCode < 0)
+   {
+      pstrCounts->lnErrors++;
+   }
+
+
+   return(nReturnCode < 0 ? nReturnCode : 0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ProcessCommandLine
+ * Params:   pstrRunOptions - stores options read from the command line
+ *           argc - number of command line parameters
+ *           argv - each command line parameter is a string
+ * Returns:  Pointer to strCommandLine with options from command line.
+ * Call by:  main()
+ * Call to:  NumaPolicyName()
+ *           PagePolicyName()
+ * Overview: Reads arguments from command line and fills options structure.
+ *           Valid options are
+ *           --debug (optional)
+ *           --engine chain|open (optional, chain is the default)
+ *           --hash sum|fnv1a|wyhash|siphash (optional, wyhash is the default)
+ *           --hashreport file (optional)
+ *           --hashsize
+ *           --batch file|- (optional)
+ *           --cache-entries n, --cache-bytes n, --ttl seconds (optional, cache
+ *           mode limits and TTL of added keys)
+ *           --filter (optional, filter of absent keys)
+ *           --fsync always|group|never, --group-ms n, --group-ops n (optional,
+ *           when --journal is synced, group is the default)
+ *           --freeze (optional, read only table with a perfect hash, after
+ *           --load and --batch)
+ *           --listen socket, --port n (optional, serve the table on a Unix
+ *           socket and on a loopback TCP port)
+ *           --journal file (optional, journal replayed at startup and kept)
+ *           --load file|- (optional)
+ *           --pages default|thp|hugetlb (optional, the pages behind the
+ *           buckets, nodes and keys), with --numa local|interleave|n (local
+ *           is the default, n binds them to node n)
+ *           --build file|- (optional, keys added by a parallel build of the
+ *           table, before --load), with --build-threads n (every online
+ *           processor is the default)
+ *           --replay file (optional, trace run on the table after --load and
+ *           --batch), with --pace original|fast (fast is the default)
+ *           --save file (optional, snapshot written before exiting)
+ *           --seed number (optional, siphash key, random when not given)
+ *           --shared name (optional, run --load and --batch on a shared memory
+ *           table), with --shared-keys n and --shared-keylen n to size it
+ *           when it is created, and --shared-remove to remove it at the end
+ *           --snapshot file (optional, snapshot mapped at startup)
+ *           --trace file (optional, every operation on the table recorded)
+ *           --verify (optional, check the checksum of --snapshot)
+ *           --bench (optional), with --keys, --ops, --keylen n|min-max, --hit
+ *           and --zipf for the workload, and --threads n with --writes ratio
+ *           to run it on the concurrent table, --keytype u64|uuid to run it
+ *           on a typed table, or --kernels to time only the key hash and
+ *           compare kernels
+ * Notes:    Exits when the --bench workload, the --port, --build-threads or the
+ *           --shared run is invalid.
+ ********************************************************************************/
+strCommandLine *ProcessCommandLine(strCommandLine *pstrRunOptions, int argc, char **argv)
+{
+   int         nIndex = 0;
+   hashfn      nHash  = HASHFN_SUM;
+   pagepolicy  nPages = PAGES_DEFAULT;
+   char       *pszEnd = NULL;
+
+
+
+   pstrRunOptions->bDebug        = FALSE;
+   pstrRunOptions->nBucketSize   = 0;
+   pstrRunOptions->nEngine       = ENGINE_CHAIN;
+   pstrRunOptions->nHash         = HASHFN_WYHASH;
+   pstrRunOptions->ulSeed        = 0;
+   pstrRunOptions->pszHashReport = NULL;
+   pstrRunOptions->pszLoad       = NULL;
+   pstrRunOptions->pszBuild      = NULL;
+   pstrRunOptions->nBuildThreads = 0;
+   pstrRunOptions->pszBatch      = NULL;
+   pstrRunOptions->pszSnapshot   = NULL;
+   pstrRunOptions->pszSave       = NULL;
+   pstrRunOptions->bVerify       = FALSE;
+   pstrRunOptions->bFreeze       = FALSE;
+   pstrRunOptions->pszJournal    = NULL;
+   pstrRunOptions->nSync         = JOURNAL_GROUP;
+   pstrRunOptions->lnGroupMs     = HASH_GROUP_MS;
+   pstrRunOptions->lnGroupOps    = HASH_GROUP_OPS;
+   pstrRunOptions->pszTrace      = NULL;
+   pstrRunOptions->pszReplay     = NULL;
+   pstrRunOptions->bPaced        = FALSE;
+   pstrRunOptions->bFilter       = FALSE;
+   pstrRunOptions->bBench        = FALSE;
+   pstrRunOptions->pszListen     = NULL;
+   pstrRunOptions->nPort         = 0;
+   pstrRunOptions->pszShared     = NULL;
+   pstrRunOptions->lnSharedKeys  = HASH_SHARED_KEYS;
+   pstrRunOptions->nSharedKeyLen = HASH_SHARED_KEYLEN;
+   pstrRunOptions->bSharedRemove = FALSE;
+   pstrRunOptions->nPages        = PAGES_DEFAULT;
+   pstrRunOptions->nNuma         = NUMA_LOCAL;
+   pstrRunOptions->nNode         = 0;
+
+   pstrRunOptions->lnCacheEntries = 0;
+   pstrRunOptions->nCacheBytes    = 0;
+   pstrRunOptions->lnTtl          = 0;
+
+   pstrRunOptions->strBench.lnKeys    = HASH_BENCH_KEYS;
+   pstrRunOptions->strBench.lnOps     = 0;
+   pstrRunOptions->strBench.nKeyMin   = HASH_BENCH_KEY_MIN;
+   pstrRunOptions->strBench.nKeyMax   = HASH_BENCH_KEY_MAX;
+   pstrRunOptions->strBench.dHitRatio = HASH_BENCH_HIT;
+   pstrRunOptions->strBench.dZipf     = HASH_BENCH_ZIPF;
+   pstrRunOptions->strBench.nThreads  = 0;
+   pstrRunOptions->strBench.dWrites   = HASH_BENCH_WRITES;
+   pstrRunOptions->strBench.ulSeed    = HASH_BENCH_SEED;
+   pstrRunOptions->strBench.nBatch    = 0;
+   pstrRunOptions->strBench.nKeyType  = KEYTYPE_STRING;
+   pstrRunOptions->strBench.bKernels  = FALSE;
+
+
+   for (nIndex=1; nIndex<argc; nIndex++)
+   {
+      if (strcmp(argv[nIndex], "--hashsize") == 0)
+      {
+         pstrRunOptions->nBucketSize = atoi(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--debug") == 0)
+      {
+         pstrRunOptions->bDebug = TRUE;
+      }
+      else if (strcmp(argv[nIndex], "--engine") == 0 && nIndex+1 < argc)
+      {
+         if (strcmp(argv[nIndex+1], "open") == 0)
+         {
+            pstrRunOptions->nEngine = ENGINE_OPEN;
+         }
+         else if (strcmp(argv[nIndex+1], "chain") == 0)
+         {
+            pstrRunOptions->nEngine = ENGINE_CHAIN;
+         }
+         else
+         {
+            fprintf(stderr, "Unknown engine [%s], using chain.\n", argv[nIndex+1]);
+         }
+      }
+      else if (strcmp(argv[nIndex], "--hash") == 0 && nIndex+1 < argc)
+      {
+         for (nHash=HASHFN_SUM; HashName(nHash) != NULL; nHash++)
+         {
+            if (strcmp(argv[nIndex+1], HashName(nHash)) == 0)
+            {
+               pstrRunOptions->nHash = nHash;
+               break;
+            }
+         }
+
+         if (HashName(nHash) == NULL)
+         {
+            fprintf(stderr, "Unknown hash [%s], using wyhash.\n", argv[nIndex+1]);
+         }
+      }
+      else if (strcmp(argv[nIndex], "--pages") == 0 && nIndex+1 < argc)
+      {
+         for (nPages=PAGES_DEFAULT; PagePolicyName(nPages) != NULL; nPages++)
+         {
+            if (strcmp(argv[nIndex+1], PagePolicyName(nPages)) == 0)
+            {
+               pstrRunOptions->nPages = nPages;
+               break;
+            }
+         }
+
+         if (PagePolicyName(nPages) == NULL)
+         {
+            fprintf(stderr, "Unknown pages [%s], using default.\n", argv[nIndex+1]);
+         }
+      }
+      else if (strcmp(argv[nIndex], "--numa") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->nNode = (int) strtol(argv[nIndex+1], &pszEnd, 10);
+
+         if (strcmp(argv[nIndex+1], NumaPolicyName(NUMA_INTERLEAVE)) == 0)
+         {
+            pstrRunOptions->nNuma = NUMA_INTERLEAVE;
+         }
+         else if (pszEnd != argv[nIndex+1] && *pszEnd == '\0')
+         {
+            pstrRunOptions->nNuma = NUMA_BIND;
+         }
+         else if (strcmp(argv[nIndex+1], NumaPolicyName(NUMA_LOCAL)) != 0)
+         {
+            fprintf(stderr, "Unknown NUMA policy [%s], using local.\n", argv[nIndex+1]);
+         }
+      }
+      else if (strcmp(argv[nIndex], "--seed") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->ulSeed = strtoul(argv[nIndex+1], NULL, 0);
+      }
+      else if (strcmp(argv[nIndex], "--hashreport") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->pszHashReport = argv[nIndex+1];
+      }
+      else if (strcmp(argv[nIndex], "--load") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->pszLoad = argv[nIndex+1];
+      }
+      else if (strcmp(argv[nIndex], "--build") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->pszBuild = argv[nIndex+1];
+      }
+      else if (strcmp(argv[nIndex], "--build-threads") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->nBuildThreads = atoi(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--batch") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->pszBatch = argv[nIndex+1];
+      }
+      else if (strcmp(argv[nIndex], "--snapshot") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->pszSnapshot = argv[nIndex+1];
+      }
+      else if (strcmp(argv[nIndex], "--save") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->pszSave = argv[nIndex+1];
+      }
+      else if (strcmp(argv[nIndex], "--verify") == 0)
+      {
+         pstrRunOptions->bVerify = TRUE;
+      }
+      else if (strcmp(argv[nIndex], "--filter") == 0)
+      {
+         pstrRunOptions->bFilter = TRUE;
+      }
+      else if (strcmp(argv[nIndex], "--freeze") == 0)
+      {
+         pstrRunOptions->bFreeze = TRUE;
+      }
+      else if (strcmp(argv[nIndex], "--journal") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->pszJournal = argv[nIndex+1];
+      }
+      else if (strcmp(argv[nIndex], "--trace") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->pszTrace = argv[nIndex+1];
+      }
+      else if (strcmp(argv[nIndex], "--replay") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->pszReplay = argv[nIndex+1];
+      }
+      else if (strcmp(argv[nIndex], "--pace") == 0 && nIndex+1 < argc)
+      {
+         if (strcmp(argv[nIndex+1], "original") == 0)
+         {
+            pstrRunOptions->bPaced = TRUE;
+         }
+         else if (strcmp(argv[nIndex+1], "fast") != 0)
+         {
+            fprintf(stderr, "Unknown pace [%s], using fast.\n", argv[nIndex+1]);
+         }
+      }
+      else if (strcmp(argv[nIndex], "--fsync") == 0 && nIndex+1 < argc)
+      {
+         if (strcmp(argv[nIndex+1], "always") == 0)
+         {
+            pstrRunOptions->nSync = JOURNAL_ALWAYS;
+         }
+         else if (strcmp(argv[nIndex+1], "never") == 0)
+         {
+            pstrRunOptions->nSync = JOURNAL_NEVER;
+         }
+         else if (strcmp(argv[nIndex+1], "group") == 0)
+         {
+            pstrRunOptions->nSync = JOURNAL_GROUP;
+         }
+         else
+         {
+            fprintf(stderr, "Unknown fsync policy [%s], using group.\n", argv[nIndex+1]);
+         }
+      }
+      else if (strcmp(argv[nIndex], "--group-ms") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->lnGroupMs = atol(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--group-ops") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->lnGroupOps = atol(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--cache-entries") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->lnCacheEntries = atol(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--cache-bytes") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->nCacheBytes = (size_t) strtoul(argv[nIndex+1], NULL, 0);
+      }
+      else if (strcmp(argv[nIndex], "--ttl") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->lnTtl = atol(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--listen") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->pszListen = argv[nIndex+1];
+      }
+      else if (strcmp(argv[nIndex], "--port") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->nPort = atoi(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--shared") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->pszShared = argv[nIndex+1];
+      }
+      else if (strcmp(argv[nIndex], "--shared-keys") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->lnSharedKeys = atol(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--shared-keylen") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->nSharedKeyLen = atoi(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--shared-remove") == 0)
+      {
+         pstrRunOptions->bSharedRemove = TRUE;
+      }
+      else if (strcmp(argv[nIndex], "--stats") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->bStats = TRUE;
+
+         if (strcmp(argv[nIndex+1], "json") == 0)
+         {
+            pstrRunOptions->bStatsJson = TRUE;
+         }
+         else if (strcmp(argv[nIndex+1], "text") != 0)
+         {
+            fprintf(stderr, "Unknown stats format [%s], using text.\n", argv[nIndex+1]);
+         }
+      }
+      else if (strcmp(argv[nIndex], "--bench") == 0)
+      {
+         pstrRunOptions->bBench = TRUE;
+      }
+      else if (strcmp(argv[nIndex], "--kernels") == 0)
+      {
+         pstrRunOptions->strBench.bKernels = TRUE;
+      }
+      else if (strcmp(argv[nIndex], "--keys") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->strBench.lnKeys = atol(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--ops") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->strBench.lnOps = atol(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--keylen") == 0 && nIndex+1 < argc)
+      {
+         if (sscanf(argv[nIndex+1], "%d-%d", &pstrRunOptions->strBench.nKeyMin,
+                    &pstrRunOptions->strBench.nKeyMax) == 1)
+         {
+            pstrRunOptions->strBench.nKeyMax = pstrRunOptions->strBench.nKeyMin;
+         }
+      }
+      else if (strcmp(argv[nIndex], "--hit") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->strBench.dHitRatio = atof(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--zipf") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->strBench.dZipf = atof(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--threads") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->strBench.nThreads = atoi(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--writes") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->strBench.dWrites = atof(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--lookup-batch") == 0 && nIndex+1 < argc)
+      {
+         pstrRunOptions->strBench.nBatch = atoi(argv[nIndex+1]);
+      }
+      else if (strcmp(argv[nIndex], "--keytype") == 0 && nIndex+1 < argc)
+      {
+         if (strcmp(argv[nIndex+1], "u64") == 0)
+         {
+            pstrRunOptions->strBench.nKeyType = KEYTYPE_U64;
+         }
+         else if (strcmp(argv[nIndex+1], "uuid") == 0)
+         {
+            pstrRunOptions->strBench.nKeyType = KEYTYPE_UUID;
+         }
+         else if (strcmp(argv[nIndex+1], "string") != 0)
+         {
+            fprintf(stderr, "Unknown key type [%s], using string.\n", argv[nIndex+1]);
+         }
+      }
+   }
+
+
+   /****************************************************************************
+    * The benchmark keys follow --seed too, but stay the same from run to run
+    * when it is not given.
+    ****************************************************************************/
+   if (pstrRunOptions->ulSeed != 0)
+   {
+      pstrRunOptions->strBench.ulSeed = pstrRunOptions->ulSeed;
+   }
+
+   if (pstrRunOptions->strBench.lnOps <= 0)
+   {
+      pstrRunOptions->strBench.lnOps = pstrRunOptions->strBench.lnKeys;
+   }
+
+   if (pstrRunOptions->bBench == TRUE &&
+       (pstrRunOptions->strBench.lnKeys < 1 ||
+        pstrRunOptions->strBench.nKeyMin < 1 ||
+        pstrRunOptions->strBench.nKeyMax < pstrRunOptions->strBench.nKeyMin ||
+        pstrRunOptions->strBench.dHitRatio < 0 ||
+        pstrRunOptions->strBench.dHitRatio > 1 ||
+        pstrRunOptions->strBench.dZipf < 0 ||
+        pstrRunOptions->strBench.nThreads < 0 ||
+        pstrRunOptions->strBench.nThreads > HASH_MAX_THREADS ||
+        pstrRunOptions->strBench.dWrites < 0 ||
+        pstrRunOptions->strBench.dWrites > 1 ||
+        pstrRunOptions->strBench.nBatch < 0 ||
+        (pstrRunOptions->strBench.nKeyType != KEYTYPE_STRING &&
+         (pstrRunOptions->strBench.nThreads > 0 || pstrRunOptions->strBench.nBatch > 0))))
+   {
+      fprintf(stderr, "Invalid --bench workload.\n");
+      exit(1);
+   }
+
+   if (pstrRunOptions->nPort < 0 || pstrRunOptions->nPort > 65535)
+   {
+      fprintf(stderr, "Invalid --port %d.\n", pstrRunOptions->nPort);
+      exit(1);
+   }
+
+
+   /****************************************************************************
+    * --build uses every online processor unless told otherwise.
+    ****************************************************************************/
+   if (pstrRunOptions->nBuildThreads == 0)
+   {
+      pstrRunOptions->nBuildThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+
+      if (pstrRunOptions->nBuildThreads > HASH_MAX_THREADS)
+      {
+         pstrRunOptions->nBuildThreads = HASH_MAX_THREADS;
+      }
+      else if (pstrRunOptions->nBuildThreads < 1)
+      {
+         pstrRunOptions->nBuildThreads = 1;
+      }
+   }
+
+   if (pstrRunOptions->nBuildThreads < 1 || pstrRunOptions->nBuildThreads > HASH_MAX_THREADS)
+   {
+      fprintf(stderr, "Invalid --build-threads %d.\n", pstrRunOptions->nBuildThreads);
+      exit(1);
+   }
+
+
+   /****************************************************************************
+    * The shared table holds keys only, and lives in its own segment, so the
+    * options of the private table do not apply to it.
+    ****************************************************************************/
+   if (pstrRunOptions->pszShared != NULL &&
+       (pstrRunOptions->bBench == TRUE ||
+        pstrRunOptions->pszSnapshot != NULL ||
+        pstrRunOptions->pszSave != NULL ||
+        pstrRunOptions->pszBuild != NULL ||
+        pstrRunOptions->bFreeze == TRUE ||
+        pstrRunOptions->pszJournal != NULL ||
+        pstrRunOptions->pszTrace != NULL ||
+        pstrRunOptions->pszReplay != NULL ||
+        pstrRunOptions->pszListen != NULL ||
+        pstrRunOptions->nPort != 0 ||
+        pstrRunOptions->bStats == TRUE ||
+        pstrRunOptions->bFilter == TRUE ||
+        pstrRunOptions->lnCacheEntries != 0 ||
+        pstrRunOptions->nCacheBytes != 0 ||
+        pstrRunOptions->lnTtl != 0 ||
+        pstrRunOptions->lnSharedKeys < 1 ||
+        pstrRunOptions->nSharedKeyLen < 1))
+   {
+      fprintf(stderr, "Invalid --shared run, it only takes --load and --batch.\n");
+      exit(1);
+   }
+
+
+   return (pstrRunOptions);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ReportBenchPhase
+ * Params:   pstrBench - workload of --bench
+ *           pstrPhase - result of the phase; its latencies are sorted here
+ * Returns:  0
+ * Call by:  RunBenchmark()
+ *           RunConcurrentBenchmark()
+ *           RunTypedBenchmark()
+ * Call to:  CompareLatency()
+ *           HashName()
+ * Overview: Prints one line of JSON with the workload, the throughput, the
+ *           latency percentiles and the peak resident set of the process, so
+ *           runs of different builds can be compared by a script.
+ * Notes:    Each latency also holds one clock read, about 20ns.  The resident
+ *           set includes the keys and arrays of the benchmark itself, which is
+ *           what start_rss_kb shows.  With several threads, the throughput is
+ *           the ops of all threads over the wall clock time of the phase.
+ ********************************************************************************/
+int ReportBenchPhase(const strBenchOptions *pstrBench, strBenchPhase *pstrPhase)
+{
+   long           lnOps     = pstrPhase->lnOps;
+   double         dSeconds  = pstrPhase->dSeconds;
+   unsigned int  *anLatency = pstrPhase->anLatency;
+   struct rusage  strUsage;
+
+
+
+   qsort(anLatency, lnOps, sizeof(unsigned int), CompareLatency);
+   getrusage(RUSAGE_SELF, &strUsage);
+
+
+   printf("{\"phase\":\"%s\",\"engine\":\"%s\",\"hash\":\"%s\",\"threads\":%d,"
+          "\"batch\":%d,\"keys\":%ld,\"ops\":%ld,\"key_min\":%d,\"key_max\":%d,"
+          "\"hit_ratio\":%.3f,\"zipf\":%.3f,\"succeeded\":%ld,"
+          "\"seconds\":%.6f,\"ops_per_sec\":%.0f,"
+          "\"p50_ns\":%u,\"p99_ns\":%u,\"p999_ns\":%u,\"max_ns\":%u,"
+          "\"entries\":%ld,\"size\":%ld,\"start_rss_kb\":%ld,\"max_rss_kb\":%ld}\n",
+          pstrPhase->pszPhase,
+          pstrPhase->pszEngine,
+          HashName(pstrPhase->nHash),
+          pstrPhase->nThreads,
+          pstrPhase->nBatch,
+          pstrBench->lnKeys,
+          lnOps,
+          pstrBench->nKeyMin,
+          pstrBench->nKeyMax,
+          pstrBench->dHitRatio,
+          pstrBench->dZipf,
+          pstrPhase->lnSucceeded,
+          dSeconds,
+          dSeconds > 0 ? lnOps / dSeconds : 0,
+          lnOps > 0 ? anLatency[lnOps * 50 / 100] : 0,
+          lnOps > 0 ? anLatency[lnOps * 99 / 100] : 0,
+          lnOps > 0 ? anLatency[lnOps * 999 / 1000] : 0,
+          lnOps > 0 ? anLatency[lnOps - 1] : 0,
+          pstrPhase->lnEntries,
+          pstrPhase->lnSize,
+          pstrPhase->lnStartRss,
+          strUsage.ru_maxrss);
+
+   fflush(stdout);
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ReportHashDistribution
+ * Params:   pszFile - file with one key per line
+ *           nBuckets - number of buckets to spread the keys over
+ *           aulSeed - key for siphash
+ * Returns:  0 - report printed
+ *           <0 - cannot read the file or allocate memory
+ * Call by:  main()
+ * Call to:  HashBytes()
+ *           HashName()
+ * Overview: Hashes every key of the file with each hash function, and prints
+ *           how evenly the keys fall into nBuckets buckets: empty buckets,
+ *           longest chain, chi-square against a uniform spread, and the time
+ *           spent hashing.
+ * Notes:    A chi-square close to the number of buckets means the hash spreads
+ *           the keys as well as random bucket choices would.  Duplicate lines
+ *           are hashed again, like any other key.
+ ********************************************************************************/
+int ReportHashDistribution(const char *pszFile, int nBuckets, const unsigned long *aulSeed)
+{
+   FILE           *pFile      = NULL;
+   char            szData[BUFSIZ+1];
+   char           *pszKeys    = NULL;
+   const char     *pszKey     = NULL;
+   char           *pszNew     = NULL;
+   size_t         *anOffsets  = NULL;
+   size_t         *anNew      = NULL;
+   size_t          nUsed      = 0;
+   size_t          nCapacity  = 0;
+   size_t          nKeys      = 0;
+   size_t          nMaxKeys   = 0;
+   size_t          nLength    = 0;
+   size_t          nIndex     = 0;
+   long           *alnCounts  = NULL;
+   long            lnMax      = 0;
+   long            lnEmpty    = 0;
+   double          dExpected  = 0;
+   double          dChiSquare = 0;
+   double          dSeconds   = 0;
+   unsigned long   ulHash     = 0;
+   struct timespec strStart;
+   struct timespec strEnd;
+   hashfn          nHash      = HASHFN_SUM;
+
+
+
+   if ((pFile = fopen(pszFile, "r")) == NULL)
+   {
+      fprintf(stderr, "Cannot open [%s]. errno=%d.\n", pszFile, errno);
+      return(-1);
+   }
+
+
+   /****************************************************************************
+    * Keep all keys in one buffer, so hashing is timed without file I/O.
+    ****************************************************************************/
+   while (fgets(szData, sizeof(szData), pFile) != NULL)
+   {
+      szData[strcspn(szData, "\r\n")] = 0;
+      nLength = strlen(szData);
+
+      if (nUsed + nLength + 1 > nCapacity || nKeys == nMaxKeys)
+      {
+         nCapacity = nCapacity * 2 + nLength + BUFSIZ;
+         nMaxKeys  = nMaxKeys * 2 + 1024;
+         pszNew    = (char *) realloc(pszKeys, nCapacity);
+         anNew     = (size_t *) realloc(anOffsets, nMaxKeys * sizeof(size_t));
+
+         if (pszNew != NULL)
+         {
+            pszKeys = pszNew;
+         }
+
+         if (anNew != NULL)
+         {
+            anOffsets = anNew;
+         }
+
+         if (pszNew == NULL || anNew == NULL)
+         {
+            fprintf(stderr, "Failed realloc() in ReportHashDistribution(). errno=%d.\n", errno);
+            fclose(pFile);
+            free(pszKeys);
+            free(anOffsets);
+            return(-1);
+         }
+      }
+
+      memcpy(pszKeys + nUsed, szData, nLength + 1);
+      anOffsets[nKeys++] = nUsed;
+      nUsed += nLength + 1;
+   }
+
+   fclose(pFile);
+
+
+   if ((alnCounts = (long *) malloc(nBuckets * sizeof(long))) == NULL)
+   {
+      fprintf(stderr, "Failed malloc() in ReportHashDistribution(). errno=%d.\n", errno);
+      free(pszKeys);
+      free(anOffsets);
+      return(-1);
+   }
+
+   dExpected = (double) nKeys / nBuckets;
+
+   printf("%zu keys, %d buckets, %.2f keys per bucket\n\n", nKeys, nBuckets, dExpected);
+   printf("%-8s %10s %8s %12s %12s\n",
+          "hash", "empty", "max", "chi-square", "ns per key");
+
+
+   for (nHash=HASHFN_SUM; HashName(nHash) != NULL; nHash++)
+   {
+      memset(alnCounts, 0, nBuckets * sizeof(long));
+
+
+      clock_gettime(CLOCK_MONOTONIC, &strStart);
+
+      for (nIndex=0; nIndex<nKeys; nIndex++)
+      {
+         pszKey  = pszKeys + anOffsets[nIndex];
+         nLength = strlen(pszKey);
+
+         ulHash  = HashBytes(nHash, aulSeed, pszKey, nLength);
+
+         alnCounts[ulHash % nBuckets]++;
+      }
+
+      clock_gettime(CLOCK_MONOTONIC, &strEnd);
+
+
+      lnMax      = 0;
+      lnEmpty    = 0;
+      dChiSquare = 0;
+
+      for (nIndex=0; nIndex<(size_t) nBuckets; nIndex++)
+      {
+         if (alnCounts[nIndex] == 0)
+         {
+            lnEmpty++;
+         }
+
+         if (alnCounts[nIndex] > lnMax)
+         {
+            lnMax = alnCounts[nIndex];
+         }
+
+         dChiSquare += (alnCounts[nIndex] - dExpected) * (alnCounts[nIndex] - dExpected);
+      }
+
+      dSeconds = (strEnd.tv_sec - strStart.tv_sec) + (strEnd.tv_nsec - strStart.tv_nsec) / 1e9;
+
+      printf("%-8s %10ld %8ld %12.1f %12.2f\n",
+             HashName(nHash),
+             lnEmpty,
+             lnMax,
+             dExpected > 0 ? dChiSquare / dExpected : 0,
+             nKeys > 0 ? dSeconds * 1e9 / nKeys : 0);
+   }
+
+
+   free(alnCounts);
+   free(pszKeys);
+   free(anOffsets);
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: RunBatch
+ * Params:   pstrHash - hash table
+ *           pstrShared - shared table to run the file on instead, or NULL
+ *           pszFile - file to read, "-" for standard input
+ *           bKeysOnly - TRUE to add every line as a key (--load), FALSE to run
+ *                       add/search/delete commands (--batch)
+ * Returns:  0 - file processed
+ *           <0 - cannot read the file or allocate memory
+ * Call by:  main()
+ *           RunShared()
+ * Call to:  FlushLoadKeys()
+ *           GetHashInfo()
+ *           GetSharedInfo()
+ *           ProcessBatchLine()
+ * Overview: Streams the file through a large buffer with read(), splits it into
+ *           lines in place, and runs each line against the table.  --load keys
+ *           are added HASH_LOAD_KEYS at a time.  Nothing is printed per line.
+ *           At the end, prints a summary with the time taken and operations
+ *           per second.
+ * Notes:    The buffer starts at HASH_BATCH_BUFFER bytes and doubles when a
+ *           single line does not fit.  A last line without a new line is still
+ *           processed.
+ ********************************************************************************/
+int RunBatch(strHash *pstrHash, strSharedHash *pstrShared, const char *pszFile,
+             boolean bKeysOnly)
+{
+   int             nFile       = STDIN_FILENO;
+   int             nReturnCode = 0;
+   int             nKeys       = 0;
+   char           *pszBuffer   = NULL;
+   char           *pszNew      = NULL;
+   char           *pszLine     = NULL;
+   char           *pszEnd      = NULL;
+   size_t          nSize       = HASH_BATCH_BUFFER;
+   size_t          nUsed       = 0;
+   ssize_t         nRead       = 0;
+   double          dSeconds    = 0;
+   strBatchCounts  strCounts;
+   strHashInfo     strInfo;
+   const char     *apszKeys[HASH_LOAD_KEYS];
+   struct timespec strStart;
+   struct timespec strEnd;
+
+
+
+   memset(&strCounts, 0, sizeof(strCounts));
+
+   if (strcmp(pszFile, "-") != 0 && (nFile = open(pszFile, O_RDONLY)) < 0)
+   {
+      fprintf(stderr, "Cannot open [%s]. errno=%d.\n", pszFile, errno);
+      return(-1);
+   }
+
+   if ((pszBuffer = (char *) malloc(nSize + 1)) == NULL)
+   {
+      fprintf(stderr, "Failed malloc() in RunBatch(). errno=%d.\n", errno);
+      close(nFile);
+      return(-1);
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &strStart);
+
+
+   /****************************************************************************
+    * Fill the buffer, run every complete line, then move the partial last line
+    * to the front of the buffer before the next read.
+    ****************************************************************************/
+   for (;;)
+   {
+      if (nUsed == nSize)
+      {
+         if ((pszNew = (char *) realloc(pszBuffer, nSize * 2 + 1)) == NULL)
+         {
+            fprintf(stderr, "Failed realloc() in RunBatch(). errno=%d.\n", errno);
+            nReturnCode = -1;
+            break;
+         }
+
+         pszBuffer = pszNew;
+         nSize     = nSize * 2;
+      }
+
+      nRead = read(nFile, pszBuffer + nUsed, nSize - nUsed);
+
+      if (nRead < 0 && errno == EINTR)
+      {
+         continue;
+      }
+
+      if (nRead < 0)
+      {
+         fprintf(stderr, "Failed read() of [%s]. errno=%d.\n", pszFile, errno);
+         nReturnCode = -1;
+         break;
+      }
+
+      if (nRead == 0)
+      {
+         if (nUsed > 0)
+         {
+            pszBuffer[nUsed] = '\0';
+            pszBuffer[strcspn(pszBuffer, "\r")] = '\0';
+            ProcessBatchLine(pstrHash, pstrShared, pszBuffer, bKeysOnly, &strCounts);
+         }
+         break;
+      }
+
+      nUsed += nRead;
+      pszLine = pszBuffer;
+
+      while ((pszEnd = memchr(pszLine, '\n', nUsed - (pszLine - pszBuffer))) != NULL)
+      {
+         *pszEnd = '\0';
+
+         if (pszEnd > pszLine && pszEnd[-1] == '\r')
+         {
+            pszEnd[-1] = '\0';
+         }
+
+         if (bKeysOnly == TRUE && pszLine[0] != '\0')
+         {
+            apszKeys[nKeys++] = pszLine;
+
+            if (nKeys == HASH_LOAD_KEYS)
+            {
+               FlushLoadKeys(pstrHash, pstrShared, apszKeys, nKeys, &strCounts);
+               nKeys = 0;
+            }
+         }
+         else
+         {
+            ProcessBatchLine(pstrHash, pstrShared, pszLine, bKeysOnly, &strCounts);
+         }
+
+         pszLine = pszEnd + 1;
+      }
+
+      FlushLoadKeys(pstrHash, pstrShared, apszKeys, nKeys, &strCounts);
+      nKeys = 0;
+
+      nUsed -= pszLine - pszBuffer;
+      memmove(pszBuffer, pszLine, nUsed);
+   }
+
+
+   clock_gettime(CLOCK_MONOTONIC, &strEnd);
+
+   if (nFile != STDIN_FILENO)
+   {
+      close(nFile);
+   }
+
+   free(pszBuffer);
+
+
+   dSeconds = (strEnd.tv_sec - strStart.tv_sec) + (strEnd.tv_nsec - strStart.tv_nsec) / 1e9;
+
+   printf("%s [%s]: %ld operations in %.3f seconds, %.0f ops/sec\n",
+          bKeysOnly == TRUE ? "Load" : "Batch",
+          pszFile,
+          strCounts.lnOps,
+          dSeconds,
+          dSeconds > 0 ? strCounts.lnOps / dSeconds : 0);
+   printf("   added %ld, already present %ld\n", strCounts.lnAdded, strCounts.lnExisting);
+
+   if (bKeysOnly == FALSE)
+   {
+      printf("   values replaced %ld\n", strCounts.lnUpdated);
+      printf("   found %ld, not found %ld\n", strCounts.lnFound, strCounts.lnNotFound);
+      printf("   deleted %ld, not found to delete %ld\n",
+             strCounts.lnDeleted, strCounts.lnNotDeleted);
+      printf("   unknown commands %ld\n", strCounts.lnUnknown);
+   }
+
+   if (pstrShared != NULL)
+   {
+      GetSharedInfo(pstrShared, &strInfo);
+   }
+   else
+   {
+      GetHashInfo(pstrHash, &strInfo);
+   }
+
+   printf("   errors %ld, entries now %ld\n", strCounts.lnErrors, strInfo.lnEntries);
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: RunBenchmark
+ * Params:   pstrHash - empty hash table
+ *           pstrBench - workload of --bench
+ * Returns:  0 - benchmark run
+ *           <0 - cannot allocate memory
+ * Call by:  main()
+ * Call to:  AddEntriesToHashTable()
+ *           AddEntryToHashTable()
+ *           BenchBatchKeys()
+ *           BenchBatchLatency()
+ *           BenchTime()
+ *           DeleteEntryFromHashTable()
+ *           GetHashInfo()
+ *           MakeBenchKeys()
+ *           MakeBenchSearches()
+ *           ReportBenchPhase()
+ *           SearchEntriesInHashTable()
+ *           SearchHashTable()
+ *           ShuffleBenchKeys()
+ * Overview: Drives the table directly, without the menu, in three timed
+ *           phases: insert every key, run lnOps searches, then delete every
+ *           key in a shuffled order.  Searches find a stored key with
+ *           probability dHitRatio, and pick the key with a Zipf distribution
+ *           of exponent dZipf, so a few keys get most of the searches.
+ * Notes:    The keys and the order of all operations are made before the
+ *           clock starts.  The clock is read once per operation, and the time
+ *           between two reads is the latency of the operation in between.
+ *           With --lookup-batch, inserts and searches go nBatch keys per call,
+ *           and each key of a call gets an equal share of its time.
+ ********************************************************************************/
+int RunBenchmark(strHash *pstrHash, const strBenchOptions *pstrBench)
+{
+   char           *pszKeys     = NULL;
+   size_t         *anOffsets   = NULL;
+   long           *alnOrder    = NULL;
+   unsigned int   *anLatency   = NULL;
+   const char    **apszBatch   = NULL;
+   int             nKeys       = 0;
+   long            lnOps       = pstrBench->lnOps;
+   long            lnIndex     = 0;
+   long            lnSucceeded = 0;
+   unsigned long   ulState     = pstrBench->ulSeed ^ 0x5deece66dUL;
+   unsigned long   ulLast      = 0;
+   unsigned long   ulStart     = 0;
+   unsigned long   ulNow       = 0;
+   strBenchPhase   strPhase;
+   strHashInfo     strInfo;
+   struct rusage   strUsage;
+
+
+
+   if (lnOps < pstrBench->lnKeys)
+   {
+      lnOps = pstrBench->lnKeys;              /* Arrays also serve the deletes  */
+   }
+
+   alnOrder  = (long *) malloc(lnOps * sizeof(long));
+   anLatency = (unsigned int *) malloc(lnOps * sizeof(unsigned int));
+   apszBatch = (const char **) malloc((pstrBench->nBatch + 1) * sizeof(const char *));
+
+   if (alnOrder == NULL || anLatency == NULL || apszBatch == NULL ||
+       MakeBenchKeys(pstrBench, &pszKeys, &anOffsets) != 0 ||
+       MakeBenchSearches(pstrBench, alnOrder, &ulState) != 0)
+   {
+      fprintf(stderr, "Failed malloc() in RunBenchmark(). errno=%d.\n", errno);
+      free(pszKeys);
+      free(anOffsets);
+      free(alnOrder);
+      free(anLatency);
+      free(apszBatch);
+      return(-1);
+   }
+
+   GetHashInfo(pstrHash, &strInfo);
+   getrusage(RUSAGE_SELF, &strUsage);
+
+   memset(&strPhase, 0, sizeof(strBenchPhase));
+   strPhase.pszEngine  = strInfo.nEngine == ENGINE_OPEN ? "open" : "chain";
+   strPhase.nHash      = strInfo.nHash;
+   strPhase.nThreads   = 1;
+   strPhase.anLatency  = anLatency;
+   strPhase.lnStartRss = strUsage.ru_maxrss;
+
+
+   /****************************************************************************
+    * Insert.
+    ****************************************************************************/
+   ulStart = BenchTime();
+   ulLast  = ulStart;
+   ulNow   = ulStart;
+
+   for (lnIndex=0; lnIndex<pstrBench->lnKeys; lnIndex+=nKeys)
+   {
+      nKeys = BenchBatchKeys(pstrBench, pstrBench->lnKeys - lnIndex, pszKeys, anOffsets, NULL,
+                             lnIndex, apszBatch);
+
+      if (pstrBench->nBatch > 0)
+      {
+         lnSucceeded += AddEntriesToHashTable(pstrHash, apszBatch, nKeys, NULL);
+      }
+      else
+      {
+         lnSucceeded += AddEntryToHashTable(pstrHash, apszBatch[0]) == 0;
+      }
+
+      ulNow  = BenchTime();
+      BenchBatchLatency(anLatency + lnIndex, nKeys, ulNow - ulLast);
+      ulLast = ulNow;
+   }
+
+   strPhase.pszPhase    = "insert";
+   strPhase.nBatch      = pstrBench->nBatch;
+   strPhase.lnOps       = pstrBench->lnKeys;
+   strPhase.lnSucceeded = lnSucceeded;
+   GetHashInfo(pstrHash, &strInfo);
+   strPhase.lnEntries   = strInfo.lnEntries;
+   strPhase.lnSize      = strInfo.lnSize;
+   strPhase.dSeconds    = (ulNow - ulStart) / 1e9;
+   ReportBenchPhase(pstrBench, &strPhase);
+
+
+   /****************************************************************************
+    * Search.
+    ****************************************************************************/
+   lnSucceeded = 0;
+   ulStart     = BenchTime();
+   ulLast      = ulStart;
+   ulNow       = ulStart;
+
+   for (lnIndex=0; lnIndex<pstrBench->lnOps; lnIndex+=nKeys)
+   {
+      nKeys = BenchBatchKeys(pstrBench, pstrBench->lnOps - lnIndex, pszKeys, anOffsets,
+                             alnOrder, lnIndex, apszBatch);
+
+      if (pstrBench->nBatch > 0)
+      {
+         lnSucceeded += SearchEntriesInHashTable(pstrHash, apszBatch, nKeys, NULL);
+      }
+      else
+      {
+         lnSucceeded += SearchHashTable(pstrHash, apszBatch[0], NULL) >= 0;
+      }
+
+      ulNow  = BenchTime();
+      BenchBatchLatency(anLatency + lnIndex, nKeys, ulNow - ulLast);
+      ulLast = ulNow;
+   }
+
+   strPhase.pszPhase    = "search";
+   strPhase.lnOps       = pstrBench->lnOps;
+   strPhase.lnSucceeded = lnSucceeded;
+   GetHashInfo(pstrHash, &strInfo);
+   strPhase.lnEntries   = strInfo.lnEntries;
+   strPhase.lnSize      = strInfo.lnSize;
+   strPhase.dSeconds    = (ulNow - ulStart) / 1e9;
+   ReportBenchPhase(pstrBench, &strPhase);
+
+
+   /****************************************************************************
+    * Delete, in a shuffled order.
+    ****************************************************************************/
+   ShuffleBenchKeys(alnOrder, pstrBench->lnKeys, &ulState);
+
+   lnSucceeded = 0;
+   ulStart     = BenchTime();
+   ulLast      = ulStart;
+   ulNow       = ulStart;
+
+   for (lnIndex=0; lnIndex<pstrBench->lnKeys; lnIndex++)
+   {
+      lnSucceeded += DeleteEntryFromHashTable(pstrHash,
+                                              pszKeys + anOffsets[alnOrder[lnIndex]]) == 0;
+
+      ulNow              = BenchTime();
+      anLatency[lnIndex] = (unsigned int) (ulNow - ulLast);
+      ulLast             = ulNow;
+   }
+
+   strPhase.pszPhase    = "delete";
+   strPhase.nBatch      = 0;
+   strPhase.lnOps       = pstrBench->lnKeys;
+   strPhase.lnSucceeded = lnSucceeded;
+   GetHashInfo(pstrHash, &strInfo);
+   strPhase.lnEntries   = strInfo.lnEntries;
+   strPhase.lnSize      = strInfo.lnSize;
+   strPhase.dSeconds    = (ulNow - ulStart) / 1e9;
+   ReportBenchPhase(pstrBench, &strPhase);
+
+
+   free(pszKeys);
+   free(anOffsets);
+   free(alnOrder);
+   free(anLatency);
+   free(apszBatch);
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: RunBuild
+ * Params:   pstrHash - hash table
+ *           pszFile - key file to read, "-" for standard input
+ *           nThreads - threads to build with
+ * Returns:  0 - keys added
+ *           <0 - cannot read the file, allocate memory or build the table
+ * Call by:  main()
+ * Call to:  BuildHashTable()
+ *           GetHashInfo()
+ * Overview: Reads the whole file, splits it into lines in place, and adds
+ *           every line as a key with one call to BuildHashTable().  Prints a
+ *           summary like --load, with the time of the build alone.
+ * Notes:    Unlike --load, the whole file is in memory at once, since the
+ *           threads of the build hash and sort all the keys before adding
+ *           them.  Empty lines are skipped.
+ ********************************************************************************/
+int RunBuild(strHash *pstrHash, const char *pszFile, int nThreads)
+{
+   int              nFile       = STDIN_FILENO;
+   int              nReturnCode = 0;
+   char            *pszBuffer   = NULL;
+   char            *pszNew      = NULL;
+   char            *pszLine     = NULL;
+   char            *pszEnd      = NULL;
+   const char     **apszKeys    = NULL;
+   size_t           nSize       = HASH_BATCH_BUFFER;
+   size_t           nUsed       = 0;
+   ssize_t          nRead       = 0;
+   long             lnKeys      = 0;
+   long             lnAdded     = 0;
+   double           dSeconds    = 0;
+   strHashInfo      strInfo;
+   struct timespec  strStart;
+   struct timespec  strEnd;
+
+
+
+   if (strcmp(pszFile, "-") != 0 && (nFile = open(pszFile, O_RDONLY)) < 0)
+   {
+      fprintf(stderr, "Cannot open [%s]. errno=%d.\n", pszFile, errno);
+      return(-1);
+   }
+
+   if ((pszBuffer = (char *) malloc(nSize + 1)) == NULL)
+   {
+      fprintf(stderr, "Failed malloc() in RunBuild(). errno=%d.\n", errno);
+      close(nFile);
+      return(-1);
+   }
+
+   while ((nRead = read(nFile, pszBuffer + nUsed, nSize - nUsed)) != 0)
+   {
+      if (nRead < 0 && errno == EINTR)
+      {
+         continue;
+      }
+
+      if (nRead < 0)
+      {
+         fprintf(stderr, "Failed read() of [%s]. errno=%d.\n", pszFile, errno);
+         nReturnCode = -1;
+         break;
+      }
+
+      nUsed += nRead;
+
+      if (nUsed == nSize)
+      {
+         if ((pszNew = (char *) realloc(pszBuffer, nSize * 2 + 1)) == NULL)
+         {
+            fprintf(stderr, "Failed realloc() in RunBuild(). errno=%d.\n", errno);
+            nReturnCode = -1;
+            break;
+         }
+
+         pszBuffer = pszNew;
+         nSize     = nSize * 2;
+      }
+   }
+
+   if (nFile != STDIN_FILENO)
+   {
+      close(nFile);
+   }
+
+
+   /****************************************************************************
+    * Each new line ends a key, so there are at most that many keys, plus a
+    * last line without a new line.
+    ****************************************************************************/
+   pszBuffer[nUsed] = '\0';
+
+   for (pszLine = pszBuffer; nReturnCode == 0 && pszLine != NULL; lnKeys++)
+   {
+      pszEnd  = memchr(pszLine, '\n', nUsed - (pszLine - pszBuffer));
+      pszLine = pszEnd != NULL ? pszEnd + 1 : NULL;
+   }
+
+   if (nReturnCode == 0 && (apszKeys = (const char **) malloc(lnKeys * sizeof(char *))) == NULL)
+   {
+      fprintf(stderr, "Failed malloc() in RunBuild(). errno=%d.\n", errno);
+      nReturnCode = -1;
+   }
+
+   lnKeys = 0;
+
+   for (pszLine = pszBuffer; nReturnCode == 0 && pszLine != NULL; pszLine = pszEnd)
+   {
+      if ((pszEnd = memchr(pszLine, '\n', nUsed - (pszLine - pszBuffer))) != NULL)
+      {
+         *pszEnd++ = '\0';
+      }
+
+      pszLine[strcspn(pszLine, "\r")] = '\0';
+
+      if (pszLine[0] != '\0')
+      {
+         apszKeys[lnKeys++] = pszLine;
+      }
+   }
+
+
+   if (nReturnCode == 0)
+   {
+      clock_gettime(CLOCK_MONOTONIC, &strStart);
+      lnAdded = BuildHashTable(pstrHash, apszKeys, lnKeys, nThreads);
+      clock_gettime(CLOCK_MONOTONIC, &strEnd);
+
+      nReturnCode = lnAdded < 0 ? -1 : 0;
+   }
+
+   free(apszKeys);
+   free(pszBuffer);
+
+   if (nReturnCode != 0)
+   {
+      return(nReturnCode);
+   }
+
+
+   dSeconds = (strEnd.tv_sec - strStart.tv_sec) + (strEnd.tv_nsec - strStart.tv_nsec) / 1e9;
+
+   printf("Build [%s]: %ld keys in %.3f seconds, %.0f keys/sec, up to %d threads\n",
+          pszFile,
+          lnKeys,
+          dSeconds,
+          dSeconds > 0 ? lnKeys / dSeconds : 0,
+          nThreads);
+
+   GetHashInfo(pstrHash, &strInfo);
+
+   printf("   added %ld, already present or not stored %ld, entries now %ld\n",
+          lnAdded, lnKeys - lnAdded, strInfo.lnEntries);
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: RunConcurrentBenchmark
+ * Params:   pstrHash - empty hash table, for its hash function, seed and size
+ *           pstrBench - workload of --bench, with nThreads threads
+ * Returns:  0 - benchmark run
+ *           <0 - cannot allocate memory
+ * Call by:  main()
+ * Call to:  BenchRandom()
+ *           CreateConcurrentTable()
+ *           FreeConcurrentTable()
+ *           GetHashInfo()
+ *           MakeBenchKeys()
+ *           MakeBenchSearches()
+ *           ReportBenchPhase()
+ *           RunConcurrentPhase()
+ *           ShuffleBenchKeys()
+ * Overview: Runs the --bench workload on a concurrent table, with nThreads
+ *           threads splitting each phase: insert every key, run lnOps mixed
+ *           operations, then delete every key in a shuffled order.  The mixed
+ *           phase is the search phase of RunBenchmark(), except that a
+ *           fraction dWrites of the searches for a stored key delete the key
+ *           and add it back instead.
+ * Notes:    Threads working on the same key at the same time may see it
+ *           missing, so succeeded can be a little lower than with one thread.
+ ********************************************************************************/
+int RunConcurrentBenchmark(const strHash *pstrHash, const strBenchOptions *pstrBench)
+{
+   char              *pszKeys    = NULL;
+   size_t            *anOffsets  = NULL;
+   long              *alnOrder   = NULL;
+   unsigned int      *anLatency  = NULL;
+   long               lnOps      = pstrBench->lnOps;
+   long               lnIndex    = 0;
+   int                nThread    = 0;
+   unsigned long      ulState    = pstrBench->ulSeed ^ 0x5deece66dUL;
+   strConcurrentHash *pstrConc   = NULL;
+   strBenchThread     astrWork[HASH_MAX_THREADS];
+   strBenchPhase      strPhase;
+   strHashInfo        strInfo;
+   struct rusage      strUsage;
+
+
+
+   if (lnOps < pstrBench->lnKeys)
+   {
+      lnOps = pstrBench->lnKeys;              /* Arrays also serve the deletes  */
+   }
+
+   GetHashInfo(pstrHash, &strInfo);
+
+   alnOrder  = (long *) malloc(lnOps * sizeof(long));
+   anLatency = (unsigned int *) malloc(lnOps * sizeof(unsigned int));
+
+   if (alnOrder == NULL || anLatency == NULL ||
+       MakeBenchKeys(pstrBench, &pszKeys, &anOffsets) != 0 ||
+       MakeBenchSearches(pstrBench, alnOrder, &ulState) != 0 ||
+       (pstrConc = CreateConcurrentTable(strInfo.nHash, strInfo.aulSeed,
+                                         (int) strInfo.lnMinSize)) == NULL)
+   {
+      fprintf(stderr, "Failed malloc() in RunConcurrentBenchmark(). errno=%d.\n", errno);
+      free(pszKeys);
+      free(anOffsets);
+      free(alnOrder);
+      free(anLatency);
+      return(-1);
+   }
+
+   for (lnIndex=0; lnIndex<pstrBench->lnOps; lnIndex++)
+   {
+      if ((BenchRandom(&ulState) >> 11) * (1.0 / 9007199254740992.0) < pstrBench->dWrites &&
+          alnOrder[lnIndex] < pstrBench->lnKeys)
+      {
+         alnOrder[lnIndex] = -alnOrder[lnIndex] - 1;  /* Delete and add back    */
+      }
+   }
+
+   memset(astrWork, 0, sizeof(astrWork));
+
+   for (nThread=0; nThread<pstrBench->nThreads; nThread++)
+   {
+      astrWork[nThread].pstrConc  = pstrConc;
+      astrWork[nThread].pszKeys   = pszKeys;
+      astrWork[nThread].anOffsets = anOffsets;
+      astrWork[nThread].anLatency = anLatency;
+   }
+
+   getrusage(RUSAGE_SELF, &strUsage);
+
+   memset(&strPhase, 0, sizeof(strBenchPhase));
+   strPhase.pszEngine  = "concurrent";
+   strPhase.nHash      = strInfo.nHash;
+   strPhase.nThreads   = pstrBench->nThreads;
+   strPhase.anLatency  = anLatency;
+   strPhase.lnStartRss = strUsage.ru_maxrss;
+
+
+   strPhase.pszPhase = "insert";
+   strPhase.lnOps    = pstrBench->lnKeys;
+   RunConcurrentPhase(pstrConc, astrWork, pstrBench->nThreads, 0, NULL, &strPhase);
+   ReportBenchPhase(pstrBench, &strPhase);
+
+   strPhase.pszPhase = "mixed";
+   strPhase.lnOps    = pstrBench->lnOps;
+   RunConcurrentPhase(pstrConc, astrWork, pstrBench->nThreads, 1, alnOrder, &strPhase);
+   ReportBenchPhase(pstrBench, &strPhase);
+
+   ShuffleBenchKeys(alnOrder, pstrBench->lnKeys, &ulState);
+
+   strPhase.pszPhase = "delete";
+   strPhase.lnOps    = pstrBench->lnKeys;
+   RunConcurrentPhase(pstrConc, astrWork, pstrBench->nThreads, 2, alnOrder, &strPhase);
+   ReportBenchPhase(pstrBench, &strPhase);
+
+
+   FreeConcurrentTable(pstrConc);
+
+   free(pszKeys);
+   free(anOffsets);
+   free(alnOrder);
+   free(anLatency);
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: RunConcurrentPhase
+ * Params:   pstrConc - concurrent hash table
+ *           astrWork - share of each thread, with the table, keys and latency
+ *                      array filled in
+ *           nThreads - number of threads to run
+ *           nPhase - 0 insert, 1 mixed, 2 delete
+ *           alnOrder - key of each operation, NULL for keys 0 to lnOps-1
+ *           pstrPhase - lnOps set, receives the rest of the result
+ * Returns:  0
+ * Call by:  RunConcurrentBenchmark()
+ * Call to:  BenchConcurrentThread(), through pthread_create()
+ *           BenchTime()
+ *           GetConcurrentInfo()
+ * Overview: Splits the lnOps operations into nThreads contiguous shares, starts
+ *           one thread per share, and times from the moment all threads are
+ *           ready until the last one is done.
+ * Notes:    Exits when a thread cannot be started, because the threads already
+ *           started wait on the barrier for it.
+ ********************************************************************************/
+int RunConcurrentPhase(strConcurrentHash *pstrConc, strBenchThread *astrWork, int nThreads,
+                       int nPhase, const long *alnOrder, strBenchPhase *pstrPhase)
+{
+   int                nThread  = 0;
+   int                nError   = 0;
+   unsigned long      ulStart  = 0;
+   pthread_t          aThreads[HASH_MAX_THREADS];
+   pthread_barrier_t  strBarrier;
+   strHashInfo        strInfo;
+
+
+
+   pthread_barrier_init(&strBarrier, NULL, nThreads + 1);
+
+   for (nThread=0; nThread<nThreads; nThread++)
+   {
+      astrWork[nThread].pstrBarrier = &strBarrier;
+      astrWork[nThread].alnOrder    = alnOrder;
+      astrWork[nThread].nPhase      = nPhase;
+      astrWork[nThread].lnFirst     = pstrPhase->lnOps * nThread / nThreads;
+      astrWork[nThread].lnLast      = pstrPhase->lnOps * (nThread + 1) / nThreads;
+      astrWork[nThread].lnSucceeded = 0;
+
+      if ((nError = pthread_create(&aThreads[nThread], NULL, BenchConcurrentThread,
+                                   &astrWork[nThread])) != 0)
+      {
+         fprintf(stderr, "Failed pthread_create() in RunConcurrentPhase(). errno=%d.\n",
+                 nError);
+         exit(-1);
+      }
+   }
+
+   pthread_barrier_wait(&strBarrier);
+   ulStart = BenchTime();
+
+   for (nThread=0; nThread<nThreads; nThread++)
+   {
+      pthread_join(aThreads[nThread], NULL);
+   }
+
+   pstrPhase->dSeconds = (BenchTime() - ulStart) / 1e9;
+
+   pthread_barrier_destroy(&strBarrier);
+
+
+   GetConcurrentInfo(pstrConc, &strInfo);
+
+   pstrPhase->lnSucceeded = 0;
+   pstrPhase->lnEntries   = strInfo.lnEntries;
+   pstrPhase->lnSize      = strInfo.lnSize;
+
+   for (nThread=0; nThread<nThreads; nThread++)
+   {
+      pstrPhase->lnSucceeded += astrWork[nThread].lnSucceeded;
+   }
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: RunKernelBenchmark
+ * Params:   pstrBench - workload of --bench
+ *           nHash - hash function of the table
+ *           aulSeed - key for siphash
+ * Returns:  0 - every row printed
+ *           <0 - cannot allocate memory
+ * Call by:  main()
+ * Call to:  BenchTime()
+ *           HashBytes()
+ *           HashKeys()
+ *           HashName()
+ *           KeyKernelName()
+ *           MakeBenchKeys()
+ *           MatchBytes()
+ *           SetKeyKernel()
+ * Overview: Times the two steps of a lookup that do not touch the table:
+ *           hashing the key and comparing it with the stored key.  The first
+ *           row is the plain way, strlen() and HashBytes() per key, then
+ *           strcmp().  Then each key compare kernel the processor has gets a
+ *           row, hashing HASH_BENCH_BATCH keys per HashKeys() call and
+ *           comparing with MatchBytes() and the lengths HashKeys() measured.
+ *           Each row is one line of JSON with the nanoseconds per key.
+ * Notes:    Keys are compared with an equal copy at another address, as on a
+ *           search that finds its key, so every byte is compared.  matched
+ *           is the fewer of the keys hashed as in the first row and the keys
+ *           compared equal, and should always be keys.  The best kernel is in
+ *           use again at the end.
+ ********************************************************************************/
+int RunKernelBenchmark(const strBenchOptions *pstrBench, hashfn nHash,
+                       const unsigned long *aulSeed)
+{
+   char           *pszKeys     = NULL;
+   char           *pszCopy     = NULL;
+   size_t         *anOffsets   = NULL;
+   const char    **apszKeys    = NULL;
+   const char    **apszCopy    = NULL;
+   unsigned long  *aulBase     = NULL;
+   unsigned long  *aulHash     = NULL;
+   size_t         *anLength    = NULL;
+   long            lnKeys      = pstrBench->lnKeys;
+   long            lnIndex     = 0;
+   long            lnMatched   = 0;
+   long            lnEqual     = 0;
+   int             nKeys       = 0;
+   keykernel       nKernel     = KERNEL_SCALAR;
+   size_t          nSize       = 0;
+   unsigned long   ulStart     = 0;
+   double          dHashNs     = 0;
+   double          dCompareNs  = 0;
+
+
+
+   if (MakeBenchKeys(pstrBench, &pszKeys, &anOffsets) != 0)
+   {
+      return(-1);
+   }
+
+   nSize    = anOffsets[lnKeys - 1] + strlen(pszKeys + anOffsets[lnKeys - 1]) + 1;
+   pszCopy  = (char *) malloc(nSize);
+   apszKeys = (const char **) malloc(lnKeys * sizeof(char *));
+   apszCopy = (const char **) malloc(lnKeys * sizeof(char *));
+   aulBase  = (unsigned long *) malloc(lnKeys * sizeof(unsigned long));
+   aulHash  = (unsigned long *) malloc(lnKeys * sizeof(unsigned long));
+   anLength = (size_t *) malloc(lnKeys * sizeof(size_t));
+
+   if (pszCopy == NULL || apszKeys == NULL || apszCopy == NULL || aulBase == NULL ||
+       aulHash == NULL || anLength == NULL)
+   {
+      fprintf(stderr, "Failed malloc() in RunKernelBenchmark(). errno=%d.\n", errno);
+      free(pszKeys);
+      free(anOffsets);
+      free(pszCopy);
+      free(apszKeys);
+      free(apszCopy);
+      free(aulBase);
+      free(aulHash);
+      free(anLength);
+      return(-1);
+   }
+
+   memcpy(pszCopy, pszKeys, nSize);
+   memset(aulBase, 0, lnKeys * sizeof(unsigned long));  /* Fault pages in now  */
+   memset(aulHash, 0, lnKeys * sizeof(unsigned long));
+   memset(anLength, 0, lnKeys * sizeof(size_t));
+
+   for (lnIndex=0; lnIndex<lnKeys; lnIndex++)
+   {
+      apszKeys[lnIndex] = pszKeys + anOffsets[lnIndex];
+      apszCopy[lnIndex] = pszCopy + anOffsets[lnIndex];
+   }
+
+
+   /****************************************************************************
+    * strlen(), HashBytes() and strcmp(), one key at a time, after an untimed
+    * pass over the keys, so the first row does not pay for cold caches.
+    ****************************************************************************/
+   for (lnIndex=0; lnIndex<lnKeys; lnIndex+=nKeys)
+   {
+      nKeys = lnKeys - lnIndex < HASH_BENCH_BATCH ? (int) (lnKeys - lnIndex)
+                                                  : HASH_BENCH_BATCH;
+      HashKeys(nHash, aulSeed, &apszKeys[lnIndex], nKeys, &aulHash[lnIndex],
+               &anLength[lnIndex]);
+   }
+
+   for (lnIndex=0; lnIndex<lnKeys; lnIndex++)
+   {
+      lnEqual += strcmp(apszKeys[lnIndex], apszCopy[lnIndex]) == 0 &&
+                 MatchBytes(apszKeys[lnIndex], apszCopy[lnIndex], anLength[lnIndex]);
+   }
+
+   lnEqual = 0;
+   ulStart = BenchTime();
+
+   for (lnIndex=0; lnIndex<lnKeys; lnIndex++)
+   {
+      aulBase[lnIndex] = HashBytes(nHash, aulSeed, apszKeys[lnIndex],
+                                   strlen(apszKeys[lnIndex]));
+   }
+
+   dHashNs = (double) (BenchTime() - ulStart) / lnKeys;
+   ulStart = BenchTime();
+
+   for (lnIndex=0; lnIndex<lnKeys; lnIndex++)
+   {
+      lnEqual += strcmp(apszKeys[lnIndex], apszCopy[lnIndex]) == 0;
+   }
+
+   dCompareNs = (double) (BenchTime() - ulStart) / lnKeys;
+
+   printf("{\"phase\":\"kernel\",\"kernel\":\"strcmp\",\"hash\":\"%s\",\"keys\":%ld,"
+          "\"key_min\":%d,\"key_max\":%d,\"hash_ns\":%.2f,\"compare_ns\":%.2f,"
+          "\"matched\":%ld}\n",
+          HashName(nHash), lnKeys, pstrBench->nKeyMin, pstrBench->nKeyMax,
+          dHashNs, dCompareNs, lnEqual);
+
+
+   /****************************************************************************
+    * HashKeys() and MatchBytes() with each kernel.  A kernel the processor
+    * lacks comes back lowered, and is skipped.
+    ****************************************************************************/
+   for (nKernel=KERNEL_SCALAR; KeyKernelName(nKernel) != NULL; nKernel++)
+   {
+      if (SetKeyKernel(nKernel) != nKernel)
+      {
+         continue;
+      }
+
+      ulStart = BenchTime();
+
+      for (lnIndex=0; lnIndex<lnKeys; lnIndex+=nKeys)
+      {
+         nKeys = lnKeys - lnIndex < HASH_BENCH_BATCH ? (int) (lnKeys - lnIndex)
+                                                     : HASH_BENCH_BATCH;
+         HashKeys(nHash, aulSeed, &apszKeys[lnIndex], nKeys, &aulHash[lnIndex],
+                  &anLength[lnIndex]);
+      }
+
+      dHashNs = (double) (BenchTime() - ulStart) / lnKeys;
+      lnEqual = 0;
+      ulStart = BenchTime();
+
+      for (lnIndex=0; lnIndex<lnKeys; lnIndex++)
+      {
+         lnEqual += MatchBytes(apszKeys[lnIndex], apszCopy[lnIndex], anLength[lnIndex]);
+      }
+
+      dCompareNs = (double) (BenchTime() - ulStart) / lnKeys;
+      lnMatched  = 0;
+
+      for (lnIndex=0; lnIndex<lnKeys; lnIndex++)
+      {
+         lnMatched += aulHash[lnIndex] == aulBase[lnIndex];
+      }
+
+      printf("{\"phase\":\"kernel\",\"kernel\":\"%s\",\"hash\":\"%s\",\"keys\":%ld,"
+             "\"key_min\":%d,\"key_max\":%d,\"hash_ns\":%.2f,\"compare_ns\":%.2f,"
+             "\"matched\":%ld}\n",
+             KeyKernelName(nKernel), HashName(nHash), lnKeys, pstrBench->nKeyMin,
+             pstrBench->nKeyMax, dHashNs, dCompareNs,
+             lnMatched < lnEqual ? lnMatched : lnEqual);
+   }
+
+   SetKeyKernel(KERNEL_AVX2);
+   fflush(stdout);
+
+
+   free(pszKeys);
+   free(anOffsets);
+   free(pszCopy);
+   free(apszKeys);
+   free(apszCopy);
+   free(aulBase);
+   free(aulHash);
+   free(anLength);
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: RunReplay
+ * Params:   pstrHash - hash table, with the keys of --snapshot, --load and
+ *                      --batch if given
+ *           pszFile - trace written with --trace
+ *           bPaced - TRUE to keep the times of the trace, FALSE to run the
+ *                    operations back to back
+ * Returns:  0 - trace replayed, up to a torn record at its end if any
+ *           <0 - cannot read the trace or allocate memory
+ * Call by:  main()
+ * Call to:  AddEntryToHashTable()
+ *           BenchTime()
+ *           CompareLatency()
+ *           DeleteEntryFromHashTable()
+ *           GetHashInfo()
+ *           HashName()
+ *           MapHashTrace()
+ *           NextTraceRecord()
+ *           PutEntryInHashTable()
+ *           SearchHashTable()
+ *           UnmapHashTrace()
+ * Overview: Runs every operation of the trace on the table, timing each one,
+ *           then prints one line of JSON with the operations of each kind,
+ *           the throughput, the latency percentiles and the chain nodes (or
+ *           open addressing groups) walked per search, so one captured
+ *           workload can be compared across --hashsize, --engine, --hash,
+ *           --filter and cache settings.  --stats then gives the histogram.
+ * Notes:    With bPaced, each operation waits until its time in the trace has
+ *           passed since the replay started; an operation that is already late
+ *           runs at once, so a slow table falls behind instead of dropping
+ *           operations.  Waits longer than HASH_REPLAY_SPIN ns sleep, shorter
+ *           ones spin.  The wait is not part of the latency.
+ ********************************************************************************/
+int RunReplay(strHash *pstrHash, const char *pszFile, boolean bPaced)
+{
+   int              nReturnCode = 0;
+   long             lnOps       = 0;
+   long             lnFound     = 0;
+   long             lnCapacity  = 65536;
+   long             alnKind[TRACE_PUT+1];
+   unsigned int    *anLatency   = NULL;
+   unsigned int    *anGrown     = NULL;
+   unsigned long    ulStart     = 0;
+   unsigned long    ulLast      = 0;
+   unsigned long    ulNow       = 0;
+   unsigned long    ulDue       = 0;
+   unsigned long    ulTraced    = 0;
+   double           dSeconds    = 0;
+   strHashTrace    *pstrTrace   = NULL;
+   strTraceRecord   strRecord;
+   strHashInfo      strBefore;
+   strHashInfo      strInfo;
+   struct timespec  strWait;
+   struct rusage    strUsage;
+
+
+
+   if ((pstrTrace = MapHashTrace(pszFile)) == NULL)
+   {
+      return(-1);
+   }
+
+   if ((anLatency = (unsigned int *) malloc(lnCapacity * sizeof(unsigned int))) == NULL)
+   {
+      fprintf(stderr, "Failed malloc() in RunReplay(). errno=%d.\n", errno);
+      UnmapHashTrace(pstrTrace);
+      return(-1);
+   }
+
+   memset(alnKind, 0, sizeof(alnKind));
+   GetHashInfo(pstrHash, &strBefore);
+
+   ulStart = BenchTime();
+   ulLast  = ulStart;
+   ulNow   = ulStart;
+
+   while ((nReturnCode = NextTraceRecord(pstrTrace, &strRecord)) > 0)
+   {
+      if (lnOps == lnCapacity)
+      {
+         if ((anGrown = (unsigned int *) realloc(anLatency, lnCapacity * 2 *
+                                                 sizeof(unsigned int))) == NULL)
+         {
+            fprintf(stderr, "Failed realloc() in RunReplay(). errno=%d.\n", errno);
+            free(anLatency);
+            UnmapHashTrace(pstrTrace);
+            return(-1);
+         }
+
+         anLatency  = anGrown;
+         lnCapacity = lnCapacity * 2;
+      }
+
+      if (bPaced == TRUE)
+      {
+         ulDue = ulStart + strRecord.ulTime;
+
+         while ((ulNow = BenchTime()) < ulDue)
+         {
+            if (ulDue - ulNow > HASH_REPLAY_SPIN)
+            {
+               strWait.tv_sec  = (ulDue - ulNow - HASH_REPLAY_SPIN) / 1000000000UL;
+               strWait.tv_nsec = (ulDue - ulNow - HASH_REPLAY_SPIN) % 1000000000UL;
+               nanosleep(&strWait, NULL);
+            }
+         }
+
+         ulLast = ulNow;
+      }
+
+      switch (strRecord.nOp)
+      {
+         case TRACE_ADD:
+            lnFound += AddEntryToHashTable(pstrHash, strRecord.pszData) == 0;
+            break;
+
+         case TRACE_SEARCH:
+            lnFound += SearchHashTable(pstrHash, strRecord.pszData, NULL) >= 0;
+            break;
+
+         case TRACE_DELETE:
+            lnFound += DeleteEntryFromHashTable(pstrHash, strRecord.pszData) == 0;
+            break;
+
+         case TRACE_PUT:
+            lnFound += PutEntryInHashTable(pstrHash, strRecord.pszData, strRecord.pchValue,
+                                           strRecord.nValueLength) >= 0;
+            break;
+      }
+
+      ulNow            = BenchTime();
+      anLatency[lnOps] = (unsigned int) (ulNow - ulLast);
+      ulLast           = ulNow;
+      ulTraced         = strRecord.ulTime;
+
+      alnKind[strRecord.nOp]++;
+      lnOps++;
+   }
+
+   if (nReturnCode < 0)
+   {
+      fprintf(stderr, "Trace [%s] ends in a torn record after %ld records.\n", pszFile,
+              lnOps);
+   }
+
+   dSeconds = (ulNow - ulStart) / 1e9;
+
+   UnmapHashTrace(pstrTrace);
+
+
+   /****************************************************************************
+    * The chain walk is taken from the counters of the table, so it only counts
+    * the searches of the replay.
+    ****************************************************************************/
+   qsort(anLatency, lnOps, sizeof(unsigned int), CompareLatency);
+   GetHashInfo(pstrHash, &strInfo);
+   getrusage(RUSAGE_SELF, &strUsage);
+
+   printf("{\"phase\":\"replay\",\"engine\":\"%s\",\"hash\":\"%s\",\"pace\":\"%s\","
+          "\"ops\":%ld,\"adds\":%ld,\"searches\":%ld,\"deletes\":%ld,\"puts\":%ld,"
+          "\"succeeded\":%ld,\"trace_seconds\":%.6f,\"seconds\":%.6f,\"ops_per_sec\":%.0f,"
+          "\"p50_ns\":%u,\"p99_ns\":%u,\"p999_ns\":%u,\"max_ns\":%u,"
+          "\"walked_per_search\":%.3f,\"entries\":%ld,\"size\":%ld,\"max_rss_kb\":%ld}\n",
+          strInfo.nEngine == ENGINE_OPEN ? "open" : "chain",
+          HashName(strInfo.nHash),
+          bPaced == TRUE ? "original" : "fast",
+          lnOps,
+          alnKind[TRACE_ADD],
+          alnKind[TRACE_SEARCH],
+          alnKind[TRACE_DELETE],
+          alnKind[TRACE_PUT],
+          lnFound,
+          ulTraced / 1e9,
+          dSeconds,
+          dSeconds > 0 ? lnOps / dSeconds : 0,
+          lnOps > 0 ? anLatency[lnOps * 50 / 100] : 0,
+          lnOps > 0 ? anLatency[lnOps * 99 / 100] : 0,
+          lnOps > 0 ? anLatency[lnOps * 999 / 1000] : 0,
+          lnOps > 0 ? anLatency[lnOps - 1] : 0,
+          strInfo.lnHits + strInfo.lnMisses > strBefore.lnHits + strBefore.lnMisses ?
+             (double) (strInfo.lnWalked - strBefore.lnWalked) /
+             (strInfo.lnHits + strInfo.lnMisses - strBefore.lnHits - strBefore.lnMisses) : 0,
+          strInfo.lnEntries,
+          strInfo.lnSize,
+          strUsage.ru_maxrss);
+
+   fflush(stdout);
+
+   free(anLatency);
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: RunServer
+ * Params:   pstrHash - hash table to serve
+ *           pszListen - Unix socket path to listen on, or NULL
+ *           nPort - loopback TCP port to listen on, or 0
+ *           lnSyncMs - milliseconds after which an idle server syncs the
+ *                      journal, or 0
+ * Returns:  0 - served until SIGINT or SIGTERM
+ *           <0 - cannot listen, or cannot set up epoll
+ * Call by:  main()
+ * Call to:  BenchTime()
+ *           GetHashInfo()
+ *           ServerAccept()
+ *           ServerClose()
+ *           ServerFlush()
+ *           ServerListen()
+ *           ServerRead()
+ *           SyncHashJournal()
+ * Overview: Runs the table as a server on one thread: an epoll loop over the
+ *           listening sockets, the client connections and a signalfd for
+ *           SIGINT and SIGTERM.  Each request is one line, and its reply is one
+ *           line too, see ServerCommand().  A client may send many requests
+ *           without waiting for the replies; all the requests of one read are
+ *           answered, then their replies are sent together.
+ * Notes:    Only one thread touches the table, so it needs no lock.  The
+ *           socket file is removed before binding and again at exit.  At exit,
+ *           prints the connections and requests served.
+ *           The signal that stopped the server is read from the signalfd, and
+ *           SIGINT and SIGTERM stay blocked after the return, so main() can
+ *           still save the table and close the journal.
+ *           Changes waiting for a group commit are synced once no request
+ *           has come for lnSyncMs, so they do not wait for the next change.
+ ********************************************************************************/
+int RunServer(strHash *pstrHash, const char *pszListen, int nPort, long lnSyncMs)
+{
+   int                      nReturnCode = 0;
+   int                      nSignal     = -1;
+   int                      nEvents     = 0;
+   int                      nEvent      = 0;
+   int                      nTimeout    = -1;
+   boolean                  bStop       = FALSE;
+   unsigned long            ulStart     = 0;
+   double                   dSeconds    = 0;
+   strServerConn           *pstrConn    = NULL;
+   strServer                strServer;
+   strServerConn            astrListen[2];
+   sigset_t                 strSignals;
+   struct epoll_event       strEvent;
+   struct epoll_event       astrEvents[HASH_SERVER_EVENTS];
+   struct signalfd_siginfo  strSignal;
+   strHashInfo              strInfo;
+
+
+
+   memset(&strServer, 0, sizeof(strServer));
+   memset(astrListen, 0, sizeof(astrListen));
+
+   strServer.pstrHash      = pstrHash;
+   astrListen[0].nSocket   = -1;
+   astrListen[1].nSocket   = -1;
+   astrListen[0].bListener = TRUE;
+   astrListen[1].bListener = TRUE;
+
+
+   /****************************************************************************
+    * The signals are blocked and read from a signalfd, so stopping is just one
+    * more event of the loop.
+    ****************************************************************************/
+   sigemptyset(&strSignals);
+   sigaddset(&strSignals, SIGINT);
+   sigaddset(&strSignals, SIGTERM);
+   signal(SIGPIPE, SIG_IGN);
+
+   if ((strServer.nEpoll = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+       pthread_sigmask(SIG_BLOCK, &strSignals, NULL) != 0 ||
+       (nSignal = signalfd(-1, &strSignals, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+   {
+      fprintf(stderr, "Cannot set up epoll. errno=%d.\n", errno);
+      nReturnCode = -1;
+   }
+
+   if (nReturnCode == 0 && pszListen != NULL &&
+       (astrListen[0].nSocket = ServerListen(pszListen, 0)) < 0)
+   {
+      nReturnCode = -1;
+   }
+
+   if (nReturnCode == 0 && nPort != 0 &&
+       (astrListen[1].nSocket = ServerListen(NULL, nPort)) < 0)
+   {
+      nReturnCode = -1;
+   }
+
+   memset(&strEvent, 0, sizeof(strEvent));
+   strEvent.events   = EPOLLIN;
+   strEvent.data.ptr = NULL;
+
+   if (nReturnCode == 0 && epoll_ctl(strServer.nEpoll, EPOLL_CTL_ADD, nSignal, &strEvent) != 0)
+   {
+      nReturnCode = -1;
+   }
+
+   for (nEvent=0; nEvent<2 && nReturnCode == 0; nEvent++)
+   {
+      strEvent.data.ptr = &astrListen[nEvent];
+
+      if (astrListen[nEvent].nSocket >= 0 &&
+          epoll_ctl(strServer.nEpoll, EPOLL_CTL_ADD, astrListen[nEvent].nSocket, &strEvent) != 0)
+      {
+         fprintf(stderr, "Failed epoll_ctl() in RunServer(). errno=%d.\n", errno);
+         nReturnCode = -1;
+      }
+   }
+
+   if (nReturnCode == 0)
+   {
+      printf("Serving %s%s%s", pszListen != NULL ? "[" : "", pszListen != NULL ? pszListen : "",
+             pszListen != NULL ? "]" : "");
+
+      if (nPort != 0)
+      {
+         printf("%s127.0.0.1:%d", pszListen != NULL ? " and " : "", nPort);
+      }
+
+      printf(", stop with Ctrl-C\n");
+      fflush(stdout);
+   }
+
+
+   ulStart = BenchTime();
+
+   while (nReturnCode == 0 && bStop == FALSE)
+   {
+      GetHashInfo(pstrHash, &strInfo);
+
+      nTimeout = (lnSyncMs > 0 && strInfo.lnUnsynced > 0) ? (int) lnSyncMs : -1;
+
+      if ((nEvents = epoll_wait(strServer.nEpoll, astrEvents, HASH_SERVER_EVENTS,
+                                nTimeout)) < 0)
+      {
+         if (errno != EINTR)
+         {
+            fprintf(stderr, "Failed epoll_wait() in RunServer(). errno=%d.\n", errno);
+            nReturnCode = -1;
+         }
+
+         continue;
+      }
+
+      if (nEvents == 0)
+      {
+         SyncHashJournal(pstrHash);           /* Idle, sync the last group       */
+      }
+
+      for (nEvent=0; nEvent<nEvents; nEvent++)
+      {
+         pstrConn = (strServerConn *) astrEvents[nEvent].data.ptr;
+
+         if (pstrConn == NULL)
+         {
+            while (read(nSignal, &strSignal, sizeof(strSignal)) == sizeof(strSignal))
+            {
+               ;                              /* Taken, so it is not delivered   */
+            }
+
+            bStop = TRUE;                     /* SIGINT or SIGTERM               */
+         }
+         else if (pstrConn->bListener == TRUE)
+         {
+            ServerAccept(&strServer, pstrConn);
+         }
+         else if ((astrEvents[nEvent].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) != 0 &&
+                  ServerRead(&strServer, pstrConn) != 0)
+         {
+            ;                                 /* Connection closed               */
+         }
+         else if ((astrEvents[nEvent].events & EPOLLOUT) != 0)
+         {
+            ServerFlush(&strServer, pstrConn);
+         }
+      }
+   }
+
+   dSeconds = (BenchTime() - ulStart) / 1e9;
+
+
+   while (strServer.pstrConns != NULL)
+   {
+      ServerClose(&strServer, strServer.pstrConns);
+   }
+
+   for (nEvent=0; nEvent<2; nEvent++)
+   {
+      if (astrListen[nEvent].nSocket >= 0)
+      {
+         close(astrListen[nEvent].nSocket);
+      }
+   }
+
+   if (astrListen[0].nSocket >= 0)
+   {
+      unlink(pszListen);
+   }
+
+   if (nSignal >= 0)
+   {
+      close(nSignal);
+   }
+
+   if (strServer.nEpoll >= 0)
+   {
+      close(strServer.nEpoll);
+   }
+
+   if (nReturnCode == 0)
+   {
+      printf("Served %ld connections, %ld requests in %.3f seconds, %.0f requests/sec\n",
+             strServer.lnConnections,
+             strServer.lnRequests,
+             dSeconds,
+             dSeconds > 0 ? strServer.lnRequests / dSeconds : 0);
+   }
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: RunShared
+ * Params:   pstrHash - hash table, only its hash function and seed are used
+ *           pstrRunOptions - options from the command line
+ * Returns:  0 - files processed
+ *           <0 - cannot open the shared table, or read a file
+ * Call by:  main()
+ * Call to:  CloseSharedTable()
+ *           GetHashInfo()
+ *           GetSharedInfo()
+ *           HashName()
+ *           OpenSharedTable()
+ *           RemoveSharedTable()
+ *           RunBatch()
+ * Overview: Creates the shared table of --shared, or attaches to it when
+ *           another process already did, then runs --load and --batch on it
+ *           and prints what this process saw of it.
+ * Notes:    Any number of processes can run at the same time on the same
+ *           table.  The table outlives them, unless --shared-remove is given.
+ ********************************************************************************/
+int RunShared(const strHash *pstrHash, const strCommandLine *pstrRunOptions)
+{
+   int            nReturnCode = 0;
+   boolean        bCreated    = FALSE;
+   strSharedHash *pstrShared  = NULL;
+   strHashInfo    strInfo;
+
+
+
+   GetHashInfo(pstrHash, &strInfo);
+
+   pstrShared = OpenSharedTable(pstrRunOptions->pszShared, strInfo.nHash, strInfo.aulSeed,
+                                pstrRunOptions->lnSharedKeys, pstrRunOptions->nSharedKeyLen,
+                                &bCreated);
+
+   if (pstrShared == NULL)
+   {
+      return(-1);
+   }
+
+   GetSharedInfo(pstrShared, &strInfo);
+
+   printf("%s shared table [%s]: %ld keys of %ld, %ld buckets, hash %s\n",
+          bCreated == TRUE ? "Created" : "Attached to",
+          pstrRunOptions->pszShared,
+          strInfo.lnEntries,
+          strInfo.lnCapacity,
+          strInfo.lnSize,
+          HashName(strInfo.nHash));
+
+
+   if (pstrRunOptions->pszLoad != NULL)
+   {
+      nReturnCode = RunBatch(NULL, pstrShared, pstrRunOptions->pszLoad, TRUE);
+   }
+
+   if (pstrRunOptions->pszBatch != NULL && nReturnCode == 0)
+   {
+      nReturnCode = RunBatch(NULL, pstrShared, pstrRunOptions->pszBatch, FALSE);
+   }
+
+   GetSharedInfo(pstrShared, &strInfo);
+
+   printf("Shared table [%s]: %ld keys of %ld, %ld inserts, %ld deletes\n",
+          pstrRunOptions->pszShared,
+          strInfo.lnEntries,
+          strInfo.lnCapacity,
+          strInfo.lnInserts,
+          strInfo.lnDeletes);
+   printf("   found %ld, not found %ld, nodes walked %ld, dead writers recovered %ld\n",
+          strInfo.lnHits, strInfo.lnMisses, strInfo.lnWalked, strInfo.lnRecovered);
+
+   CloseSharedTable(pstrShared);
+
+   if (pstrRunOptions->bSharedRemove == TRUE && RemoveSharedTable(pstrRunOptions->pszShared) != 0)
+   {
+      nReturnCode = -1;
+   }
+
+
+   return(nReturnCode);
+}
+
+
+
+
+/********************************************************************************
+ * Function: RunTypedBenchmark
+ * Params:   pstrBench - workload of --bench, with nKeyType KEYTYPE_U64 or
+ *                       KEYTYPE_UUID
+ *           ulSeed - seed of the table, 0 for a random one
+ * Returns:  0 - benchmark run
+ *           <0 - cannot allocate memory
+ * Call by:  main()
+ * Call to:  BenchRandom()
+ *           BenchTime()
+ *           CreateU64Table()
+ *           CreateUuidTable()
+ *           DeleteU64Entry()
+ *           DeleteUuidEntry()
+ *           FreeU64Table()
+ *           FreeUuidTable()
+ *           GetU64Info()
+ *           GetUuidInfo()
+ *           MakeBenchSearches()
+ *           PutU64Entry()
+ *           PutUuidEntry()
+ *           ReportBenchPhase()
+ *           SearchU64Table()
+ *           SearchUuidTable()
+ *           ShuffleBenchKeys()
+ * Overview: The three phases of RunBenchmark() on a typed table, so the cost
+ *           of string keys can be compared with word keys on the same
+ *           workload.  Keys are random 64 bit IDs, or UUIDs of two random
+ *           words, and each key's value is its index.  The engine of the JSON
+ *           lines is u64 or uuid, and the key length is 8 or 16 bytes.
+ * Notes:    The table starts at HASH_TYPED_MIN_SIZE slots and grows as the
+ *           keys go in, as a string table does.  Random keys may repeat, once
+ *           in about 2^64 / lnKeys^2 runs.
+ ********************************************************************************/
+int RunTypedBenchmark(const strBenchOptions *pstrBench, unsigned long ulSeed)
+{
+   strUuid         *astrKeys    = NULL;
+   long            *alnOrder    = NULL;
+   unsigned int    *anLatency   = NULL;
+   strU64Hash      *pstrU64     = NULL;
+   strUuidHash     *pstrUuid    = NULL;
+   boolean          bU64        = pstrBench->nKeyType == KEYTYPE_U64;
+   long             lnOps       = pstrBench->lnOps;
+   long             lnIndex     = 0;
+   long             lnSucceeded = 0;
+   unsigned long    ulState     = pstrBench->ulSeed ^ 0x5deece66dUL;
+   unsigned long    ulValue     = 0;
+   unsigned long    ulLast      = 0;
+   unsigned long    ulStart     = 0;
+   unsigned long    ulNow       = 0;
+   strBenchOptions  strBench    = *pstrBench;
+   strBenchPhase    strPhase;
+   strTypedInfo     strInfo;
+   struct rusage    strUsage;
+
+
+
+   if (lnOps < pstrBench->lnKeys)
+   {
+      lnOps = pstrBench->lnKeys;              /* Arrays also serve the deletes  */
+   }
+
+   astrKeys  = (strUuid *) malloc(pstrBench->lnKeys * 2 * sizeof(strUuid));
+   alnOrder  = (long *) malloc(lnOps * sizeof(long));
+   anLatency = (unsigned int *) malloc(lnOps * sizeof(unsigned int));
+
+   if (bU64 == TRUE)
+   {
+      pstrU64 = CreateU64Table(ulSeed, 0);
+   }
+   else
+   {
+      pstrUuid = CreateUuidTable(ulSeed, 0);
+   }
+
+   if (astrKeys == NULL || alnOrder == NULL || anLatency == NULL ||
+       (pstrU64 == NULL && pstrUuid == NULL) ||
+       MakeBenchSearches(pstrBench, alnOrder, &ulState) != 0)
+   {
+      fprintf(stderr, "Failed malloc() in RunTypedBenchmark(). errno=%d.\n", errno);
+      free(astrKeys);
+      free(alnOrder);
+      free(anLatency);
+      FreeU64Table(pstrU64);
+      FreeUuidTable(pstrUuid);
+      return(-1);
+   }
+
+
+   /****************************************************************************
+    * The U64 table uses the first word of each key.
+    ****************************************************************************/
+   for (lnIndex=0; lnIndex<pstrBench->lnKeys*2; lnIndex++)
+   {
+      astrKeys[lnIndex].aulWord[0] = BenchRandom(&ulState);
+      astrKeys[lnIndex].aulWord[1] = BenchRandom(&ulState);
+   }
+
+   strBench.nKeyMin = bU64 == TRUE ? sizeof(unsigned long) : sizeof(strUuid);
+   strBench.nKeyMax = strBench.nKeyMin;
+
+   getrusage(RUSAGE_SELF, &strUsage);
+
+   memset(&strPhase, 0, sizeof(strBenchPhase));
+   strPhase.pszEngine  = bU64 == TRUE ? "u64" : "uuid";
+   strPhase.nHash      = HASHFN_WYHASH;
+   strPhase.nThreads   = 1;
+   strPhase.anLatency  = anLatency;
+   strPhase.lnStartRss = strUsage.ru_maxrss;
+
+
+   /****************************************************************************
+    * Insert.
+    ****************************************************************************/
+   ulStart = BenchTime();
+   ulLast  = ulStart;
+   ulNow   = ulStart;
+
+   for (lnIndex=0; lnIndex<pstrBench->lnKeys; lnIndex++)
+   {
+      if (bU64 == TRUE)
+      {
+         lnSucceeded += PutU64Entry(pstrU64, astrKeys[lnIndex].aulWord[0], lnIndex) == 0;
+      }
+      else
+      {
+         lnSucceeded += PutUuidEntry(pstrUuid, astrKeys[lnIndex], lnIndex) == 0;
+      }
+
+      ulNow              = BenchTime();
+      anLatency[lnIndex] = (unsigned int) (ulNow - ulLast);
+      ulLast             = ulNow;
+   }
+
+   strPhase.pszPhase    = "insert";
+   strPhase.lnOps       = pstrBench->lnKeys;
+   strPhase.lnSucceeded = lnSucceeded;
+   strPhase.dSeconds    = (ulNow - ulStart) / 1e9;
+
+   if (bU64 == TRUE)
+   {
+      GetU64Info(pstrU64, &strInfo);
+   }
+   else
+   {
+      GetUuidInfo(pstrUuid, &strInfo);
+   }
+
+   strPhase.lnEntries   = strInfo.lnEntries;
+   strPhase.lnSize      = strInfo.lnSize;
+   ReportBenchPhase(&strBench, &strPhase);
+
+
+   /****************************************************************************
+    * Search.
+    ****************************************************************************/
+   lnSucceeded = 0;
+   ulStart     = BenchTime();
+   ulLast      = ulStart;
+   ulNow       = ulStart;
+
+   for (lnIndex=0; lnIndex<pstrBench->lnOps; lnIndex++)
+   {
+      if (bU64 == TRUE)
+      {
+         lnSucceeded += SearchU64Table(pstrU64, astrKeys[alnOrder[lnIndex]].aulWord[0],
+                                       &ulValue) >= 0;
+      }
+      else
+      {
+         lnSucceeded += SearchUuidTable(pstrUuid, astrKeys[alnOrder[lnIndex]], &ulValue) >= 0;
+      }
+
+      ulNow              = BenchTime();
+      anLatency[lnIndex] = (unsigned int) (ulNow - ulLast);
+      ulLast             = ulNow;
+   }
+
+   strPhase.pszPhase    = "search";
+   strPhase.lnOps       = pstrBench->lnOps;
+   strPhase.lnSucceeded = lnSucceeded;
+   strPhase.dSeconds    = (ulNow - ulStart) / 1e9;
+   ReportBenchPhase(&strBench, &strPhase);
+
+
+   /****************************************************************************
+    * Delete, in a shuffled order.
+    ****************************************************************************/
+   ShuffleBenchKeys(alnOrder, pstrBench->lnKeys, &ulState);
+
+   lnSucceeded = 0;
+   ulStart     = BenchTime();
+   ulLast      = ulStart;
+   ulNow       = ulStart;
+
+   for (lnIndex=0; lnIndex<pstrBench->lnKeys; lnIndex++)
+   {
+      if (bU64 == TRUE)
+      {
+         lnSucceeded += DeleteU64Entry(pstrU64, astrKeys[alnOrder[lnIndex]].aulWord[0]) == 0;
+      }
+      else
+      {
+         lnSucceeded += DeleteUuidEntry(pstrUuid, astrKeys[alnOrder[lnIndex]]) == 0;
+      }
+
+      ulNow              = BenchTime();
+      anLatency[lnIndex] = (unsigned int) (ulNow - ulLast);
+      ulLast             = ulNow;
+   }
+
+   strPhase.pszPhase    = "delete";
+   strPhase.lnOps       = pstrBench->lnKeys;
+   strPhase.lnSucceeded = lnSucceeded;
+   strPhase.dSeconds    = (ulNow - ulStart) / 1e9;
+
+   if (bU64 == TRUE)
+   {
+      GetU64Info(pstrU64, &strInfo);
+   }
+   else
+   {
+      GetUuidInfo(pstrUuid, &strInfo);
+   }
+
+   strPhase.lnEntries   = strInfo.lnEntries;
+   strPhase.lnSize      = strInfo.lnSize;
+   ReportBenchPhase(&strBench, &strPhase);
+
+
+   free(astrKeys);
+   free(alnOrder);
+   free(anLatency);
+   FreeU64Table(pstrU64);
+   FreeUuidTable(pstrUuid);
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: SaveHashTable
+ * Params:   pstrHash - hash table
+ *           pszFile - snapshot file to write
+ * Returns:  0 - snapshot written
+ *           <0 - cannot write the snapshot
+ * Call by:  main()
+ * Call to:  GetHashInfo()
+ *           SaveSnapshot()
+ * Overview: Writes a snapshot of the table and tells the user how big it is.
+ * Notes:    The library does not print, so the message is printed here.
+ ********************************************************************************/
+int SaveHashTable(strHash *pstrHash, const char *pszFile)
+{
+   long        lnBytes = 0;
+   strHashInfo strInfo;
+
+
+
+   if ((lnBytes = SaveSnapshot(pstrHash, pszFile)) < 0)
+   {
+      return(-1);
+   }
+
+   GetHashInfo(pstrHash, &strInfo);
+
+   printf("Saved %ld entries to [%s], %ld bytes\n", strInfo.lnEntries, pszFile, lnBytes);
+
+
+   return(0);
 }
 
 
 
 
 /********************************************************************************
- * Function: ProcessCommandLine
- * Params:   pstrRunOptions - stores options read from the command line
- *           argc - number of command line parameters
- *           argv - each command line parameter is a string
- * Returns:  Pointer to strCommandLine with options from command line.
- * Call by:  main()
+ * Function: ServerAccept
+ * Params:   pstrServer - server state
+ *           pstrListen - listening socket with a connection waiting
+ * Returns:  Number of connections accepted
+ * Call by:  RunServer()
  * Call to:  None
- * Overview: Reads arguments from command line and fills options structure.
- *           Valid options are
- *           --debug (optional)
- *           --hashsize
- * Notes:    None
+ * Overview: Accepts every waiting connection, non-blocking, and adds it to the
+ *           list of connections and to epoll, waiting for requests.
+ * Notes:    Nagle's algorithm is turned off on TCP connections, since replies
+ *           are already sent in batches.  A connection that cannot be set up
+ *           is closed at once.
  ********************************************************************************/
-strCommandLine *ProcessCommandLine(strCommandLine *pstrRunOptions, int argc, char **argv)
+int ServerAccept(strServer *pstrServer, const strServerConn *pstrListen)
 {
-   int nIndex = 0;
+   int                nSocket   = -1;
+   int                nAccepted = 0;
+   int                nOn       = 1;
+   strServerConn     *pstrConn  = NULL;
+   struct epoll_event strEvent;
 
 
 
-   pstrRunOptions->bDebug      = FALSE;
-   pstrRunOptions->nBucketSize = 0;
+   while ((nSocket = accept(pstrListen->nSocket, NULL, NULL)) >= 0)
+   {
+      fcntl(nSocket, F_SETFL, fcntl(nSocket, F_GETFL) | O_NONBLOCK);
+      fcntl(nSocket, F_SETFD, FD_CLOEXEC);
+      setsockopt(nSocket, IPPROTO_TCP, TCP_NODELAY, &nOn, sizeof(nOn));
 
+      if ((pstrConn = calloc(1, sizeof(strServerConn))) == NULL)
+      {
+         fprintf(stderr, "Cannot allocate memory for a connection.\n");
+         close(nSocket);
+         continue;
+      }
 
-   for (nIndex=1; nIndex<argc; nIndex++)
-   {
-      if (strcmp(argv[nIndex], "--hashsize") == 0)
+      pstrConn->nSocket = nSocket;
+      pstrConn->nEvents = EPOLLIN;
+
+      memset(&strEvent, 0, sizeof(strEvent));
+      strEvent.events   = EPOLLIN;
+      strEvent.data.ptr = pstrConn;
+
+      if (epoll_ctl(pstrServer->nEpoll, EPOLL_CTL_ADD, nSocket, &strEvent) != 0)
       {
-         pstrRunOptions->nBucketSize = atoi(argv[nIndex+1]);
+         fprintf(stderr, "Failed epoll_ctl() in ServerAccept(). errno=%d.\n", errno);
+         close(nSocket);
+         free(pstrConn);
+         continue;
       }
-      else if (strcmp(argv[nIndex], "--debug") == 0)
+
+      pstrConn->pstrNext = pstrServer->pstrConns;
+
+      if (pstrServer->pstrConns != NULL)
       {
-         pstrRunOptions->bDebug = TRUE;
+         pstrServer->pstrConns->pstrPrev = pstrConn;
       }
+
+      pstrServer->pstrConns = pstrConn;
+      pstrServer->lnConnections++;
+      nAccepted++;
    }
 
 
-   return (pstrRunOptions);
+   return(nAccepted);
 }
 
 
 
 
 /********************************************************************************
- * Function: SearchHashTable
- * Params:   pastrHash
- *           nSize
- * Returns:  -1 - not found
- *           >0 - bucket index where found
- * Call by:  main()
+ * Function: ServerClose
+ * Params:   pstrServer - server state
+ *           pstrConn - client connection to close
+ * Returns:  None
+ * Call by:  RunServer()
+ *           ServerFlush()
+ *           ServerRead()
  * Call to:  None
- * Overview: Search a value in the hash table after finding the proper bucket.
- * Notes:    None
+ * Overview: Closes a client connection, takes it off the list of connections
+ *           and frees it.
+ * Notes:    Closing the socket also takes it out of epoll.  Replies not sent
+ *           yet are dropped.
  ********************************************************************************/
-int SearchHashTable(const strHashTable *pastrHash, int nSize, const char *pszData)
+void ServerClose(strServer *pstrServer, strServerConn *pstrConn)
 {
-   int           nChain      = 0;
-   int           nHashIndex  = 0;
-   int           nReturnCode = -1;
-   strHashTable *pstrCurrent = NULL;
+   if (pstrConn->pstrPrev != NULL)
+   {
+      pstrConn->pstrPrev->pstrNext = pstrConn->pstrNext;
+   }
+   else
+   {
+      pstrServer->pstrConns = pstrConn->pstrNext;
+   }
+
+   if (pstrConn->pstrNext != NULL)
+   {
+      pstrConn->pstrNext->pstrPrev = pstrConn->pstrPrev;
+   }
+
+   close(pstrConn->nSocket);
+
+   free(pstrConn->pchInput);
+   free(pstrConn->pchOutput);
+   free(pstrConn);
+}
 
 
 
-   Debug("Inside SearchHashTable()\n");
 
-   nHashIndex = HashFunction(nSize, pszData);
+/********************************************************************************
+ * Function: ServerCommand
+ * Params:   pstrServer - server state
+ *           pstrConn - client connection that sent the request
+ *           pszLine - one request, without the new line
+ * Returns:  0 - request answered
+ *           <0 - cannot allocate memory for the reply
+ * Call by:  ServerRead()
+ * Call to:  AddEntryToHashTable()
+ *           AddExpiringEntry()
+ *           DeleteEntryFromHashTable()
+ *           GetValueFromHashTable()
+ *           ListHashTable()
+ *           PutEntryInHashTable()
+ *           SearchHashTable()
+ *           ServerReply()
+ *           StatsHashTable()
+ * Overview: Runs one request and queues its reply.  Requests are the batch
+ *           commands, see ProcessBatchLine(), with "list" and "stats" added:
+ *             add KEY, addttl SECONDS KEY  ADDED, EXISTS
+ *             put KEY VALUE                ADDED, UPDATED
+ *             search KEY                   FOUND bucket, NOT_FOUND
+ *             get KEY                      VALUE value, NOT_FOUND
+ *             delete KEY                   DELETED, NOT_FOUND
+ *             list                         one line per bucket, then END
+ *             stats                        one line of JSON
+ *           A request the table cannot carry out gets ERROR and a reason.
+ * Notes:    Empty lines get no reply.  A carriage return at the end of the
+ *           line is dropped, so the server can be tried with telnet.
+ ********************************************************************************/
+int ServerCommand(strServer *pstrServer, strServerConn *pstrConn, char *pszLine)
+{
+   int         nResult      = 0;
+   long        lnTtl        = 0;
+   size_t      nLength      = strlen(pszLine);
+   size_t      nValueLength = 0;
+   char       *pszKey       = NULL;
+   char       *pszTtlKey    = NULL;
+   char       *pszValue     = NULL;
+   char       *pchList      = NULL;
+   const char *pchValue     = NULL;
+   const char *pszReply     = NULL;
+   FILE       *pFile        = NULL;
+   strHash    *pstrHash     = pstrServer->pstrHash;
+   char        szReply[64];
+
+
+
+   if (nLength > 0 && pszLine[nLength-1] == '\r')
+   {
+      pszLine[--nLength] = '\0';
+   }
+
+   if (nLength == 0)
+   {
+      return(0);
+   }
+
+   pstrServer->lnRequests++;
+
+   if ((pszKey = strchr(pszLine, ' ')) != NULL)
+   {
+      *pszKey++ = '\0';
+   }
 
 
    /****************************************************************************
-    * Loop through through the linked list in the proper bucket to search.
+    * list and stats write to a stream in memory, which is then queued whole.
     ****************************************************************************/
-   for (pstrCurrent  = (strHashTable *) &pastrHash[nHashIndex];
-        pstrCurrent != NULL;
-        pstrCurrent  = pstrCurrent->pstrNext, nChain++)
+   if (pszKey == NULL && (strcmp(pszLine, "list") == 0 || strcmp(pszLine, "stats") == 0))
+   {
+      if ((pFile = open_memstream(&pchList, &nValueLength)) == NULL)
+      {
+         return(ServerReply(pstrConn, "ERROR no memory\n", 16));
+      }
+
+      if (pszLine[0] == 'l')
+      {
+         nResult = ListHashTable(pstrHash, pFile);
+         fprintf(pFile, "END %d\n", nResult);
+      }
+      else
+      {
+         StatsHashTable(pstrHash, pFile, TRUE);
+      }
+
+      fclose(pFile);
+
+      nResult = ServerReply(pstrConn, pchList, nValueLength);
+      free(pchList);
+
+      return(nResult);
+   }
+
+   if (pszKey == NULL)
+   {
+      pszReply = "ERROR unknown command\n";
+   }
+   else if (strcmp(pszLine, "add") == 0 ||
+            (strcmp(pszLine, "addttl") == 0 &&
+             (lnTtl = strtol(pszKey, &pszTtlKey, 10)) > 0 && *pszTtlKey == ' '))
+   {
+      nResult  = lnTtl > 0 ? AddExpiringEntry(pstrHash, pszTtlKey + 1, lnTtl)
+                           : AddEntryToHashTable(pstrHash, pszKey);
+      pszReply = nResult == 0 ? "ADDED\n" : nResult > 0 ? "EXISTS\n" : "ERROR add failed\n";
+   }
+   else if (strcmp(pszLine, "put") == 0 && (pszValue = strchr(pszKey, ' ')) != NULL)
+   {
+      *pszValue++ = '\0';
+
+      nResult  = PutEntryInHashTable(pstrHash, pszKey, pszValue, strlen(pszValue));
+      pszReply = nResult == 0 ? "ADDED\n" : nResult > 0 ? "UPDATED\n" : "ERROR put failed\n";
+   }
+   else if (strcmp(pszLine, "get") == 0)
+   {
+      if (GetValueFromHashTable(pstrHash, pszKey, NULL, &pchValue, &nValueLength) < 0)
+      {
+         pszReply = "NOT_FOUND\n";
+      }
+      else if (ServerReply(pstrConn, "VALUE ", 6) != 0 ||
+               ServerReply(pstrConn, pchValue, nValueLength) != 0)
+      {
+         return(-1);
+      }
+      else
+      {
+         pszReply = "\n";
+      }
+   }
+   else if (strcmp(pszLine, "search") == 0)
    {
-      if (strcmp(pstrCurrent->szData, pszData) == 0)
+      if ((nResult = SearchHashTable(pstrHash, pszKey, NULL)) < 0)
+      {
+         pszReply = "NOT_FOUND\n";
+      }
+      else
       {
-          printf("Data [%s] found in bucket [%d] in chain [%d]\n", pszData, nHashIndex, nChain);
-          nReturnCode = nHashIndex;
-          break;
+         snprintf(szReply, sizeof(szReply), "FOUND %d\n", nResult);
+         pszReply = szReply;
       }
    }
+   else if (strcmp(pszLine, "delete") == 0)
+   {
+      nResult  = DeleteEntryFromHashTable(pstrHash, pszKey);
+      pszReply = nResult == 0 ? "DELETED\n" : nResult > 0 ? "NOT_FOUND\n" : "ERROR delete failed\n";
+   }
+   else
+   {
+      pszReply = "ERROR unknown command\n";
+   }
 
 
-   return(nReturnCode);
+   return(ServerReply(pstrConn, pszReply, strlen(pszReply)));
 }
 
 
 
 
 /********************************************************************************
- * Function: Debug()
- * Params:   pszFormat - Formatting of variable parameters.
- *           ...
- * Returns:  Returns the number of characters printed by vprintf()
- * Call by:  most fuctions in this program
- * Call to:  DebugOn()
- * Overview: Debugging aid if needed, which prints messages to standard output.
- * Notes:    va_start, va_end uses stdarg.h
- *           DebugOn(0) the zero does not matter, it can be any value, but 0 for
- *           simplicity.
- *           Debug is enabled by calling the program with --debug
+ * Function: ServerFlush
+ * Params:   pstrServer - server state
+ *           pstrConn - client connection with replies to send
+ * Returns:  0 - connection still open
+ *           1 - connection closed
+ * Call by:  RunServer()
+ *           ServerRead()
+ * Call to:  ServerClose()
+ * Overview: Sends the queued replies until they are all sent or the socket is
+ *           full, then asks epoll for the events the connection now needs:
+ *           EPOLLOUT while replies are left, EPOLLIN while the client is still
+ *           sending and the replies left are under HASH_SERVER_OUTPUT.
+ * Notes:    Not reading from a client that does not read its replies bounds
+ *           the memory it can take.  A connection whose client is done
+ *           sending is closed once its replies are all sent.
  ********************************************************************************/
-int Debug(const char *pszFormat, ...)
+int ServerFlush(strServer *pstrServer, strServerConn *pstrConn)
 {
-    int nReturnCode = 0;
-    va_list pstrList;
+   ssize_t            nSent   = 0;
+   unsigned int       nEvents = 0;
+   struct epoll_event strEvent;
+
+
+
+   while (pstrConn->nOutputSent < pstrConn->nOutputUsed)
+   {
+      nSent = send(pstrConn->nSocket, pstrConn->pchOutput + pstrConn->nOutputSent,
+                   pstrConn->nOutputUsed - pstrConn->nOutputSent, MSG_NOSIGNAL);
+
+      if (nSent < 0 && errno == EINTR)
+      {
+         continue;
+      }
+
+      if (nSent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      {
+         break;
+      }
+
+      if (nSent <= 0)
+      {
+         ServerClose(pstrServer, pstrConn);
+         return(1);
+      }
+
+      pstrConn->nOutputSent += nSent;
+   }
+
+   if (pstrConn->nOutputSent == pstrConn->nOutputUsed)
+   {
+      pstrConn->nOutputSent = 0;
+      pstrConn->nOutputUsed = 0;
+
+      if (pstrConn->bClosing == TRUE)
+      {
+         ServerClose(pstrServer, pstrConn);
+         return(1);
+      }
+   }
+
+
+   /****************************************************************************
+    * Only change the events of epoll when they are not the ones asked for.
+    ****************************************************************************/
+   if (pstrConn->bClosing == FALSE &&
+       pstrConn->nOutputUsed - pstrConn->nOutputSent < HASH_SERVER_OUTPUT)
+   {
+      nEvents |= EPOLLIN;
+   }
 
+   if (pstrConn->nOutputSent < pstrConn->nOutputUsed)
+   {
+      nEvents |= EPOLLOUT;
+   }
 
+   if (nEvents != pstrConn->nEvents)
+   {
+      memset(&strEvent, 0, sizeof(strEvent));
+      strEvent.events   = nEvents;
+      strEvent.data.ptr = pstrConn;
 
-    if (DebugOn(0) == TRUE)
-    {
-       printf("DEBUG ");
+      if (epoll_ctl(pstrServer->nEpoll, EPOLL_CTL_MOD, pstrConn->nSocket, &strEvent) != 0)
+      {
+         fprintf(stderr, "Failed epoll_ctl() in ServerFlush(). errno=%d.\n", errno);
+         ServerClose(pstrServer, pstrConn);
+         return(1);
+      }
 
-       va_start(pstrList, pszFormat);
-       nReturnCode = vprintf(pszFormat, pstrList);
-       va_end(pstrList);
-    }
+      pstrConn->nEvents = nEvents;
+   }
 
 
-    return(nReturnCode);
+   return(0);
 }
 
 
 
 
 /********************************************************************************
- * Function: DebugOn()
- * Params:   bInit - value is either TRUE or FALSE on the first call.
- *           On subsequent calls, bInit doesn't matter, but should be something
-             simple like 0.
- * Returns:  TRUE
- *           FALSE
- * Call by:  main()
- *           Debug()
+ * Function: ServerListen
+ * Params:   pszPath - Unix socket path, or NULL for TCP
+ *           nPort - loopback TCP port, used when pszPath is NULL
+ * Returns:  >=0 - listening socket, non-blocking
+ *           <0 - cannot create, bind or listen on the socket
+ * Call by:  RunServer()
  * Call to:  None
- * Overview: The first time DebugOn() is called, bDebug will always be -100.  The
- *           value of bInit will determine whether bDebug will be TRUE or FALSE.
- *           On subsequent calls to DebugOn(), bDebug will either have a value of
- *           TRUE or FALSE, that is, it's only -100 on the first call only.
- *
- *           if bInit is FALSE on the first call, debugging is turned off.
- *           if bInit is TRUE  on the first call, debugging is turned on.
- *           Subsequent calls to DebugOn() checks whether debug messages should be
- *            printed.
- *           The argument on subsequent calls does not matter, but use 0 for
- *           simplicity.
- * Notes:    This keeps us from having to utilize a global variable.
+ * Overview: Opens a listening socket on a Unix socket path, or on 127.0.0.1
+ *           and a TCP port.
+ * Notes:    A file left at pszPath, by a server that did not exit cleanly, is
+ *           removed first.  TCP only listens on the loopback address, since
+ *           the protocol has no authentication.
  ********************************************************************************/
-int DebugOn(int bInit)
+int ServerListen(const char *pszPath, int nPort)
 {
-   static int bDebug = -100;
+   int                nSocket = -1;
+   int                nOn     = 1;
+   socklen_t          nLength = 0;
+   struct sockaddr_un strUnix;
+   struct sockaddr_in strInet;
+   struct sockaddr   *pstrAddress = NULL;
+
+
+
+   memset(&strUnix, 0, sizeof(strUnix));
+   memset(&strInet, 0, sizeof(strInet));
+
+   if (pszPath != NULL)
+   {
+      if (strlen(pszPath) >= sizeof(strUnix.sun_path))
+      {
+         fprintf(stderr, "Socket path [%s] is too long.\n", pszPath);
+         return(-1);
+      }
+
+      strUnix.sun_family = AF_UNIX;
+      strcpy(strUnix.sun_path, pszPath);
+      unlink(pszPath);
 
+      pstrAddress = (struct sockaddr *) &strUnix;
+      nLength     = sizeof(strUnix);
+   }
+   else
+   {
+      strInet.sin_family      = AF_INET;
+      strInet.sin_port        = htons(nPort);
+      strInet.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+      pstrAddress = (struct sockaddr *) &strInet;
+      nLength     = sizeof(strInet);
+   }
+
+   if ((nSocket = socket(pstrAddress->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                         0)) < 0)
+   {
+      fprintf(stderr, "Cannot create a socket. errno=%d.\n", errno);
+      return(-1);
+   }
 
+   if (pszPath == NULL)
+   {
+      setsockopt(nSocket, SOL_SOCKET, SO_REUSEADDR, &nOn, sizeof(nOn));
+   }
 
-   if (bDebug == -100)
+   if (bind(nSocket, pstrAddress, nLength) != 0 || listen(nSocket, SOMAXCONN) != 0)
    {
-      if (bInit == TRUE)
+      if (pszPath != NULL)
       {
-         bDebug = TRUE;
+         fprintf(stderr, "Cannot listen on [%s]. errno=%d.\n", pszPath, errno);
       }
       else
       {
-         bDebug = FALSE;
+         fprintf(stderr, "Cannot listen on port %d. errno=%d.\n", nPort, errno);
+      }
+
+      close(nSocket);
+      return(-1);
+   }
+
+
+   return(nSocket);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ServerRead
+ * Params:   pstrServer - server state
+ *           pstrConn - client connection with bytes to read
+ * Returns:  0 - connection still open
+ *           1 - connection closed
+ * Call by:  RunServer()
+ * Call to:  ServerClose()
+ *           ServerCommand()
+ *           ServerFlush()
+ * Overview: Reads what the client sent, runs every whole request in it, then
+ *           sends the replies together.  The bytes of a request not received
+ *           whole yet are kept for the next read.
+ * Notes:    The input buffer grows up to HASH_SERVER_LINE bytes, the longest
+ *           request; a longer one gets an error and closes the connection.
+ *           When the client shuts down its side, a last request without a new
+ *           line is run, and the connection closes once the replies are sent.
+ ********************************************************************************/
+int ServerRead(strServer *pstrServer, strServerConn *pstrConn)
+{
+   ssize_t  nRead    = 0;
+   size_t   nSize    = 0;
+   char    *pchStart = NULL;
+   char    *pchEnd   = NULL;
+   char    *pchLimit = NULL;
+   char    *pchNew   = NULL;
+
+
+
+   if (pstrConn->nInputUsed == pstrConn->nInputSize)
+   {
+      nSize = pstrConn->nInputSize == 0 ? HASH_SERVER_BUFFER : pstrConn->nInputSize * 2;
+
+      if (nSize > HASH_SERVER_LINE)
+      {
+         ServerReply(pstrConn, "ERROR request too long\n", 23);
+         pstrConn->bClosing   = TRUE;
+         pstrConn->nInputUsed = 0;
+
+         return(ServerFlush(pstrServer, pstrConn));
+      }
+
+      if ((pchNew = realloc(pstrConn->pchInput, nSize)) == NULL)
+      {
+         fprintf(stderr, "Cannot allocate memory for a request.\n");
+         ServerClose(pstrServer, pstrConn);
+         return(1);
+      }
+
+      pstrConn->pchInput   = pchNew;
+      pstrConn->nInputSize = nSize;
+   }
+
+   nRead = read(pstrConn->nSocket, pstrConn->pchInput + pstrConn->nInputUsed,
+                pstrConn->nInputSize - pstrConn->nInputUsed);
+
+   if (nRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+   {
+      return(0);
+   }
+
+   if (nRead < 0)
+   {
+      ServerClose(pstrServer, pstrConn);
+      return(1);
+   }
+
+   if (nRead == 0)
+   {
+      pstrConn->bClosing = TRUE;
+   }
+
+   pstrConn->nInputUsed += nRead;
+
+
+   /****************************************************************************
+    * Run every whole line, then move the start of the next one to the front.
+    ****************************************************************************/
+   pchStart = pstrConn->pchInput;
+   pchLimit = pstrConn->pchInput + pstrConn->nInputUsed;
+
+   while (pchStart < pchLimit &&
+          (pchEnd = memchr(pchStart, '\n', pchLimit - pchStart)) != NULL)
+   {
+      *pchEnd = '\0';
+
+      if (ServerCommand(pstrServer, pstrConn, pchStart) != 0)
+      {
+         ServerClose(pstrServer, pstrConn);
+         return(1);
+      }
+
+      pchStart = pchEnd + 1;
+   }
+
+   if (pstrConn->bClosing == TRUE && pchStart < pchLimit)
+   {
+      if (pstrConn->nInputUsed == pstrConn->nInputSize)
+      {
+         pchLimit--;                          /* Room for the terminator         */
+      }
+
+      *pchLimit = '\0';
+
+      if (ServerCommand(pstrServer, pstrConn, pchStart) != 0)
+      {
+         ServerClose(pstrServer, pstrConn);
+         return(1);
+      }
+
+      pchStart = pchLimit;
+   }
+
+   pstrConn->nInputUsed = pchLimit - pchStart;
+   memmove(pstrConn->pchInput, pchStart, pstrConn->nInputUsed);
+
+
+   return(ServerFlush(pstrServer, pstrConn));
+}
+
+
+
+
+/********************************************************************************
+ * Function: ServerReply
+ * Params:   pstrConn - client connection
+ *           pchReply - bytes to queue
+ *           nLength - number of bytes
+ * Returns:  0 - reply queued
+ *           <0 - cannot allocate memory
+ * Call by:  ServerCommand()
+ *           ServerRead()
+ * Call to:  None
+ * Overview: Adds a reply to the output buffer of the connection, growing the
+ *           buffer as needed.  Nothing is sent until ServerFlush().
+ * Notes:    None
+ ********************************************************************************/
+int ServerReply(strServerConn *pstrConn, const char *pchReply, size_t nLength)
+{
+   size_t  nSize  = pstrConn->nOutputSize;
+   char   *pchNew = NULL;
+
+
+
+   if (pstrConn->nOutputUsed + nLength > nSize)
+   {
+      if (nSize == 0)
+      {
+         nSize = HASH_SERVER_BUFFER;
+      }
+
+      while (pstrConn->nOutputUsed + nLength > nSize)
+      {
+         nSize *= 2;
+      }
+
+      if ((pchNew = realloc(pstrConn->pchOutput, nSize)) == NULL)
+      {
+         fprintf(stderr, "Cannot allocate memory for a reply.\n");
+         return(-1);
       }
+
+      pstrConn->pchOutput   = pchNew;
+      pstrConn->nOutputSize = nSize;
    }
 
+   memcpy(pstrConn->pchOutput + pstrConn->nOutputUsed, pchReply, nLength);
+   pstrConn->nOutputUsed += nLength;
+
+
+   return(0);
+}
+
+
+
+
+/********************************************************************************
+ * Function: ShuffleBenchKeys
+ * Params:   alnOrder - receives the key indexes 0 to lnKeys-1, shuffled
+ *           lnKeys - number of keys
+ *           pulState - generator state, updated
+ * Returns:  None
+ * Call by:  RunBenchmark()
+ *           RunConcurrentBenchmark()
+ *           RunTypedBenchmark()
+ * Call to:  BenchRandom()
+ * Overview: Fisher-Yates shuffle of the inserted keys, the order of the delete
+ *           phase.
+ * Notes:    None
+ ********************************************************************************/
+void ShuffleBenchKeys(long *alnOrder, long lnKeys, unsigned long *pulState)
+{
+   long lnIndex = 0;
+   long lnRank  = 0;
+   long lnSwap  = 0;
+
+
+
+   for (lnIndex=0; lnIndex<lnKeys; lnIndex++)
+   {
+      alnOrder[lnIndex] = lnIndex;
+   }
 
-   return(bDebug);
+   for (lnIndex=lnKeys-1; lnIndex>0; lnIndex--)
+   {
+      lnRank            = (long) (BenchRandom(pulState) % (unsigned long) (lnIndex + 1));
+      lnSwap            = alnOrder[lnIndex];
+      alnOrder[lnIndex] = alnOrder[lnRank];
+      alnOrder[lnRank]  = lnSwap;
+   }
 }
+
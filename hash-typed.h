@@ -0,0 +1,353 @@
+/*********************************************************************************
+ * Written by Lance N. Le
+ *
+ * Free to use.
+ * Free to distribute.
+ * No warranty, expressed or implied, comes with this program.
+ *********************************************************************************/
+#ifndef HASH_TYPED_H
+#define HASH_TYPED_H
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/random.h>
+
+
+
+
+/*********************************************************************************
+ * Typed tables.  The tables of hash-lib.h take C strings: every key is hashed
+ * byte by byte, compared with strcmp() and stored with its terminator.  A table
+ * keyed by a 64 bit ID or a 16 byte UUID pays for all of that for nothing.
+ *
+ * HASH_TYPED_DECLARE(NAME, KEY, VALUE) declares a table of KEY to VALUE, and
+ * HASH_TYPED_DEFINE(NAME, KEY, VALUE, HASHFN, EQUALFN) compiles its functions,
+ * once, in one source file.  HASHFN(key, seed) returns the 64 bit hash of a key
+ * and EQUALFN(key1, key2) is true when two keys are the same; both are given
+ * the keys by value, so for word sized keys they are a multiply and a compare.
+ * The functions are named after NAME:
+ *
+ *    strNAMEHash *CreateNAMETable(unsigned long ulSeed, long lnSize)
+ *    int          DeleteNAMEEntry(strNAMEHash *, KEY)
+ *    void         FreeNAMETable(strNAMEHash *)
+ *    void         GetNAMEInfo(const strNAMEHash *, strTypedInfo *)
+ *    int          PutNAMEEntry(strNAMEHash *, KEY, VALUE)
+ *    long         SearchNAMETable(const strNAMEHash *, KEY, VALUE *)
+ *
+ * hash-lib.h instantiates U64 (unsigned long keys) and Uuid (strUuid keys).
+ *********************************************************************************/
+
+
+/*********************************************************************************
+ * Layout.  Keys and values are stored in slots by value, with open addressing
+ * and linear probing.  Each slot has a control byte: HASH_TYPED_EMPTY, or
+ * HASH_TYPED_FULL with the top 7 bits of the key's hash, so a probe only
+ * compares the keys of slots whose hash bits match.  Deletes shift the
+ * following keys back instead of leaving tombstones.  The slots are a power of
+ * 2, at least HASH_TYPED_MIN_SIZE, and double as soon as more than
+ * HASH_TYPED_LOAD_NUM/HASH_TYPED_LOAD_DEN of them would be used.
+ *********************************************************************************/
+#define HASH_TYPED_EMPTY        0x00
+#define HASH_TYPED_FULL         0x80
+#define HASH_TYPED_MIN_SIZE     16
+#define HASH_TYPED_LOAD_NUM     3
+#define HASH_TYPED_LOAD_DEN     4
+
+
+/*********************************************************************************
+ * What GetNAMEInfo() reports about a typed table.
+ *********************************************************************************/
+typedef struct
+{
+   unsigned long  ulSeed;                     /* Seed given to HASHFN            */
+   long           lnEntries;                  /* Keys stored in the table        */
+   long           lnSize;                     /* Slots, a power of 2             */
+   long           lnResizes;                  /* Times the slots doubled         */
+   size_t         nBytes;                     /* Control bytes and slots         */
+} strTypedInfo;
+
+
+/*********************************************************************************
+ * Declares the handle and the functions of a typed table.  Goes in a header.
+ *********************************************************************************/
+#define HASH_TYPED_DECLARE(NAME, KEY, VALUE)                                          \
+typedef struct _str##NAME##Hash str##NAME##Hash;                                      \
+str##NAME##Hash *Create##NAME##Table(unsigned long, long);                            \
+int Delete##NAME##Entry(str##NAME##Hash *, KEY);                                      \
+void Free##NAME##Table(str##NAME##Hash *);                                            \
+void Get##NAME##Info(const str##NAME##Hash *, strTypedInfo *);                        \
+int Put##NAME##Entry(str##NAME##Hash *, KEY, VALUE);                                  \
+long Search##NAME##Table(const str##NAME##Hash *, KEY, VALUE *);
+
+
+/*********************************************************************************
+ * Defines the functions of a typed table.  Goes in one source file, after
+ * HASH_TYPED_DECLARE() with the same NAME, KEY and VALUE.
+ *
+ * CreateNAMETable() allocates lnSize slots, rounded up to a power of 2.  A seed
+ * of 0 is replaced with a random one.  Returns NULL when memory runs out.
+ *
+ * DeleteNAMEEntry() returns 0 when the key was deleted, 1 when it was not there.
+ * The keys after it in the probe run are moved back into the hole when that
+ * brings them closer to their home slot.
+ *
+ * FreeNAMETable() releases the table.  The table may be NULL.
+ *
+ * PutNAMEEntry() adds the key with its value, or replaces the value of the key
+ * in place.  Returns 0 when the key was added, 1 when its value was replaced,
+ * and less than 0 when the slots could not grow.  Growing moves every key into
+ * an array twice as large at once.
+ *
+ * SearchNAMETable() returns the slot of the key, or -1 when the key is not
+ * there, and copies the value to *pValue when pValue is not NULL.
+ *********************************************************************************/
+#define HASH_TYPED_DEFINE(NAME, KEY, VALUE, HASHFN, EQUALFN)                          \
+typedef struct                                                                        \
+{                                                                                     \
+   KEY            tKey;                       /* Key, stored by value            */   \
+   VALUE          tValue;                     /* Value of the key                */   \
+} str##NAME##Slot;                                                                    \
+                                                                                      \
+struct _str##NAME##Hash                                                               \
+{                                                                                     \
+   unsigned long    ulSeed;                   /* Seed given to HASHFN            */   \
+   unsigned long    ulMask;                   /* Slots minus 1                   */   \
+   long             lnEntries;                /* Keys stored                     */   \
+   long             lnResizes;                /* Times the slots doubled         */   \
+   unsigned char   *pnCtrl;                   /* Control byte of each slot       */   \
+   str##NAME##Slot *pstrSlot;                 /* Keys and values                 */   \
+};                                                                                    \
+                                                                                      \
+static int Grow##NAME##Table(str##NAME##Hash *pstrHash)                               \
+{                                                                                     \
+   unsigned long    ulOld    = pstrHash->ulMask + 1;                                  \
+   unsigned long    ulNew    = ulOld * 2;                                             \
+   unsigned long    ulIndex  = 0;                                                     \
+   unsigned long    ulSlot   = 0;                                                     \
+   unsigned long    ulHash   = 0;                                                     \
+   unsigned char   *pnCtrl   = NULL;                                                  \
+   str##NAME##Slot *pstrSlot = NULL;                                                  \
+                                                                                      \
+                                                                                      \
+                                                                                      \
+   pnCtrl   = (unsigned char *) calloc(ulNew, sizeof(unsigned char));                 \
+   pstrSlot = (str##NAME##Slot *) malloc(ulNew * sizeof(str##NAME##Slot));            \
+                                                                                      \
+   if (pnCtrl == NULL || pstrSlot == NULL)                                            \
+   {                                                                                  \
+      fprintf(stderr, "Failed malloc() in Grow" #NAME "Table(). errno=%d.\n", errno); \
+      free(pnCtrl);                                                                   \
+      free(pstrSlot);                                                                 \
+      return(-1);                                                                     \
+   }                                                                                  \
+                                                                                      \
+   for (ulIndex=0; ulIndex<ulOld; ulIndex++)                                          \
+   {                                                                                  \
+      if (pstrHash->pnCtrl[ulIndex] == HASH_TYPED_EMPTY)                              \
+      {                                                                               \
+         continue;                                                                    \
+      }                                                                               \
+                                                                                      \
+      ulHash = HASHFN(pstrHash->pstrSlot[ulIndex].tKey, pstrHash->ulSeed);            \
+      ulSlot = ulHash & (ulNew - 1);                                                  \
+                                                                                      \
+      while (pnCtrl[ulSlot] != HASH_TYPED_EMPTY)                                      \
+      {                                                                               \
+         ulSlot = (ulSlot + 1) & (ulNew - 1);                                         \
+      }                                                                               \
+                                                                                      \
+      pnCtrl[ulSlot]   = pstrHash->pnCtrl[ulIndex];                                   \
+      pstrSlot[ulSlot] = pstrHash->pstrSlot[ulIndex];                                 \
+   }                                                                                  \
+                                                                                      \
+   free(pstrHash->pnCtrl);                                                            \
+   free(pstrHash->pstrSlot);                                                          \
+                                                                                      \
+   pstrHash->pnCtrl   = pnCtrl;                                                       \
+   pstrHash->pstrSlot = pstrSlot;                                                     \
+   pstrHash->ulMask   = ulNew - 1;                                                    \
+   pstrHash->lnResizes++;                                                             \
+                                                                                      \
+   return(0);                                                                         \
+}                                                                                     \
+                                                                                      \
+str##NAME##Hash *Create##NAME##Table(unsigned long ulSeed, long lnSize)               \
+{                                                                                     \
+   unsigned long    ulSlots  = HASH_TYPED_MIN_SIZE;                                   \
+   str##NAME##Hash *pstrHash = NULL;                                                  \
+                                                                                      \
+                                                                                      \
+                                                                                      \
+   while ((long) ulSlots < lnSize)                                                    \
+   {                                                                                  \
+      ulSlots = ulSlots * 2;                                                          \
+   }                                                                                  \
+                                                                                      \
+   if ((pstrHash = (str##NAME##Hash *) calloc(1, sizeof(str##NAME##Hash))) == NULL)   \
+   {                                                                                  \
+      fprintf(stderr, "Failed calloc() in Create" #NAME "Table(). errno=%d.\n",       \
+              errno);                                                                 \
+      return(NULL);                                                                   \
+   }                                                                                  \
+                                                                                      \
+   if (ulSeed == 0 && getrandom(&ulSeed, sizeof(ulSeed), 0) != sizeof(ulSeed))        \
+   {                                                                                  \
+      ulSeed = (unsigned long) time(NULL) ^ ((unsigned long) getpid() << 32);         \
+   }                                                                                  \
+                                                                                      \
+   pstrHash->ulSeed   = ulSeed;                                                       \
+   pstrHash->ulMask   = ulSlots - 1;                                                  \
+   pstrHash->pnCtrl   = (unsigned char *) calloc(ulSlots, sizeof(unsigned char));     \
+   pstrHash->pstrSlot = (str##NAME##Slot *) malloc(ulSlots * sizeof(str##NAME##Slot)); \
+                                                                                      \
+   if (pstrHash->pnCtrl == NULL || pstrHash->pstrSlot == NULL)                        \
+   {                                                                                  \
+      fprintf(stderr, "Failed malloc() in Create" #NAME "Table(). errno=%d.\n",       \
+              errno);                                                                 \
+      Free##NAME##Table(pstrHash);                                                    \
+      return(NULL);                                                                   \
+   }                                                                                  \
+                                                                                      \
+   return(pstrHash);                                                                  \
+}                                                                                     \
+                                                                                      \
+int Delete##NAME##Entry(str##NAME##Hash *pstrHash, KEY tKey)                          \
+{                                                                                     \
+   unsigned long  ulHole = 0;                                                         \
+   unsigned long  ulNext = 0;                                                         \
+   unsigned long  ulHome = 0;                                                         \
+   long           lnSlot = Search##NAME##Table(pstrHash, tKey, NULL);                 \
+                                                                                      \
+                                                                                      \
+                                                                                      \
+   if (lnSlot < 0)                                                                    \
+   {                                                                                  \
+      return(1);                                                                      \
+   }                                                                                  \
+                                                                                      \
+   ulHole = (unsigned long) lnSlot;                                                   \
+   ulNext = ulHole;                                                                   \
+                                                                                      \
+   for (;;)                                                                           \
+   {                                                                                  \
+      ulNext = (ulNext + 1) & pstrHash->ulMask;                                       \
+                                                                                      \
+      if (pstrHash->pnCtrl[ulNext] == HASH_TYPED_EMPTY)                               \
+      {                                                                               \
+         break;                                                                       \
+      }                                                                               \
+                                                                                      \
+      ulHome = HASHFN(pstrHash->pstrSlot[ulNext].tKey, pstrHash->ulSeed) &            \
+               pstrHash->ulMask;                                                      \
+                                                                                      \
+      /* Moves back unless its home slot lies between the hole and the key */         \
+      if (((ulNext - ulHome) & pstrHash->ulMask) >=                                   \
+          ((ulNext - ulHole) & pstrHash->ulMask))                                     \
+      {                                                                               \
+         pstrHash->pnCtrl[ulHole]   = pstrHash->pnCtrl[ulNext];                       \
+         pstrHash->pstrSlot[ulHole] = pstrHash->pstrSlot[ulNext];                     \
+         ulHole                     = ulNext;                                         \
+      }                                                                               \
+   }                                                                                  \
+                                                                                      \
+   pstrHash->pnCtrl[ulHole] = HASH_TYPED_EMPTY;                                       \
+   pstrHash->lnEntries--;                                                             \
+                                                                                      \
+   return(0);                                                                         \
+}                                                                                     \
+                                                                                      \
+void Free##NAME##Table(str##NAME##Hash *pstrHash)                                     \
+{                                                                                     \
+   if (pstrHash == NULL)                                                              \
+   {                                                                                  \
+      return;                                                                         \
+   }                                                                                  \
+                                                                                      \
+   free(pstrHash->pnCtrl);                                                            \
+   free(pstrHash->pstrSlot);                                                          \
+   free(pstrHash);                                                                    \
+}                                                                                     \
+                                                                                      \
+void Get##NAME##Info(const str##NAME##Hash *pstrHash, strTypedInfo *pstrInfo)         \
+{                                                                                     \
+   pstrInfo->ulSeed    = pstrHash->ulSeed;                                            \
+   pstrInfo->lnEntries = pstrHash->lnEntries;                                         \
+   pstrInfo->lnSize    = (long) pstrHash->ulMask + 1;                                 \
+   pstrInfo->lnResizes = pstrHash->lnResizes;                                         \
+   pstrInfo->nBytes    = sizeof(str##NAME##Hash) +                                    \
+                         (pstrHash->ulMask + 1) *                                     \
+                         (sizeof(unsigned char) + sizeof(str##NAME##Slot));           \
+}                                                                                     \
+                                                                                      \
+int Put##NAME##Entry(str##NAME##Hash *pstrHash, KEY tKey, VALUE tValue)               \
+{                                                                                     \
+   unsigned long  ulHash = 0;                                                         \
+   unsigned long  ulSlot = 0;                                                         \
+   unsigned char  nTag   = 0;                                                         \
+                                                                                      \
+                                                                                      \
+                                                                                      \
+   if ((unsigned long) (pstrHash->lnEntries + 1) * HASH_TYPED_LOAD_DEN >              \
+       (pstrHash->ulMask + 1) * HASH_TYPED_LOAD_NUM &&                                \
+       Search##NAME##Table(pstrHash, tKey, NULL) < 0 &&                               \
+       Grow##NAME##Table(pstrHash) != 0)                                              \
+   {                                                                                  \
+      return(-1);                                                                     \
+   }                                                                                  \
+                                                                                      \
+   ulHash = HASHFN(tKey, pstrHash->ulSeed);                                           \
+   ulSlot = ulHash & pstrHash->ulMask;                                                \
+   nTag   = (unsigned char) (HASH_TYPED_FULL | (ulHash >> 57));                       \
+                                                                                      \
+   while (pstrHash->pnCtrl[ulSlot] != HASH_TYPED_EMPTY)                               \
+   {                                                                                  \
+      if (pstrHash->pnCtrl[ulSlot] == nTag &&                                         \
+          EQUALFN(pstrHash->pstrSlot[ulSlot].tKey, tKey))                             \
+      {                                                                               \
+         pstrHash->pstrSlot[ulSlot].tValue = tValue;                                  \
+         return(1);                                                                   \
+      }                                                                               \
+                                                                                      \
+      ulSlot = (ulSlot + 1) & pstrHash->ulMask;                                       \
+   }                                                                                  \
+                                                                                      \
+   pstrHash->pnCtrl[ulSlot]          = nTag;                                          \
+   pstrHash->pstrSlot[ulSlot].tKey   = tKey;                                          \
+   pstrHash->pstrSlot[ulSlot].tValue = tValue;                                        \
+   pstrHash->lnEntries++;                                                             \
+                                                                                      \
+   return(0);                                                                         \
+}                                                                                     \
+                                                                                      \
+long Search##NAME##Table(const str##NAME##Hash *pstrHash, KEY tKey, VALUE *pValue)    \
+{                                                                                     \
+   unsigned long  ulHash = HASHFN(tKey, pstrHash->ulSeed);                            \
+   unsigned long  ulSlot = ulHash & pstrHash->ulMask;                                 \
+   unsigned char  nTag   = (unsigned char) (HASH_TYPED_FULL | (ulHash >> 57));        \
+   unsigned char  nCtrl  = 0;                                                         \
+                                                                                      \
+                                                                                      \
+                                                                                      \
+   while ((nCtrl = pstrHash->pnCtrl[ulSlot]) != HASH_TYPED_EMPTY)                     \
+   {                                                                                  \
+      if (nCtrl == nTag && EQUALFN(pstrHash->pstrSlot[ulSlot].tKey, tKey))            \
+      {                                                                               \
+         if (pValue != NULL)                                                          \
+         {                                                                            \
+            *pValue = pstrHash->pstrSlot[ulSlot].tValue;                              \
+         }                                                                            \
+                                                                                      \
+         return((long) ulSlot);                                                       \
+      }                                                                               \
+                                                                                      \
+      ulSlot = (ulSlot + 1) & pstrHash->ulMask;                                       \
+   }                                                                                  \
+                                                                                      \
+   return(-1);                                                                        \
+}
+
+
+#endif
@@ -0,0 +1,93 @@
+#!/bin/bash
+#################################################################################
+# Checks what --journal gives back after a crash and after damage: a server
+# killed with SIGKILL keeps every add it answered, even with --fsync never; a
+# journal cut in its last record loses only that record; a journal damaged in
+# the middle is refused and left as it is.  Run by "make check" from the top of
+# the tree.
+#################################################################################
+HASH_TABLE=${HASH_TABLE:-./hash-table}
+DIR=$(mktemp -d)
+PORT=$((20000 + ($$ + 1) % 20000))
+KEYS=100
+FAILED=0
+
+trap 'rm -rf "$DIR"' EXIT
+
+
+fail()
+{
+   echo "FAIL: $*"
+   FAILED=1
+}
+
+
+entries()
+{
+   $HASH_TABLE --hashsize 64 --journal "$1" --batch "$DIR/empty.txt" --stats json \
+               2> "$DIR/replay.err" | grep -o '"entries":[0-9]*' | cut -d: -f2
+}
+
+
+: > "$DIR/empty.txt"
+
+
+#################################################################################
+# SIGKILL after the replies, so only what was written to the file is left.
+#################################################################################
+$HASH_TABLE --hashsize 64 --port $PORT --journal "$DIR/killed.jrnl" --fsync never \
+            > "$DIR/server.out" 2>&1 &
+SERVER=$!
+
+for TRY in $(seq 1 50); do
+   grep -q "^Serving" "$DIR/server.out" && break
+   sleep 0.1
+done
+
+exec 3<>/dev/tcp/127.0.0.1/$PORT || { kill $SERVER; exit 1; }
+
+for KEY in $(seq 1 $KEYS); do
+   echo "add key$KEY" >&3
+done
+
+for KEY in $(seq 1 $KEYS); do
+   read -r REPLY <&3
+done
+
+{ kill -KILL $SERVER; wait $SERVER; } 2> /dev/null
+exec 3<&-
+
+[ "$(entries "$DIR/killed.jrnl")" = "$KEYS" ] || fail "killed server lost adds"
+
+
+#################################################################################
+# A journal of $KEYS adds, cut 3 bytes short, then with one byte of its tenth
+# record flipped.  Records are 16 bytes of header and "keyN" with its
+# terminator, after a 16 byte file header.
+#################################################################################
+for KEY in $(seq 1 $KEYS); do
+   echo "add key$KEY"
+done > "$DIR/adds.txt"
+
+$HASH_TABLE --hashsize 64 --journal "$DIR/keys.jrnl" --batch "$DIR/adds.txt" > /dev/null
+cp "$DIR/keys.jrnl" "$DIR/torn.jrnl"
+truncate -s -3 "$DIR/torn.jrnl"
+
+[ "$(entries "$DIR/torn.jrnl")" = "$((KEYS - 1))" ] || fail "torn tail not cut"
+grep -q "torn record" "$DIR/replay.err" || fail "torn tail not reported"
+
+cp "$DIR/keys.jrnl" "$DIR/damaged.jrnl"
+SIZE=$(stat -c %s "$DIR/damaged.jrnl")
+printf 'X' | dd of="$DIR/damaged.jrnl" bs=1 seek=$((16 + 9 * 21 + 17)) conv=notrunc \
+                2> /dev/null
+
+if $HASH_TABLE --hashsize 64 --journal "$DIR/damaged.jrnl" --batch "$DIR/empty.txt" \
+               > /dev/null 2> "$DIR/replay.err"; then
+   fail "damaged journal opened"
+fi
+
+grep -q "damaged record" "$DIR/replay.err" || fail "damage not reported"
+[ "$(stat -c %s "$DIR/damaged.jrnl")" = "$SIZE" ] || fail "damaged journal was cut"
+
+[ $FAILED -eq 0 ] && echo "PASS: journal-recovery"
+exit $FAILED
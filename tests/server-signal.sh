@@ -0,0 +1,71 @@
+#!/bin/bash
+#################################################################################
+# Stops "hash-table --port" with SIGTERM after it has answered 100 adds, and
+# checks that it exits 0 through the normal path: the "Served" summary is
+# printed, --save writes the snapshot and the journal holds every add.  Run by
+# "make check" from the top of the tree.
+#################################################################################
+HASH_TABLE=${HASH_TABLE:-./hash-table}
+DIR=$(mktemp -d)
+PORT=$((20000 + $$ % 20000))
+KEYS=100
+FAILED=0
+
+trap 'rm -rf "$DIR"' EXIT
+
+
+fail()
+{
+   echo "FAIL: $*"
+   FAILED=1
+}
+
+
+#################################################################################
+# Serves with --fsync never, so nothing but the shutdown path syncs the journal.
+#################################################################################
+$HASH_TABLE --hashsize 64 --port $PORT --journal "$DIR/keys.jrnl" --fsync never \
+            --save "$DIR/keys.snap" > "$DIR/server.out" 2>&1 &
+SERVER=$!
+
+for TRY in $(seq 1 50); do
+   grep -q "^Serving" "$DIR/server.out" && break
+   sleep 0.1
+done
+
+exec 3<>/dev/tcp/127.0.0.1/$PORT || { kill $SERVER; exit 1; }
+
+for KEY in $(seq 1 $KEYS); do
+   echo "add key$KEY" >&3
+done
+
+for KEY in $(seq 1 $KEYS); do
+   read -r REPLY <&3
+   [ "$REPLY" = "ADDED" ] || fail "add key$KEY answered [$REPLY]"
+done
+
+kill -TERM $SERVER
+wait $SERVER
+STATUS=$?
+exec 3<&-
+
+[ $STATUS -eq 0 ] || fail "server exited with $STATUS"
+grep -q "^Served 1 connections, $KEYS requests" "$DIR/server.out" ||
+   fail "no summary line"
+
+
+#################################################################################
+# Both the snapshot and the journal must give back every key.
+#################################################################################
+: > "$DIR/empty.txt"
+
+ENTRIES=$($HASH_TABLE --hashsize 64 --snapshot "$DIR/keys.snap" --batch "$DIR/empty.txt" \
+                      --stats json | grep -o '"entries":[0-9]*')
+[ "$ENTRIES" = "\"entries\":$KEYS" ] || fail "snapshot has [$ENTRIES]"
+
+ENTRIES=$($HASH_TABLE --hashsize 64 --journal "$DIR/keys.jrnl" --batch "$DIR/empty.txt" \
+                      --stats json | grep -o '"entries":[0-9]*')
+[ "$ENTRIES" = "\"entries\":$KEYS" ] || fail "journal replays [$ENTRIES]"
+
+[ $FAILED -eq 0 ] && echo "PASS: server-signal"
+exit $FAILED